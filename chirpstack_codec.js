@@ -232,7 +232,51 @@ function encodeDownlink(input) {
       fPort: input.fPort || 1
     };
   }
-  
+
+  // CASE 7: Keyframe animation
+  // { keyframe: "stop" }
+  // { keyframe: { lookahead: 3000 } }
+  // { keyframe: { time: 2000, spline: true, newStream: false, channels: { "1": 255, "2": 128 } } }
+  if (input.data.keyframe) {
+    var kf = input.data.keyframe;
+    if (kf === 'stop') {
+      return {
+        bytes: [0xE1],
+        fPort: input.fPort || 1
+      };
+    }
+    if (typeof kf.lookahead === 'number') {
+      return {
+        bytes: [0xE2, kf.lookahead & 0xFF, (kf.lookahead >> 8) & 0xFF],
+        fPort: input.fPort || 1
+      };
+    }
+
+    // Byte 0: 0xE0, byte 1: flags, bytes 2-3: time in 10 ms units (LE)
+    var flags = (kf.spline ? 0x01 : 0) | (kf.newStream ? 0x02 : 0);
+    var time = Math.round((kf.time || 0) / 10) & 0xFFFF;
+    var bytes = [0xE0, flags, time & 0xFF, (time >> 8) & 0xFF];
+
+    // Group consecutive channels into runs: start (LE), count, values
+    var chans = Object.keys(kf.channels || {}).map(Number).sort(function (a, b) { return a - b; });
+    var i = 0;
+    while (i < chans.length) {
+      var start = chans[i];
+      var run = [];
+      while (i < chans.length && chans[i] === start + run.length && run.length < 255) {
+        run.push(kf.channels[chans[i]] & 0xFF);
+        i++;
+      }
+      bytes.push(start & 0xFF, (start >> 8) & 0xFF, run.length);
+      bytes = bytes.concat(run);
+    }
+
+    return {
+      bytes: bytes,
+      fPort: input.fPort || 1
+    };
+  }
+
     // Fallback - any other data is converted to a string and sent
     if (typeof input.data === 'object') {
       var jsonString = JSON.stringify(input.data);
@@ -325,6 +369,64 @@ function decodeUplink(input) {
       return result;
     }
 
+    // DMX loopback self-test result (big endian fields)
+    if (messageType === 0x04 && input.bytes.length === 16) {
+      const b = input.bytes;
+      const flags = b[1];
+      const u16 = (offset) => (b[offset] << 8) | b[offset + 1];
+      result.data.selfTest = {
+        passed: (flags & 0x01) !== 0,
+        mode: (flags & 0x02) ? "line" : "internal",
+        pattern: (flags & 0x04) !== 0,
+        edgesMissed: (flags & 0x08) !== 0,
+        frames: b[2],
+        framesMissing: b[3],
+        slotErrors: u16(4),
+        firstBadSlot: u16(6) === 0xFFFF ? null : u16(6),
+        breakUs: u16(8),
+        mabUs: u16(10),
+        refreshUs: u16(12),
+        slots: u16(14)
+      };
+      return result;
+    }
+
+    // Black-box dump fragment: index and total (big endian), then data;
+    // feed the "fragment" hex of every uplink to tools/blackbox to decode
+    if (messageType === 0x05 && input.bytes.length > 5) {
+      const b = input.bytes;
+      result.data.blackBox = {
+        index: (b[1] << 8) | b[2],
+        total: (b[3] << 8) | b[4],
+        fragment: b.map((x) => ('0' + x.toString(16)).slice(-2)).join('').toUpperCase()
+      };
+      return result;
+    }
+
+    // Capability advertisement (sent on join and when the data rate changes):
+    // keep downlinks at or under maxDownlinkPayload, the server drops larger ones
+    if (messageType === 0x06 && input.bytes.length >= 13 && input.bytes[1] !== 0) {
+      const b = input.bytes;
+      const u16 = (offset) => (b[offset] << 8) | b[offset + 1];
+      const features = u16(3);
+      const featureNames = ["presets", "compactLights", "json", "patterns", "fixtures", "patchEdits",
+                            "keyframes", "triggers", "schedule", "fuota"];
+      result.data.capability = {
+        version: b[1],
+        isClassC: (b[2] & 0x01) !== 0,
+        adr: (b[2] & 0x02) !== 0,
+        features: featureNames.filter((name, bit) => (features & (1 << bit)) !== 0),
+        uplinkDataRate: b[5],
+        downlinkDataRate: b[6],
+        maxDownlinkPayload: b[7],
+        fragmentSlots: u16(8),
+        maxFragmentSize: b[10],
+        freeCueSlots: b[11],
+        freeScheduleRules: b[12]
+      };
+      return result;
+    }
+
     // If we can't identify the message type
     result.data.rawBytes = input.bytes;
     result.warnings.push("Unknown message format");
@@ -19,6 +19,11 @@
 // For LoRaWAN 1.0.x, this can be the same as APPKEY
 #define NWKKEY "f7edcfe4617e66701665a13a2b76dd52"
 
+// WiFi credentials for the optional Art-Net bridge
+// Leave WIFI_SSID empty to keep WiFi off and disable Art-Net output
+#define WIFI_SSID ""
+#define WIFI_PASSWORD ""
+
 // Note: For security reasons, it's recommended to store these credentials
 // in a separate file that is not committed to version control.
 // You should replace these placeholder values with your actual credentials. 
\ No newline at end of file
@@ -0,0 +1,245 @@
+/**
+ * ArtNetOutput.cpp - Implementation of the Art-Net output bridge
+ */
+
+#include "ArtNetOutput.h"
+#include <string.h>
+
+#ifndef ARDUINO
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef ARDUINO
+// Constructor
+WiFiUdpArtNetTransport::WiFiUdpArtNetTransport(IPAddress target, uint16_t port) {
+    _target = target;
+    _port = port;
+}
+
+// Send the header and payload as one UDP datagram without merging them first
+bool WiFiUdpArtNetTransport::sendPacket(const uint8_t* header, size_t headerLen,
+                                        const uint8_t* payload, size_t payloadLen) {
+    if (!_udp.beginPacket(_target, _port)) {
+        return false;
+    }
+    _udp.write(header, headerLen);
+    if (payload != NULL && payloadLen > 0) {
+        _udp.write(payload, payloadLen);
+    }
+    return _udp.endPacket() == 1;
+}
+#else
+// Constructor
+PosixUdpArtNetTransport::PosixUdpArtNetTransport(const char* targetIp, uint16_t port) {
+    _port = port;
+    _targetAddr = 0;
+    _socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    struct in_addr addr;
+    if (_socket < 0 || inet_pton(AF_INET, targetIp, &addr) != 1) {
+        if (_socket >= 0) {
+            close(_socket);
+        }
+        _socket = -1;
+        return;
+    }
+    _targetAddr = addr.s_addr;
+
+    // Allow subnet broadcast targets as well as unicast
+    int enable = 1;
+    setsockopt(_socket, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+}
+
+// Destructor
+PosixUdpArtNetTransport::~PosixUdpArtNetTransport() {
+    if (_socket >= 0) {
+        close(_socket);
+    }
+}
+
+// Gather the header and payload with sendmsg() so neither is copied
+bool PosixUdpArtNetTransport::sendPacket(const uint8_t* header, size_t headerLen,
+                                         const uint8_t* payload, size_t payloadLen) {
+    if (_socket < 0) {
+        return false;
+    }
+
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(_port);
+    dest.sin_addr.s_addr = _targetAddr;
+
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)header;
+    iov[0].iov_len = headerLen;
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len = payload != NULL ? payloadLen : 0;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &dest;
+    msg.msg_namelen = sizeof(dest);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov[1].iov_len > 0 ? 2 : 1;
+
+    ssize_t sent = sendmsg(_socket, &msg, 0);
+    return sent == (ssize_t)(headerLen + iov[1].iov_len);
+}
+#endif
+
+// Constructor
+ArtNetOutput::ArtNetOutput() {
+    _transport = NULL;
+    _startUniverse = 0;
+    _numUniverses = 0;
+    _keepaliveMs = ARTNET_DEFAULT_KEEPALIVE_MS;
+    _syncEnabled = false;
+    _needsFullRefresh = true;
+
+    _dmxPacketsSent = 0;
+    _syncPacketsSent = 0;
+    _sendFailures = 0;
+
+    memset(_sequence, 0, sizeof(_sequence));
+    memset(_lastHash, 0, sizeof(_lastHash));
+    memset(_lastSendMs, 0, sizeof(_lastSendMs));
+
+    buildHeaders();
+}
+
+// Attach the transport and select the universes to emit
+void ArtNetOutput::begin(ArtNetTransport* transport, uint16_t startUniverse, uint8_t numUniverses) {
+    if (numUniverses < 1) numUniverses = 1;
+    if (numUniverses > ARTNET_MAX_UNIVERSES) numUniverses = ARTNET_MAX_UNIVERSES;
+
+    _transport = transport;
+    _startUniverse = startUniverse & 0x7FFF;  // Port-address is 15 bits
+    _numUniverses = numUniverses;
+
+    // Multi-universe output is only frame-consistent on the node with ArtSync
+    _syncEnabled = numUniverses > 1;
+    _needsFullRefresh = true;
+
+    for (int u = 0; u < ARTNET_MAX_UNIVERSES; u++) {
+        _sequence[u] = 0;
+    }
+}
+
+// Stop emitting
+void ArtNetOutput::end() {
+    _transport = NULL;
+    _needsFullRefresh = true;
+}
+
+// Fill the fixed parts of the packet headers
+void ArtNetOutput::buildHeaders() {
+    static const char ARTNET_ID[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+
+    // ArtDmx: ID, OpCode (LE), ProtVer (BE), Sequence, Physical, SubUni, Net, Length (BE)
+    memset(_dmxHeader, 0, sizeof(_dmxHeader));
+    memcpy(_dmxHeader, ARTNET_ID, sizeof(ARTNET_ID));
+    _dmxHeader[8] = ARTNET_OP_DMX & 0xFF;
+    _dmxHeader[9] = ARTNET_OP_DMX >> 8;
+    _dmxHeader[10] = 0;
+    _dmxHeader[11] = ARTNET_PROTOCOL_VERSION;
+
+    // ArtSync: ID, OpCode (LE), ProtVer (BE), Aux1, Aux2
+    memset(_syncPacket, 0, sizeof(_syncPacket));
+    memcpy(_syncPacket, ARTNET_ID, sizeof(ARTNET_ID));
+    _syncPacket[8] = ARTNET_OP_SYNC & 0xFF;
+    _syncPacket[9] = ARTNET_OP_SYNC >> 8;
+    _syncPacket[10] = 0;
+    _syncPacket[11] = ARTNET_PROTOCOL_VERSION;
+}
+
+// FNV-1a over the universe, processed four slots per iteration
+uint32_t ArtNetOutput::hashSlots(const uint8_t* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        hash = (hash ^ data[i]) * 16777619u;
+        hash = (hash ^ data[i + 1]) * 16777619u;
+        hash = (hash ^ data[i + 2]) * 16777619u;
+        hash = (hash ^ data[i + 3]) * 16777619u;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Emit the universes that changed, or all of them once the keepalive expires
+int ArtNetOutput::update(const uint8_t* slots, size_t numSlots, uint32_t nowMs) {
+    if (_transport == NULL || slots == NULL) {
+        return 0;
+    }
+
+    int sent = 0;
+    for (int u = 0; u < _numUniverses; u++) {
+        size_t offset = (size_t)u * ARTNET_UNIVERSE_SIZE;
+        if (offset >= numSlots) {
+            break;
+        }
+
+        size_t length = numSlots - offset;
+        if (length > ARTNET_UNIVERSE_SIZE) length = ARTNET_UNIVERSE_SIZE;
+
+        const uint8_t* universe = slots + offset;
+        uint32_t hash = hashSlots(universe, length);
+        bool changed = _needsFullRefresh || hash != _lastHash[u];
+        bool keepaliveDue = (uint32_t)(nowMs - _lastSendMs[u]) >= _keepaliveMs;
+        if (!changed && !keepaliveDue) {
+            continue;
+        }
+
+        // ArtDmx length must be even (and at least 2): zero-pad a short universe
+        size_t packetLength = length;
+        const uint8_t* payload = universe;
+        if (length < 2 || (length & 1) != 0) {
+            packetLength = length < 2 ? 2 : length + 1;
+            memcpy(_padded, universe, length);
+            memset(_padded + length, 0, packetLength - length);
+            payload = _padded;
+        }
+
+        // Sequence runs 1-255; 0 would tell the receiver to ignore ordering
+        _sequence[u] = (_sequence[u] == 255) ? 1 : (uint8_t)(_sequence[u] + 1);
+
+        uint16_t portAddress = (uint16_t)(_startUniverse + u) & 0x7FFF;
+        _dmxHeader[12] = _sequence[u];
+        _dmxHeader[13] = 0;                               // Physical input port
+        _dmxHeader[14] = portAddress & 0xFF;              // SubUni
+        _dmxHeader[15] = (portAddress >> 8) & 0x7F;       // Net
+        _dmxHeader[16] = (packetLength >> 8) & 0xFF;      // Length high byte
+        _dmxHeader[17] = packetLength & 0xFF;             // Length low byte
+
+        if (_transport->sendPacket(_dmxHeader, ARTNET_DMX_HEADER_SIZE, payload, packetLength)) {
+            _lastHash[u] = hash;
+            _lastSendMs[u] = nowMs;
+            _dmxPacketsSent++;
+            sent++;
+        } else {
+            _sendFailures++;
+        }
+    }
+
+    if (sent > 0) {
+        _needsFullRefresh = false;
+
+        // ArtSync latches every universe of this batch at once on the receivers
+        if (_syncEnabled) {
+            if (_transport->sendPacket(_syncPacket, ARTNET_SYNC_SIZE, NULL, 0)) {
+                _syncPacketsSent++;
+            } else {
+                _sendFailures++;
+            }
+        }
+    }
+
+    return sent;
+}
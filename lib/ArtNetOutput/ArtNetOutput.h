@@ -0,0 +1,195 @@
+/**
+ * ArtNetOutput.h - Re-emit the composed DMX frame as Art-Net
+ *
+ * Sends ArtDmx packets (with per-universe sequence numbers) and an optional
+ * ArtSync after each batch, so WiFi-connected Art-Net nodes can mirror what
+ * the LoRa node drives on its own DMX port.
+ *
+ * Packets are only sent when a universe changes or when the keepalive
+ * interval elapses. The 18-byte ArtDmx header is kept in a member buffer and
+ * the slot data is passed to the transport as a second segment straight from
+ * the frame buffer, so the universe is never copied. The exception is a last
+ * universe of odd length: ArtDmx lengths are even, so it is copied and
+ * zero-padded by one slot.
+ *
+ * The socket layer is the ArtNetTransport interface: the firmware uses
+ * WiFiUDP, a Linux host can use the POSIX UDP transport (e.g. against a
+ * loopback listener) or a mock to check rate and content.
+ */
+
+#ifndef ARTNET_OUTPUT_H
+#define ARTNET_OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#endif
+
+// Art-Net protocol constants
+#define ARTNET_PORT 6454
+#define ARTNET_PROTOCOL_VERSION 14
+#define ARTNET_OP_DMX 0x5000
+#define ARTNET_OP_SYNC 0x5200
+#define ARTNET_DMX_HEADER_SIZE 18
+#define ARTNET_SYNC_SIZE 14
+#define ARTNET_UNIVERSE_SIZE 512
+
+// Output configuration
+#define ARTNET_MAX_UNIVERSES 4           // Universes one node can re-emit
+#define ARTNET_DEFAULT_KEEPALIVE_MS 1000 // Art-Net nodes expect a refresh at least every ~1s
+
+/**
+ * Datagram transport used by ArtNetOutput
+ *
+ * A packet is handed over as a header segment plus an optional payload
+ * segment, so implementations can gather both without an intermediate copy.
+ */
+class ArtNetTransport {
+public:
+    virtual ~ArtNetTransport() {}
+
+    /**
+     * Send one datagram
+     *
+     * @param header Packet header bytes
+     * @param headerLen Header length
+     * @param payload Payload bytes (may be NULL)
+     * @param payloadLen Payload length
+     * @return True if the datagram was handed to the network stack
+     */
+    virtual bool sendPacket(const uint8_t* header, size_t headerLen,
+                            const uint8_t* payload, size_t payloadLen) = 0;
+};
+
+#ifdef ARDUINO
+/**
+ * Art-Net transport over the ESP32 WiFi stack
+ */
+class WiFiUdpArtNetTransport : public ArtNetTransport {
+public:
+    /**
+     * Constructor
+     *
+     * @param target Destination address (node unicast or subnet broadcast)
+     * @param port Destination UDP port
+     */
+    WiFiUdpArtNetTransport(IPAddress target, uint16_t port = ARTNET_PORT);
+
+    bool sendPacket(const uint8_t* header, size_t headerLen,
+                    const uint8_t* payload, size_t payloadLen) override;
+
+private:
+    WiFiUDP _udp;
+    IPAddress _target;
+    uint16_t _port;
+};
+#else
+/**
+ * Art-Net transport over a POSIX UDP socket (host builds)
+ */
+class PosixUdpArtNetTransport : public ArtNetTransport {
+public:
+    /**
+     * Constructor
+     *
+     * @param targetIp Destination IPv4 address in dotted notation
+     * @param port Destination UDP port
+     */
+    PosixUdpArtNetTransport(const char* targetIp, uint16_t port = ARTNET_PORT);
+    ~PosixUdpArtNetTransport();
+
+    bool sendPacket(const uint8_t* header, size_t headerLen,
+                    const uint8_t* payload, size_t payloadLen) override;
+
+    /**
+     * Check that the socket was opened and the address parsed
+     */
+    bool isOpen() const { return _socket >= 0; }
+
+private:
+    int _socket;
+    uint32_t _targetAddr;  // Network byte order
+    uint16_t _port;
+};
+#endif
+
+class ArtNetOutput {
+public:
+    ArtNetOutput();
+
+    /**
+     * Attach the transport and select the universes to emit
+     *
+     * @param transport Datagram transport (must outlive this object)
+     * @param startUniverse Art-Net port-address of the first universe (15 bits)
+     * @param numUniverses Number of consecutive universes (1-ARTNET_MAX_UNIVERSES)
+     */
+    void begin(ArtNetTransport* transport, uint16_t startUniverse = 0, uint8_t numUniverses = 1);
+
+    /**
+     * Stop emitting; the next begin() starts with a full refresh
+     */
+    void end();
+
+    /**
+     * Set the interval after which an unchanged universe is re-sent
+     */
+    void setKeepaliveInterval(uint32_t intervalMs) { _keepaliveMs = intervalMs; }
+
+    /**
+     * Enable or disable ArtSync after each batch
+     * By default ArtSync is only sent when more than one universe is emitted.
+     */
+    void setSyncEnabled(bool enabled) { _syncEnabled = enabled; }
+
+    /**
+     * Emit the universes that changed, or all of them once the keepalive expires
+     *
+     * @param slots DMX slot data without the start code, universes back to back
+     * @param numSlots Number of valid slots in the buffer
+     * @param nowMs Current time in milliseconds
+     * @return Number of ArtDmx packets sent
+     */
+    int update(const uint8_t* slots, size_t numSlots, uint32_t nowMs);
+
+    /**
+     * Force every universe to be re-sent on the next update()
+     */
+    void invalidate() { _needsFullRefresh = true; }
+
+    bool isActive() const { return _transport != NULL; }
+    uint32_t getDmxPacketsSent() const { return _dmxPacketsSent; }
+    uint32_t getSyncPacketsSent() const { return _syncPacketsSent; }
+    uint32_t getSendFailures() const { return _sendFailures; }
+
+private:
+    ArtNetTransport* _transport;
+    uint16_t _startUniverse;
+    uint8_t _numUniverses;
+    uint32_t _keepaliveMs;
+    bool _syncEnabled;
+    bool _needsFullRefresh;
+
+    uint8_t _dmxHeader[ARTNET_DMX_HEADER_SIZE];  // Reused for every ArtDmx packet
+    uint8_t _syncPacket[ARTNET_SYNC_SIZE];       // ArtSync never changes
+    uint8_t _padded[ARTNET_UNIVERSE_SIZE];       // Odd-length universe with its zero pad slot
+
+    uint8_t _sequence[ARTNET_MAX_UNIVERSES];     // Per-universe sequence (1-255, 0 = disabled)
+    uint32_t _lastHash[ARTNET_MAX_UNIVERSES];    // Hash of the last frame sent per universe
+    uint32_t _lastSendMs[ARTNET_MAX_UNIVERSES];  // Time of the last send per universe
+
+    uint32_t _dmxPacketsSent;
+    uint32_t _syncPacketsSent;
+    uint32_t _sendFailures;
+
+    // Fill the fixed parts of the packet headers
+    void buildHeaders();
+
+    // FNV-1a hash used for change detection without keeping a shadow copy
+    static uint32_t hashSlots(const uint8_t* data, size_t length);
+};
+
+#endif // ARTNET_OUTPUT_H
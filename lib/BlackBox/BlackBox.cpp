@@ -0,0 +1,396 @@
+/**
+ * BlackBox.cpp - Implementation of the black-box recorder
+ */
+
+#ifdef ARDUINO
+
+#include "BlackBox.h"
+#include <Preferences.h>
+
+// Constructor
+BlackBox::BlackBox() {
+    _partition = NULL;
+    _sectorCount = 0;
+    _sequence = 0;
+    _bootSequence = 0;
+    _sectorUsed = 0;
+    _sectorOpen = false;
+    _buffered = 0;
+    _bufferedSinceMs = 0;
+    _flushMs = BLACKBOX_DEFAULT_FLUSH_MS;
+    memset(_last, 0, sizeof(_last));
+    _lastSlots = 0;
+    _lastRecordMs = 0;
+    _sampleMs = BLACKBOX_DEFAULT_SAMPLE_MS;
+    _lastSampleMs = 0;
+    _bytesLogged = 0;
+    _sectorsErased = 0;
+    _dumpTotal = 0;
+    _dumpIndex = 0;
+    _dumpFragment = 0;
+    _dumpFirst = 0;
+    _dumpSectors = 0;
+    _dumpElement = 0;
+    _dumpOffset = 0;
+    _dumpLengths = NULL;
+    memset(_dumpHeader, 0, sizeof(_dumpHeader));
+}
+
+// Destructor
+BlackBox::~BlackBox() {
+    stopDump();
+}
+
+// Find the flash ring, resume after the newest sector and log the boot
+bool BlackBox::begin(uint8_t resetReason) {
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BLACKBOX_PARTITION_LABEL);
+    if (_partition == NULL) {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BLACKBOX_FALLBACK_LABEL);
+    }
+    if (_partition == NULL || _partition->size < 2 * BLACKBOX_SECTOR_SIZE) {
+        Serial.println("[BlackBox] No blackbox or spiffs partition, recorder disabled");
+        _partition = NULL;
+        return false;
+    }
+    _sectorCount = _partition->size / BLACKBOX_SECTOR_SIZE;
+
+    // Resume after the newest sector; a sector whose sequence does not
+    // match its position belongs to an older partition layout
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t i = 0; i < _sectorCount; i++) {
+        uint8_t header[BLACKBOX_HEADER_SIZE];
+        uint32_t sequence;
+        if (esp_partition_read(_partition, i * BLACKBOX_SECTOR_SIZE, header, sizeof(header)) == ESP_OK &&
+            BlackBoxDecoder::readHeader(header, sizeof(header), sequence) &&
+            sequence % _sectorCount == i && (!found || sequence > newest)) {
+            newest = sequence;
+            found = true;
+        }
+    }
+    _sequence = found ? newest : (uint32_t)-1;  // openSector() moves to the next one
+    _bootSequence = _sequence + 1;
+
+    Preferences preferences;
+    preferences.begin("blackbox", true);
+    _sampleMs = (uint16_t)preferences.getInt("rate", BLACKBOX_DEFAULT_SAMPLE_MS);
+    preferences.end();
+
+    uint32_t nowMs = millis();
+    if (!openSector(nowMs)) {
+        _partition = NULL;
+        return false;
+    }
+    logEvent(BLACKBOX_EVENT_BOOT, &resetReason, 1, nowMs);
+    flush();
+
+    Serial.printf("[BlackBox] %lu KB ring in \"%s\", boot %lu, sampling every %u ms\n",
+                  (unsigned long)(_sectorCount * BLACKBOX_SECTOR_SIZE / 1024), _partition->label,
+                  (unsigned long)_bootSequence, _sampleMs);
+    return true;
+}
+
+// Set the sample interval
+void BlackBox::setSampleInterval(uint16_t intervalMs, bool persist) {
+    if (intervalMs != 0 && intervalMs < BLACKBOX_MIN_SAMPLE_MS) {
+        intervalMs = BLACKBOX_MIN_SAMPLE_MS;
+    }
+    _sampleMs = intervalMs;
+
+    if (persist) {
+        Preferences preferences;
+        preferences.begin("blackbox", false);
+        preferences.putInt("rate", intervalMs);
+        preferences.end();
+    }
+}
+
+// Record the frame if it is due and changed
+void BlackBox::sample(const uint8_t* frame, uint16_t slots, uint32_t nowMs) {
+    if (!_sectorOpen || _sampleMs == 0 || nowMs - _lastSampleMs < _sampleMs) {
+        return;
+    }
+    _lastSampleMs = nowMs;
+    if (slots > BLACKBOX_MAX_SLOTS) {
+        slots = BLACKBOX_MAX_SLOTS;
+    }
+
+    // A new universe size starts over from a keyframe
+    size_t length = 0;
+    if (slots != _lastSlots) {
+        _record[length++] = BLACKBOX_RECORD_KEYFRAME;
+        length += blackBoxPutVarint(_record + length, nowMs);
+        length += blackBoxPutVarint(_record + length, _bootSequence);
+        length += blackBoxPutVarint(_record + length, slots);
+        length += blackBoxEncodeRuns(NULL, frame, slots, _record + length);
+    } else {
+        if (memcmp(_last, frame, slots) == 0) {
+            return;  // Unchanged frames cost nothing
+        }
+        _record[length++] = BLACKBOX_RECORD_FRAME;
+        length += blackBoxPutVarint(_record + length, nowMs - _lastRecordMs);
+        length += blackBoxEncodeRuns(_last, frame, slots, _record + length);
+    }
+    memcpy(_last, frame, slots);
+    _lastSlots = slots;
+
+    // If the record does not fit, the next sector's keyframe carries the frame
+    if (_sectorUsed + length + 1 > BLACKBOX_SECTOR_SIZE) {
+        openSector(nowMs);
+        return;
+    }
+    appendBytes(_record, length);
+    _lastRecordMs = nowMs;
+}
+
+// Record an event
+void BlackBox::logEvent(uint8_t kind, const uint8_t* data, size_t length, uint32_t nowMs) {
+    if (!_sectorOpen) {
+        return;
+    }
+    if (length > BLACKBOX_MAX_EVENT) {
+        length = BLACKBOX_MAX_EVENT;
+    }
+
+    uint8_t record[1 + 5 + 2 + BLACKBOX_MAX_EVENT];
+    if (_sectorUsed + sizeof(record) - BLACKBOX_MAX_EVENT + length + 1 > BLACKBOX_SECTOR_SIZE && !openSector(nowMs)) {
+        return;
+    }
+    size_t used = 0;
+    record[used++] = BLACKBOX_RECORD_EVENT;
+    used += blackBoxPutVarint(record + used, nowMs - _lastRecordMs);
+    record[used++] = kind;
+    record[used++] = (uint8_t)length;
+    memcpy(record + used, data, length);
+    appendBytes(record, used + length);
+    _lastRecordMs = nowMs;
+}
+
+// Write buffered records once they have waited long enough
+void BlackBox::poll(uint32_t nowMs) {
+    if (_buffered > 0 && nowMs - _bufferedSinceMs >= _flushMs) {
+        flush();
+    }
+}
+
+// Write buffered records now, ending with a flush marker so the data on
+// flash never ends in 0xFF and its length can be read back exactly
+bool BlackBox::flush() {
+    if (!_sectorOpen || _buffered == 0) {
+        return true;
+    }
+    if (_sectorUsed < BLACKBOX_SECTOR_SIZE) {
+        uint8_t marker = BLACKBOX_RECORD_FLUSH;
+        appendBytes(&marker, 1);
+    }
+    return writeBuffer();
+}
+
+// Partition offset of a sequence number's sector
+uint32_t BlackBox::sectorAddress(uint32_t sequence) const {
+    return (sequence % _sectorCount) * BLACKBOX_SECTOR_SIZE;
+}
+
+// Bytes of a sector in use
+uint16_t BlackBox::usedLength(uint32_t sequence) {
+    if (sequence == _sequence && _sectorOpen) {
+        return (uint16_t)_sectorUsed;
+    }
+
+    uint32_t address = sectorAddress(sequence);
+    uint8_t block[64];
+    uint32_t found;
+    if (esp_partition_read(_partition, address, block, BLACKBOX_HEADER_SIZE) != ESP_OK ||
+        !BlackBoxDecoder::readHeader(block, BLACKBOX_HEADER_SIZE, found) || found != sequence) {
+        return 0;  // Never written, or reused by a newer pass
+    }
+
+    // Trim trailing erased bytes
+    for (uint32_t end = BLACKBOX_SECTOR_SIZE; end > 0; end -= sizeof(block)) {
+        if (esp_partition_read(_partition, address + end - sizeof(block), block, sizeof(block)) != ESP_OK) {
+            return 0;
+        }
+        for (int i = sizeof(block) - 1; i >= 0; i--) {
+            if (block[i] != 0xFF) {
+                return (uint16_t)(end - sizeof(block) + i + 1);
+            }
+        }
+    }
+    return 0;
+}
+
+// Erase the next sector and start it with a header and a keyframe
+bool BlackBox::openSector(uint32_t nowMs) {
+    if (_sectorOpen) {
+        flush();
+    }
+    _sectorOpen = false;
+    _sequence++;
+
+    if (esp_partition_erase_range(_partition, sectorAddress(_sequence), BLACKBOX_SECTOR_SIZE) != ESP_OK) {
+        Serial.printf("[BlackBox] Erasing sector %lu failed\n", (unsigned long)(_sequence % _sectorCount));
+        return false;
+    }
+    _sectorsErased++;
+    _sectorOpen = true;
+    _sectorUsed = 0;
+
+    uint8_t header[BLACKBOX_HEADER_SIZE] = {
+        (uint8_t)BLACKBOX_MAGIC, (uint8_t)(BLACKBOX_MAGIC >> 8),
+        (uint8_t)(BLACKBOX_MAGIC >> 16), (uint8_t)(BLACKBOX_MAGIC >> 24),
+        (uint8_t)_sequence, (uint8_t)(_sequence >> 8),
+        (uint8_t)(_sequence >> 16), (uint8_t)(_sequence >> 24)
+    };
+    appendBytes(header, sizeof(header));
+
+    size_t length = 0;
+    _record[length++] = BLACKBOX_RECORD_KEYFRAME;
+    length += blackBoxPutVarint(_record + length, nowMs);
+    length += blackBoxPutVarint(_record + length, _bootSequence);
+    length += blackBoxPutVarint(_record + length, _lastSlots);
+    length += blackBoxEncodeRuns(NULL, _last, _lastSlots, _record + length);
+    appendBytes(_record, length);
+    _lastRecordMs = nowMs;
+    return true;
+}
+
+// Append bytes through the RAM buffer
+void BlackBox::appendBytes(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        if (_buffered == 0) {
+            _bufferedSinceMs = millis();
+        }
+        size_t chunk = min(length, (size_t)(BLACKBOX_BUFFER_SIZE - _buffered));
+        memcpy(_buffer + _buffered, data, chunk);
+        _buffered += chunk;
+        _sectorUsed += chunk;
+        data += chunk;
+        length -= chunk;
+        if (_buffered == BLACKBOX_BUFFER_SIZE) {
+            writeBuffer();
+        }
+    }
+}
+
+// Write the RAM buffer to flash
+bool BlackBox::writeBuffer() {
+    if (_buffered == 0) {
+        return true;
+    }
+    uint32_t address = sectorAddress(_sequence) + _sectorUsed - _buffered;
+    bool ok = esp_partition_write(_partition, address, _buffer, _buffered) == ESP_OK;
+    _bytesLogged += _buffered;
+    _buffered = 0;
+    return ok;
+}
+
+// Start a dump of the newest sectors
+uint16_t BlackBox::startDump(uint16_t sectors, uint16_t fragmentSize, uint32_t nowMs) {
+    stopDump();
+    if (!_sectorOpen || fragmentSize == 0) {
+        return 0;
+    }
+    flush();
+
+    uint32_t available = min(_sequence + 1, _sectorCount);
+    if (sectors == 0 || sectors > available) {
+        sectors = (uint16_t)min(available, (uint32_t)0xFFFF);
+    }
+    _dumpSectors = sectors;
+    _dumpFirst = _sequence - sectors + 1;
+    _dumpLengths = new uint16_t[sectors];
+
+    uint32_t total = BLACKBOX_DUMP_HEADER;
+    for (uint16_t i = 0; i < sectors; i++) {
+        _dumpLengths[i] = usedLength(_dumpFirst + i);
+        total += 2 + _dumpLengths[i];
+    }
+    uint32_t fragments = (total + fragmentSize - 1) / fragmentSize;
+    if (fragments > 0xFFFF) {
+        Serial.println("[BlackBox] Dump too large for 16-bit fragment numbers; use fewer sectors or larger fragments");
+        stopDump();
+        return 0;
+    }
+
+    uint32_t boot = _bootSequence;
+    uint8_t header[BLACKBOX_DUMP_HEADER] = {
+        (uint8_t)nowMs, (uint8_t)(nowMs >> 8), (uint8_t)(nowMs >> 16), (uint8_t)(nowMs >> 24),
+        (uint8_t)boot, (uint8_t)(boot >> 8), (uint8_t)(boot >> 16), (uint8_t)(boot >> 24)
+    };
+    memcpy(_dumpHeader, header, sizeof(header));
+    _dumpFragment = fragmentSize;
+    _dumpTotal = (uint16_t)fragments;
+    _dumpIndex = 0;
+    _dumpElement = -1;
+    _dumpOffset = 0;
+    return _dumpTotal;
+}
+
+// Build the next dump fragment
+size_t BlackBox::nextDumpFragment(uint8_t* out) {
+    if (_dumpTotal == 0 || _dumpIndex >= _dumpTotal) {
+        stopDump();
+        return 0;
+    }
+
+    out[0] = BLACKBOX_FRAGMENT_TYPE;
+    out[1] = (uint8_t)(_dumpIndex >> 8);
+    out[2] = (uint8_t)_dumpIndex;
+    out[3] = (uint8_t)(_dumpTotal >> 8);
+    out[4] = (uint8_t)_dumpTotal;
+    size_t length = BLACKBOX_FRAGMENT_HEADER;
+    size_t room = _dumpFragment;
+
+    // The stream is the dump header, then (length, bytes) for each sector
+    while (room > 0 && _dumpElement < (int32_t)_dumpSectors) {
+        if (_dumpElement < 0) {
+            size_t chunk = min(room, (size_t)(BLACKBOX_DUMP_HEADER - _dumpOffset));
+            memcpy(out + length, _dumpHeader + _dumpOffset, chunk);
+            length += chunk;
+            room -= chunk;
+            _dumpOffset += chunk;
+            if (_dumpOffset == BLACKBOX_DUMP_HEADER) {
+                _dumpElement++;
+                _dumpOffset = 0;
+            }
+            continue;
+        }
+
+        uint16_t sectorLength = _dumpLengths[_dumpElement];
+        if (_dumpOffset < 2) {
+            out[length++] = _dumpOffset == 0 ? (uint8_t)sectorLength : (uint8_t)(sectorLength >> 8);
+            room--;
+            _dumpOffset++;
+        } else {
+            size_t chunk = min(room, (size_t)(sectorLength + 2 - _dumpOffset));
+            if (chunk > 0) {
+                uint32_t address = sectorAddress(_dumpFirst + _dumpElement) + _dumpOffset - 2;
+                if (esp_partition_read(_partition, address, out + length, chunk) != ESP_OK) {
+                    memset(out + length, 0xFF, chunk);
+                }
+                length += chunk;
+                room -= chunk;
+                _dumpOffset += chunk;
+            }
+        }
+        if (_dumpOffset == (uint32_t)sectorLength + 2) {
+            _dumpElement++;
+            _dumpOffset = 0;
+        }
+    }
+
+    _dumpIndex++;
+    return length;
+}
+
+// Abandon the running dump
+void BlackBox::stopDump() {
+    if (_dumpLengths != NULL) {
+        delete[] _dumpLengths;
+        _dumpLengths = NULL;
+    }
+    _dumpTotal = 0;
+    _dumpIndex = 0;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,194 @@
+/**
+ * BlackBox.h - Black-box recorder for the DMX output and command events
+ *
+ * Samples the on-air frame at a configurable interval and appends the slots
+ * that changed to a ring of flash sectors, with downlinks and boots logged
+ * as events in between. When a client reports that the lights did
+ * something odd at 21:40, the universe and the commands that led to it can
+ * be dumped and replayed with tools/blackbox.
+ *
+ * The ring lives in the "blackbox" data partition, or in the "spiffs"
+ * partition of the stock partition table, which the firmware does not
+ * mount. Records are buffered in RAM and written when the buffer fills or
+ * the flush interval passes. Each byte is programmed once and each sector
+ * erased once per pass of the ring, so wear follows the logged volume: an
+ * unchanged frame costs nothing and a sector costs one header and one
+ * keyframe. A reset loses at most one flush interval.
+ *
+ * A sector erase stalls code running from flash on both cores for tens of
+ * milliseconds, once per 4 KB logged. DMX fixtures hold the last frame
+ * through it.
+ *
+ * Dumps stream the newest sectors as fragments (see BlackBoxFormat.h),
+ * either as hex lines on the serial console or as port 2 uplinks.
+ */
+
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include "BlackBoxFormat.h"
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define BLACKBOX_PARTITION_LABEL "blackbox"
+#define BLACKBOX_FALLBACK_LABEL "spiffs"
+#define BLACKBOX_BUFFER_SIZE 256            // RAM buffer in front of flash (one flash page)
+#define BLACKBOX_DEFAULT_SAMPLE_MS 200      // Sample interval (0 = recording off)
+#define BLACKBOX_MIN_SAMPLE_MS 25           // One DMX frame period
+#define BLACKBOX_DEFAULT_FLUSH_MS 5000      // Longest time records wait in RAM
+
+class BlackBox {
+public:
+    BlackBox();
+    ~BlackBox();
+
+    /**
+     * Find the flash ring, resume after the newest sector and log a boot
+     * event
+     *
+     * The sample interval is restored from Preferences.
+     *
+     * @param resetReason Reset reason to log (esp_reset_reason())
+     * @return True if a partition was found
+     */
+    bool begin(uint8_t resetReason);
+
+    /**
+     * Set the sample interval
+     *
+     * @param intervalMs Milliseconds between samples (0 = off, else at
+     *        least BLACKBOX_MIN_SAMPLE_MS)
+     * @param persist Save the interval to Preferences
+     */
+    void setSampleInterval(uint16_t intervalMs, bool persist = true);
+
+    /**
+     * Set how long records may wait in RAM before they are written
+     */
+    void setFlushInterval(uint32_t intervalMs) { _flushMs = intervalMs; }
+
+    /**
+     * Record the frame if the sample interval has passed and it changed
+     *
+     * @param frame Slot values, starting at channel 1
+     * @param slots Number of slots (max BLACKBOX_MAX_SLOTS)
+     * @param nowMs millis()
+     */
+    void sample(const uint8_t* frame, uint16_t slots, uint32_t nowMs);
+
+    /**
+     * Record an event
+     *
+     * @param kind BLACKBOX_EVENT_* value
+     * @param data Event data (truncated to BLACKBOX_MAX_EVENT bytes)
+     * @param length Number of bytes
+     * @param nowMs millis()
+     */
+    void logEvent(uint8_t kind, const uint8_t* data, size_t length, uint32_t nowMs);
+
+    /**
+     * Write buffered records once the flush interval has passed; call from
+     * loop()
+     */
+    void poll(uint32_t nowMs);
+
+    /**
+     * Write buffered records now
+     *
+     * @return True on success
+     */
+    bool flush();
+
+    /**
+     * Start a dump of the newest sectors
+     *
+     * Buffered records are flushed first. Recording continues during the
+     * dump; records written after this call are not part of it.
+     *
+     * @param sectors Number of sectors (0 = every sector in the ring)
+     * @param fragmentSize Data bytes per fragment (header not included)
+     * @param nowMs millis(), stored in the dump header
+     * @return Number of fragments, or 0 if there is nothing to dump
+     */
+    uint16_t startDump(uint16_t sectors, uint16_t fragmentSize, uint32_t nowMs);
+
+    /**
+     * Build the next dump fragment
+     *
+     * @param out Buffer of at least BLACKBOX_FRAGMENT_HEADER + fragmentSize bytes
+     * @return Fragment length, or 0 when the dump is complete
+     */
+    size_t nextDumpFragment(uint8_t* out);
+
+    /**
+     * Abandon the running dump
+     */
+    void stopDump();
+
+    bool isReady() const { return _partition != NULL; }
+    bool isDumping() const { return _dumpTotal != 0; }
+    uint16_t getDumpIndex() const { return _dumpIndex; }
+    uint16_t getDumpTotal() const { return _dumpTotal; }
+    uint16_t getSampleInterval() const { return _sampleMs; }
+    uint32_t getSectorCount() const { return _sectorCount; }
+    uint32_t getSequence() const { return _sequence; }
+    uint32_t getBootSequence() const { return _bootSequence; }
+    uint32_t getBytesLogged() const { return _bytesLogged; }
+    uint32_t getSectorsErased() const { return _sectorsErased; }
+
+private:
+    const esp_partition_t* _partition;
+    uint32_t _sectorCount;
+    uint32_t _sequence;          // Sequence of the open sector (sector = sequence % count)
+    uint32_t _bootSequence;      // Sequence of the first sector of this boot
+    uint32_t _sectorUsed;        // Bytes in the open sector, buffered ones included
+    bool _sectorOpen;
+
+    uint8_t _buffer[BLACKBOX_BUFFER_SIZE];
+    uint16_t _buffered;
+    uint32_t _bufferedSinceMs;   // When the oldest buffered record was added
+    uint32_t _flushMs;
+
+    uint8_t _last[BLACKBOX_MAX_SLOTS];  // Last recorded frame
+    uint16_t _lastSlots;
+    uint32_t _lastRecordMs;      // Time base of the open sector's records
+    uint16_t _sampleMs;
+    uint32_t _lastSampleMs;
+    uint8_t _record[BLACKBOX_MAX_RECORD];
+
+    uint32_t _bytesLogged;
+    uint32_t _sectorsErased;
+
+    // Dump cursor
+    uint16_t _dumpTotal;
+    uint16_t _dumpIndex;
+    uint16_t _dumpFragment;
+    uint32_t _dumpFirst;         // Sequence of the oldest dumped sector
+    uint16_t _dumpSectors;
+    int32_t _dumpElement;        // -1 = dump header, else index of the sector being sent
+    uint32_t _dumpOffset;        // Position within the element (length prefix included)
+    uint16_t* _dumpLengths;      // Used bytes of each dumped sector
+    uint8_t _dumpHeader[BLACKBOX_DUMP_HEADER];
+
+    // Partition offset of a sequence number's sector
+    uint32_t sectorAddress(uint32_t sequence) const;
+
+    // Bytes of a sector in use (trailing erased bytes trimmed)
+    uint16_t usedLength(uint32_t sequence);
+
+    // Erase the next sector and start it with a header and a keyframe
+    bool openSector(uint32_t nowMs);
+
+    // Append bytes through the RAM buffer
+    void appendBytes(const uint8_t* data, size_t length);
+
+    // Write the RAM buffer to flash
+    bool writeBuffer();
+};
+
+#endif // ARDUINO
+
+#endif // BLACKBOX_H
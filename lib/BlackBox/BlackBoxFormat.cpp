@@ -0,0 +1,197 @@
+/**
+ * BlackBoxFormat.cpp - Encoding helpers and decoder for black-box records
+ */
+
+#include "BlackBoxFormat.h"
+#include <string.h>
+
+// Longest run of unchanged slots folded into a run
+#define BLACKBOX_MAX_FOLDED_GAP 2
+
+// Append an unsigned LEB128 varint
+size_t blackBoxPutVarint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+// Read an unsigned LEB128 varint
+size_t blackBoxGetVarint(const uint8_t* data, size_t length, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < length && i < 5; i++) {
+        value |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Encode the changed slots of a frame as (gap, length, bytes) runs
+size_t blackBoxEncodeRuns(const uint8_t* previous, const uint8_t* frame, uint16_t slots, uint8_t* out) {
+    size_t length = 0;
+    uint16_t runEnd = 0;  // End of the previous run
+    uint16_t i = 0;
+
+    while (i < slots) {
+        if (frame[i] == (previous != NULL ? previous[i] : 0)) {
+            i++;
+            continue;
+        }
+
+        // Extend the run over changes and short unchanged gaps
+        uint16_t start = i;
+        uint16_t end = i + 1;
+        for (uint16_t j = end; j < slots && j - end < BLACKBOX_MAX_FOLDED_GAP + 1; j++) {
+            if (frame[j] != (previous != NULL ? previous[j] : 0)) {
+                end = j + 1;
+            }
+        }
+
+        length += blackBoxPutVarint(out + length, start - runEnd);
+        length += blackBoxPutVarint(out + length, end - start);
+        memcpy(out + length, frame + start, end - start);
+        length += end - start;
+        runEnd = end;
+        i = end;
+    }
+
+    out[length++] = 0;  // Gap
+    out[length++] = 0;  // Empty run: end of list
+    return length;
+}
+
+// Constructor
+BlackBoxDecoder::BlackBoxDecoder() {
+    memset(_frame, 0, sizeof(_frame));
+    memset(_scratch, 0, sizeof(_scratch));
+    _slots = 0;
+    _errors = 0;
+}
+
+// Read the sequence number of a sector
+bool BlackBoxDecoder::readHeader(const uint8_t* sector, size_t length, uint32_t& sequence) {
+    if (length < BLACKBOX_HEADER_SIZE) {
+        return false;
+    }
+    uint32_t magic = (uint32_t)sector[0] | ((uint32_t)sector[1] << 8) |
+                     ((uint32_t)sector[2] << 16) | ((uint32_t)sector[3] << 24);
+    sequence = (uint32_t)sector[4] | ((uint32_t)sector[5] << 8) |
+               ((uint32_t)sector[6] << 16) | ((uint32_t)sector[7] << 24);
+    return magic == BLACKBOX_MAGIC;
+}
+
+// Apply runs to the scratch frame
+size_t BlackBoxDecoder::readRuns(const uint8_t* data, size_t length) {
+    size_t offset = 0;
+    uint32_t position = 0;
+
+    while (true) {
+        uint32_t gap, count;
+        size_t used = blackBoxGetVarint(data + offset, length - offset, gap);
+        if (used == 0) {
+            return 0;
+        }
+        offset += used;
+        used = blackBoxGetVarint(data + offset, length - offset, count);
+        if (used == 0) {
+            return 0;
+        }
+        offset += used;
+        if (count == 0) {
+            return offset;
+        }
+
+        position += gap;
+        if (position + count > _slots || count > length - offset) {
+            return 0;
+        }
+        memcpy(_scratch + position, data + offset, count);
+        position += count;
+        offset += count;
+    }
+}
+
+// Decode one sector into a sink
+int BlackBoxDecoder::decodeSector(const uint8_t* sector, size_t length, BlackBoxSink* sink) {
+    uint32_t sequence;
+    if (!readHeader(sector, length, sequence)) {
+        return -1;
+    }
+
+    size_t offset = BLACKBOX_HEADER_SIZE;
+    uint32_t boot = 0;
+    uint32_t timeMs = 0;
+    bool keyed = false;
+    int records = 0;
+
+    while (offset < length) {
+        uint8_t type = sector[offset];
+        if (type == BLACKBOX_RECORD_END) {
+            break;
+        }
+        if (type == BLACKBOX_RECORD_FLUSH) {
+            offset++;
+            continue;
+        }
+
+        const uint8_t* data = sector + offset + 1;
+        size_t remaining = length - offset - 1;
+        size_t used = 0;
+        uint32_t value;
+
+        if (type == BLACKBOX_RECORD_KEYFRAME) {
+            uint32_t uptime, slots;
+            size_t n1 = blackBoxGetVarint(data, remaining, uptime);
+            size_t n2 = n1 ? blackBoxGetVarint(data + n1, remaining - n1, boot) : 0;
+            size_t n3 = n2 ? blackBoxGetVarint(data + n1 + n2, remaining - n1 - n2, slots) : 0;
+            if (n3 != 0 && slots <= BLACKBOX_MAX_SLOTS) {
+                _slots = (uint16_t)slots;
+                memset(_scratch, 0, sizeof(_scratch));
+                size_t runs = readRuns(data + n1 + n2 + n3, remaining - n1 - n2 - n3);
+                if (runs != 0) {
+                    used = n1 + n2 + n3 + runs;
+                    timeMs = uptime;
+                    keyed = true;
+                }
+            }
+        } else if (keyed && type == BLACKBOX_RECORD_FRAME) {
+            size_t n1 = blackBoxGetVarint(data, remaining, value);
+            if (n1 != 0) {
+                memcpy(_scratch, _frame, _slots);
+                size_t runs = readRuns(data + n1, remaining - n1);
+                if (runs != 0) {
+                    used = n1 + runs;
+                    timeMs += value;
+                }
+            }
+        } else if (keyed && type == BLACKBOX_RECORD_EVENT) {
+            size_t n1 = blackBoxGetVarint(data, remaining, value);
+            if (n1 != 0 && remaining - n1 >= 2 && data[n1 + 1] <= remaining - n1 - 2) {
+                used = n1 + 2 + data[n1 + 1];
+                timeMs += value;
+                if (sink != NULL) {
+                    sink->onEvent(boot, timeMs, data[n1], data + n1 + 2, data[n1 + 1]);
+                }
+            }
+        }
+
+        if (used == 0) {
+            _errors++;  // Malformed, truncated or before the keyframe: nothing after it can be trusted
+            break;
+        }
+        if (type != BLACKBOX_RECORD_EVENT) {
+            memcpy(_frame, _scratch, _slots);
+            if (sink != NULL) {
+                sink->onFrame(boot, timeMs, _frame, _slots);
+            }
+        }
+        offset += 1 + used;
+        records++;
+    }
+    return records;
+}
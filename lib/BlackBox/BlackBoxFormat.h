@@ -0,0 +1,149 @@
+/**
+ * BlackBoxFormat.h - Record format of the black-box recorder
+ *
+ * Shared by the recorder on the device (BlackBox.h) and the host decoder
+ * (tools/blackbox), so this file only uses the C library.
+ *
+ * Flash holds a ring of 4 KB sectors. A sector starts with an 8-byte header
+ * (magic, sequence number; little endian) followed by records. The first
+ * record of every sector is a keyframe, so each sector decodes on its own.
+ * Integers are unsigned LEB128 varints; times are milliseconds since boot,
+ * as deltas from the previous record of the sector:
+ *
+ *   0x00 flush    Padding written at the end of each flush (no payload)
+ *   0x01 keyframe uptime, boot, slots, runs against an all-zero frame
+ *   0x02 frame    dt, runs against the previous frame
+ *   0x03 event    dt, kind (1 byte), length (1 byte), data
+ *   0xFF          Erased flash: end of the sector
+ *
+ * "boot" is the sequence number of the first sector written after a reset,
+ * so records from different boots can be told apart without a counter in
+ * NVS. Runs are (gap, length, bytes) triples, where gap counts unchanged
+ * slots since the previous run; a length of 0 ends the list.
+ *
+ * Dumps (serial or uplink) carry the same bytes in fragments:
+ *   0x05, index (u16 BE), total (u16 BE), data
+ * The reassembled stream is the uptime and boot at dump time (u32 LE each),
+ * then one (length u16 LE, sector bytes) chunk per sector, oldest first.
+ */
+
+#ifndef BLACKBOX_FORMAT_H
+#define BLACKBOX_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLACKBOX_SECTOR_SIZE 4096
+#define BLACKBOX_MAGIC 0x31584242UL      // "BBX1"
+#define BLACKBOX_HEADER_SIZE 8
+#define BLACKBOX_MAX_SLOTS 512
+#define BLACKBOX_MAX_EVENT 64            // Event data is truncated to this
+#define BLACKBOX_MAX_RECORD (2 * BLACKBOX_MAX_SLOTS + 24)
+
+// Record types
+#define BLACKBOX_RECORD_FLUSH 0x00
+#define BLACKBOX_RECORD_KEYFRAME 0x01
+#define BLACKBOX_RECORD_FRAME 0x02
+#define BLACKBOX_RECORD_EVENT 0x03
+#define BLACKBOX_RECORD_END 0xFF
+
+// Event kinds
+#define BLACKBOX_EVENT_BOOT 1            // data: reset reason (esp_reset_reason_t)
+#define BLACKBOX_EVENT_DOWNLINK 2        // data: payload, truncated
+#define BLACKBOX_EVENT_SELFTEST 3        // data: self-test uplink payload
+
+// Dump fragments
+#define BLACKBOX_FRAGMENT_TYPE 0x05
+#define BLACKBOX_FRAGMENT_HEADER 5
+#define BLACKBOX_DUMP_HEADER 8
+
+/**
+ * Append an unsigned LEB128 varint
+ *
+ * @return Bytes written (1-5)
+ */
+size_t blackBoxPutVarint(uint8_t* out, uint32_t value);
+
+/**
+ * Read an unsigned LEB128 varint
+ *
+ * @return Bytes read, or 0 if the varint runs past the end or is too long
+ */
+size_t blackBoxGetVarint(const uint8_t* data, size_t length, uint32_t& value);
+
+/**
+ * Encode the slots of a frame that differ from a reference frame as runs
+ *
+ * Unchanged gaps of up to two slots are folded into the surrounding run,
+ * since a new run would cost more than the slots it skips.
+ *
+ * @param previous Reference frame, or NULL for all zeros
+ * @param frame Frame to encode
+ * @param slots Slots in both frames (max BLACKBOX_MAX_SLOTS)
+ * @param out Output buffer (at least 2 * slots + 8 bytes)
+ * @return Bytes written, including the terminating empty run
+ */
+size_t blackBoxEncodeRuns(const uint8_t* previous, const uint8_t* frame, uint16_t slots, uint8_t* out);
+
+/**
+ * Receives what a BlackBoxDecoder reads back
+ */
+class BlackBoxSink {
+public:
+    virtual ~BlackBoxSink() {}
+
+    /**
+     * A recorded frame (every keyframe and frame record)
+     *
+     * @param boot Boot the record belongs to
+     * @param timeMs Milliseconds since that boot
+     */
+    virtual void onFrame(uint32_t boot, uint32_t timeMs, const uint8_t* frame, uint16_t slots) = 0;
+
+    /**
+     * A recorded event
+     */
+    virtual void onEvent(uint32_t boot, uint32_t timeMs, uint8_t kind, const uint8_t* data, uint8_t length) = 0;
+};
+
+class BlackBoxDecoder {
+public:
+    BlackBoxDecoder();
+
+    /**
+     * Read the sequence number of a sector
+     *
+     * @return True if the sector starts with a valid header
+     */
+    static bool readHeader(const uint8_t* sector, size_t length, uint32_t& sequence);
+
+    /**
+     * Decode one sector into a sink
+     *
+     * Decoding stops at erased flash or at the first malformed or truncated
+     * record, so a sector cut short by a reset still yields everything
+     * before the cut.
+     *
+     * @param sector Sector bytes (trailing erased bytes may be left out)
+     * @param length Number of bytes
+     * @param sink Receives the frames and events
+     * @return Number of records decoded, or -1 without a valid header
+     */
+    int decodeSector(const uint8_t* sector, size_t length, BlackBoxSink* sink);
+
+    /**
+     * Records skipped as malformed since construction
+     */
+    uint32_t getErrors() const { return _errors; }
+
+private:
+    uint8_t _frame[BLACKBOX_MAX_SLOTS];
+    uint8_t _scratch[BLACKBOX_MAX_SLOTS];
+    uint16_t _slots;
+    uint32_t _errors;
+
+    // Apply runs to _scratch; returns bytes used, or 0 if malformed
+    size_t readRuns(const uint8_t* data, size_t length);
+};
+
+#endif // BLACKBOX_FORMAT_H
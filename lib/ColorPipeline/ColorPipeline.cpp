@@ -0,0 +1,173 @@
+/**
+ * ColorPipeline.cpp - Implementation of the color calibration pass
+ */
+
+#include "ColorPipeline.h"
+
+// Black-body color from 1000 K to 12000 K in 500 K steps
+#define KELVIN_MIN 1000
+#define KELVIN_MAX 12000
+#define KELVIN_STEP 500
+static const uint8_t KELVIN_TABLE[][3] = {
+    {255, 68, 0},    {255, 108, 0},   {255, 137, 14},  {255, 159, 70},
+    {255, 177, 110}, {255, 193, 141}, {255, 206, 166}, {255, 218, 187},
+    {255, 228, 206}, {255, 237, 222}, {255, 246, 237}, {255, 254, 250},
+    {243, 242, 255}, {230, 235, 255}, {221, 230, 255}, {215, 226, 255},
+    {210, 223, 255}, {205, 220, 255}, {202, 218, 255}, {199, 216, 255},
+    {196, 214, 255}, {193, 213, 255}, {191, 211, 255}
+};
+
+// Rounded v / 255 for 0 <= v <= 255 * 255
+static inline int div255(int v) {
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+// Clamp to a DMX value
+static inline uint8_t clampByte(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)v);
+}
+
+// Constructor
+ColorPipeline::ColorPipeline() {
+    clear();
+}
+
+// Fill a profile with pass-through settings
+void ColorPipeline::identityProfile(ColorProfile& profile) {
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            profile.matrix[row][col] = row == col ? COLOR_Q_ONE : 0;
+        }
+    }
+    profile.whiteGain = COLOR_Q_ONE;
+    profile.whiteExtract = 0;
+    profile.whitePoint[0] = 255;
+    profile.whitePoint[1] = 255;
+    profile.whitePoint[2] = 255;
+}
+
+// True if a profile changes nothing
+bool ColorPipeline::isIdentity(const ColorProfile& profile) {
+    if (profile.whiteExtract != 0 || profile.whiteGain != COLOR_Q_ONE) {
+        return false;
+    }
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 4; col++) {
+            if (profile.matrix[row][col] != (row == col ? COLOR_Q_ONE : 0)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Set one fixture type
+bool ColorPipeline::setProfile(uint8_t index, const ColorProfile& profile) {
+    if (index >= COLOR_MAX_PROFILES) {
+        return false;
+    }
+    _profiles[index] = profile;
+    refresh(index);
+    return true;
+}
+
+// Reset every profile to pass-through
+void ColorPipeline::clear() {
+    for (uint8_t i = 0; i < COLOR_MAX_PROFILES; i++) {
+        identityProfile(_profiles[i]);
+        refresh(i);
+    }
+}
+
+// Recompute the cached values of one profile
+void ColorPipeline::refresh(uint8_t index) {
+    ColorProfile& profile = _profiles[index];
+    _identity[index] = isIdentity(profile);
+    for (int c = 0; c < 3; c++) {
+        if (profile.whitePoint[c] == 0) {
+            profile.whitePoint[c] = 1;  // The white emitter always has some of each
+        }
+        _whiteRecip[index][c] = (uint16_t)((255 << 8) / profile.whitePoint[c]);
+    }
+}
+
+// Run the pass over a frame in place
+void ColorPipeline::process(uint8_t* frame, const ColorFixture* fixtures, int count) const {
+    for (int i = 0; i < count; i++) {
+        const ColorFixture& fixture = fixtures[i];
+        const ColorProfile& profile = _profiles[fixture.profile];
+        int r = frame[fixture.red];
+        int g = frame[fixture.green];
+        int b = frame[fixture.blue];
+        int w = fixture.white ? frame[fixture.white] : 0;
+
+        // White extraction: the most white light that fits under r, g and b
+        // given the white emitter's tint, scaled by the extraction amount
+        if (fixture.white && profile.whiteExtract) {
+            const uint16_t* recip = _whiteRecip[fixture.profile];
+            int common = (r * recip[0]) >> 8;
+            int eg = (g * recip[1]) >> 8;
+            int eb = (b * recip[2]) >> 8;
+            if (eg < common) common = eg;
+            if (eb < common) common = eb;
+            if (common > 255) common = 255;
+            int white = div255(common * profile.whiteExtract);
+
+            r -= div255(white * profile.whitePoint[0]);
+            g -= div255(white * profile.whitePoint[1]);
+            b -= div255(white * profile.whitePoint[2]);
+            if (r < 0) r = 0;
+            if (g < 0) g = 0;
+            if (b < 0) b = 0;
+            w += white;
+            if (w > 255) w = 255;
+        }
+
+        // Calibration: R/G/B emitters from (r, g, b, w)
+        const int16_t (*m)[4] = profile.matrix;
+        const int half = COLOR_Q_ONE / 2;
+        frame[fixture.red] = clampByte((m[0][0] * r + m[0][1] * g + m[0][2] * b + m[0][3] * w + half) >> COLOR_Q_BITS);
+        frame[fixture.green] = clampByte((m[1][0] * r + m[1][1] * g + m[1][2] * b + m[1][3] * w + half) >> COLOR_Q_BITS);
+        frame[fixture.blue] = clampByte((m[2][0] * r + m[2][1] * g + m[2][2] * b + m[2][3] * w + half) >> COLOR_Q_BITS);
+        if (fixture.white) {
+            frame[fixture.white] = clampByte((w * profile.whiteGain + half) >> COLOR_Q_BITS);
+        }
+    }
+}
+
+// Color temperature to RGB
+void ColorPipeline::kelvinToRgb(uint16_t kelvin, uint8_t level, uint8_t& r, uint8_t& g, uint8_t& b) {
+    if (kelvin < KELVIN_MIN) kelvin = KELVIN_MIN;
+    if (kelvin > KELVIN_MAX) kelvin = KELVIN_MAX;
+
+    int index = (kelvin - KELVIN_MIN) / KELVIN_STEP;
+    int frac = ((kelvin - KELVIN_MIN) % KELVIN_STEP) * 256 / KELVIN_STEP;
+    int next = kelvin == KELVIN_MAX ? index : index + 1;
+
+    uint8_t out[3];
+    for (int c = 0; c < 3; c++) {
+        int a = KELVIN_TABLE[index][c];
+        int v = a + (((KELVIN_TABLE[next][c] - a) * frac) >> 8);
+        out[c] = (uint8_t)div255(v * level);
+    }
+    r = out[0];
+    g = out[1];
+    b = out[2];
+}
+
+// Time the pass
+uint32_t ColorPipeline::benchmark(unsigned long (*clockUs)(), int iterations, uint8_t* frame,
+                                  const ColorFixture* fixtures, int count) const {
+    unsigned long start = clockUs();
+    for (int n = 0; n < iterations; n++) {
+        // Fresh pastel input each pass so extraction has work to do
+        for (int i = 0; i < count; i++) {
+            frame[fixtures[i].red] = (uint8_t)(200 + (n & 31));
+            frame[fixtures[i].green] = 180;
+            frame[fixtures[i].blue] = (uint8_t)(160 + (i & 63));
+        }
+        process(frame, fixtures, count);
+    }
+    return (uint32_t)(clockUs() - start);
+}
@@ -0,0 +1,124 @@
+/**
+ * ColorPipeline.h - Per-fixture-type color calibration and RGBW extraction
+ *
+ * Effects render plain RGB (white = 0). Just before a frame is published,
+ * one batched pass walks every color fixture and, per fixture type
+ * (profile):
+ *
+ *   1. White extraction: the part of the color the white emitter can
+ *      produce (given its own tint, the profile's white point) moves from
+ *      R/G/B to W, so pastels and whites use the white LED.
+ *   2. Calibration: a 3x4 matrix maps (r, g, b, w) to the R/G/B emitters,
+ *      matching fixtures from different batches or makers; W gets its own
+ *      gain.
+ *
+ * Everything is integer fixed point (Q12 matrix, Q8 reciprocals). The
+ * caller passes only fixtures on non-identity profiles, and with none the
+ * pass is not run at all. kelvinToRgb() turns a color temperature into
+ * the RGB input for the same pipeline.
+ *
+ * No Arduino dependencies.
+ */
+
+#ifndef COLOR_PIPELINE_H
+#define COLOR_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define COLOR_MAX_PROFILES 4        // Fixture types
+#define COLOR_Q_BITS 12
+#define COLOR_Q_ONE (1 << COLOR_Q_BITS)
+
+// One fixture type
+struct ColorProfile {
+    int16_t matrix[3][4];     // Q12: rows = R, G, B emitters; columns = r, g, b, w in
+    uint16_t whiteGain;       // Q12 gain of the W emitter
+    uint8_t whiteExtract;     // 0-255: share of the common color moved to W
+    uint8_t whitePoint[3];    // The white emitter's color as RGB (255,255,255 = neutral)
+};
+
+// Channels of one color fixture (DMX channel numbers, 0 = not present)
+struct ColorFixture {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t white;
+    uint8_t profile;
+};
+
+class ColorPipeline {
+public:
+    ColorPipeline();
+
+    /**
+     * Fill a profile with pass-through settings
+     */
+    static void identityProfile(ColorProfile& profile);
+
+    /**
+     * True if a profile changes nothing
+     */
+    static bool isIdentity(const ColorProfile& profile);
+
+    /**
+     * Set one fixture type
+     *
+     * @param index Profile (0 to COLOR_MAX_PROFILES - 1)
+     * @param profile Settings
+     * @return False if the index is out of range
+     */
+    bool setProfile(uint8_t index, const ColorProfile& profile);
+
+    const ColorProfile* getProfile(uint8_t index) const { return index < COLOR_MAX_PROFILES ? &_profiles[index] : NULL; }
+
+    /**
+     * Reset every profile to pass-through
+     */
+    void clear();
+
+    /**
+     * True if a profile is pass-through (fixtures using it can be left out)
+     */
+    bool isPassThrough(uint8_t index) const { return index >= COLOR_MAX_PROFILES || _identity[index]; }
+
+    /**
+     * Run the pass over a frame in place
+     *
+     * @param frame DMX frame (index 0 = start code)
+     * @param fixtures Color fixtures; every channel must lie inside the frame
+     * @param count Number of fixtures
+     */
+    void process(uint8_t* frame, const ColorFixture* fixtures, int count) const;
+
+    /**
+     * Color temperature to RGB (1000-12000 K)
+     *
+     * @param kelvin Color temperature
+     * @param level Brightness (0-255)
+     */
+    static void kelvinToRgb(uint16_t kelvin, uint8_t level, uint8_t& r, uint8_t& g, uint8_t& b);
+
+    /**
+     * Time the pass
+     *
+     * @param clockUs Microsecond clock (micros on the device)
+     * @param iterations Passes to run
+     * @param frame Scratch frame (overwritten)
+     * @param fixtures Color fixtures
+     * @param count Number of fixtures
+     * @return Total microseconds for all iterations
+     */
+    uint32_t benchmark(unsigned long (*clockUs)(), int iterations, uint8_t* frame,
+                       const ColorFixture* fixtures, int count) const;
+
+private:
+    ColorProfile _profiles[COLOR_MAX_PROFILES];
+    bool _identity[COLOR_MAX_PROFILES];
+    uint16_t _whiteRecip[COLOR_MAX_PROFILES][3];  // Q8 of 255 / white point
+
+    // Recompute the cached values of one profile
+    void refresh(uint8_t index);
+};
+
+#endif // COLOR_PIPELINE_H
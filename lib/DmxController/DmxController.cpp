@@ -6,27 +6,100 @@
  */
 
 #include "DmxController.h"
+#include "FrameKernels.h"
 
 // Define the static member
-const char* DmxController::CUSTOM_PREFS_NAMESPACE = "dmx_custom";
+template <int MaxChannels, int MaxFixtures>
+const char* DmxControllerT<MaxChannels, MaxFixtures>::CUSTOM_PREFS_NAMESPACE = "dmx_custom";
 
 // Constructor
-DmxController::DmxController(uint8_t dmxPort, uint8_t txPin, uint8_t rxPin, uint8_t dirPin) {
+template <int MaxChannels, int MaxFixtures>
+DmxControllerT<MaxChannels, MaxFixtures>::DmxControllerT(uint8_t dmxPort, uint8_t txPin, uint8_t rxPin, uint8_t dirPin) {
     _dmxPort = dmxPort;
     _txPin = txPin;
     _rxPin = rxPin;
     _dirPin = dirPin;
     
     // Initialize the DMX data buffer with all zeros
-    memset(_dmxData, 0, DMX_PACKET_SIZE);
+    memset(_dmxData, 0, FRAME_SIZE);
     
     // DMX start code must be 0
     _dmxData[0] = 0;
     
+    // Output frames: one pending (last published), one on the wire
+    memset(_frameBuffers, 0, sizeof(_frameBuffers));
+    _pendingFrame = _frameBuffers[0];
+    _frontFrame = _frameBuffers[1];
+    _frameReady = false;
+    _frameSlots = MaxChannels;
+    _urgentSlots = 0;
+    _outputTask = NULL;
+    _framesSent = 0;
+    _framesLate = 0;
+    _frameLock = portMUX_INITIALIZER_UNLOCKED;
+    
+    // Idle-frame tracking
+    memset(_publishedData, 0, FRAME_SIZE);
+    memset(_publishedFraction, 0, FRAME_SIZE);
+    memset(_dmxFraction, 0, FRAME_SIZE);
+    _fractionUsed = false;
+    _publishedValid = false;
+    _outputIdle = false;
+    _keepaliveMs = DMX_KEEPALIVE_DEFAULT_MS;
+    _framesSkipped = 0;
+    _publishesSkipped = 0;
+    _frameCostUs = 0;
+    _publishCostUs = 0;
+    _cpuSavedUs = 0;
+    _master = 255;
+    
+    // No self-test queued
+    _selfTestState = SELF_TEST_IDLE;
+    _selfTestMode = LOOPBACK_INTERNAL;
+    _selfTestFrames = 0;
+    _selfTestPattern = false;
+    
+    // Slew limiting starts disabled
+    memset(_outData, 0, FRAME_SIZE);
+    _slewSettling = false;
+    _slewOutput = false;
+    memset(_slewRates, 0, sizeof(_slewRates));
+    _slewRatesPending = false;
+    _lastSendMs = 0;
+    
+    // Dithering starts disabled; an error of half a step rounds to nearest
+    memset(_fractionBuffers, 0, sizeof(_fractionBuffers));
+    _pendingFraction = _fractionBuffers[0];
+    _frontFraction = _fractionBuffers[1];
+    memset(_outFraction, 0, FRAME_SIZE);
+    memset(_ditherError, 0x80, FRAME_SIZE);
+    _ditherVersion = 0;
+    memset(_maskBuffers, 0, sizeof(_maskBuffers));
+    _pendingMask = _maskBuffers[0];
+    _frontMask = _maskBuffers[1];
+    _pendingMaskVersion = 0;
+    _frontMaskVersion = 0;
+    _maskChanged = false;
+    _pendingDither = false;
+    _frontDither = false;
+    _ditherRoles = 0;
+    _ditherActive = false;
+    _ditherOutput = false;
+    _ditherSuspended = false;
+    
     // Initialize member variables
-    _fixtures = NULL;
-    _numFixtures = 0;
-    _channelsPerFixture = 0;
+    memset(_loggedData, 0, FRAME_SIZE);
+    _loggedValid = false;
+    memset(_fixtureProfiles, 0, sizeof(_fixtureProfiles));
+    
+    // Start with an empty live patch and no patch being built
+    memset(_patches, 0, sizeof(_patches));
+    memset(_patchRetired, 0, sizeof(_patchRetired));
+    memset(_retiredPublish, 0, sizeof(_retiredPublish));
+    memset(_retiredMs, 0, sizeof(_retiredMs));
+    _livePatch = &_patches[0];
+    _draftPatch = NULL;
+    _publishCount = 0;
     
     // Initialize scanner variables
     _scanCurrentAddr = 1;
@@ -34,7 +107,8 @@ DmxController::DmxController(uint8_t dmxPort, uint8_t txPin, uint8_t rxPin, uint
 }
 
 // Initialize the DMX controller
-void DmxController::begin() {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::begin() {
     // Configure DMX with default config
     dmx_config_t config = DMX_CONFIG_DEFAULT;
     
@@ -44,7 +118,7 @@ void DmxController::begin() {
     strcpy(personality.description, "RGBW");
     
     // Clear the DMX data buffer first
-    memset(_dmxData, 0, DMX_PACKET_SIZE);
+    memset(_dmxData, 0, FRAME_SIZE);
     _dmxData[0] = 0; // Start code must be 0
     
     // Always properly delete any previous driver to avoid "already installed" error
@@ -58,9 +132,12 @@ void DmxController::begin() {
     pinMode(_dirPin, OUTPUT);
     digitalWrite(_dirPin, HIGH);  // HIGH = transmit mode
     
-    // Configure hardware UART directly instead of relying on the driver
+    // Configure hardware UART directly instead of relying on the driver;
+    // the receive buffer holds a whole frame for the loopback self-test
+    Serial1.setRxBufferSize(FRAME_SIZE + LOOPBACK_RX_SLACK);
     Serial1.begin(250000, SERIAL_8N2, _rxPin, _txPin);
     delay(100); // Allow UART to stabilize
+    _loopback.begin(&Serial1, 1, _txPin, _rxPin);  // Serial1 is UART1
     
     Serial.println("DMX controller initialized successfully!");
     Serial.print("DMX using pins - TX: ");
@@ -75,18 +152,24 @@ void DmxController::begin() {
 }
 
 // Initialize fixtures array with the given configuration
-void DmxController::initializeFixtures(int numFixtures, int channelsPerFixture) {
-    // Free previous array if it exists
-    if (_fixtures != NULL) {
-        delete[] _fixtures;
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::initializeFixtures(int numFixtures, int channelsPerFixture) {
+    // The fixture table is sized at compile time
+    if (numFixtures > MaxFixtures) {
+        Serial.print("Fixture count limited to ");
+        Serial.println(MaxFixtures);
+        numFixtures = MaxFixtures;
+    }
+    if (numFixtures < 0) {
+        numFixtures = 0;
     }
     
-    // Store configuration
-    _numFixtures = numFixtures;
-    _channelsPerFixture = channelsPerFixture;
-    
-    // Allocate new array
-    _fixtures = new FixtureConfig[numFixtures];
+    // Build the new patch in a spare slot; the live one is left alone
+    FixturePatch* patch = openPatch(false);
+    patch->numFixtures = numFixtures;
+    patch->channelsPerFixture = channelsPerFixture;
+    buildColorFixtures(*patch);
+    buildDitherMask(*patch);
     
     Serial.print("Initialized for ");
     Serial.print(numFixtures);
@@ -95,16 +178,45 @@ void DmxController::initializeFixtures(int numFixtures, int channelsPerFixture)
     Serial.println(" channels per fixture");
 }
 
+// Start a new fixture patch from a copy of the live one
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::editFixtures(int numFixtures) {
+    numFixtures = max(0, min(numFixtures, MaxFixtures));
+    FixturePatch* patch = openPatch(true);
+    for (int i = patch->numFixtures; i < numFixtures; i++) {
+        memset(&patch->fixtures[i], 0, sizeof(FixtureConfig));
+    }
+    patch->numFixtures = numFixtures;
+    buildColorFixtures(*patch);
+    buildDitherMask(*patch);
+}
+
 // Set fixture configuration
-void DmxController::setFixtureConfig(int index, const char* name, int startAddr, 
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::setFixtureConfig(int index, const char* name, int startAddr, 
                                     int rChan, int gChan, int bChan, int wChan) {
-    if (index >= 0 && index < _numFixtures && _fixtures != NULL) {
-        _fixtures[index].name = name;
-        _fixtures[index].startAddr = startAddr;
-        _fixtures[index].redChannel = rChan;
-        _fixtures[index].greenChannel = gChan;
-        _fixtures[index].blueChannel = bChan;
-        _fixtures[index].whiteChannel = wChan;
+    bool building = _draftPatch != NULL;
+    // Every channel must be inside this instance's frame; white 0 means none
+    if (!isChannel(startAddr) || !isChannel(rChan) || !isChannel(gChan) || !isChannel(bChan) ||
+        (wChan != 0 && !isChannel(wChan))) {
+        Serial.printf("Fixture %d rejected: channels must be 1-%d\n", index + 1, MaxChannels);
+        return false;
+    }
+    if (index >= 0 && index < (building ? _draftPatch : livePatch())->numFixtures) {
+        // A single change to the live patch goes out as a new version
+        FixturePatch* patch = building ? _draftPatch : openPatch(true);
+        FixtureConfig& fixture = patch->fixtures[index];
+        fixture.name = name;
+        fixture.startAddr = startAddr;
+        fixture.redChannel = rChan;
+        fixture.greenChannel = gChan;
+        fixture.blueChannel = bChan;
+        fixture.whiteChannel = wChan;
+        buildColorFixtures(*patch);
+        buildDitherMask(*patch);
+        if (!building) {
+            publishFixtures();
+        }
         
         Serial.print("Configured fixture ");
         Serial.print(index + 1);
@@ -120,31 +232,108 @@ void DmxController::setFixtureConfig(int index, const char* name, int startAddr,
         Serial.print(bChan);
         Serial.print(", W=Ch");
         Serial.println(wChan);
+        return true;
     }
+    return false;
+}
+
+// Open the patch being built in a slot nobody reads any more
+template <int MaxChannels, int MaxFixtures>
+typename DmxControllerT<MaxChannels, MaxFixtures>::FixturePatch* DmxControllerT<MaxChannels, MaxFixtures>::openPatch(bool copyLive) {
+    const FixturePatch* live = livePatch();
+    if (_draftPatch == NULL) {
+        // A retired slot is free once a frame boundary has passed since it
+        // was replaced (every render step ends with a publish), or after
+        // the grace period when nothing is publishing
+        while (_draftPatch == NULL) {
+            for (int i = 0; i < DMX_PATCH_SLOTS && _draftPatch == NULL; i++) {
+                if (&_patches[i] != live &&
+                    (!_patchRetired[i] || _publishCount != _retiredPublish[i] ||
+                     millis() - _retiredMs[i] >= DMX_PATCH_GRACE_MS)) {
+                    _draftPatch = &_patches[i];
+                }
+            }
+            if (_draftPatch == NULL) {
+                delay(1);  // Two reconfigurations within one frame; only the writer waits
+            }
+        }
+        _patchRetired[_draftPatch - _patches] = false;
+    }
+    if (copyLive) {
+        memcpy(_draftPatch, live, sizeof(FixturePatch));
+    } else {
+        memset(_draftPatch, 0, sizeof(FixturePatch));
+    }
+    return _draftPatch;
+}
+
+// Make the patch being built live
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::publishFixtures() {
+    if (_draftPatch == NULL) {
+        return;
+    }
+    FixturePatch* old = _livePatch;
+    _draftPatch->version = old->version + 1;
+    __atomic_store_n(&_livePatch, _draftPatch, __ATOMIC_RELEASE);
+    _draftPatch = NULL;
+    
+    // Readers that loaded the old pointer may still be using it
+    int slot = old - _patches;
+    _patchRetired[slot] = true;
+    _retiredPublish[slot] = _publishCount;
+    _retiredMs[slot] = millis();
+    
+    // The published frame must be re-processed even if the render did not change
+    _publishedValid = false;
 }
 
 // Get a fixture's configuration
-FixtureConfig* DmxController::getFixture(int index) {
-    if (index >= 0 && index < _numFixtures && _fixtures != NULL) {
-        return &_fixtures[index];
+template <int MaxChannels, int MaxFixtures>
+const FixtureConfig* DmxControllerT<MaxChannels, MaxFixtures>::getFixture(int index) {
+    const FixturePatch* patch = livePatch();
+    if (index >= 0 && index < patch->numFixtures) {
+        return &patch->fixtures[index];
     }
     return NULL;
 }
 
 // Helper function to set a fixture's color with direct RGBW handling
-void DmxController::setFixtureColor(int fixtureIndex, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setFixtureColor(int fixtureIndex, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+    const FixturePatch* patch = livePatch();
     // Check if the fixture index is valid
-    if (fixtureIndex >= 0 && fixtureIndex < _numFixtures && _fixtures != NULL) {
+    if (fixtureIndex >= 0 && fixtureIndex < patch->numFixtures) {
         // Set RGBW values directly to their respective channels
-        _dmxData[_fixtures[fixtureIndex].redChannel] = r;
-        _dmxData[_fixtures[fixtureIndex].greenChannel] = g;
-        _dmxData[_fixtures[fixtureIndex].blueChannel] = b;
-        _dmxData[_fixtures[fixtureIndex].whiteChannel] = w;
+        const FixtureConfig& fixture = patch->fixtures[fixtureIndex];
+        setChannel(fixture.redChannel, r);
+        setChannel(fixture.greenChannel, g);
+        setChannel(fixture.blueChannel, b);
+        setChannel(fixture.whiteChannel, w);
+    }
+}
+
+// Set a fixture's color in 8.8 fixed point: whole steps and the fraction plane
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setFixtureColorFine(int fixtureIndex, uint16_t r, uint16_t g, uint16_t b, uint16_t w) {
+    const FixturePatch* patch = livePatch();
+    if (fixtureIndex >= 0 && fixtureIndex < patch->numFixtures) {
+        const FixtureConfig& fixture = patch->fixtures[fixtureIndex];
+        uint8_t* fraction = getDmxFraction();
+        setChannelFine(fraction, fixture.redChannel, r);
+        setChannelFine(fraction, fixture.greenChannel, g);
+        setChannelFine(fraction, fixture.blueChannel, b);
+        setChannelFine(fraction, fixture.whiteChannel, w);
     }
 }
 
 // Helper function to set a fixture's color with direct RGBW handling at any address
-void DmxController::setManualFixtureColor(int startAddr, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setManualFixtureColor(int startAddr, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+    // All four channels must fit in the frame
+    if (!isChannel(startAddr) || !isChannel(startAddr + 3)) {
+        return;
+    }
     // Set RGBW values directly to channels starting at startAddr
     _dmxData[startAddr] = r;     // Red channel
     _dmxData[startAddr + 1] = g; // Green channel
@@ -152,56 +341,40 @@ void DmxController::setManualFixtureColor(int startAddr, uint8_t r, uint8_t g, u
     _dmxData[startAddr + 3] = w; // White channel
 }
 
-// Send the current DMX data to the fixtures
-void DmxController::sendData() {
+// Publish the current DMX data for the output task to send
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::sendData() {
+    const FixturePatch* patch = livePatch();
     // Ensure DMX start code is 0
     _dmxData[0] = 0;
     
-    // If the driver failed, use direct UART implementation
     if (_isInitialized) {
-        // Store current values for debug comparison
-        static bool first_send = true;
-        static uint8_t last_values[DMX_PACKET_SIZE];
+        publishFrame();
         
-        bool values_changed = first_send;
-        if (!first_send) {
+
+        // Compare with the last logged frame
+        bool values_changed = !_loggedValid;
+        if (_loggedValid) {
             // Check if any values changed by more than 5 (to avoid minor fluctuations)
-            for (int i = 1; i < DMX_PACKET_SIZE; i++) {
-                if (abs(_dmxData[i] - last_values[i]) > 5) {
+            for (int i = 1; i < FRAME_SIZE; i++) {
+                if (abs(_dmxData[i] - _loggedData[i]) > 5) {
                     values_changed = true;
                     break;
                 }
             }
         }
         
-        // IMPROVED DMX OUTPUT PROTOCOL - More reliable timing
-        digitalWrite(_dirPin, HIGH);    // Ensure in transmit mode (DE=HIGH, RE=HIGH)
-        
-        // Generate DMX break without closing UART - more stable method
-        Serial1.flush();                // Wait for all data to be sent
-        Serial1.updateBaudRate(90000);  // Temporary baud rate change to create break
-        Serial1.write(0);               // Send a zero byte at lower baud rate
-        Serial1.flush();                // Wait for completion
-        Serial1.updateBaudRate(250000); // Restore DMX baud rate (standard)
-        
-        // Send DMX data - all 513 bytes (start code + 512 channels)
-        Serial1.write(_dmxData, DMX_PACKET_SIZE);
-        Serial1.flush();                // Ensure all data is completely sent
-        
-        // Wait longer to ensure data is fully transmitted (helps with stability)
-        delay(3); // Increased from 1ms to 3ms
-        
         // Save current values for next comparison
-        if (first_send || values_changed) {
-            memcpy(last_values, _dmxData, DMX_PACKET_SIZE);
-            first_send = false;
+        if (values_changed) {
+            memcpy(_loggedData, _dmxData, FRAME_SIZE);
+            _loggedValid = true;
             
             // Print DMX data values for debugging, but only when they change
             Serial.println("DMX Output Data Updated:");
             
             // Print active channel values (non-zero channels only)
             bool hasActiveChannels = false;
-            for (int i = 1; i < DMX_PACKET_SIZE; i++) {
+            for (int i = 1; i < FRAME_SIZE; i++) {
                 if (_dmxData[i] > 0) {
                     if (!hasActiveChannels) {
                         Serial.println("Active channels:");
@@ -219,25 +392,25 @@ void DmxController::sendData() {
             }
             
             // Print fixture information if available
-            if (_fixtures != NULL && _numFixtures > 0) {
+            if (patch->numFixtures > 0) {
                 Serial.println("Fixture Colors:");
-                for (int i = 0; i < _numFixtures; i++) {
+                for (int i = 0; i < patch->numFixtures; i++) {
                     Serial.print("  ");
-                    Serial.print(_fixtures[i].name);
+                    Serial.print(patch->fixtures[i].name);
                     Serial.print(": R=");
-                    Serial.print(_dmxData[_fixtures[i].redChannel]);
+                    Serial.print(_dmxData[patch->fixtures[i].redChannel]);
                     Serial.print(", G=");
-                    Serial.print(_dmxData[_fixtures[i].greenChannel]);
+                    Serial.print(_dmxData[patch->fixtures[i].greenChannel]);
                     Serial.print(", B=");
-                    Serial.print(_dmxData[_fixtures[i].blueChannel]);
+                    Serial.print(_dmxData[patch->fixtures[i].blueChannel]);
                     Serial.print(", W=");
-                    Serial.println(_dmxData[_fixtures[i].whiteChannel]);
+                    Serial.println(_dmxData[patch->fixtures[i].whiteChannel]);
                 }
             }
             
             // Log success
-            Serial.print("DMX data sent (");
-            Serial.print(DMX_PACKET_SIZE);
+            Serial.print("DMX frame published (");
+            Serial.print(FRAME_SIZE);
             Serial.println(" bytes)");
         }
     } else {
@@ -245,10 +418,388 @@ void DmxController::sendData() {
     }
 }
 
+// Copy the back buffer into the pending frame (taken at the next frame boundary)
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::publishFrame(bool force) {
+    // Unchanged frames are dropped here, so the output task stays idle
+    if (!force && _publishedValid && memcmp(_dmxData, _publishedData, FRAME_SIZE) == 0 &&
+        memcmp(_dmxFraction, _publishedFraction, FRAME_SIZE) == 0) {
+        portENTER_CRITICAL(&_frameLock);
+        _publishesSkipped++;
+        _cpuSavedUs += _publishCostUs;
+        portEXIT_CRITICAL(&_frameLock);
+        if (_fractionUsed) {
+            memset(_dmxFraction, 0, FRAME_SIZE);
+            _fractionUsed = false;
+        }
+        _publishCount++;  // Still the end of a render step
+        return;
+    }
+    memcpy(_publishedData, _dmxData, FRAME_SIZE);
+    memcpy(_publishedFraction, _dmxFraction, FRAME_SIZE);
+    _publishedValid = true;
+    
+    int64_t start = esp_timer_get_time();
+    
+    // Keep the output task off the pending buffers while they are written;
+    // only publishers (serialized by the DMX mutex) touch them otherwise
+    portENTER_CRITICAL(&_frameLock);
+    _frameReady = false;
+    portEXIT_CRITICAL(&_frameLock);
+    
+    memcpy(_pendingFrame, _dmxData, FRAME_SIZE);
+    const FixturePatch* patch = livePatch();
+    bool dither = patch->numDitherChannels > 0 && !_ditherSuspended;
+    if (dither && patch->version != _pendingMaskVersion) {
+        memcpy(_pendingMask, patch->ditherMask, FRAME_SIZE);
+        _pendingMaskVersion = patch->version;
+        _maskChanged = true;
+    }
+    _pendingDither = dither;
+    if (_fractionUsed) {
+        takeFractions(patch, dither);
+    } else if (dither) {
+        memset(_pendingFraction, 0, FRAME_SIZE);
+    }
+    if (patch->numColorFixtures > 0) {
+        _color.process(_pendingFrame, patch->colorFixtures, patch->numColorFixtures);
+    }
+    if (_master < 255) {
+        if (dither) {
+            memcpy(_unscaledFrame, _pendingFrame, FRAME_SIZE);
+        }
+        frameScale(_pendingFrame + 1, _pendingFrame + 1, _master, FRAME_SIZE - 1);
+        if (dither) {
+            // Dithered channels keep the scaled value to 1/256 of a step
+            for (int i = 1; i < FRAME_SIZE; i++) {
+                if (patch->ditherMask[i]) {
+                    uint32_t value = ((uint32_t)_unscaledFrame[i] << 8) | _pendingFraction[i];
+                    uint32_t scaled = (value * _master * 2 + 255) / 510;
+                    _pendingFrame[i] = (uint8_t)(scaled >> 8);
+                    _pendingFraction[i] = (uint8_t)scaled;
+                }
+            }
+        }
+    }
+    
+    portENTER_CRITICAL(&_frameLock);
+    _frameReady = true;
+    portEXIT_CRITICAL(&_frameLock);
+    uint32_t cost = (uint32_t)(esp_timer_get_time() - start);
+    _publishCostUs = _publishCostUs == 0 ? cost : (_publishCostUs * 7 + cost) / 8;
+    
+    // Frame boundary: patches replaced before this publish are no longer read
+    _publishCount++;
+    
+    // An idle output task sleeps until the keepalive; wake it for the change
+    if (_outputIdle && _outputTask != NULL) {
+        xTaskNotifyGive(_outputTask);
+    }
+}
+
+// Move the renderers' fractions under the pending frame: dithered
+// channels keep them, the others round to the nearest step
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::takeFractions(const FixturePatch* patch, bool dither) {
+    // The color pass rewrites its fixtures' channels from whole steps
+    if (dither) {
+        for (int f = 0; f < patch->numColorFixtures; f++) {
+            const ColorFixture& fixture = patch->colorFixtures[f];
+            const uint16_t channels[4] = { fixture.red, fixture.green, fixture.blue, fixture.white };
+            for (int c = 0; c < 4; c++) {
+                if (channels[c] != 0 && _dmxFraction[channels[c]] >= 0x80 && _pendingFrame[channels[c]] < 255) {
+                    _pendingFrame[channels[c]]++;
+                }
+                _dmxFraction[channels[c]] = 0;
+            }
+        }
+    }
+    for (int i = 1; i < FRAME_SIZE; i++) {
+        uint8_t fraction = _dmxFraction[i];
+        if (dither && patch->ditherMask[i]) {
+            _pendingFraction[i] = fraction;
+            continue;
+        }
+        if (dither) {
+            _pendingFraction[i] = 0;
+        }
+        if (fraction >= 0x80 && _pendingFrame[i] < 255) {
+            _pendingFrame[i]++;
+        }
+    }
+    _pendingFraction[0] = 0;
+    memset(_dmxFraction, 0, FRAME_SIZE);
+    _fractionUsed = false;
+}
+
+// Publish the frame and have the output task send it straight away
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::sendFrameNow(int numSlots) {
+    if (!_isInitialized) {
+        return;
+    }
+    if (numSlots < 1 || numSlots > MaxChannels) {
+        numSlots = MaxChannels;
+    }
+    _dmxData[0] = 0;
+    
+    publishFrame(true);
+    portENTER_CRITICAL(&_frameLock);
+    _urgentSlots = numSlots;
+    portEXIT_CRITICAL(&_frameLock);
+    
+    if (_outputTask != NULL) {
+        xTaskNotifyGive(_outputTask);
+    }
+}
+
+// Transmit one frame (called from the output task only)
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::transmitFrame(uint32_t frameMs) {
+    if (!_isInitialized) {
+        return false;
+    }
+    
+    // A queued self-test takes this frame slot
+    if (_selfTestState == SELF_TEST_QUEUED) {
+        runSelfTest(frameMs);
+        return true;
+    }
+    
+    unsigned long now = millis();
+    uint32_t keepalive = max(_keepaliveMs, frameMs);
+    
+    // New slew limits ramp from the frame on the wire, so take them before
+    // the buffers swap
+    bool newRates = __atomic_load_n(&_slewRatesPending, __ATOMIC_ACQUIRE);
+    if (newRates) {
+        takeSlewRates();
+    }
+    
+    // Frame boundary: take the newest published frame, if any
+    portENTER_CRITICAL(&_frameLock);
+    bool changed = _frameReady;
+    bool urgent = _urgentSlots > 0;
+    
+    // Nothing new, nothing ramping or dithering and the fixtures are still
+    // holding the last frame: skip slew and the UART write until the keepalive is due
+    if (!changed && !urgent && !newRates && !_slewSettling && !_ditherActive && now - _lastSendMs < keepalive) {
+        _framesSkipped++;
+        _cpuSavedUs += _frameCostUs;
+        _outputIdle = true;
+        portEXIT_CRITICAL(&_frameLock);
+        return false;
+    }
+    
+    if (changed) {
+        uint8_t* previous = _frontFrame;
+        _frontFrame = _pendingFrame;
+        _pendingFrame = previous;
+        previous = _frontFraction;
+        _frontFraction = _pendingFraction;
+        _pendingFraction = previous;
+        if (_maskChanged) {
+            previous = _frontMask;
+            _frontMask = _pendingMask;
+            _pendingMask = previous;
+            _frontMaskVersion = _pendingMaskVersion;
+            _maskChanged = false;
+        }
+        _frontDither = _pendingDither;
+        _frameReady = false;
+    }
+    int slots = urgent ? _urgentSlots : _frameSlots;
+    _urgentSlots = 0;
+    
+    // Frames follow each other at the frame period unless the task was held up
+    if (!_outputIdle && _lastSendMs != 0 && now - _lastSendMs > frameMs + frameMs / 2) {
+        _framesLate++;
+    }
+    _outputIdle = false;
+    portEXIT_CRITICAL(&_frameLock);
+    
+    // Apply slew limits and dithering if set; urgent (strobe) frames go out
+    // as is and become the point the limiter ramps on from. The front
+    // buffers and the limiter belong to this task until the next swap.
+    const uint8_t* frame = _frontFrame;
+    int64_t start = esp_timer_get_time();
+    if (!urgent) {
+        bool dither = _frontDither;
+        const uint8_t* fraction = _frontFraction;
+        if (_slew.isEnabled()) {
+            _slewSettling = _slew.process(_frontFrame, _outData, now - _lastSendMs,
+                                          dither ? _frontFraction : NULL, dither ? _outFraction : NULL);
+            frame = _outData;
+            fraction = _outFraction;
+        }
+        
+        if (dither) {
+            // A new dither layout starts from rounding again
+            if (_frontMaskVersion != _ditherVersion) {
+                memset(_ditherError, 0x80, FRAME_SIZE);
+                _ditherVersion = _frontMaskVersion;
+            }
+            if (frame != _outData) {
+                memcpy(_outData, _frontFrame, FRAME_SIZE);
+                frame = _outData;
+            }
+            _ditherActive = frameDither(_outData, fraction, _frontMask, _ditherError, FRAME_SIZE);
+        } else {
+            _ditherActive = false;
+        }
+        _ditherOutput = dither;
+    } else if (_slew.isEnabled() || _ditherOutput) {
+        // The strobe frame is what the fixtures show now: later frames ramp
+        // from it, and the output buffer must report it
+        memcpy(_outData, _frontFrame, FRAME_SIZE);
+        _slew.reset(_outData);
+        frame = _outData;
+    }
+    uint32_t cost = (uint32_t)(esp_timer_get_time() - start);
+    _lastSendMs = now;
+    
+    start = esp_timer_get_time();
+    writeFrame(frame, slots);
+    _framesSent++;
+    
+    // Cost excludes the flushes: waiting on the UART is not CPU time
+    cost += (uint32_t)(esp_timer_get_time() - start);
+    _frameCostUs = _frameCostUs == 0 ? cost : (_frameCostUs * 7 + cost) / 8;
+    return true;
+}
+
+// Break, MAB, start code and slots on the UART
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::writeFrame(const uint8_t* frame, int slots) {
+    // IMPROVED DMX OUTPUT PROTOCOL - More reliable timing
+    digitalWrite(_dirPin, HIGH);    // Ensure in transmit mode (DE=HIGH, RE=HIGH)
+    
+    // Generate DMX break without closing UART - more stable method
+    Serial1.flush();                // Wait for all data to be sent
+    Serial1.updateBaudRate(90000);  // Temporary baud rate change to create break
+    Serial1.write(0);               // Send a zero byte at lower baud rate
+    Serial1.flush();                // Wait for completion
+    Serial1.updateBaudRate(250000); // Restore DMX baud rate (standard)
+    
+    // Start code + slots; the UART drains while the next frame is rendered
+    Serial1.write(frame, slots + 1);
+}
+
+// Queue a loopback self-test for the output task
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::requestSelfTest(uint8_t mode, uint8_t frames, bool pattern) {
+    if (!_isInitialized) {
+        return false;
+    }
+    
+    portENTER_CRITICAL(&_frameLock);
+    bool queued = _selfTestState != SELF_TEST_QUEUED;
+    if (queued) {
+        _selfTestMode = mode == LOOPBACK_LINE ? LOOPBACK_LINE : LOOPBACK_INTERNAL;
+        _selfTestFrames = frames < 1 ? 1 : (frames > LOOPBACK_MAX_FRAMES ? LOOPBACK_MAX_FRAMES : frames);
+        _selfTestPattern = pattern;
+        _selfTestState = SELF_TEST_QUEUED;
+    }
+    portEXIT_CRITICAL(&_frameLock);
+    
+    // An idle output task sleeps until the keepalive; start the test now
+    if (queued && _outputTask != NULL) {
+        xTaskNotifyGive(_outputTask);
+    }
+    return queued;
+}
+
+// Fetch the result of a finished self-test
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::getSelfTestResult(DmxLoopbackResult& result) {
+    portENTER_CRITICAL(&_frameLock);
+    bool done = _selfTestState == SELF_TEST_DONE;
+    if (done) {
+        result = _loopback.getResult();
+        _selfTestState = SELF_TEST_IDLE;
+    }
+    portEXIT_CRITICAL(&_frameLock);
+    return done;
+}
+
+// Run a queued self-test
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::runSelfTest(uint32_t frameMs) {
+    portENTER_CRITICAL(&_frameLock);
+    uint8_t mode = _selfTestMode;
+    uint8_t frames = _selfTestFrames;
+    bool pattern = _selfTestPattern;
+    int slots = _frameSlots;
+    portEXIT_CRITICAL(&_frameLock);
+    
+    // The live universe is the frame currently on the wire; publishes wait
+    // in the pending buffer until the test is over
+    const uint8_t* live = getOutputData();
+    
+    if (_loopback.start(mode, pattern)) {
+        int64_t next = esp_timer_get_time();
+        for (int n = 0; n < frames; n++) {
+            const uint8_t* frame = _loopback.prepareFrame(live, slots, n);
+            _loopback.armCapture();
+            writeFrame(frame, slots);
+            _loopback.checkFrame(frame, slots);
+            _framesSent++;
+            
+            // Keep the regular frame period so the refresh reading is the real one
+            next += (int64_t)frameMs * 1000;
+            int64_t wait = next - esp_timer_get_time();
+            if (wait >= 1000) {
+                vTaskDelay(pdMS_TO_TICKS(wait / 1000));
+            }
+        }
+    }
+    _loopback.finish();
+    
+    // Put the live frame back on the wire (a pattern test left the fixtures showing it)
+    writeFrame(live, slots);
+    _framesSent++;
+    _lastSendMs = millis();
+    
+    portENTER_CRITICAL(&_frameLock);
+    _selfTestState = SELF_TEST_DONE;
+    portEXIT_CRITICAL(&_frameLock);
+}
+
+// Milliseconds until the next keepalive frame is due
+template <int MaxChannels, int MaxFixtures>
+uint32_t DmxControllerT<MaxChannels, MaxFixtures>::getKeepaliveWaitMs() {
+    unsigned long elapsed = millis() - _lastSendMs;
+    return elapsed < _keepaliveMs ? _keepaliveMs - elapsed : 1;
+}
+
+// Estimated CPU time saved by idle skips (ms)
+template <int MaxChannels, int MaxFixtures>
+uint32_t DmxControllerT<MaxChannels, MaxFixtures>::getCpuSavedMs() {
+    portENTER_CRITICAL(&_frameLock);
+    uint64_t saved = _cpuSavedUs;
+    portEXIT_CRITICAL(&_frameLock);
+    return (uint32_t)(saved / 1000);
+}
+
+// Get the highest DMX channel used by any fixture
+template <int MaxChannels, int MaxFixtures>
+int DmxControllerT<MaxChannels, MaxFixtures>::getHighestChannel() {
+    const FixturePatch* patch = livePatch();
+    int highest = 0;
+    for (int i = 0; i < patch->numFixtures; i++) {
+        highest = max(highest, patch->fixtures[i].redChannel);
+        highest = max(highest, patch->fixtures[i].greenChannel);
+        highest = max(highest, patch->fixtures[i].blueChannel);
+        highest = max(highest, patch->fixtures[i].whiteChannel);
+    }
+    return highest;
+}
+
 // Clear all DMX channels (set to 0)
-void DmxController::clearAllChannels() {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::clearAllChannels() {
     // Clear all DMX data
-    memset(_dmxData, 0, DMX_PACKET_SIZE);
+    memset(_dmxData, 0, FRAME_SIZE);
     
     // DMX start code must be 0
     _dmxData[0] = 0;
@@ -257,14 +808,16 @@ void DmxController::clearAllChannels() {
 }
 
 // Helper function to print fixture values
-void DmxController::printFixtureValues() {
-    if (_fixtures == NULL || _numFixtures <= 0) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::printFixtureValues() {
+    const FixturePatch* patch = livePatch();
+    if (patch->numFixtures <= 0) {
         Serial.println("No fixtures configured");
         return;
     }
     
     // Calculate total channels to display (up to 32 channels max)
-    int channelsToShow = min(_numFixtures * _channelsPerFixture, 32);
+    int channelsToShow = min(patch->numFixtures * patch->channelsPerFixture, 32);
     
     // Print the DMX start code and first set of channels for debugging
     Serial.print("DMX Data: [0]=");
@@ -279,34 +832,36 @@ void DmxController::printFixtureValues() {
     Serial.println();
     
     // Print RGBW info for each fixture
-    for (int i = 0; i < _numFixtures; i++) {
-        Serial.print(_fixtures[i].name);
+    for (int i = 0; i < patch->numFixtures; i++) {
+        Serial.print(patch->fixtures[i].name);
         Serial.print(": R=");
-        Serial.print(_dmxData[_fixtures[i].redChannel]);
+        Serial.print(_dmxData[patch->fixtures[i].redChannel]);
         Serial.print(", G=");
-        Serial.print(_dmxData[_fixtures[i].greenChannel]);
+        Serial.print(_dmxData[patch->fixtures[i].greenChannel]);
         Serial.print(", B=");
-        Serial.print(_dmxData[_fixtures[i].blueChannel]);
+        Serial.print(_dmxData[patch->fixtures[i].blueChannel]);
         Serial.print(", W=");
-        Serial.println(_dmxData[_fixtures[i].whiteChannel]);
+        Serial.println(_dmxData[patch->fixtures[i].whiteChannel]);
     }
 }
 
 // Helper function to scan through possible DMX addresses for fixtures
-void DmxController::scanForFixtures(int scanStartAddr, int scanEndAddr, int scanStep) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::scanForFixtures(int scanStartAddr, int scanEndAddr, int scanStep) {
+    const FixturePatch* patch = livePatch();
     // Always keep fixture 1 on with RED to have a reference point
-    if (_numFixtures > 0) {
+    if (patch->numFixtures > 0) {
         setFixtureColor(0, 255, 0, 0);
     }
     
     // Clear other DMX channels (except fixture 1)
-    for (int i = 1; i <= DMX_PACKET_SIZE - 1; i++) {
+    for (int i = 1; i <= MaxChannels; i++) {
         bool shouldSkip = false;
         
         // Skip fixture 1's channels
-        if (_numFixtures > 0) {
-            if (i >= _fixtures[0].startAddr && 
-                i <= _fixtures[0].startAddr + _channelsPerFixture - 1) {
+        if (patch->numFixtures > 0) {
+            if (i >= patch->fixtures[0].startAddr && 
+                i <= patch->fixtures[0].startAddr + patch->channelsPerFixture - 1) {
                 shouldSkip = true;
             }
         }
@@ -346,8 +901,10 @@ void DmxController::scanForFixtures(int scanStartAddr, int scanEndAddr, int scan
 }
 
 // Run a channel test at startup to help identify the correct channels
-void DmxController::testAllChannels() {
-    if (_fixtures == NULL || _numFixtures <= 0) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::testAllChannels() {
+    const FixturePatch* patch = livePatch();
+    if (patch->numFixtures <= 0) {
         Serial.println("No fixtures configured");
         return;
     }
@@ -355,7 +912,7 @@ void DmxController::testAllChannels() {
     Serial.println("Starting channel test sequence...");
     
     // Calculate total channels to test (up to 32 max)
-    int channelsToTest = min(_numFixtures * _channelsPerFixture, 32);
+    int channelsToTest = min(patch->numFixtures * patch->channelsPerFixture, 32);
     
     // Test each channel individually
     for (int channel = 1; channel <= channelsToTest; channel++) {
@@ -375,23 +932,23 @@ void DmxController::testAllChannels() {
         
         // Figure out which fixture and which channel this is
         bool foundChannel = false;
-        for (int i = 0; i < _numFixtures; i++) {
-            if (channel == _fixtures[i].redChannel) {
+        for (int i = 0; i < patch->numFixtures; i++) {
+            if (channel == patch->fixtures[i].redChannel) {
                 Serial.print("  This is Fixture ");
                 Serial.print(i+1);
                 Serial.println(" Red Channel");
                 foundChannel = true;
-            } else if (channel == _fixtures[i].greenChannel) {
+            } else if (channel == patch->fixtures[i].greenChannel) {
                 Serial.print("  This is Fixture ");
                 Serial.print(i+1);
                 Serial.println(" Green Channel");
                 foundChannel = true;
-            } else if (channel == _fixtures[i].blueChannel) {
+            } else if (channel == patch->fixtures[i].blueChannel) {
                 Serial.print("  This is Fixture ");
                 Serial.print(i+1);
                 Serial.println(" Blue Channel");
                 foundChannel = true;
-            } else if (channel == _fixtures[i].whiteChannel) {
+            } else if (channel == patch->fixtures[i].whiteChannel) {
                 Serial.print("  This is Fixture ");
                 Serial.print(i+1);
                 Serial.println(" White Channel");
@@ -439,26 +996,28 @@ void DmxController::testAllChannels() {
 }
 
 // Test all fixtures with color patterns
-void DmxController::testAllFixtures() {
-    if (_fixtures == NULL || _numFixtures <= 0) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::testAllFixtures() {
+    const FixturePatch* patch = livePatch();
+    if (patch->numFixtures <= 0) {
         Serial.println("No fixtures configured");
         return;
     }
     
     Serial.println("Testing all fixtures with RGBW configuration...");
     Serial.print("Channel mapping: ");
-    for (int i = 0; i < _numFixtures; i++) {
+    for (int i = 0; i < patch->numFixtures; i++) {
         Serial.print("Fixture ");
         Serial.print(i+1);
         Serial.print(": R=Ch");
-        Serial.print(_fixtures[i].redChannel);
+        Serial.print(patch->fixtures[i].redChannel);
         Serial.print(", G=Ch");
-        Serial.print(_fixtures[i].greenChannel);
+        Serial.print(patch->fixtures[i].greenChannel);
         Serial.print(", B=Ch");
-        Serial.print(_fixtures[i].blueChannel);
+        Serial.print(patch->fixtures[i].blueChannel);
         Serial.print(", W=Ch");
-        Serial.print(_fixtures[i].whiteChannel);
-        if (i < _numFixtures - 1) {
+        Serial.print(patch->fixtures[i].whiteChannel);
+        if (i < patch->numFixtures - 1) {
             Serial.print(" | ");
         }
     }
@@ -496,7 +1055,7 @@ void DmxController::testAllFixtures() {
     
     // Allocate and initialize each test step
     for (int step = 0; step < numSteps; step++) {
-        testSteps[step] = new TestStep(_numFixtures);
+        testSteps[step] = new TestStep(patch->numFixtures);
     }
     
     // Set descriptions for each test step
@@ -513,7 +1072,7 @@ void DmxController::testAllFixtures() {
     testSteps[10]->description = "All channels OFF";
     
     // Set color values for each test step and fixture
-    for (int i = 0; i < _numFixtures; i++) {
+    for (int i = 0; i < patch->numFixtures; i++) {
         // Step 0: All fixtures RED
         testSteps[0]->r[i] = 255;
         testSteps[0]->g[i] = 0;
@@ -585,11 +1144,11 @@ void DmxController::testAllFixtures() {
         clearAllChannels();
         
         // Set color for each fixture according to test step
-        for (int i = 0; i < _numFixtures; i++) {
-            _dmxData[_fixtures[i].redChannel] = testSteps[step]->r[i];
-            _dmxData[_fixtures[i].greenChannel] = testSteps[step]->g[i];
-            _dmxData[_fixtures[i].blueChannel] = testSteps[step]->b[i];
-            _dmxData[_fixtures[i].whiteChannel] = testSteps[step]->w[i];
+        for (int i = 0; i < patch->numFixtures; i++) {
+            _dmxData[patch->fixtures[i].redChannel] = testSteps[step]->r[i];
+            _dmxData[patch->fixtures[i].greenChannel] = testSteps[step]->g[i];
+            _dmxData[patch->fixtures[i].blueChannel] = testSteps[step]->b[i];
+            _dmxData[patch->fixtures[i].whiteChannel] = testSteps[step]->w[i];
         }
         
         // Send the data
@@ -608,16 +1167,16 @@ void DmxController::testAllFixtures() {
         Serial.print("Expected colors - ");
         
         // For each fixture, describe what color should be displayed
-        for (int i = 0; i < _numFixtures; i++) {
+        for (int i = 0; i < patch->numFixtures; i++) {
             Serial.print("Fixture ");
             Serial.print(i+1);
             Serial.print(": ");
             
             // Determine color based on RGB values
-            uint8_t r = _dmxData[_fixtures[i].redChannel];
-            uint8_t g = _dmxData[_fixtures[i].greenChannel];
-            uint8_t b = _dmxData[_fixtures[i].blueChannel];
-            uint8_t w = _dmxData[_fixtures[i].whiteChannel];
+            uint8_t r = _dmxData[patch->fixtures[i].redChannel];
+            uint8_t g = _dmxData[patch->fixtures[i].greenChannel];
+            uint8_t b = _dmxData[patch->fixtures[i].blueChannel];
+            uint8_t w = _dmxData[patch->fixtures[i].whiteChannel];
             
             if (w > 0 || (r > 0 && g > 0 && b > 0)) {
                 Serial.print("WHITE");
@@ -638,7 +1197,7 @@ void DmxController::testAllFixtures() {
             }
             
             // Add separator between fixtures except for the last one
-            if (i < _numFixtures - 1) {
+            if (i < patch->numFixtures - 1) {
                 Serial.print(", ");
             }
         }
@@ -661,8 +1220,10 @@ void DmxController::testAllFixtures() {
 }
 
 // Run a rainbow chase test pattern across fixtures
-void DmxController::runRainbowChase(int cycles, int speedMs, bool staggered) {
-    if (_fixtures == NULL || _numFixtures <= 0) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::runRainbowChase(int cycles, int speedMs, bool staggered) {
+    const FixturePatch* patch = livePatch();
+    if (patch->numFixtures <= 0) {
         Serial.println("No fixtures configured");
         return;
     }
@@ -702,15 +1263,17 @@ void DmxController::runRainbowChase(int cycles, int speedMs, bool staggered) {
 }
 
 // Calculate and set a single step of the rainbow pattern
-void DmxController::cycleRainbowStep(uint32_t step, bool staggered) {
-    if (_fixtures == NULL || _numFixtures <= 0) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::cycleRainbowStep(uint32_t step, bool staggered) {
+    const FixturePatch* patch = livePatch();
+    if (patch->numFixtures <= 0) {
         return;
     }
     
     // Calculate rainbow colors for each fixture
-    for (int i = 0; i < _numFixtures; i++) {
+    for (int i = 0; i < patch->numFixtures; i++) {
         // Calculate hue, shift it for each fixture if staggered
-        uint8_t hue = (step + (staggered ? (i * 256 / _numFixtures) : 0)) % 256;
+        uint8_t hue = (step + (staggered ? (i * 256 / patch->numFixtures) : 0)) % 256;
         
         // Convert HSV to RGB (S and V are fixed at 255)
         RgbwColor color = hsvToRgb(hue, 255, 255);
@@ -724,15 +1287,17 @@ void DmxController::cycleRainbowStep(uint32_t step, bool staggered) {
 }
 
 // Thread-safe version of the rainbow step function for use with FreeRTOS
-void DmxController::updateRainbowStep(uint32_t step, bool staggered) {
-    if (_fixtures == NULL || _numFixtures <= 0) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::updateRainbowStep(uint32_t step, bool staggered) {
+    const FixturePatch* patch = livePatch();
+    if (patch->numFixtures <= 0) {
         return;
     }
     
     // Calculate rainbow colors for each fixture
-    for (int i = 0; i < _numFixtures; i++) {
+    for (int i = 0; i < patch->numFixtures; i++) {
         // Calculate hue, shift it for each fixture if staggered
-        uint8_t hue = (step + (staggered ? (i * 256 / _numFixtures) : 0)) % 256;
+        uint8_t hue = (step + (staggered ? (i * 256 / patch->numFixtures) : 0)) % 256;
         
         // Convert HSV to RGB (S and V are fixed at 255)
         RgbwColor color = hsvToRgb(hue, 255, 255);
@@ -745,103 +1310,9 @@ void DmxController::updateRainbowStep(uint32_t step, bool staggered) {
     // This just updates the DMX buffer with new values
 }
 
-// Run a strobe test pattern on all fixtures
-void DmxController::runStrobeTest(uint8_t color, int count, int onTimeMs, int offTimeMs, bool alternate) {
-    if (_fixtures == NULL || _numFixtures <= 0) {
-        Serial.println("No fixtures configured");
-        return;
-    }
-    
-    Serial.println("Starting strobe test pattern...");
-    Serial.print("Running ");
-    Serial.print(count);
-    Serial.print(" strobe flashes with ");
-    Serial.print(onTimeMs);
-    Serial.print("ms on time and ");
-    Serial.print(offTimeMs);
-    Serial.print("ms off time. Mode: ");
-    Serial.println(alternate ? "Alternating" : "All fixtures");
-    
-    // Create arrays for color values
-    uint8_t rValues[4] = {255, 255, 0, 0};     // White, Red, Green, Blue
-    uint8_t gValues[4] = {255, 0, 255, 0};     // White, Red, Green, Blue
-    uint8_t bValues[4] = {255, 0, 0, 255};     // White, Red, Green, Blue
-    uint8_t wValues[4] = {255, 0, 0, 0};       // Only White uses W channel
-    
-    // Ensure color selection is within bounds
-    color = min(color, (uint8_t)3);
-    
-    // Store selected color values
-    uint8_t r = rValues[color];
-    uint8_t g = gValues[color];
-    uint8_t b = bValues[color];
-    uint8_t w = wValues[color];
-    
-    // Print selected color
-    Serial.print("Strobe color: ");
-    switch(color) {
-        case 0: Serial.println("WHITE"); break;
-        case 1: Serial.println("RED"); break;
-        case 2: Serial.println("GREEN"); break;
-        case 3: Serial.println("BLUE"); break;
-    }
-    
-    // Run the strobe pattern
-    for (int i = 0; i < count; i++) {
-        // Clear all channels first
-        clearAllChannels();
-        
-        // Set the fixture colors based on the selected mode
-        if (alternate) {
-            // Alternating mode: turn on either odd or even fixtures
-            bool evenPhase = (i % 2 == 0);
-            
-            for (int f = 0; f < _numFixtures; f++) {
-                bool isEvenFixture = (f % 2 == 0);
-                
-                // Only light up fixtures that match the current phase
-                if (isEvenFixture == evenPhase) {
-                    setFixtureColor(f, r, g, b, w);
-                }
-            }
-        } else {
-            // All fixtures mode: turn on all fixtures
-            for (int f = 0; f < _numFixtures; f++) {
-                setFixtureColor(f, r, g, b, w);
-            }
-        }
-        
-        // Send the DMX data for "on" phase
-        sendData();
-        
-        // Print progress every 5 flashes
-        if (i % 5 == 0) {
-            Serial.print("Strobe flash ");
-            Serial.print(i + 1);
-            Serial.print("/");
-            Serial.println(count);
-        }
-        
-        // Wait for the "on" time
-        delay(onTimeMs);
-        
-        // Turn all fixtures off
-        clearAllChannels();
-        sendData();
-        
-        // Wait for the "off" time
-        delay(offTimeMs);
-    }
-    
-    // Clear all channels when done
-    clearAllChannels();
-    sendData();
-    
-    Serial.println("Strobe test pattern complete!");
-}
-
 // Helper function to blink an LED a specific number of times
-void DmxController::blinkLED(int ledPin, int times, int delayMs) {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::blinkLED(int ledPin, int times, int delayMs) {
     for (int i = 0; i < times; i++) {
         digitalWrite(ledPin, HIGH);
         delay(delayMs);
@@ -851,7 +1322,9 @@ void DmxController::blinkLED(int ledPin, int times, int delayMs) {
 }
 
 // Save the current DMX settings to persistent storage
-bool DmxController::saveSettings() {
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::saveSettings() {
+    const FixturePatch* patch = livePatch();
     // Open the preferences with the namespace "dmx_settings"
     if (!_preferences.begin("dmx_settings", false)) {
         Serial.println("Failed to open preferences");
@@ -859,35 +1332,77 @@ bool DmxController::saveSettings() {
     }
     
     // Store the number of fixtures and channels per fixture for validation on load
-    _preferences.putInt("num_fixtures", _numFixtures);
-    _preferences.putInt("chan_per_fix", _channelsPerFixture);
+    _preferences.putInt("num_fixtures", patch->numFixtures);
+    _preferences.putInt("chan_per_fix", patch->channelsPerFixture);
     
     // Create a buffer for the DMX data (excluding the start code)
-    size_t dataSize = DMX_PACKET_SIZE - 1;  // Exclude the start code
+    size_t dataSize = MaxChannels;  // Exclude the start code
     
     // Store the DMX data (excluding the start code at index 0)
     _preferences.putBytes("dmx_data", &_dmxData[1], dataSize);
     
+    // Store slew limits (only when some are set)
+    bool limited = false;
+    for (int ch = 1; ch < FRAME_SIZE && !limited; ch++) {
+        limited = _slewRates[ch] != 0;
+    }
+    if (limited) {
+        _preferences.putBytes("slew_rates", _slewRates, sizeof(_slewRates));
+    } else if (_preferences.isKey("slew_rates")) {
+        _preferences.remove("slew_rates");
+    }
+    
+    // Store the keepalive interval (only when changed from the default)
+    if (_keepaliveMs != DMX_KEEPALIVE_DEFAULT_MS) {
+        _preferences.putInt("keepalive_ms", _keepaliveMs);
+    } else if (_preferences.isKey("keepalive_ms")) {
+        _preferences.remove("keepalive_ms");
+    }
+    
+    // Store dithered roles (only when some are set)
+    if (_ditherRoles != 0) {
+        _preferences.putInt("dither_roles", _ditherRoles);
+    } else if (_preferences.isKey("dither_roles")) {
+        _preferences.remove("dither_roles");
+    }
+    
+    // Store color profiles and assignments (only when some are active)
+    bool colorActive = false;
+    for (uint8_t i = 0; i < COLOR_MAX_PROFILES; i++) {
+        colorActive = colorActive || !_color.isPassThrough(i);
+    }
+    if (colorActive) {
+        ColorProfile profiles[COLOR_MAX_PROFILES];
+        for (uint8_t i = 0; i < COLOR_MAX_PROFILES; i++) {
+            profiles[i] = *_color.getProfile(i);
+        }
+        _preferences.putBytes("color_prof", profiles, sizeof(profiles));
+        _preferences.putBytes("color_fix", _fixtureProfiles, sizeof(_fixtureProfiles));
+    } else if (_preferences.isKey("color_prof")) {
+        _preferences.remove("color_prof");
+        _preferences.remove("color_fix");
+    }
+    
     // Store fixture configurations
-    if (_fixtures != NULL && _numFixtures > 0) {
-        for (int i = 0; i < _numFixtures; i++) {
+    if (patch->numFixtures > 0) {
+        for (int i = 0; i < patch->numFixtures; i++) {
             char keyBuffer[32]; // Buffer for storing key names
             
             // Format key names using snprintf
             snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_addr", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].startAddr);
+            _preferences.putInt(keyBuffer, patch->fixtures[i].startAddr);
             
             snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_red", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].redChannel);
+            _preferences.putInt(keyBuffer, patch->fixtures[i].redChannel);
             
             snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_green", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].greenChannel);
+            _preferences.putInt(keyBuffer, patch->fixtures[i].greenChannel);
             
             snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_blue", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].blueChannel);
+            _preferences.putInt(keyBuffer, patch->fixtures[i].blueChannel);
             
             snprintf(keyBuffer, sizeof(keyBuffer), "fix_%d_white", i);
-            _preferences.putInt(keyBuffer, _fixtures[i].whiteChannel);
+            _preferences.putInt(keyBuffer, patch->fixtures[i].whiteChannel);
             // We can't store the name directly as it's a char* pointer
         }
     }
@@ -898,7 +1413,9 @@ bool DmxController::saveSettings() {
 }
 
 // Load DMX settings from persistent storage
-bool DmxController::loadSettings() {
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::loadSettings() {
+    const FixturePatch* patch = livePatch();
     bool settingsLoaded = false;
     
     // Open the preferences with the namespace "dmx_settings"
@@ -914,9 +1431,9 @@ bool DmxController::loadSettings() {
         int savedChannelsPerFixture = _preferences.getInt("chan_per_fix", 0);
         
         // Only load if the configuration is compatible
-        if (savedNumFixtures == _numFixtures && savedChannelsPerFixture == _channelsPerFixture) {
+        if (savedNumFixtures == patch->numFixtures && savedChannelsPerFixture == patch->channelsPerFixture) {
             // Create a buffer for the DMX data (excluding the start code)
-            size_t dataSize = DMX_PACKET_SIZE - 1;  // Exclude the start code
+            size_t dataSize = MaxChannels;  // Exclude the start code
             
             // Load the DMX data (excluding the start code at index 0)
             _preferences.getBytes("dmx_data", &_dmxData[1], dataSize);
@@ -933,6 +1450,45 @@ bool DmxController::loadSettings() {
         Serial.println("No saved DMX settings found");
     }
     
+    // Slew limits apply regardless of the fixture layout
+    if (_preferences.isKey("slew_rates")) {
+        uint16_t rates[FRAME_SIZE];
+        if (_preferences.getBytes("slew_rates", rates, sizeof(rates)) == sizeof(rates)) {
+            applySlewRates(rates);
+            Serial.println("Slew limits loaded from persistent storage");
+        }
+    }
+    
+    // Keepalive interval for idle output
+    if (_preferences.isKey("keepalive_ms")) {
+        setKeepaliveInterval(_preferences.getInt("keepalive_ms", DMX_KEEPALIVE_DEFAULT_MS));
+    }
+    
+    // Dithered roles follow whatever fixtures are configured
+    if (_preferences.isKey("dither_roles")) {
+        _ditherRoles = _preferences.getInt("dither_roles", 0) & ((1 << (FIXTURE_ROLE_WHITE + 1)) - 1);
+        rebuildDitherMask();
+        Serial.println("Dither roles loaded from persistent storage");
+    }
+    
+    // Color profiles apply to whatever fixtures are configured
+    if (_preferences.isKey("color_prof")) {
+        ColorProfile profiles[COLOR_MAX_PROFILES];
+        if (_preferences.getBytes("color_prof", profiles, sizeof(profiles)) == sizeof(profiles)) {
+            for (uint8_t i = 0; i < COLOR_MAX_PROFILES; i++) {
+                _color.setProfile(i, profiles[i]);
+            }
+            _preferences.getBytes("color_fix", _fixtureProfiles, sizeof(_fixtureProfiles));
+            for (int i = 0; i < MaxFixtures; i++) {
+                if (_fixtureProfiles[i] >= COLOR_MAX_PROFILES) {
+                    _fixtureProfiles[i] = 0;
+                }
+            }
+            rebuildColorFixtures();
+            Serial.println("Color profiles loaded from persistent storage");
+        }
+    }
+    
     _preferences.end();
     
     // If no settings were loaded, set the default white color
@@ -943,16 +1499,227 @@ bool DmxController::loadSettings() {
     return settingsLoaded;
 }
 
+// Limit how fast a range of channels may change
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setSlewLimit(int startAddr, int count, uint16_t rate) {
+    if (startAddr < 1 || startAddr >= FRAME_SIZE || count < 1) {
+        Serial.println("Invalid slew limit range");
+        return;
+    }
+    
+    uint16_t rates[FRAME_SIZE];
+    memcpy(rates, _slewRates, sizeof(rates));
+    for (int ch = startAddr; ch < startAddr + count && ch < FRAME_SIZE; ch++) {
+        rates[ch] = rate;
+    }
+    applySlewRates(rates);
+}
+
+// Limit how fast one channel role changes on every fixture
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setSlewLimitForRole(int role, uint16_t rate) {
+    const FixturePatch* patch = livePatch();
+    if (role < FIXTURE_ROLE_RED || role > FIXTURE_ROLE_WHITE) {
+        return;
+    }
+    
+    uint16_t rates[FRAME_SIZE];
+    memcpy(rates, _slewRates, sizeof(rates));
+    for (int i = 0; i < patch->numFixtures; i++) {
+        int channel;
+        switch (role) {
+            case FIXTURE_ROLE_RED: channel = patch->fixtures[i].redChannel; break;
+            case FIXTURE_ROLE_GREEN: channel = patch->fixtures[i].greenChannel; break;
+            case FIXTURE_ROLE_BLUE: channel = patch->fixtures[i].blueChannel; break;
+            default: channel = patch->fixtures[i].whiteChannel; break;
+        }
+        if (channel > 0 && channel < FRAME_SIZE) {
+            rates[channel] = rate;
+        }
+    }
+    applySlewRates(rates);
+}
+
+// Remove all slew limits
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::clearSlewLimits() {
+    uint16_t rates[FRAME_SIZE];
+    memset(rates, 0, sizeof(rates));
+    applySlewRates(rates);
+}
+
+// Hand a new slew rate table to the output task
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::applySlewRates(const uint16_t* rates) {
+    // Before the output task runs nothing else touches the limiter
+    if (_outputTask == NULL || !_isInitialized) {
+        memcpy(_slewRates, rates, sizeof(_slewRates));
+        takeSlewRates();
+        return;
+    }
+    
+    // The output task takes a table at its next frame; only the writer waits
+    while (__atomic_load_n(&_slewRatesPending, __ATOMIC_ACQUIRE)) {
+        delay(1);
+    }
+    memcpy(_slewRates, rates, sizeof(_slewRates));
+    __atomic_store_n(&_slewRatesPending, true, __ATOMIC_RELEASE);
+    xTaskNotifyGive(_outputTask);
+}
+
+// Swap in the handed-over rate table, ramping from what is on the wire now
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::takeSlewRates() {
+    const uint8_t* wire = getOutputData();
+    _slew.reset(wire);
+    _slew.setRates(_slewRates);
+    if (_slew.isEnabled()) {
+        // Readers of the output buffer must find the wire frame there
+        if (wire != _outData) {
+            memcpy(_outData, wire, FRAME_SIZE);
+        }
+    } else {
+        _slewSettling = false;
+    }
+    _slewOutput = _slew.isEnabled();
+    __atomic_store_n(&_slewRatesPending, false, __ATOMIC_RELEASE);
+}
+
+// Set a color profile for the publish-time color pass
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::setColorProfile(uint8_t index, const ColorProfile& profile) {
+    if (!_color.setProfile(index, profile)) {
+        return false;
+    }
+    rebuildColorFixtures();
+    return true;
+}
+
+// Assign a color profile to one fixture or all of them
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setFixtureColorProfile(int fixtureIndex, uint8_t profile) {
+    if (profile >= COLOR_MAX_PROFILES) {
+        return;
+    }
+    if (fixtureIndex < 0) {
+        memset(_fixtureProfiles, profile, sizeof(_fixtureProfiles));
+    } else if (fixtureIndex < MaxFixtures) {
+        _fixtureProfiles[fixtureIndex] = profile;
+    }
+    rebuildColorFixtures();
+}
+
+// Reset all color profiles to pass-through
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::clearColorProfiles() {
+    _color.clear();
+    rebuildColorFixtures();
+}
+
+// Rebuild the color pass list in the patch being built, or publish a copy
+// of the live patch with a new list
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::rebuildColorFixtures() {
+    bool building = _draftPatch != NULL;
+    FixturePatch* patch = building ? _draftPatch : openPatch(true);
+    buildColorFixtures(*patch);
+    if (!building) {
+        publishFixtures();
+    }
+}
+
+// Dither one channel role on every fixture
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setDitherForRole(int role, bool enabled) {
+    if (role < FIXTURE_ROLE_RED || role > FIXTURE_ROLE_WHITE) {
+        return;
+    }
+    if (enabled) {
+        _ditherRoles |= (uint8_t)(1 << role);
+    } else {
+        _ditherRoles &= (uint8_t)~(1 << role);
+    }
+    rebuildDitherMask();
+}
+
+// Rebuild the dither mask in the patch being built, or publish a copy of
+// the live patch with a new mask
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::rebuildDitherMask() {
+    bool building = _draftPatch != NULL;
+    FixturePatch* patch = building ? _draftPatch : openPatch(true);
+    buildDitherMask(*patch);
+    if (!building) {
+        publishFixtures();
+    }
+}
+
+// Mark the channels of the dithered roles
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::buildDitherMask(FixturePatch& patch) {
+    memset(patch.ditherMask, 0, sizeof(patch.ditherMask));
+    int count = 0;
+    for (int i = 0; i < patch.numFixtures && _ditherRoles != 0; i++) {
+        const FixtureConfig& f = patch.fixtures[i];
+        int channels[] = { f.redChannel, f.greenChannel, f.blueChannel, f.whiteChannel };
+        for (int role = FIXTURE_ROLE_RED; role <= FIXTURE_ROLE_WHITE; role++) {
+            int channel = channels[role];
+            if ((_ditherRoles & (1 << role)) && channel >= 1 && channel <= MaxChannels && !patch.ditherMask[channel]) {
+                patch.ditherMask[channel] = 0xFF;
+                count++;
+            }
+        }
+    }
+    patch.numDitherChannels = count;
+}
+
+// Build the list of fixtures the color pass walks
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::buildColorFixtures(FixturePatch& patch) {
+    int count = 0;
+    for (int i = 0; i < patch.numFixtures; i++) {
+        const FixtureConfig& f = patch.fixtures[i];
+        uint8_t profile = _fixtureProfiles[i];
+        if (_color.isPassThrough(profile)) {
+            continue;
+        }
+        // Color channels must all be inside the frame; white is optional
+        if (f.redChannel < 1 || f.redChannel > MaxChannels ||
+            f.greenChannel < 1 || f.greenChannel > MaxChannels ||
+            f.blueChannel < 1 || f.blueChannel > MaxChannels) {
+            continue;
+        }
+        ColorFixture& c = patch.colorFixtures[count++];
+        c.red = f.redChannel;
+        c.green = f.greenChannel;
+        c.blue = f.blueChannel;
+        c.white = (f.whiteChannel >= 1 && f.whiteChannel <= MaxChannels) ? f.whiteChannel : 0;
+        c.profile = profile;
+    }
+    patch.numColorFixtures = count;
+}
+
+// Time the color pass over the current fixtures
+template <int MaxChannels, int MaxFixtures>
+uint32_t DmxControllerT<MaxChannels, MaxFixtures>::benchmarkColorPass(unsigned long (*clockUs)(), int iterations) {
+    uint8_t scratch[FRAME_SIZE];
+    memset(scratch, 0, FRAME_SIZE);
+    const FixturePatch* patch = livePatch();
+    return _color.benchmark(clockUs, iterations, scratch, patch->colorFixtures, patch->numColorFixtures);
+}
+
 // Set all fixtures to default white color
-void DmxController::setDefaultWhite() {
+template <int MaxChannels, int MaxFixtures>
+void DmxControllerT<MaxChannels, MaxFixtures>::setDefaultWhite() {
+    const FixturePatch* patch = livePatch();
     Serial.println("Setting all fixtures to default white color");
     
     // Clear all DMX channels first
     clearAllChannels();
     
     // Set all fixtures to white
-    if (_fixtures != NULL && _numFixtures > 0) {
-        for (int i = 0; i < _numFixtures; i++) {
+    if (patch->numFixtures > 0) {
+        for (int i = 0; i < patch->numFixtures; i++) {
             // Setting to full white (0 for RGB, 255 for W)
             setFixtureColor(i, 0, 0, 0, 255);
             
@@ -960,26 +1727,26 @@ void DmxController::setDefaultWhite() {
             Serial.print("Setting fixture ");
             Serial.print(i);
             Serial.print(" (");
-            Serial.print(_fixtures[i].name);
+            Serial.print(patch->fixtures[i].name);
             Serial.print(") to white: W channel ");
-            Serial.print(_fixtures[i].whiteChannel);
+            Serial.print(patch->fixtures[i].whiteChannel);
             Serial.print(" = 255, at DMX addr ");
-            Serial.println(_fixtures[i].startAddr);
+            Serial.println(patch->fixtures[i].startAddr);
         }
         
         // Print DMX data for verification
         Serial.println("DMX Data before sending:");
-        for (int i = 0; i < _numFixtures; i++) {
+        for (int i = 0; i < patch->numFixtures; i++) {
             Serial.print("Fixture ");
             Serial.print(i);
             Serial.print(" values - R:");
-            Serial.print(_dmxData[_fixtures[i].redChannel]);
+            Serial.print(_dmxData[patch->fixtures[i].redChannel]);
             Serial.print(", G:");
-            Serial.print(_dmxData[_fixtures[i].greenChannel]);
+            Serial.print(_dmxData[patch->fixtures[i].greenChannel]);
             Serial.print(", B:");
-            Serial.print(_dmxData[_fixtures[i].blueChannel]);
+            Serial.print(_dmxData[patch->fixtures[i].blueChannel]);
             Serial.print(", W:");
-            Serial.println(_dmxData[_fixtures[i].whiteChannel]);
+            Serial.println(_dmxData[patch->fixtures[i].whiteChannel]);
         }
         
         sendData();  // Send data to fixtures
@@ -998,7 +1765,8 @@ void DmxController::setDefaultWhite() {
 }
 
 // Helper to convert HSV to RGB for rainbow effects
-RgbwColor DmxController::hsvToRgb(uint8_t h, uint8_t s, uint8_t v) {
+template <int MaxChannels, int MaxFixtures>
+RgbwColor DmxControllerT<MaxChannels, MaxFixtures>::hsvToRgb(uint8_t h, uint8_t s, uint8_t v) {
     RgbwColor rgb;
     
     // If saturation is 0, it's a shade of gray
@@ -1028,7 +1796,8 @@ RgbwColor DmxController::hsvToRgb(uint8_t h, uint8_t s, uint8_t v) {
     return rgb;
 }
 
-bool DmxController::saveCustomData(const char* key, uint8_t* data, size_t size) {
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::saveCustomData(const char* key, uint8_t* data, size_t size) {
     if (!customPrefs.begin(CUSTOM_PREFS_NAMESPACE, false)) {
         Serial.println("Failed to initialize custom preferences");
         return false;
@@ -1048,7 +1817,8 @@ bool DmxController::saveCustomData(const char* key, uint8_t* data, size_t size)
     return success;
 }
 
-bool DmxController::loadCustomData(const char* key, uint8_t* data, size_t size) {
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::loadCustomData(const char* key, uint8_t* data, size_t size) {
     if (!customPrefs.begin(CUSTOM_PREFS_NAMESPACE, true)) {
         Serial.println("Failed to initialize custom preferences");
         return false;
@@ -1069,7 +1839,21 @@ bool DmxController::loadCustomData(const char* key, uint8_t* data, size_t size)
     return success;
 }
 
-bool DmxController::clearCustomData(const char* key) {
+// Load a custom record of variable length
+template <int MaxChannels, int MaxFixtures>
+size_t DmxControllerT<MaxChannels, MaxFixtures>::loadCustomDataUpTo(const char* key, uint8_t* data, size_t maxSize) {
+    if (!customPrefs.begin(CUSTOM_PREFS_NAMESPACE, true)) {
+        Serial.println("Failed to initialize custom preferences");
+        return 0;
+    }
+
+    size_t readSize = customPrefs.isKey(key) ? customPrefs.getBytes(key, data, maxSize) : 0;
+    customPrefs.end();
+    return readSize;
+}
+
+template <int MaxChannels, int MaxFixtures>
+bool DmxControllerT<MaxChannels, MaxFixtures>::clearCustomData(const char* key) {
     if (!customPrefs.begin(CUSTOM_PREFS_NAMESPACE, false)) {
         Serial.println("Failed to initialize custom preferences");
         return false;
@@ -1087,4 +1871,7 @@ bool DmxController::clearCustomData(const char* key) {
     }
     
     return success;
-} 
\ No newline at end of file
+} 
+
+// Instantiate the controller for this build
+template class DmxControllerT<DMX_MAX_CHANNELS, DMX_MAX_FIXTURES>;
@@ -13,6 +13,10 @@
 #include <Arduino.h>
 #include <esp_dmx.h>
 #include <Preferences.h>  // For persistent storage
+#include <esp_timer.h>
+#include "SlewLimiter.h"
+#include "ColorPipeline.h"
+#include "DmxLoopback.h"
 
 // Add the DMX_INTR_FLAGS_DEFAULT definition if it's not already included
 #ifndef DMX_INTR_FLAGS_DEFAULT
@@ -21,8 +25,40 @@
 
 // DMX configuration
 #define DMX_PACKET_SIZE 513  // DMX packet size (512 channels + start code)
+
+// Controller capacity for this build (override with build flags)
+#ifndef DMX_MAX_CHANNELS
+#define DMX_MAX_CHANNELS 512
+#endif
+#ifndef DMX_MAX_FIXTURES
+#define DMX_MAX_FIXTURES 32
+#endif
 #define DMX_TIMEOUT_TICK 100 // Timeout for DMX operations
 
+// Idle output: with nothing changing, frames are only repeated often enough
+// to stay inside the fixtures' hold timeout (DMX512 allows 1 s between breaks).
+// The default can be set with -D and changed at run time.
+#ifndef DMX_KEEPALIVE_DEFAULT_MS
+#define DMX_KEEPALIVE_DEFAULT_MS 800
+#endif
+#define DMX_KEEPALIVE_MAX_MS 1000
+
+// Fixture patches: the live one, one retired and waiting out its grace
+// period, and one being built
+#define DMX_PATCH_SLOTS 3
+#define DMX_PATCH_GRACE_MS 100   // Longer than any render step; a retired patch is reused after this or a publish
+
+// Fixture channel roles (for per-role settings such as slew limits)
+#define FIXTURE_ROLE_RED 0
+#define FIXTURE_ROLE_GREEN 1
+#define FIXTURE_ROLE_BLUE 2
+#define FIXTURE_ROLE_WHITE 3
+
+// Loopback self-test states
+#define SELF_TEST_IDLE 0
+#define SELF_TEST_QUEUED 1
+#define SELF_TEST_DONE 2
+
 // Fixture configuration structure
 struct FixtureConfig {
   const char* name;
@@ -41,8 +77,32 @@ struct RgbwColor {
   uint8_t w;
 };
 
-class DmxController {
+template <int MaxChannels = 512, int MaxFixtures = 32>
+class DmxControllerT {
 public:
+    static const int MAX_CHANNELS = MaxChannels;    // Highest DMX channel
+    static const int MAX_FIXTURES = MaxFixtures;
+    static const int FRAME_SIZE = MaxChannels + 1;  // Start code + channels
+    static const int FRAME_STRIDE = (FRAME_SIZE + 15) & ~15;  // Buffer rows keep the vector alignment
+
+    static_assert(MaxChannels >= 1 && MaxChannels <= DMX_PACKET_SIZE - 1, "A DMX universe has 1-512 channels");
+    static_assert(MaxFixtures >= 1, "At least one fixture is required");
+
+    /**
+     * An immutable fixture patch: the layout and the color pass list built
+     * from it. Readers only ever see a complete patch.
+     */
+    struct FixturePatch {
+        uint32_t version;
+        int numFixtures;
+        int channelsPerFixture;
+        FixtureConfig fixtures[MaxFixtures];
+        ColorFixture colorFixtures[MaxFixtures];   // Fixtures on non-identity profiles
+        int numColorFixtures;
+        uint8_t ditherMask[MaxChannels + 1] __attribute__((aligned(16)));   // 0xFF on dithered channels
+        int numDitherChannels;
+    };
+
     /**
      * Constructor
      * 
@@ -51,7 +111,7 @@ public:
      * @param rxPin The RX pin for DMX input
      * @param dirPin The direction pin for DMX direction control
      */
-    DmxController(
+    DmxControllerT(
         uint8_t dmxPort = 1,
         uint8_t txPin = 19,
         uint8_t rxPin = 20,
@@ -86,10 +146,33 @@ public:
     void setManualFixtureColor(int startAddr, uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0);
 
     /**
-     * Initialize the fixtures array with default values
+     * Start building a new fixture patch off to the side
+     * Fill it in with setFixtureConfig() and make it live with
+     * publishFixtures(); until then renderers keep using the current one.
+     * Fixture slots start unassigned (all channels 0).
      */
     void initializeFixtures(int numFixtures, int channelsPerFixture);
 
+    /**
+     * Start building a new fixture patch from a copy of the live one
+     * For incremental edits: only the entries passed to setFixtureConfig()
+     * change. Fixtures added by growing the count start unassigned.
+     */
+    void editFixtures(int numFixtures);
+
+    /**
+     * Make the patch being built live with a single pointer store
+     * The previous patch stays intact until the next frame boundary (or
+     * DMX_PATCH_GRACE_MS), so a render step that started on it finishes on
+     * it. Call with the DMX mutex held to keep the swap between render steps.
+     */
+    void publishFixtures();
+
+    /**
+     * Version of the live patch (incremented on every publish)
+     */
+    uint32_t getPatchVersion() { return livePatch()->version; }
+
     /**
      * Scan through possible DMX addresses for fixtures
      */
@@ -111,10 +194,120 @@ public:
     void printFixtureValues();
 
     /**
-     * Send the current DMX data to the fixtures
+     * Publish the current DMX data to the fixtures
+     * Copies the back buffer into the pending frame and returns; the output
+     * task picks it up at the next frame boundary while rendering continues.
      */
     void sendData();
 
+    /**
+     * Publish the frame and have the output task send it immediately,
+     * truncated after the given slot and without slew limiting, for
+     * time-critical edges (strobe)
+     * 
+     * @param numSlots Channels to send (1-512)
+     */
+    void sendFrameNow(int numSlots);
+
+    /**
+     * Transmit one frame: swap in the newest published frame (if any),
+     * apply slew limits and write it to the UART.
+     * Only the output task may call this.
+     * 
+     * When nothing was published, no slew ramp is running and the keepalive
+     * interval has not expired, the frame is skipped entirely.
+     * 
+     * @param frameMs Regular frame period, used as the minimum keepalive
+     * @return True if a frame was sent, false if it was skipped as idle
+     */
+    bool transmitFrame(uint32_t frameMs);
+
+    /**
+     * True when the last frame was skipped; the output task may then sleep
+     * until getKeepaliveWaitMs() (a publish wakes it early)
+     */
+    bool isOutputIdle() { return _outputIdle; }
+
+    /**
+     * Milliseconds until the next keepalive frame is due
+     */
+    uint32_t getKeepaliveWaitMs();
+
+    /**
+     * Set how often an unchanged frame is repeated
+     * Must stay below the fixtures' hold timeout.
+     * 
+     * @param intervalMs Keepalive interval (clamped to DMX_KEEPALIVE_MAX_MS)
+     */
+    void setKeepaliveInterval(uint32_t intervalMs) { _keepaliveMs = intervalMs > DMX_KEEPALIVE_MAX_MS ? DMX_KEEPALIVE_MAX_MS : intervalMs; }
+    uint32_t getKeepaliveInterval() { return _keepaliveMs; }
+
+    /**
+     * Set the grand master, which scales every channel of each published
+     * frame (after the color pass). Call with the DMX mutex held.
+     *
+     * @param level 0 = blackout, 255 = full
+     */
+    void setMaster(uint8_t level) { _master = level; _publishedValid = false; }
+    uint8_t getMaster() { return _master; }
+
+    /**
+     * Register the output task so sendFrameNow() can wake it
+     */
+    void setOutputTask(TaskHandle_t task) { _outputTask = task; }
+
+    /**
+     * Set how many slots each regular frame carries (0 = all channels)
+     * Shorter frames refresh faster and keep the UART free for urgent frames.
+     */
+    void setFrameSlots(int numSlots) { _frameSlots = (numSlots < 1 || numSlots > MaxChannels) ? MaxChannels : numSlots; }
+
+    /**
+     * Queue a loopback self-test; the output task runs it in place of its
+     * next regular frame and then puts the live frame back on the wire
+     * 
+     * @param mode LOOPBACK_INTERNAL (no wiring) or LOOPBACK_LINE (MAX485 receiver, RE held low)
+     * @param frames Frames to send and read back (1 to LOOPBACK_MAX_FRAMES)
+     * @param pattern Send a test pattern instead of the live universe (fixtures will flicker)
+     * @return False if not initialized or a test is already queued
+     */
+    bool requestSelfTest(uint8_t mode, uint8_t frames, bool pattern);
+
+    /**
+     * Fetch the result of a finished self-test (each result is returned once)
+     * 
+     * @param result Filled in when a result is available
+     * @return True if a new result was copied out
+     */
+    bool getSelfTestResult(DmxLoopbackResult& result);
+
+    /**
+     * Number of frames transmitted by the output task
+     */
+    uint32_t getFramesSent() { return _framesSent; }
+
+    /**
+     * Number of frames that went out more than half a period after the
+     * previous one (the output task was held up)
+     */
+    uint32_t getFramesLate() { return _framesLate; }
+
+    /**
+     * Number of output frames skipped because nothing changed
+     */
+    uint32_t getFramesSkipped() { return _framesSkipped; }
+
+    /**
+     * Number of sendData() calls dropped because the frame was unchanged
+     */
+    uint32_t getPublishesSkipped() { return _publishesSkipped; }
+
+    /**
+     * Estimated CPU time saved by skipped frames and publishes (ms)
+     * Each skip is credited with the running average cost of the work it avoided.
+     */
+    uint32_t getCpuSavedMs();
+
     /**
      * Clear all DMX data (set all channels to 0)
      * Preserves the DMX start code (0 at index 0)
@@ -123,6 +316,8 @@ public:
 
     /**
      * Create and store a new fixture configuration
+     * Edits the patch being built; with none open, a copy of the live patch
+     * with this change is published.
      * 
      * @param index Index in fixtures array
      * @param name Fixture name
@@ -130,20 +325,26 @@ public:
      * @param rChan Red channel
      * @param gChan Green channel
      * @param bChan Blue channel
-     * @param wChan White channel
+     * @param wChan White channel (0 = none)
+     * @return False if the index or a channel is out of range (1-MaxChannels)
      */
-    void setFixtureConfig(int index, const char* name, int startAddr, 
+    bool setFixtureConfig(int index, const char* name, int startAddr, 
                          int rChan, int gChan, int bChan, int wChan);
 
     /**
      * Get the number of configured fixtures
      */
-    int getNumFixtures() { return _numFixtures; }
+    int getNumFixtures() { return livePatch()->numFixtures; }
 
     /**
      * Get the number of channels per fixture
      */
-    int getChannelsPerFixture() { return _channelsPerFixture; }
+    int getChannelsPerFixture() { return livePatch()->channelsPerFixture; }
+
+    /**
+     * Get the highest DMX channel used by any fixture (0 if none)
+     */
+    int getHighestChannel();
 
     /**
      * Get the DMX data buffer
@@ -151,14 +352,143 @@ public:
     uint8_t* getDmxData() { return _dmxData; }
 
     /**
-     * Get a fixture configuration
+     * Get the fraction plane of the DMX data buffer, for renderers that
+     * work finer than a step (keyframe and effect fades)
+     *
+     * Holds the 1/256 steps below each channel of getDmxData(), which
+     * then holds the value rounded down. Taken and cleared by the next
+     * sendData(): dithered channels pass it on, the others round to the
+     * nearest step. Call before each render that writes it.
      */
-    FixtureConfig* getFixture(int index);
+    uint8_t* getDmxFraction() { _fractionUsed = true; return _dmxFraction; }
 
     /**
-     * Get all fixtures
+     * Set a fixture's color in 8.8 fixed point (see getDmxFraction())
      */
-    FixtureConfig* getAllFixtures() { return _fixtures; }
+    void setFixtureColorFine(int fixtureIndex, uint16_t r, uint16_t g, uint16_t b, uint16_t w);
+
+    /**
+     * Get the frame last put on the wire (after slew limiting)
+     * Stable only from the output task, between transmitFrame() calls.
+     */
+    uint8_t* getOutputData() { return (_slewOutput || _ditherOutput) ? _outData : _frontFrame; }
+
+    /**
+     * Limit how fast a range of channels may change
+     * 
+     * @param startAddr First DMX channel (1-512)
+     * @param count Number of channels
+     * @param rate Maximum change in DMX steps per second (0 = unlimited)
+     */
+    void setSlewLimit(int startAddr, int count, uint16_t rate);
+
+    /**
+     * Limit how fast one channel role changes on every fixture
+     * 
+     * @param role FIXTURE_ROLE_RED, _GREEN, _BLUE or _WHITE
+     * @param rate Maximum change in DMX steps per second (0 = unlimited)
+     */
+    void setSlewLimitForRole(int role, uint16_t rate);
+
+    /**
+     * Remove all slew limits (output follows the frame directly again)
+     */
+    void clearSlewLimits();
+
+    /**
+     * True while slew-limited channels are still ramping towards their targets
+     * Keep calling sendData() until this returns false
+     */
+    bool isSlewSettling() { return _slewSettling; }
+
+    /**
+     * Temporally dither one channel role on every fixture
+     *
+     * The master scale and slew ramps work below one DMX step; with dithering
+     * the remainder is spread over the following frames (error diffusion per
+     * channel), so slow fades and low levels do not step visibly. Only
+     * intensity roles can be dithered; other channels are never touched.
+     *
+     * @param role FIXTURE_ROLE_RED, _GREEN, _BLUE or _WHITE
+     */
+    void setDitherForRole(int role, bool enabled);
+
+    /**
+     * Dithered roles, bit n = FIXTURE_ROLE n
+     */
+    uint8_t getDitherRoles() { return _ditherRoles; }
+
+    /**
+     * True while dithered channels are between two steps (frames differ)
+     */
+    bool isDithering() { return _ditherActive; }
+
+    /**
+     * Suspend dithering without changing the roles (render QoS); channels round
+     */
+    void setDitherSuspended(bool suspended) { _ditherSuspended = suspended; _publishedValid = false; }
+    bool isDitherSuspended() { return _ditherSuspended; }
+
+    /**
+     * Set a color profile (fixture type) for the publish-time color pass
+     * 
+     * @param index Profile (0 to COLOR_MAX_PROFILES - 1)
+     * @param profile White extraction and calibration settings
+     * @return False if the index is out of range
+     */
+    bool setColorProfile(uint8_t index, const ColorProfile& profile);
+
+    const ColorProfile* getColorProfile(uint8_t index) { return _color.getProfile(index); }
+
+    /**
+     * Assign a color profile to a fixture
+     * 
+     * @param fixtureIndex Fixture, or -1 for all fixtures
+     * @param profile Profile index
+     */
+    void setFixtureColorProfile(int fixtureIndex, uint8_t profile);
+
+    /**
+     * Color profile assigned to a fixture (0 = pass-through)
+     */
+    uint8_t getFixtureColorProfile(int fixtureIndex) {
+        return fixtureIndex >= 0 && fixtureIndex < MaxFixtures ? _fixtureProfiles[fixtureIndex] : 0;
+    }
+
+    /**
+     * Reset all color profiles to pass-through
+     */
+    void clearColorProfiles();
+
+    /**
+     * Number of fixtures the color pass processes
+     */
+    int getColorFixtureCount() { return livePatch()->numColorFixtures; }
+
+    /**
+     * Time the color pass over the current fixtures
+     * 
+     * @param clockUs Microsecond clock (micros)
+     * @param iterations Passes to run
+     * @return Total microseconds for all iterations
+     */
+    uint32_t benchmarkColorPass(unsigned long (*clockUs)(), int iterations);
+
+    /**
+     * Get a fixture configuration from the live patch
+     */
+    const FixtureConfig* getFixture(int index);
+
+    /**
+     * Get all fixtures of the live patch
+     */
+    const FixtureConfig* getAllFixtures() { return livePatch()->fixtures; }
+
+    /**
+     * Get the live patch, for a consistent view across several calls
+     * Stays valid until the next frame boundary after a publishFixtures().
+     */
+    const FixturePatch* getPatch() { return livePatch(); }
 
     /**
      * Run a rainbow chase pattern across all fixtures
@@ -177,17 +507,6 @@ public:
      */
     void updateRainbowStep(uint32_t step, bool staggered = true);
 
-    /**
-     * Run a strobe test pattern on all fixtures
-     * 
-     * @param color Color to use for the strobe (0=white, 1=red, 2=green, 3=blue)
-     * @param count Number of strobe flashes
-     * @param onTimeMs Time for the "on" phase in milliseconds
-     * @param offTimeMs Time for the "off" phase in milliseconds
-     * @param alternate If true, alternate between fixtures for a back-and-forth effect
-     */
-    void runStrobeTest(uint8_t color = 0, int count = 20, int onTimeMs = 50, int offTimeMs = 50, bool alternate = false);
-
     /**
      * Helper function to blink an LED a specific number of times
      * 
@@ -221,6 +540,13 @@ public:
     // Add custom data storage methods
     bool saveCustomData(const char* key, uint8_t* data, size_t size);
     bool loadCustomData(const char* key, uint8_t* data, size_t size);
+
+    /**
+     * Load a custom record of variable length
+     *
+     * @return Bytes read, or 0 if the key is missing or holds more than maxSize
+     */
+    size_t loadCustomDataUpTo(const char* key, uint8_t* data, size_t maxSize);
     bool clearCustomData(const char* key);
 
 private:
@@ -228,13 +554,140 @@ private:
     uint8_t _txPin;
     uint8_t _rxPin;
     uint8_t _dirPin;
-    uint8_t _dmxData[DMX_PACKET_SIZE];  // Array to hold DMX data
+    uint8_t _dmxData[FRAME_SIZE];       // Back buffer: everything renders here
+    uint8_t _dmxFraction[FRAME_SIZE];   // 1/256 steps below the back buffer (renderers that set it)
+    bool _fractionUsed;                 // The fraction plane was handed out since the last publish
+    uint8_t _frameBuffers[2][FRAME_STRIDE] __attribute__((aligned(16)));  // Pending and on-air frames
+    uint8_t* _pendingFrame;             // Last published frame, not yet on the wire
+    uint8_t* _frontFrame;               // Frame the output task is transmitting
+    volatile bool _frameReady;          // A newer frame was published
+    int _frameSlots;                    // Slots per regular frame
+    volatile int _urgentSlots;          // Slots for an immediate frame (0 = none)
+    TaskHandle_t _outputTask;           // Woken by sendFrameNow()
+    volatile uint32_t _framesSent;
+    volatile uint32_t _framesLate;
+    portMUX_TYPE _frameLock;            // Guards the pending/front swap
+    
+    // Idle-frame short-circuit
+    uint8_t _publishedData[FRAME_SIZE]; // Back buffer as last published (publishers only)
+    uint8_t _publishedFraction[FRAME_SIZE];  // Its fraction plane
+    bool _publishedValid;               // False until the first publish
+    volatile bool _outputIdle;          // Output task is sleeping until keepalive
+    uint32_t _keepaliveMs;              // Repeat interval for unchanged frames
+    volatile uint32_t _framesSkipped;
+    volatile uint32_t _publishesSkipped;
+    uint32_t _frameCostUs;              // Running average cost of a sent frame
+    uint32_t _publishCostUs;            // Running average cost of a publish
+    uint64_t _cpuSavedUs;               // Guarded by _frameLock
+    uint8_t _master;                    // Grand master, applied at publish
+    
+    // Loopback self-test, run by the output task
+    DmxLoopbackT<FRAME_SIZE> _loopback;
+    volatile uint8_t _selfTestState;    // SELF_TEST_IDLE, _QUEUED or _DONE; guarded by _frameLock
+    uint8_t _selfTestMode;
+    uint8_t _selfTestFrames;
+    bool _selfTestPattern;
+    
+    // Run a queued self-test (output task only)
+    void runSelfTest(uint32_t frameMs);
+    
+    // Break, MAB, start code and slots on the UART (output task only)
+    void writeFrame(const uint8_t* frame, int slots);
+    
+    // Copy the back buffer into the pending frame (unless unchanged, or forced)
+    void publishFrame(bool force = false);
+    
+    // Move the renderers' fraction plane under the pending frame
+    void takeFractions(const FixturePatch* patch, bool dither);
+
+    // Hand a new slew rate table to the output task
+    void applySlewRates(const uint16_t* rates);
+    
+    // Take a handed-over rate table (output task only)
+    void takeSlewRates();
+    uint8_t _outData[FRAME_SIZE] __attribute__((aligned(16)));   // Slew-limited or dithered frame (only used when enabled)
+    uint8_t _loggedData[FRAME_SIZE];    // Last frame printed by sendData()
+    bool _loggedValid;
+    
+    // Color pass, run on each published frame
+    ColorPipeline _color;
+    uint8_t _fixtureProfiles[MaxFixtures];      // Color profile per fixture (writer side)
+    
+    // True for a channel inside the frame (1-MaxChannels)
+    static bool isChannel(int channel) { return channel >= 1 && channel <= MaxChannels; }
+
+    // Write one channel, skipping channels outside the frame
+    void setChannel(int channel, uint8_t value) {
+        if (isChannel(channel)) _dmxData[channel] = value;
+    }
+    void setChannelFine(uint8_t* fraction, int channel, uint16_t value) {
+        if (isChannel(channel)) {
+            _dmxData[channel] = (uint8_t)(value >> 8);
+            fraction[channel] = (uint8_t)value;
+        }
+    }
+
+    // Rebuild the color pass fixture list after a fixture or profile change
+    void rebuildColorFixtures();
+    void buildColorFixtures(FixturePatch& patch);
+    SlewLimiterT<FRAME_SIZE> _slew;     // Per-channel rate-of-change limits (output task)
+    bool _slewSettling;                 // Limited channels still ramping
+    volatile bool _slewOutput;          // Limiter enabled, so frames come from _outData
+    
+    // Rate table handed to the output task: the writer only touches it
+    // while no hand-over is pending, the output task only while one is
+    uint16_t _slewRates[FRAME_SIZE];
+    volatile bool _slewRatesPending;
+    unsigned long _lastSendMs;          // Time of the previous frame, for the slew step
+    
+    // Temporal dithering: each frame buffer has a plane with the 1/256 steps
+    // below it, swapped with it; the output task diffuses them
+    uint8_t _fractionBuffers[2][FRAME_STRIDE] __attribute__((aligned(16)));
+    uint8_t* _pendingFraction;
+    uint8_t* _frontFraction;
+    uint8_t _outFraction[FRAME_SIZE] __attribute__((aligned(16)));     // Below the slew output
+    uint8_t _ditherError[FRAME_SIZE] __attribute__((aligned(16)));     // Carried per channel (output task)
+    uint32_t _ditherVersion;            // Patch the error was carried under
+    uint8_t _unscaledFrame[FRAME_SIZE]; // Pending frame before the grand master (publishers only)
+    
+    // The dither mask travels with the frames: a publish copies a changed
+    // mask into the pending buffer, and the frame swap hands it over, so
+    // the output task never reads a patch the writer may recycle
+    uint8_t _maskBuffers[2][FRAME_STRIDE] __attribute__((aligned(16)));
+    uint8_t* _pendingMask;
+    uint8_t* _frontMask;
+    uint32_t _pendingMaskVersion;       // Patch the pending mask was copied from
+    uint32_t _frontMaskVersion;
+    bool _maskChanged;                  // A new mask waits for the next swap
+    bool _pendingDither;                // Dither the pending frame
+    bool _frontDither;
+    uint8_t _ditherRoles;               // Bit per FIXTURE_ROLE (writer side)
+    bool _ditherActive;                 // Dithered channels still alternating
+    volatile bool _ditherOutput;        // Last frame came from _outData
+    volatile bool _ditherSuspended;
+    
+    // Rebuild the dither mask in the patch being built, or publish a new patch
+    void rebuildDitherMask();
+    void buildDitherMask(FixturePatch& patch);
     bool _isInitialized = false;        // Flag indicating if DMX is properly initialized
     Preferences _preferences;           // Preferences instance for storing settings
     
-    FixtureConfig* _fixtures;  // Dynamic array of fixture configurations
-    int _numFixtures;          // Number of fixtures
-    int _channelsPerFixture;   // Number of channels per fixture
+    // Fixture patches, swapped RCU-style: readers load _livePatch once and
+    // never see a patch change under them; the writer (loop task) builds in
+    // a free slot and publishes with a release store
+    FixturePatch _patches[DMX_PATCH_SLOTS];
+    FixturePatch* _livePatch;
+    FixturePatch* _draftPatch;                  // Being built (NULL if none)
+    bool _patchRetired[DMX_PATCH_SLOTS];        // Replaced, possibly still being read
+    uint32_t _retiredPublish[DMX_PATCH_SLOTS];  // _publishCount when replaced
+    uint32_t _retiredMs[DMX_PATCH_SLOTS];
+    volatile uint32_t _publishCount;            // Frame boundaries (publishes) so far
+    
+    const FixturePatch* livePatch() { return __atomic_load_n(&_livePatch, __ATOMIC_ACQUIRE); }
+    
+    // Open the patch being built, waiting out a grace period if every
+    // spare slot is still being read
+    FixturePatch* openPatch(bool copyLive);
 
     // Internal counter for scanner function
     int _scanCurrentAddr;
@@ -248,4 +701,15 @@ private:
     Preferences customPrefs;
 };
 
+template <int MaxChannels, int MaxFixtures>
+const int DmxControllerT<MaxChannels, MaxFixtures>::MAX_CHANNELS;
+template <int MaxChannels, int MaxFixtures>
+const int DmxControllerT<MaxChannels, MaxFixtures>::MAX_FIXTURES;
+template <int MaxChannels, int MaxFixtures>
+const int DmxControllerT<MaxChannels, MaxFixtures>::FRAME_SIZE;
+
+// The controller used by this build (instantiated in DmxController.cpp)
+typedef DmxControllerT<DMX_MAX_CHANNELS, DMX_MAX_FIXTURES> DmxController;
+extern template class DmxControllerT<DMX_MAX_CHANNELS, DMX_MAX_FIXTURES>;
+
 #endif // DMX_CONTROLLER_H 
\ No newline at end of file
@@ -0,0 +1,235 @@
+/**
+ * DmxLoopback.cpp - Implementation of the DMX read-back self-test
+ */
+
+#include "DmxLoopback.h"
+#include <driver/gpio.h>
+#include <esp_rom_gpio.h>
+#include <esp_timer.h>
+#include <soc/gpio_periph.h>
+#include <soc/uart_periph.h>
+
+// Edge capture states
+enum {
+    EDGE_OFF,
+    EDGE_ARMED,
+    EDGE_BREAK,
+    EDGE_MAB,
+    EDGE_DONE
+};
+
+// Constructor
+DmxLoopback::DmxLoopback(uint8_t* tx, uint8_t* rx, uint16_t frameSize) {
+    _tx = tx;
+    _rx = rx;
+    _frameSize = frameSize;
+    _uart = NULL;
+    _uartNum = 0;
+    _txPin = 0;
+    _rxPin = 0;
+    _edgePin = 0;
+    _isrInstalled = false;
+    _startMs = 0;
+    _lastBreakUs = 0;
+    memset(&_result, 0, sizeof(_result));
+    _result.firstBadSlot = -1;
+    _edge = EDGE_OFF;
+    _breakStartUs = 0;
+    _breakEndUs = 0;
+    _mabEndUs = 0;
+}
+
+// Attach to the DMX UART
+void DmxLoopback::begin(HardwareSerial* uart, uint8_t uartNum, uint8_t txPin, uint8_t rxPin) {
+    _uart = uart;
+    _uartNum = uartNum;
+    _txPin = txPin;
+    _rxPin = rxPin;
+}
+
+// Route the UART RX input from a pin
+void DmxLoopback::routeRx(uint8_t pin) {
+    // An output pad still drives the line with its input enabled
+    PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[pin]);
+#ifdef UART_PERIPH_SIGNAL
+    esp_rom_gpio_connect_in_signal(pin, UART_PERIPH_SIGNAL(_uartNum, SOC_UART_RX_PIN_IDX), false);
+#else
+    esp_rom_gpio_connect_in_signal(pin, uart_periph_signal[_uartNum].rx_sig, false);
+#endif
+}
+
+// Route the read-back path and hook the edge interrupt
+bool DmxLoopback::start(uint8_t mode, bool pattern) {
+    memset(&_result, 0, sizeof(_result));
+    _result.mode = mode;
+    _result.pattern = pattern;
+    _result.firstBadSlot = -1;
+    _result.breakUs = 0xFFFF;
+    _result.mabUs = 0xFFFF;
+    _startMs = millis();
+    _lastBreakUs = 0;
+
+    if (_uart == NULL) {
+        return false;
+    }
+
+    // Let the frame on the wire finish before switching the RX input
+    _uart->flush();
+    if (mode == LOOPBACK_INTERNAL) {
+        routeRx(_txPin);
+        _edgePin = _txPin;
+    } else {
+        _edgePin = _rxPin;
+    }
+    while (_uart->available() > 0) {
+        _uart->read();
+    }
+
+    _edge = EDGE_OFF;
+    gpio_install_isr_service(0);  // Already installed by attachInterrupt() is fine
+    gpio_set_intr_type((gpio_num_t)_edgePin, GPIO_INTR_DISABLE);
+    if (gpio_isr_handler_add((gpio_num_t)_edgePin, &DmxLoopback::onEdge, this) != ESP_OK) {
+        if (mode == LOOPBACK_INTERNAL) {
+            routeRx(_rxPin);
+        }
+        return false;
+    }
+    gpio_intr_enable((gpio_num_t)_edgePin);
+    _isrInstalled = true;
+    return true;
+}
+
+// Frame to send for test frame n
+const uint8_t* DmxLoopback::prepareFrame(const uint8_t* live, int slots, int n) {
+    if (!_result.pattern) {
+        return live;
+    }
+
+    // Neighbouring slots differ, each frame shifts the values and every
+    // other frame is inverted, so stuck, swapped or dropped bits all show
+    uint8_t invert = (n & 1) ? 0xFF : 0x00;
+    if (slots > _frameSize - 1) {
+        slots = _frameSize - 1;
+    }
+    _tx[0] = 0;
+    for (int s = 1; s <= slots; s++) {
+        _tx[s] = (uint8_t)((s * 37 + n * 101) ^ invert);
+    }
+    return _tx;
+}
+
+// Arm the edge capture
+void DmxLoopback::armCapture() {
+    _edge = EDGE_ARMED;
+    gpio_set_intr_type((gpio_num_t)_edgePin, GPIO_INTR_ANYEDGE);
+}
+
+// Edge ISR: break start (fall), break end (rise), MAB end (fall)
+void IRAM_ATTR DmxLoopback::onEdge(void* arg) {
+    DmxLoopback* self = (DmxLoopback*)arg;
+    int64_t now = esp_timer_get_time();
+
+    switch (self->_edge) {
+        case EDGE_ARMED:
+            self->_breakStartUs = now;
+            self->_edge = EDGE_BREAK;
+            break;
+        case EDGE_BREAK:
+            self->_breakEndUs = now;
+            self->_edge = EDGE_MAB;
+            break;
+        case EDGE_MAB:
+            // Start bit of the start code; the slot edges that follow are not needed
+            self->_mabEndUs = now;
+            self->_edge = EDGE_DONE;
+            gpio_set_intr_type((gpio_num_t)self->_edgePin, GPIO_INTR_DISABLE);
+            break;
+        default:
+            break;
+    }
+}
+
+// Read one frame back and compare every slot
+void DmxLoopback::checkFrame(const uint8_t* sent, int slots) {
+    _uart->flush();
+    vTaskDelay(pdMS_TO_TICKS(LOOPBACK_SETTLE_MS));
+    _result.frames++;
+    _result.slots = slots;
+
+    if (_edge == EDGE_DONE) {
+        uint32_t breakUs = (uint32_t)(_breakEndUs - _breakStartUs);
+        uint32_t mabUs = (uint32_t)(_mabEndUs - _breakEndUs);
+        _result.breakUs = min(_result.breakUs, (uint16_t)min(breakUs, (uint32_t)0xFFFF));
+        _result.mabUs = min(_result.mabUs, (uint16_t)min(mabUs, (uint32_t)0xFFFF));
+        if (_lastBreakUs != 0) {
+            _result.refreshUs = max(_result.refreshUs, (uint32_t)(_breakStartUs - _lastBreakUs));
+        }
+        _lastBreakUs = _breakStartUs;
+    } else {
+        gpio_set_intr_type((gpio_num_t)_edgePin, GPIO_INTR_DISABLE);
+        _edge = EDGE_OFF;
+        _result.framesUntimed++;
+        _lastBreakUs = 0;
+    }
+
+    // The break arrives as a 0x00 at the break baud rate, then the start
+    // code and slots; compare the tail
+    int expected = slots + 1;
+    int received = 0;
+    int capacity = _frameSize + LOOPBACK_RX_STRAY;
+    while (_uart->available() > 0) {
+        int value = _uart->read();
+        if (received < capacity) {
+            _rx[received] = (uint8_t)value;
+        }
+        received++;
+    }
+    if (received < expected || received > capacity) {
+        _result.framesMissing++;
+        return;
+    }
+
+    const uint8_t* frame = _rx + (received - expected);
+    for (int s = 0; s < expected; s++) {
+        if (frame[s] != sent[s]) {
+            if (_result.slotErrors < 0xFFFF) {
+                _result.slotErrors++;
+            }
+            if (_result.firstBadSlot < 0 || s < _result.firstBadSlot) {
+                _result.firstBadSlot = s;
+            }
+        }
+    }
+}
+
+// Restore the RX routing and grade the result
+void DmxLoopback::finish() {
+    if (_isrInstalled) {
+        gpio_set_intr_type((gpio_num_t)_edgePin, GPIO_INTR_DISABLE);
+        gpio_isr_handler_remove((gpio_num_t)_edgePin);
+        _isrInstalled = false;
+    }
+    _edge = EDGE_OFF;
+
+    if (_uart != NULL) {
+        if (_result.mode == LOOPBACK_INTERNAL) {
+            routeRx(_rxPin);
+        }
+        while (_uart->available() > 0) {
+            _uart->read();
+        }
+    }
+
+    if (_result.framesUntimed == _result.frames) {
+        _result.breakUs = 0;
+        _result.mabUs = 0;
+    }
+    _result.passed = _result.frames > 0 &&
+                     _result.framesMissing == 0 &&
+                     _result.framesUntimed == 0 &&
+                     _result.slotErrors == 0 &&
+                     _result.breakUs >= LOOPBACK_MIN_BREAK_US &&
+                     _result.mabUs >= LOOPBACK_MIN_MAB_US &&
+                     _result.refreshUs <= LOOPBACK_MAX_REFRESH_US;
+    _result.durationMs = millis() - _startMs;
+}
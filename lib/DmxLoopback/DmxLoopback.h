@@ -0,0 +1,155 @@
+/**
+ * DmxLoopback.h - Automated DMX output self-test by reading the line back
+ *
+ * Sends a few frames and receives them on the DMX UART's own RX input,
+ * comparing every slot against what was sent. A GPIO edge interrupt on the
+ * received signal timestamps break start, break end and the first start
+ * bit, giving break and mark-after-break (MAB) lengths and the
+ * break-to-break refresh interval. Commissioning checks take a fraction of
+ * a second instead of watching each channel by hand.
+ *
+ * Two read-back paths:
+ *   - LOOPBACK_INTERNAL: the TX pad is routed to the UART RX input inside
+ *     the chip. Checks the UART, framing and timing; needs no wiring.
+ *   - LOOPBACK_LINE: reads the MAX485 receiver on the RX pin, so the
+ *     transceiver and the line are checked too. The receiver must be
+ *     enabled while transmitting (RE held low instead of tied to DE).
+ *
+ * Edge timestamps come from an interrupt, so they carry a few
+ * microseconds of latency; that is well inside the DMX512-A margins.
+ *
+ * DmxLoopbackT<FrameSize> holds the pattern and read-back buffers, so each
+ * controller instance sizes the test to its own universe.
+ */
+
+#ifndef DMX_LOOPBACK_H
+#define DMX_LOOPBACK_H
+
+#include <Arduino.h>
+
+#define LOOPBACK_RX_SLACK 64           // UART receive buffer beyond one frame
+#define LOOPBACK_RX_STRAY 8            // Read-back room for the break byte and stray bytes
+#define LOOPBACK_MAX_FRAMES 20
+#define LOOPBACK_SETTLE_MS 2          // Wait after the last stop bit for the UART RX timeout
+
+// DMX512-A transmitter limits
+#define LOOPBACK_MIN_BREAK_US 92
+#define LOOPBACK_MIN_MAB_US 12
+#define LOOPBACK_MAX_REFRESH_US 1000000UL
+
+// Read-back paths
+#define LOOPBACK_INTERNAL 0
+#define LOOPBACK_LINE 1
+
+// Outcome of one self-test
+struct DmxLoopbackResult {
+    bool passed;
+    uint8_t mode;             // LOOPBACK_INTERNAL or LOOPBACK_LINE
+    bool pattern;             // Test pattern instead of the live universe
+    uint8_t frames;           // Frames sent
+    uint8_t framesMissing;    // Frames with no, short or overlong read-back
+    uint8_t framesUntimed;    // Frames where the break/MAB edges were not seen
+    uint16_t slots;           // Channels per frame (start code not counted)
+    uint16_t slotErrors;      // Slots that read back wrong, over all frames
+    int16_t firstBadSlot;     // Lowest wrong slot (0 = start code), -1 if none
+    uint16_t breakUs;         // Shortest break
+    uint16_t mabUs;           // Shortest mark-after-break
+    uint32_t refreshUs;       // Longest break-to-break interval
+    uint32_t durationMs;      // Whole test
+};
+
+class DmxLoopback {
+public:
+    /**
+     * Attach to the DMX UART (call after the UART is started)
+     *
+     * @param uart DMX UART, started with a receive buffer of at least
+     *             frame size + LOOPBACK_RX_SLACK
+     * @param uartNum Hardware UART number of uart
+     * @param txPin UART TX pin
+     * @param rxPin UART RX pin (MAX485 RO)
+     */
+    void begin(HardwareSerial* uart, uint8_t uartNum, uint8_t txPin, uint8_t rxPin);
+
+    /**
+     * Route the read-back path, hook the edge interrupt and reset the result
+     *
+     * @param mode LOOPBACK_INTERNAL or LOOPBACK_LINE
+     * @param pattern Send a test pattern instead of the caller's frame
+     * @return False if the edge interrupt could not be installed
+     */
+    bool start(uint8_t mode, bool pattern);
+
+    /**
+     * Frame to send for test frame n: the live frame, or the test pattern
+     */
+    const uint8_t* prepareFrame(const uint8_t* live, int slots, int n);
+
+    /**
+     * Arm the edge capture; call with the line idle, just before the break
+     */
+    void armCapture();
+
+    /**
+     * Wait for the frame to leave, read it back and compare every slot
+     *
+     * @param sent Frame as sent (index 0 = start code)
+     * @param slots Channels sent
+     */
+    void checkFrame(const uint8_t* sent, int slots);
+
+    /**
+     * Restore the RX routing, unhook the interrupt and grade the result
+     */
+    void finish();
+
+    const DmxLoopbackResult& getResult() const { return _result; }
+
+protected:
+    /**
+     * Bind the test to its buffers: tx of frameSize bytes, rx of
+     * frameSize + LOOPBACK_RX_STRAY bytes
+     */
+    DmxLoopback(uint8_t* tx, uint8_t* rx, uint16_t frameSize);
+
+private:
+    HardwareSerial* _uart;
+    uint8_t _uartNum;
+    uint8_t _txPin;
+    uint8_t _rxPin;
+    uint8_t _edgePin;                 // Pin the edge interrupt watches
+    bool _isrInstalled;
+    unsigned long _startMs;
+    int64_t _lastBreakUs;             // Break start of the previous timed frame (0 = none)
+    DmxLoopbackResult _result;
+    uint8_t* _tx;                     // Test pattern frame
+    uint8_t* _rx;                     // Read-back (break byte and stray bytes first)
+    uint16_t _frameSize;              // Start code + channels
+
+    // Edge capture, written by the ISR
+    volatile uint8_t _edge;
+    volatile int64_t _breakStartUs;
+    volatile int64_t _breakEndUs;
+    volatile int64_t _mabEndUs;
+
+    // Route the UART RX input from a pin
+    void routeRx(uint8_t pin);
+
+    // Edge ISR: break start (fall), break end (rise), MAB end (fall)
+    static void onEdge(void* arg);
+};
+
+/**
+ * Loopback test with buffers for FrameSize bytes (start code + channels)
+ */
+template <int FrameSize>
+class DmxLoopbackT : public DmxLoopback {
+public:
+    DmxLoopbackT() : DmxLoopback(_txFrame, _rxFrame, FrameSize) {}
+
+private:
+    uint8_t _txFrame[FrameSize];
+    uint8_t _rxFrame[FrameSize + LOOPBACK_RX_STRAY];
+};
+
+#endif // DMX_LOOPBACK_H
@@ -0,0 +1,409 @@
+/**
+ * DmxPattern.cpp - Implementation of the effect registry and pattern player
+ */
+
+#include "DmxPattern.h"
+
+// The registry, in 0xF1 type byte order (the saved pattern state stores index + 1)
+constexpr EffectInfo DmxPattern::EFFECTS[DmxPattern::EFFECT_COUNT] = {
+    EffectInfo("colorFade", 0, 50, 5, false, NULL, &DmxPattern::updateColorFade, NULL),
+    EffectInfo("rainbow", 1, 50, 3, false, NULL, &DmxPattern::updateRainbow, NULL),
+    EffectInfo("strobe", 2, 100, 10, true, &DmxPattern::startStrobe, &DmxPattern::updateStrobe, &DmxPattern::stopStrobe),
+    EffectInfo("chase", 3, 200, 3, false, NULL, &DmxPattern::updateChase, NULL),
+    EffectInfo("alternate", 4, 300, 5, false, NULL, &DmxPattern::updateAlternate, NULL)
+};
+
+// Registry index owning a hash slot (EFFECT_NONE if empty)
+constexpr uint8_t effectForSlot(int slot, int index = 0) {
+    return index == DmxPattern::EFFECT_COUNT ? EFFECT_NONE :
+           effectSlot(DmxPattern::EFFECTS[index].nameHash) == slot ? index : effectForSlot(slot, index + 1);
+}
+
+// True if no two names share a hash slot
+constexpr bool effectSlotsUnique(int index = 0, int other = 1) {
+    return index >= DmxPattern::EFFECT_COUNT - 1 ? true :
+           other == DmxPattern::EFFECT_COUNT ? effectSlotsUnique(index + 1, index + 2) :
+           effectSlot(DmxPattern::EFFECTS[index].nameHash) != effectSlot(DmxPattern::EFFECTS[other].nameHash) &&
+           effectSlotsUnique(index, other + 1);
+}
+
+// True if every binary id matches its table index
+constexpr bool effectIdsInOrder(int index = 0) {
+    return index == DmxPattern::EFFECT_COUNT ? true :
+           DmxPattern::EFFECTS[index].binaryId == index && effectIdsInOrder(index + 1);
+}
+
+static_assert(EFFECT_HASH_SLOTS == 8, "EFFECT_BY_SLOT below lists 8 slots");
+static_assert(effectSlotsUnique(), "Effect names collide in the hash table: change EFFECT_HASH_SHIFT");
+static_assert(effectIdsInOrder(), "EFFECTS must be listed in binary id order");
+
+// Compile-time dispatch: one branch per registry row, each a direct call to
+// the row's hook that the compiler may inline
+template <int Hook, int Index, bool End = (Index == DmxPattern::EFFECT_COUNT)>
+struct EffectDispatch {
+    static inline void run(DmxPattern* player, uint8_t index) {
+        if (index != Index) {
+            EffectDispatch<Hook, Index + 1>::run(player, index);
+            return;
+        }
+        constexpr void (DmxPattern::*fn)() = DmxPattern::EFFECTS[Index].hook(Hook);
+        if (fn != NULL) {
+            (player->*fn)();
+        }
+    }
+};
+
+template <int Hook, int Index>
+struct EffectDispatch<Hook, Index, true> {
+    static inline void run(DmxPattern* player, uint8_t index) {}
+};
+
+template <int Hook>
+void DmxPattern::runHook(uint8_t index) {
+    EffectDispatch<Hook, 0>::run(this, index);
+}
+
+const uint8_t DmxPattern::EFFECT_BY_SLOT[EFFECT_HASH_SLOTS] = {
+    effectForSlot(0), effectForSlot(1), effectForSlot(2), effectForSlot(3),
+    effectForSlot(4), effectForSlot(5), effectForSlot(6), effectForSlot(7)
+};
+
+// Constructor
+DmxPattern::DmxPattern() {
+    _dmx = NULL;
+    _mutex = NULL;
+    _strobe = NULL;
+    _active = false;
+    _effect = NULL;
+    _speed = 50;
+    _rateDivider = 1;
+    _step = 0;
+    _lastUpdate = 0;
+    _cycleCount = 0;
+    _maxCycles = 5;
+    _staggered = true;
+}
+
+// Attach the player to its output
+void DmxPattern::begin(DmxController* dmx, SemaphoreHandle_t dmxMutex, StrobeGenerator* strobe) {
+    _dmx = dmx;
+    _mutex = dmxMutex;
+    _strobe = strobe;
+}
+
+// Look up an effect by JSON name
+const EffectInfo* DmxPattern::findEffect(const char* name) {
+    uint32_t hash = 2166136261UL;
+    for (const char* p = name; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619UL;
+    }
+    uint8_t index = EFFECT_BY_SLOT[effectSlot(hash)];
+    if (index == EFFECT_NONE || EFFECTS[index].nameHash != hash || strcmp(EFFECTS[index].name, name) != 0) {
+        return NULL;
+    }
+    return &EFFECTS[index];
+}
+
+// Start an effect
+void DmxPattern::start(const EffectInfo* newEffect, int patternSpeed, int cycles) {
+    if (_active && _effect != NULL) {
+        runHook<EFFECT_HOOK_STOP>(_effect->binaryId);
+    }
+
+    _active = true;
+    _effect = newEffect;
+    _speed = patternSpeed;
+    _step = 0;
+    _cycleCount = 0;
+    _maxCycles = cycles;
+    _lastUpdate = millis();
+    _staggered = true;
+
+    // A strobe test may still be running on the edge timer
+    if (_strobe != NULL && _strobe->isActive()) {
+        _strobe->stop();
+    }
+    runHook<EFFECT_HOOK_START>(_effect->binaryId);
+
+    Serial.print("Pattern started: ");
+    Serial.println(_effect->name);
+
+    // Save pattern state when started
+    savePatternState();
+}
+
+// Stop the running effect
+void DmxPattern::stop() {
+    const EffectInfo* stopped = _effect;
+    _active = false;
+    _effect = NULL;
+    if (stopped != NULL) {
+        runHook<EFFECT_HOOK_STOP>(stopped->binaryId);
+    }
+    Serial.println("Pattern stopped");
+
+    // Clear saved pattern state when stopped
+    clearSavedPatternState();
+}
+
+// Advance the running effect if its step is due
+void DmxPattern::update() {
+    if (!_active || _effect == NULL || _dmx == NULL) {
+        return;
+    }
+
+    // Self-timed effects only need polling
+    if (_effect->selfTimed) {
+        runHook<EFFECT_HOOK_UPDATE>(_effect->binaryId);
+        return;
+    }
+
+    unsigned long now = millis();
+    if (now - _lastUpdate < (unsigned long)_speed * _rateDivider) {
+        return;
+    }
+
+    // Take mutex before updating DMX data
+    if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) {
+        Serial.println("Failed to take DMX mutex for pattern update");
+        return;
+    }
+
+    _lastUpdate = now;
+    runHook<EFFECT_HOOK_UPDATE>(_effect->binaryId);
+
+    // Send the DMX data
+    _dmx->sendData();
+
+    // Save pattern state periodically (every 10 steps)
+    if (_step % 10 == 0) {
+        savePatternState();
+    }
+
+    // Release the mutex
+    xSemaphoreGive(_mutex);
+}
+
+// Save the pattern state
+void DmxPattern::savePatternState() {
+    if (_dmx == NULL) return;
+
+    PatternState state;
+    state.isActive = _active;
+    state.patternType = _effect != NULL ? _effect->binaryId + 1 : 0;  // 0 = none
+    state.speed = _speed;
+    state.maxCycles = _maxCycles;
+    state.staggered = _staggered;
+    state.step = _step;
+
+    // Use DMX controller's persistent storage to save pattern state
+    _dmx->saveCustomData("pattern_state", (uint8_t*)&state, sizeof(PatternState));
+    Serial.println("Pattern state saved to persistent storage");
+}
+
+// Restore the saved pattern state
+void DmxPattern::restorePatternState() {
+    if (_dmx == NULL) return;
+
+    PatternState state;
+    if (_dmx->loadCustomData("pattern_state", (uint8_t*)&state, sizeof(PatternState))) {
+        Serial.println("Restoring saved pattern state");
+
+        if (state.isActive && state.patternType >= 1 && state.patternType <= EFFECT_COUNT) {
+            _active = true;
+            _effect = &EFFECTS[state.patternType - 1];
+            _speed = state.speed;
+            _maxCycles = state.maxCycles;
+            _staggered = state.staggered;
+            _step = state.step;
+            _lastUpdate = millis();
+            _cycleCount = 0;  // Reset cycle count on restore
+
+            Serial.print("Restored pattern: ");
+            Serial.println(_effect->name);
+            Serial.print("Speed: "); Serial.println(_speed);
+            Serial.print("Staggered: "); Serial.println(_staggered ? "Yes" : "No");
+        }
+    } else {
+        Serial.println("No saved pattern state found");
+        _active = false;
+        _effect = NULL;
+    }
+}
+
+// Clear the saved pattern state
+void DmxPattern::clearSavedPatternState() {
+    if (_dmx == NULL) return;
+
+    PatternState state;
+    memset(&state, 0, sizeof(PatternState));  // Clear all data
+    _dmx->saveCustomData("pattern_state", (uint8_t*)&state, sizeof(PatternState));
+    Serial.println("Pattern state cleared from persistent storage");
+}
+
+// HSV to RGB conversion for color effects
+void DmxPattern::hsvToRgb(float h, float s, float v, uint8_t& r, uint8_t& g, uint8_t& b) {
+    uint16_t r16, g16, b16;
+    hsvToRgbFine(h, s, v, r16, g16, b16);
+    r = r16 >> 8;
+    g = g16 >> 8;
+    b = b16 >> 8;
+}
+
+// HSV to RGB in 8.8 fixed point; the whole steps match hsvToRgb()
+void DmxPattern::hsvToRgbFine(float h, float s, float v, uint16_t& r, uint16_t& g, uint16_t& b) {
+    float c = v * s;
+    float x = c * (1 - fabs(fmod(h / 60.0, 2) - 1));
+    float m = v - c;
+
+    float r1, g1, b1;
+    if (h < 60) {
+        r1 = c; g1 = x; b1 = 0;
+    } else if (h < 120) {
+        r1 = x; g1 = c; b1 = 0;
+    } else if (h < 180) {
+        r1 = 0; g1 = c; b1 = x;
+    } else if (h < 240) {
+        r1 = 0; g1 = x; b1 = c;
+    } else if (h < 300) {
+        r1 = x; g1 = 0; b1 = c;
+    } else {
+        r1 = c; g1 = 0; b1 = x;
+    }
+
+    r = (r1 + m) * (255 * 256);
+    g = (g1 + m) * (255 * 256);
+    b = (b1 + m) * (255 * 256);
+}
+
+// Strobe edges come from the hardware timer, not from update()
+void DmxPattern::startStrobe() {
+    if (_strobe != NULL) {
+        _strobe->start(255, 255, 255, 255, _speed, _speed, _maxCycles > 0 ? _maxCycles : 0);
+    }
+}
+
+// The strobe runs on its own timer; just notice when it has finished
+void DmxPattern::updateStrobe() {
+    if (_strobe == NULL || !_strobe->isActive()) {
+        stop();
+    }
+}
+
+void DmxPattern::stopStrobe() {
+    if (_strobe != NULL) {
+        _strobe->stop();
+    }
+}
+
+// Color fade pattern (gradually cycles through colors)
+void DmxPattern::updateColorFade() {
+    float hue = (_step % 360);
+    _step = (_step + 2) % 360;
+
+    // Kept to 1/256 of a step, so dithered channels fade smoothly
+    uint16_t r, g, b;
+    hsvToRgbFine(hue, 1.0, 1.0, r, g, b);
+
+    // Set all fixtures to the same color
+    int numFixtures = _dmx->getNumFixtures();
+    for (int i = 0; i < numFixtures; i++) {
+        _dmx->setFixtureColorFine(i, r, g, b, 0);
+    }
+
+    // Check if we've completed a cycle
+    if (_step == 0) {
+        _cycleCount++;
+        if (_cycleCount >= _maxCycles && _maxCycles > 0) {
+            stop();
+        }
+    }
+}
+
+// Rainbow pattern (different color on each fixture)
+void DmxPattern::updateRainbow() {
+    int numFixtures = _dmx->getNumFixtures();
+    if (numFixtures == 0) return;
+
+    // Calculate hue offset for this step
+    int baseHue = _step % 360;
+    _step = (_step + 5) % 360;
+
+    // Distribute colors across fixtures
+    for (int i = 0; i < numFixtures; i++) {
+        float hue = fmod(baseHue + (360.0 * i / numFixtures), 360);
+
+        uint16_t r, g, b;
+        hsvToRgbFine(hue, 1.0, 1.0, r, g, b);
+
+        _dmx->setFixtureColorFine(i, r, g, b, 0);
+    }
+
+    // Check if we've completed a cycle
+    if (_step == 0) {
+        _cycleCount++;
+        if (_cycleCount >= _maxCycles && _maxCycles > 0) {
+            stop();
+        }
+    }
+}
+
+// Chase pattern (one light at a time)
+void DmxPattern::updateChase() {
+    int numFixtures = _dmx->getNumFixtures();
+    if (numFixtures == 0) return;
+
+    int activeFixture = _step % numFixtures;
+    _step = (_step + 1) % numFixtures;
+
+    // Turn all fixtures off first
+    for (int i = 0; i < numFixtures; i++) {
+        if (i == activeFixture) {
+            // This fixture gets the color - use a rotating hue
+            uint8_t r, g, b;
+            float hue = (_cycleCount * 30) % 360;  // Change color every full chase cycle
+            hsvToRgb(hue, 1.0, 1.0, r, g, b);
+
+            _dmx->setFixtureColor(i, r, g, b, 0);
+        } else {
+            _dmx->setFixtureColor(i, 0, 0, 0, 0);
+        }
+    }
+
+    // Count a full chase sequence as one complete cycle
+    if (_step == 0) {
+        _cycleCount++;
+        if (_cycleCount >= _maxCycles && _maxCycles > 0) {
+            stop();
+        }
+    }
+}
+
+// Alternating pattern (every other fixture)
+void DmxPattern::updateAlternate() {
+    int numFixtures = _dmx->getNumFixtures();
+    bool flipState = (_step % 2) == 0;
+    _step++;
+
+    for (int i = 0; i < numFixtures; i++) {
+        bool isOn = (i % 2 == 0) ? flipState : !flipState;
+
+        if (isOn) {
+            uint8_t r, g, b;
+            float hue = (_cycleCount * 40) % 360;  // Change color every flip
+            hsvToRgb(hue, 1.0, 1.0, r, g, b);
+
+            _dmx->setFixtureColor(i, r, g, b, 0);
+        } else {
+            _dmx->setFixtureColor(i, 0, 0, 0, 0);
+        }
+    }
+
+    // Count each on-off alternation as one complete cycle
+    if (_step % 2 == 0) {
+        _cycleCount++;
+        if (_cycleCount >= _maxCycles && _maxCycles > 0) {
+            stop();
+        }
+    }
+}
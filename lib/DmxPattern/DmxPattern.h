@@ -0,0 +1,181 @@
+/**
+ * DmxPattern.h - Effect registry and pattern player
+ *
+ * Every pattern is one compile-time row in DmxPattern::EFFECTS (name, 0xF1
+ * binary id, default speed/cycles and member-function hooks). JSON names
+ * resolve through a perfect hash of the name and binary ids index the table
+ * directly, so adding an effect means one method and one row. The hooks are
+ * only read at compile time: EffectDispatch expands the table into a branch
+ * per row with a direct call, so no effect is called through a pointer.
+ *
+ * The player only uses the controller, mutex and strobe generator handed to
+ * begin(), so the same code runs in the firmware and in the host renderer
+ * (tools/render).
+ */
+
+#ifndef DMX_PATTERN_H
+#define DMX_PATTERN_H
+
+#include <Arduino.h>
+#include "DmxController.h"
+#include "StrobeGenerator.h"
+
+#define EFFECT_HASH_SLOTS 8
+#define EFFECT_HASH_SHIFT 16   // Chosen so the registered names land in distinct slots
+#define EFFECT_NONE 0xFF
+
+// Saved pattern state (persisted through the DMX controller)
+struct PatternState {
+    bool isActive;
+    uint8_t patternType;       // Registry index + 1, 0 = none
+    int speed;
+    int maxCycles;
+    bool staggered;
+    uint32_t step;
+};
+
+// FNV-1a of an effect name, usable in constant expressions
+constexpr uint32_t effectNameHash(const char* s, uint32_t hash = 2166136261UL) {
+    return *s ? effectNameHash(s + 1, (hash ^ (uint8_t)*s) * 16777619UL) : hash;
+}
+
+// Perfect-hash slot of an effect name hash
+constexpr uint8_t effectSlot(uint32_t hash) {
+    return (hash >> EFFECT_HASH_SHIFT) % EFFECT_HASH_SLOTS;
+}
+
+class DmxPattern;
+
+// Effect hooks, in EffectInfo order
+enum EffectHook {
+    EFFECT_HOOK_START,
+    EFFECT_HOOK_UPDATE,
+    EFFECT_HOOK_STOP
+};
+
+template <int Hook, int Index, bool End> struct EffectDispatch;
+
+// One registered effect
+struct EffectInfo {
+    const char* name;         // JSON "pattern" name
+    uint32_t nameHash;        // effectNameHash(name)
+    uint8_t binaryId;         // Type byte of the 0xF1 command (= table index)
+    uint16_t defaultSpeed;    // ms between steps
+    uint16_t defaultCycles;
+    bool selfTimed;           // Runs on its own timer: update() only polls it
+    void (DmxPattern::*onStart)();  // Optional
+    void (DmxPattern::*update)();
+    void (DmxPattern::*onStop)();   // Optional
+
+    constexpr EffectInfo(const char* effectName, uint8_t id, uint16_t speed, uint16_t cycles, bool timed,
+                         void (DmxPattern::*startFn)(), void (DmxPattern::*updateFn)(), void (DmxPattern::*stopFn)())
+        : name(effectName), nameHash(effectNameHash(effectName)), binaryId(id), defaultSpeed(speed),
+          defaultCycles(cycles), selfTimed(timed), onStart(startFn), update(updateFn), onStop(stopFn) {}
+
+    // A hook by EffectHook, for constant expressions
+    constexpr void (DmxPattern::*hook(int which) const)() {
+        return which == EFFECT_HOOK_START ? onStart : which == EFFECT_HOOK_UPDATE ? update : onStop;
+    }
+};
+
+class DmxPattern {
+public:
+    static const int EFFECT_COUNT = 5;
+    static const EffectInfo EFFECTS[EFFECT_COUNT];
+    static const uint8_t EFFECT_BY_SLOT[EFFECT_HASH_SLOTS];
+
+    DmxPattern();
+
+    /**
+     * Attach the player to its output
+     *
+     * @param dmx DMX controller the effects render into
+     * @param dmxMutex Mutex guarding the DMX buffer
+     * @param strobe Strobe generator for self-timed strobes
+     */
+    void begin(DmxController* dmx, SemaphoreHandle_t dmxMutex, StrobeGenerator* strobe);
+
+    /**
+     * Look up an effect by JSON name (NULL if unknown)
+     */
+    static const EffectInfo* findEffect(const char* name);
+
+    /**
+     * Look up an effect by its 0xF1 type byte (NULL if unknown)
+     */
+    static const EffectInfo* findEffect(uint8_t binaryId) {
+        return binaryId < EFFECT_COUNT ? &EFFECTS[binaryId] : NULL;
+    }
+
+    /**
+     * Start an effect (stops the running one)
+     *
+     * @param newEffect Registry row
+     * @param patternSpeed ms between steps
+     * @param cycles Cycles before stopping (0 = forever)
+     */
+    void start(const EffectInfo* newEffect, int patternSpeed, int cycles = 5);
+
+    /**
+     * Stop the running effect
+     */
+    void stop();
+
+    /**
+     * Advance the running effect if its step is due and send the frame
+     */
+    void update();
+
+    bool isActive() { return _active; }
+    const EffectInfo* getEffect() { return _effect; }
+
+    /**
+     * Stretch the time between effect steps (render QoS); 1 = as configured
+     * Self-timed effects (strobe) are not affected.
+     */
+    void setRateDivider(uint8_t divider) { _rateDivider = divider > 0 ? divider : 1; }
+
+    /**
+     * Save, restore or clear the pattern state in persistent storage
+     */
+    void savePatternState();
+    void restorePatternState();
+    void clearSavedPatternState();
+
+private:
+    template <int Hook, int Index, bool End> friend struct EffectDispatch;
+
+    DmxController* _dmx;
+    SemaphoreHandle_t _mutex;
+    StrobeGenerator* _strobe;
+
+    bool _active;
+    const EffectInfo* _effect;  // NULL when idle
+    int _speed;                 // Time in ms between updates
+    uint8_t _rateDivider;       // Steps are _speed * _rateDivider apart
+    uint32_t _step;             // Current step in the pattern
+    unsigned long _lastUpdate;
+    int _cycleCount;
+    int _maxCycles;
+    bool _staggered;
+
+    // Run a hook of the registry row at index (no-op if the row has none)
+    template <int Hook> void runHook(uint8_t index);
+
+    // HSV to RGB conversion for color effects
+    static void hsvToRgb(float h, float s, float v, uint8_t& r, uint8_t& g, uint8_t& b);
+
+    // HSV to RGB in 8.8 fixed point, for fades that dither between steps
+    static void hsvToRgbFine(float h, float s, float v, uint16_t& r, uint16_t& g, uint16_t& b);
+
+    // Effects (referenced from EFFECTS)
+    void startStrobe();
+    void updateStrobe();
+    void stopStrobe();
+    void updateColorFade();
+    void updateRainbow();
+    void updateChase();
+    void updateAlternate();
+};
+
+#endif // DMX_PATTERN_H
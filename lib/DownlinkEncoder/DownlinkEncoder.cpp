@@ -0,0 +1,327 @@
+/**
+ * DownlinkEncoder.cpp - Candidate encodings and airtime costing
+ */
+
+#include "DownlinkEncoder.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define JSON_LIGHTS_PREFIX "{\"lights\":["
+#define JSON_LIGHTS_SUFFIX "]}"
+#define JSON_WRAPPER_LENGTH 13       // Prefix and suffix
+#define COMPACT_WINDOW 4             // Channels per compact light
+#define LORA_PREAMBLE_SYMBOLS 8
+#define LORA_CODING_RATE 1           // 4/5
+
+const LoraDataRate US915_DOWNLINK_RATES[] = {
+    { "DR8", 12, 500, 53 },
+    { "DR9", 11, 500, 129 },
+    { "DR10", 10, 500, 242 },
+    { "DR11", 9, 500, 242 },
+    { "DR12", 8, 500, 242 },
+    { "DR13", 7, 500, 242 },
+};
+const int US915_DOWNLINK_RATE_COUNT = sizeof(US915_DOWNLINK_RATES) / sizeof(US915_DOWNLINK_RATES[0]);
+
+// Use the downlink data rate and payload limit a node advertised
+bool DownlinkEncoder::applyCapability(const NodeCapability& capability) {
+    int index = capability.downlinkDataRate - 8;
+    if (index < 0 || index >= US915_DOWNLINK_RATE_COUNT || capability.maxDownlinkPayload == 0) {
+        return false;
+    }
+    _rate = US915_DOWNLINK_RATES[index];
+    if (capability.maxDownlinkPayload < _rate.maxPayload) {
+        _rate.maxPayload = capability.maxDownlinkPayload;
+    }
+    return true;
+}
+
+// RGBW values of the one-byte presets
+static const uint8_t PRESET_COLORS[DOWNLINK_PRESET_COUNT][4] = {
+    { 0, 0, 0, 0 },        // 0x00 off
+    { 255, 0, 0, 0 },      // 0x01 red
+    { 0, 255, 0, 0 },      // 0x02 green
+    { 0, 0, 255, 0 },      // 0x03 blue
+    { 0, 0, 0, 255 },      // 0x04 white
+};
+
+// Characters of a value in decimal
+static size_t digits(unsigned value) {
+    return value >= 100 ? 3 : value >= 10 ? 2 : 1;
+}
+
+// {"address":A,"channels":[v,...]} for count channels from address
+static std::string jsonEntry(uint16_t address, const uint8_t* target, size_t count) {
+    char text[16];
+    snprintf(text, sizeof(text), "%u", address);
+    std::string entry = std::string("{\"address\":") + text + ",\"channels\":[";
+    for (size_t i = 0; i < count; i++) {
+        snprintf(text, sizeof(text), i == 0 ? "%u" : ",%u", target[address - 1 + i]);
+        entry += text;
+    }
+    return entry + "]}";
+}
+
+// Application payload bytes over all downlinks
+size_t DownlinkPlan::getBytes() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < downlinks.size(); i++) {
+        bytes += downlinks[i].payload.size();
+    }
+    return bytes;
+}
+
+// Constructor
+DownlinkEncoder::DownlinkEncoder(const LoraDataRate& rate) : _rate(rate) {
+}
+
+// Set the node's fixture layout
+void DownlinkEncoder::setFixtures(const DownlinkFixture* fixtures, size_t count) {
+    _fixtures.assign(fixtures, fixtures + count);
+}
+
+// LoRa time on air (Semtech AN1200.13): explicit header, no payload CRC on
+// downlinks, low data rate optimization when a symbol lasts 16 ms or more
+double DownlinkEncoder::airtimeMs(size_t payloadBytes) const {
+    int sf = _rate.spreadingFactor;
+    double symbolMs = (double)(1UL << sf) / _rate.bandwidthKhz;
+    int lowDataRate = symbolMs >= 16.0 ? 1 : 0;
+    int phyBytes = (int)(payloadBytes + DOWNLINK_LORAWAN_OVERHEAD);
+    double blocks = ceil((8.0 * phyBytes - 4.0 * sf + 28) / (4.0 * (sf - 2 * lowDataRate)));
+    double payloadSymbols = 8 + (blocks > 0 ? blocks * (LORA_CODING_RATE + 4) : 0);
+    return (LORA_PREAMBLE_SYMBOLS + 4.25 + payloadSymbols) * symbolMs;
+}
+
+// Total airtime of a plan
+double DownlinkEncoder::planAirtime(const DownlinkPlan& plan) const {
+    double total = 0;
+    for (size_t i = 0; i < plan.downlinks.size(); i++) {
+        total += airtimeMs(plan.downlinks[i].payload.size());
+    }
+    return total;
+}
+
+// Frame after a preset
+void DownlinkEncoder::applyPreset(uint8_t preset, uint8_t* frame) const {
+    const uint8_t* color = PRESET_COLORS[preset];
+    for (size_t i = 0; i < _fixtures.size(); i++) {
+        const uint16_t channels[4] = { _fixtures[i].red, _fixtures[i].green, _fixtures[i].blue, _fixtures[i].white };
+        for (int c = 0; c < 4; c++) {
+            if (channels[c] >= 1 && channels[c] <= DOWNLINK_SLOTS) {
+                frame[channels[c] - 1] = color[c];
+            }
+        }
+    }
+}
+
+// Pack JSON light entries for a set of channels into packets
+void DownlinkEncoder::addJsonLights(const std::vector<uint16_t>& channels, const uint8_t* target,
+                                    DownlinkPlan& plan) const {
+    if (channels.empty()) {
+        return;
+    }
+    size_t room = _rate.maxPayload - JSON_WRAPPER_LENGTH;
+
+    // Runs of changed channels; a gap is folded in when its values cost
+    // fewer characters than starting another entry
+    std::vector<std::pair<uint16_t, uint16_t> > runs;   // first channel, count
+    size_t i = 0;
+    while (i < channels.size()) {
+        uint16_t first = channels[i];
+        uint16_t last = first;
+        i++;
+        while (i < channels.size()) {
+            size_t gapCost = 0;
+            for (uint16_t ch = last + 1; ch <= channels[i]; ch++) {
+                gapCost += digits(target[ch - 1]) + 1;
+            }
+            size_t entryCost = strlen("{\"address\":,\"channels\":[]},") + digits(channels[i]) +
+                               digits(target[channels[i] - 1]);
+            if (gapCost > entryCost) {
+                break;
+            }
+            last = channels[i++];
+        }
+        runs.push_back(std::make_pair(first, (uint16_t)(last - first + 1)));
+    }
+
+    // Entries, split where one would not fit a packet on its own
+    std::vector<std::string> entries;
+    for (size_t r = 0; r < runs.size(); r++) {
+        uint16_t address = runs[r].first;
+        uint16_t remaining = runs[r].second;
+        while (remaining > 0) {
+            uint16_t count = remaining;
+            std::string entry = jsonEntry(address, target, count);
+            while (entry.size() > room && count > 1) {
+                entry = jsonEntry(address, target, --count);
+            }
+            entries.push_back(entry);
+            address += count;
+            remaining -= count;
+        }
+    }
+
+    // Fill packets in order
+    std::string body;
+    for (size_t e = 0; e <= entries.size(); e++) {
+        bool full = e < entries.size() && !body.empty() && body.size() + 1 + entries[e].size() > room;
+        if ((e == entries.size() || full) && !body.empty()) {
+            std::string json = JSON_LIGHTS_PREFIX + body + JSON_LIGHTS_SUFFIX;
+            Downlink downlink;
+            downlink.format = "json";
+            downlink.payload.assign(json.begin(), json.end());
+            plan.downlinks.push_back(downlink);
+            body.clear();
+        }
+        if (e < entries.size()) {
+            body += (body.empty() ? "" : ",") + entries[e];
+        }
+    }
+}
+
+// Cover the changed channels with compact lights where possible and JSON
+// lights for the rest
+void DownlinkEncoder::addLights(const uint8_t* current, const uint8_t* target, bool compact,
+                                DownlinkPlan& plan) const {
+    std::vector<uint16_t> windows;      // Compact light addresses
+    std::vector<uint16_t> remaining;    // Channels left for JSON
+    uint16_t covered = 0;               // Last channel a window covers
+    for (uint16_t ch = 1; ch <= DOWNLINK_SLOTS; ch++) {
+        if (current[ch - 1] == target[ch - 1] || ch <= covered) {
+            continue;
+        }
+        // Windows starting at the leftmost uncovered change are optimal
+        if (compact && ch <= DOWNLINK_MAX_COMPACT_ADDRESS + COMPACT_WINDOW - 1) {
+            uint16_t address = ch <= DOWNLINK_MAX_COMPACT_ADDRESS ? ch : DOWNLINK_MAX_COMPACT_ADDRESS;
+            windows.push_back(address);
+            covered = address + COMPACT_WINDOW - 1;
+        } else {
+            remaining.push_back(ch);
+        }
+    }
+
+    size_t perPacket = (_rate.maxPayload - 1) / (1 + COMPACT_WINDOW);
+    perPacket = perPacket < DOWNLINK_MAX_LIGHTS ? perPacket : DOWNLINK_MAX_LIGHTS;
+    for (size_t w = 0; w < windows.size(); w += perPacket) {
+        size_t count = windows.size() - w < perPacket ? windows.size() - w : perPacket;
+        Downlink downlink;
+        downlink.format = "lights";
+        downlink.payload.push_back((uint8_t)count);
+        for (size_t i = w; i < w + count; i++) {
+            downlink.payload.push_back((uint8_t)windows[i]);
+            downlink.payload.insert(downlink.payload.end(), target + windows[i] - 1,
+                                    target + windows[i] - 1 + COMPACT_WINDOW);
+        }
+        plan.downlinks.push_back(downlink);
+    }
+    addJsonLights(remaining, target, plan);
+}
+
+// Try every base and lights encoding; keep the one with the least airtime
+DownlinkPlan DownlinkEncoder::encodeFrame(const uint8_t* current, const uint8_t* target, bool patternActive) const {
+    DownlinkPlan best;
+    bool found = false;
+    uint8_t base[DOWNLINK_SLOTS];
+
+    int presets = _fixtures.empty() ? 0 : DOWNLINK_PRESET_COUNT;
+    for (int preset = -1; preset < presets; preset++) {
+        memcpy(base, current, DOWNLINK_SLOTS);
+        if (preset >= 0) {
+            applyPreset((uint8_t)preset, base);
+        }
+        for (int compact = 1; compact >= 0; compact--) {
+            DownlinkPlan plan;
+            if (patternActive) {
+                Downlink stop;
+                stop.format = "stop";
+                stop.payload.push_back(DOWNLINK_PATTERN_STOP);
+                plan.downlinks.push_back(stop);
+            }
+            if (preset >= 0) {
+                Downlink command;
+                command.format = "preset";
+                command.payload.push_back((uint8_t)preset);
+                plan.downlinks.push_back(command);
+            }
+            addLights(base, target, compact != 0, plan);
+            plan.airtimeMs = planAirtime(plan);
+            if (!found || plan.airtimeMs < best.airtimeMs ||
+                (plan.airtimeMs == best.airtimeMs && plan.getBytes() < best.getBytes())) {
+                best = plan;
+                found = true;
+            }
+        }
+    }
+    return best;
+}
+
+// Start a pattern
+DownlinkPlan DownlinkEncoder::encodePattern(uint8_t type, uint16_t speedMs, uint16_t cycles) const {
+    DownlinkPlan plan;
+    Downlink downlink;
+    downlink.format = "pattern";
+    const uint8_t payload[6] = { DOWNLINK_PATTERN_START, type, (uint8_t)speedMs, (uint8_t)(speedMs >> 8),
+                                 (uint8_t)cycles, (uint8_t)(cycles >> 8) };
+    downlink.payload.assign(payload, payload + sizeof(payload));
+    plan.downlinks.push_back(downlink);
+    plan.airtimeMs = planAirtime(plan);
+    return plan;
+}
+
+// Apply a payload to a frame the way processDownlink() would
+bool DownlinkEncoder::apply(const uint8_t* payload, size_t length, uint8_t* frame) const {
+    if (length == 1 && payload[0] < DOWNLINK_PRESET_COUNT) {
+        applyPreset(payload[0], frame);
+        return true;
+    }
+    if (length == 1 && payload[0] == DOWNLINK_PATTERN_STOP) {
+        return true;
+    }
+
+    // Compact lights: count, then (address, 4 values) per light
+    if (length >= 6 && payload[0] >= 1 && payload[0] <= DOWNLINK_MAX_LIGHTS &&
+        length == 1 + (size_t)payload[0] * (1 + COMPACT_WINDOW)) {
+        for (int i = 0; i < payload[0]; i++) {
+            const uint8_t* light = payload + 1 + i * (1 + COMPACT_WINDOW);
+            if (light[0] >= 1 && light[0] + COMPACT_WINDOW - 1 <= DOWNLINK_SLOTS) {
+                memcpy(frame + light[0] - 1, light + 1, COMPACT_WINDOW);
+            }
+        }
+        return true;
+    }
+
+    // JSON lights, as produced by addJsonLights()
+    if (length > 0 && payload[0] == '{') {
+        std::string json((const char*)payload, length);
+        if (json.compare(0, strlen(JSON_LIGHTS_PREFIX), JSON_LIGHTS_PREFIX) != 0) {
+            return false;
+        }
+        size_t at = 0;
+        while ((at = json.find("\"address\":", at)) != std::string::npos) {
+            long address = strtol(json.c_str() + at + 10, NULL, 10);
+            size_t values = json.find("\"channels\":[", at);
+            if (values == std::string::npos) {
+                return false;
+            }
+            const char* cursor = json.c_str() + values + 12;
+            for (long ch = address; *cursor != ']' && *cursor != '\0'; ch++) {
+                char* end;
+                long value = strtol(cursor, &end, 10);
+                if (end == cursor) {
+                    return false;
+                }
+                if (ch >= 1 && ch <= DOWNLINK_SLOTS) {
+                    frame[ch - 1] = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+                }
+                cursor = *end == ',' ? end + 1 : end;
+            }
+            at = values;
+        }
+        return true;
+    }
+    return false;
+}
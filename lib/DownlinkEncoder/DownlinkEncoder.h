@@ -0,0 +1,151 @@
+/**
+ * DownlinkEncoder.h - Shortest downlink sequence for a frame change
+ *
+ * Server-side helper: given the frame the node last showed and the frame it
+ * should show, picks among the encodings the firmware accepts the sequence
+ * of downlinks with the least airtime at a given data rate:
+ *
+ *   0x00-0x04        One byte: every fixture off, red, green, blue or white
+ *                    (needs the fixture layout, and only touches fixtures)
+ *   compact lights   count, then (address, 4 values) per light; addresses
+ *                    1-255, up to 25 lights
+ *   JSON lights      {"lights":[{"address":A,"channels":[...]}]}; any
+ *                    address, runs of any length
+ *   0xF0             Pattern stop, sent first if a pattern would overwrite
+ *                    the new values
+ *
+ * A preset may be followed by fix-up packets, and compact packets cover
+ * channels up to 258 while JSON takes the rest. Every combination is
+ * costed with the LoRa airtime formula and the cheapest is returned.
+ * Keyframe packets are not used: they animate behind a look-ahead rather
+ * than set values. New formats are added as another candidate in
+ * encodeFrame().
+ *
+ * apply() replays payloads the way the firmware handles them, so plans
+ * can be checked without a node. applyCapability() takes the limits from
+ * the node's capability uplink. No Arduino dependencies; built for the
+ * host by tools/airtime.
+ */
+
+#ifndef DOWNLINK_ENCODER_H
+#define DOWNLINK_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "NodeCapability.h"
+
+#define DOWNLINK_SLOTS 512
+#define DOWNLINK_MAX_LIGHTS 25             // Compact lights per packet (firmware limit)
+#define DOWNLINK_MAX_COMPACT_ADDRESS 255   // Addresses are one byte
+#define DOWNLINK_LORAWAN_OVERHEAD 13       // MHDR, FHDR without options, FPort, MIC
+#define DOWNLINK_PATTERN_STOP 0xF0
+#define DOWNLINK_PATTERN_START 0xF1
+#define DOWNLINK_PRESET_COUNT 5            // 0x00 off, 0x01 red, 0x02 green, 0x03 blue, 0x04 white
+
+// A LoRaWAN data rate
+struct LoraDataRate {
+    const char* name;
+    uint8_t spreadingFactor;
+    uint16_t bandwidthKhz;
+    uint8_t maxPayload;        // Application payload limit (N)
+};
+
+// US915 downlink data rates DR8-DR13
+extern const LoraDataRate US915_DOWNLINK_RATES[];
+extern const int US915_DOWNLINK_RATE_COUNT;
+
+// Channels of one RGBW fixture as configured on the node (0 = none)
+struct DownlinkFixture {
+    uint16_t red;
+    uint16_t green;
+    uint16_t blue;
+    uint16_t white;
+};
+
+// One downlink payload and the encoding it uses
+struct Downlink {
+    const char* format;        // "preset", "lights", "json", "stop", "pattern"
+    std::vector<uint8_t> payload;
+};
+
+// A sequence of downlinks
+struct DownlinkPlan {
+    std::vector<Downlink> downlinks;
+    double airtimeMs;
+
+    DownlinkPlan() : airtimeMs(0) {}
+
+    /**
+     * Application payload bytes over all downlinks
+     */
+    size_t getBytes() const;
+};
+
+class DownlinkEncoder {
+public:
+    /**
+     * @param rate Data rate that limits the payload and sets the airtime
+     */
+    explicit DownlinkEncoder(const LoraDataRate& rate = US915_DOWNLINK_RATES[0]);
+
+    void setDataRate(const LoraDataRate& rate) { _rate = rate; }
+    const LoraDataRate& getDataRate() const { return _rate; }
+
+    /**
+     * Use the downlink data rate and payload limit a node advertised
+     *
+     * @return False if the advertised rate is not a US915 downlink rate
+     */
+    bool applyCapability(const NodeCapability& capability);
+
+    /**
+     * Set the node's fixture layout, which the one-byte presets act on
+     */
+    void setFixtures(const DownlinkFixture* fixtures, size_t count);
+
+    /**
+     * Shortest sequence of downlinks that turns one frame into another
+     *
+     * @param current Frame the node shows (DOWNLINK_SLOTS values, channel 1 first)
+     * @param target Frame it should show
+     * @param patternActive A pattern is running and must be stopped first
+     */
+    DownlinkPlan encodeFrame(const uint8_t* current, const uint8_t* target, bool patternActive = false) const;
+
+    /**
+     * Start a pattern (0xF1, type, speed and cycles as uint16 LE)
+     */
+    DownlinkPlan encodePattern(uint8_t type, uint16_t speedMs, uint16_t cycles) const;
+
+    /**
+     * Airtime of one downlink with this application payload size
+     */
+    double airtimeMs(size_t payloadBytes) const;
+
+    /**
+     * Apply a payload to a frame the way the firmware would
+     *
+     * @return False if the payload is not a frame-setting command
+     */
+    bool apply(const uint8_t* payload, size_t length, uint8_t* frame) const;
+
+private:
+    LoraDataRate _rate;
+    std::vector<DownlinkFixture> _fixtures;
+
+    // Cover the changed channels with compact lights where possible and
+    // JSON lights for the rest
+    void addLights(const uint8_t* current, const uint8_t* target, bool compact, DownlinkPlan& plan) const;
+
+    // Pack JSON light entries for a set of channels into packets
+    void addJsonLights(const std::vector<uint16_t>& channels, const uint8_t* target, DownlinkPlan& plan) const;
+
+    // Frame after a preset
+    void applyPreset(uint8_t preset, uint8_t* frame) const;
+
+    // Total airtime of a plan
+    double planAirtime(const DownlinkPlan& plan) const;
+};
+
+#endif // DOWNLINK_ENCODER_H
@@ -0,0 +1,493 @@
+/**
+ * FrameKernels.cpp - Implementation of the byte-wise frame kernels
+ */
+
+#include "FrameKernels.h"
+#include <string.h>
+#ifdef ARDUINO
+#include "sdkconfig.h"
+#endif
+
+// PIE vector path: 16 channels per 128-bit operation
+#if defined(CONFIG_IDF_TARGET_ESP32S3)
+#define FRAME_KERNELS_PIE 1
+#else
+#define FRAME_KERNELS_PIE 0
+#endif
+
+#define LANE_HIGH ((uint32_t)0x80808080)  // Top bit of each byte lane
+
+// Load / store a word through 4-byte aligned pointers
+static inline uint32_t loadWord(const uint8_t* p) {
+    uint32_t w;
+    memcpy(&w, __builtin_assume_aligned(p, 4), 4);
+    return w;
+}
+
+static inline void storeWord(uint8_t* p, uint32_t w) {
+    memcpy(__builtin_assume_aligned(p, 4), &w, 4);
+}
+
+// Bytes before p reaches 4-byte alignment (at most count)
+static inline size_t headLength(const uint8_t* p, size_t count) {
+    size_t head = (4 - ((uintptr_t)p & 3)) & 3;
+    return head < count ? head : count;
+}
+
+// True if both pointers have the same alignment within a word
+static inline bool sameAlignment(const uint8_t* a, const uint8_t* b) {
+    return (((uintptr_t)a ^ (uintptr_t)b) & 3) == 0;
+}
+
+// Expand the top bit of each byte lane to a full 0xFF / 0x00 mask
+static inline uint32_t laneMask(uint32_t highBits) {
+    return (highBits >> 7) * 0xFF;
+}
+
+// Rounded v / 255 for v <= 255 * 255
+static inline uint8_t div255(uint32_t v) {
+    v += 128;
+    return (uint8_t)((v + (v >> 8)) >> 8);
+}
+
+#if FRAME_KERNELS_PIE
+// Bytes before p reaches 16-byte alignment (at most count)
+static inline size_t vectorHead(const uint8_t* p, size_t count) {
+    size_t head = (16 - ((uintptr_t)p & 15)) & 15;
+    return head < count ? head : count;
+}
+
+// True if both pointers have the same alignment within a vector
+static inline bool sameVectorAlignment(const uint8_t* a, const uint8_t* b) {
+    return (((uintptr_t)a ^ (uintptr_t)b) & 15) == 0;
+}
+
+// Broadcast constants for the vector kernels
+static const uint16_t kBias16 = 0x8000;   // Moves unsigned 16-bit lanes into signed range
+static const uint16_t kHalf16 = 128;      // Rounding term of div255
+static const uint16_t kOne16 = 1;         // Multiplier for a shift by SAR
+static const uint8_t kBias8 = 0x80;       // Moves unsigned bytes into signed range
+
+// Scale 16-channel blocks (16-byte aligned). Each block is widened to two
+// vectors of 16-bit lanes holding value << 8; with SAR = 8 the multiplies
+// give value * scale and then shifts. The unsigned lanes go through the
+// signed saturating add biased by 0x8000, where nothing saturates, and the
+// high bytes of v + 128 + ((v + 128) >> 8) are the rounded quotients.
+static void scaleBlocks(uint8_t* dst, const uint8_t* src, uint8_t scale, size_t blocks) {
+    uint16_t factor = scale;
+    __asm__ __volatile__(
+        "ssai 8\n"
+        "ee.vldbc.16 q3, %[factor]\n"
+        "ee.vldbc.16 q4, %[bias]\n"
+        "ee.vldbc.16 q5, %[half]\n"
+        "ee.vldbc.16 q6, %[one]\n"
+        "beqz %[blocks], 2f\n"
+        "1:\n"
+        "ee.vld.128.ip q0, %[src], 16\n"
+        "ee.zero.q q1\n"
+        "ee.vzip.8 q1, q0\n"            // q1, q0: channels 0-7, 8-15 as value << 8
+        "ee.vmul.u16 q1, q1, q3\n"      // v = value * scale
+        "ee.vmul.u16 q0, q0, q3\n"
+        "ee.xorq q1, q1, q4\n"
+        "ee.xorq q0, q0, q4\n"
+        "ee.vadds.s16 q1, q1, q5\n"     // w = v + 128 (biased)
+        "ee.vadds.s16 q0, q0, q5\n"
+        "ee.xorq q2, q1, q4\n"
+        "ee.vmul.u16 q2, q2, q6\n"      // w >> 8
+        "ee.vadds.s16 q1, q1, q2\n"
+        "ee.xorq q2, q0, q4\n"
+        "ee.vmul.u16 q2, q2, q6\n"
+        "ee.vadds.s16 q0, q0, q2\n"
+        "ee.xorq q1, q1, q4\n"          // w + (w >> 8)
+        "ee.xorq q0, q0, q4\n"
+        "ee.vunzip.8 q1, q0\n"          // q0: the high bytes
+        "ee.vst.128.ip q0, %[dst], 16\n"
+        "addi %[blocks], %[blocks], -1\n"
+        "bnez %[blocks], 1b\n"
+        "2:\n"
+        : [dst] "+r"(dst), [src] "+r"(src), [blocks] "+r"(blocks)
+        : [factor] "r"(&factor), [bias] "r"(&kBias16),
+          [half] "r"(&kHalf16), [one] "r"(&kOne16)
+        : "memory");
+}
+
+// Dither 16-channel blocks (16-byte aligned). Fraction and error are added
+// in 16-bit lanes; unzipping the sums gives the new remainders (low bytes)
+// and the steps up (high bytes, 0 or 1). The step is added to the value
+// biased into signed range, so 255 saturates in place.
+static bool ditherBlocks(uint8_t* dst, const uint8_t* fraction, const uint8_t* mask, uint8_t* error, size_t blocks) {
+    uint8_t any[16] __attribute__((aligned(16)));
+    uint8_t* anyPtr = any;
+    __asm__ __volatile__(
+        "ee.vldbc.8 q6, %[bias]\n"
+        "ee.zero.q q7\n"
+        "beqz %[blocks], 2f\n"
+        "1:\n"
+        "ee.vld.128.ip q0, %[fraction], 16\n"
+        "ee.vld.128.ip q4, %[mask], 16\n"
+        "ee.andq q5, q0, q4\n"
+        "ee.orq q7, q7, q5\n"           // Masked fractions seen
+        "ee.zero.q q1\n"
+        "ee.vzip.8 q0, q1\n"            // Fraction as 16-bit lanes
+        "ee.vld.128.ip q2, %[error], 0\n"
+        "ee.zero.q q3\n"
+        "ee.vzip.8 q2, q3\n"            // Error as 16-bit lanes
+        "ee.vadds.s16 q0, q0, q2\n"
+        "ee.vadds.s16 q1, q1, q3\n"
+        "ee.vunzip.8 q0, q1\n"          // q0: remainders, q1: steps
+        "ee.vunzip.8 q2, q3\n"          // q2: error again
+        "ee.andq q5, q0, q4\n"
+        "ee.notq q4, q4\n"
+        "ee.andq q4, q2, q4\n"
+        "ee.orq q5, q5, q4\n"
+        "ee.vst.128.ip q5, %[error], 16\n"
+        "ee.vld.128.ip q0, %[dst], 0\n"
+        "ee.xorq q0, q0, q6\n"
+        "ee.vadds.s8 q0, q0, q1\n"
+        "ee.xorq q0, q0, q6\n"
+        "ee.vst.128.ip q0, %[dst], 16\n"
+        "addi %[blocks], %[blocks], -1\n"
+        "bnez %[blocks], 1b\n"
+        "2:\n"
+        "ee.vst.128.ip q7, %[any], 0\n"
+        : [dst] "+r"(dst), [fraction] "+r"(fraction), [mask] "+r"(mask), [error] "+r"(error),
+          [any] "+r"(anyPtr), [blocks] "+r"(blocks)
+        : [bias] "r"(&kBias8)
+        : "memory");
+    uint32_t words[4];
+    memcpy(words, any, sizeof(words));
+    return (words[0] | words[1] | words[2] | words[3]) != 0;
+}
+#endif
+
+// Scalar saturating add
+void frameAddSaturateScalar(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint16_t sum = dst[i] + src[i];
+        dst[i] = sum > 255 ? 255 : (uint8_t)sum;
+    }
+}
+
+// Scalar maximum
+void frameMaxScalar(uint8_t* dst, const uint8_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (src[i] > dst[i]) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+// Scalar scale
+void frameScaleScalar(uint8_t* dst, const uint8_t* src, uint8_t scale, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = div255((uint32_t)src[i] * scale);
+    }
+}
+
+// Scalar crossfade
+void frameLerpScalar(uint8_t* dst, const uint8_t* a, const uint8_t* b, uint8_t t, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = div255((uint32_t)a[i] * (255 - t) + (uint32_t)b[i] * t);
+    }
+}
+
+// Scalar table lookup
+void frameLutScalar(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = lut[src[i]];
+    }
+}
+
+// Scalar temporal dither
+bool frameDitherScalar(uint8_t* dst, const uint8_t* fraction, const uint8_t* mask, uint8_t* error, size_t count) {
+    bool active = false;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t f = fraction[i] + error[i];
+        uint16_t v = dst[i] + (f >> 8);
+        dst[i] = v > 255 ? 255 : (uint8_t)v;
+        error[i] = (uint8_t)((f & mask[i]) | (error[i] & ~mask[i]));
+        active = active || (fraction[i] & mask[i]) != 0;
+    }
+    return active;
+}
+
+// Saturating add (the byte loop beats the word version)
+void frameAddSaturate(uint8_t* dst, const uint8_t* src, size_t count) {
+    frameAddSaturateScalar(dst, src, count);
+}
+
+// Maximum, four channels per word
+void frameMax(uint8_t* dst, const uint8_t* src, size_t count) {
+    size_t head = headLength(dst, count);
+    frameMaxScalar(dst, src, head);
+    if (!sameAlignment(dst, src)) {
+        frameMaxScalar(dst + head, src + head, count - head);
+        return;
+    }
+
+    size_t i = head;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t a = loadWord(dst + i);
+        uint32_t b = loadWord(src + i);
+        // max(a, b) = a + saturating(b - a); lanes never carry
+        uint32_t diff = ((b | LANE_HIGH) - (a & ~LANE_HIGH)) ^ ((b ^ ~a) & LANE_HIGH);
+        uint32_t borrow = ((~b & a) | (~(b ^ a) & diff)) & LANE_HIGH;
+        storeWord(dst + i, a + (diff & ~laneMask(borrow)));
+    }
+    frameMaxScalar(dst + i, src + i, count - i);
+}
+
+// Scale, 16 channels per vector on the ESP32-S3
+void frameScale(uint8_t* dst, const uint8_t* src, uint8_t scale, size_t count) {
+#if FRAME_KERNELS_PIE
+    size_t head = vectorHead(dst, count);
+    frameScaleScalar(dst, src, scale, head);
+    if (!sameVectorAlignment(dst, src)) {
+        frameScaleScalar(dst + head, src + head, scale, count - head);
+        return;
+    }
+
+    size_t blocks = (count - head) / 16;
+    scaleBlocks(dst + head, src + head, scale, blocks);
+    size_t i = head + blocks * 16;
+    frameScaleScalar(dst + i, src + i, scale, count - i);
+#else
+    frameScaleScalar(dst, src, scale, count);
+#endif
+}
+
+// Crossfade (the byte loop beats the word version)
+void frameLerp(uint8_t* dst, const uint8_t* a, const uint8_t* b, uint8_t t, size_t count) {
+    frameLerpScalar(dst, a, b, t, count);
+}
+
+// Table lookup: no gather instruction, so read four, store one word
+void frameLut(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t count) {
+    size_t head = headLength(dst, count);
+    frameLutScalar(dst, src, lut, head);
+
+    size_t i = head;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t w = (uint32_t)lut[src[i]] |
+                     ((uint32_t)lut[src[i + 1]] << 8) |
+                     ((uint32_t)lut[src[i + 2]] << 16) |
+                     ((uint32_t)lut[src[i + 3]] << 24);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        w = __builtin_bswap32(w);
+#endif
+        storeWord(dst + i, w);
+    }
+    frameLutScalar(dst + i, src + i, lut, count - i);
+}
+
+// Temporal dither, 16 channels per vector on the ESP32-S3
+bool frameDither(uint8_t* dst, const uint8_t* fraction, const uint8_t* mask, uint8_t* error, size_t count) {
+#if FRAME_KERNELS_PIE
+    size_t head = vectorHead(dst, count);
+    bool active = frameDitherScalar(dst, fraction, mask, error, head);
+    if (!sameVectorAlignment(dst, fraction) || !sameVectorAlignment(dst, mask) || !sameVectorAlignment(dst, error)) {
+        return frameDitherScalar(dst + head, fraction + head, mask + head, error + head, count - head) || active;
+    }
+
+    size_t blocks = (count - head) / 16;
+    if (blocks > 0) {
+        active = ditherBlocks(dst + head, fraction + head, mask + head, error + head, blocks) || active;
+    }
+    size_t i = head + blocks * 16;
+    return frameDitherScalar(dst + i, fraction + i, mask + i, error + i, count - i) || active;
+#else
+    return frameDitherScalar(dst, fraction, mask, error, count);
+#endif
+}
+
+// Deterministic test data
+static uint32_t nextRandom(uint32_t* state) {
+    *state = *state * 1664525UL + 1013904223UL;
+    return *state >> 24;
+}
+
+// Cross-check the kernels against the scalar references
+int frameKernelsSelfTest() {
+    static const size_t kMax = 520;
+    static const size_t kPad = 16;   // Room for every offset within a vector
+    static uint8_t a[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t b[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t outK[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t outS[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t errK[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t errS[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t mask[kMax + kPad] __attribute__((aligned(16)));
+    static uint8_t lut[256];
+    uint32_t seed = 12345;
+    int failures = 0;
+
+    for (int i = 0; i < 256; i++) {
+        lut[i] = (uint8_t)nextRandom(&seed);
+    }
+
+    // Random data at every dst/src alignment, against the scalar references
+    for (size_t len = 0; len <= kMax; len += (len < 72 ? 1 : 37)) {
+        for (int offDst = 0; offDst < (int)kPad; offDst++) {
+            // The same alignment (vector path), and a few that force the fallback
+            static const int kSrcShift[] = { 0, 1, 4, 8 };
+            for (int n = 0; n < 4; n++) {
+                int offSrc = (offDst + kSrcShift[n]) % (int)kPad;
+                for (size_t i = 0; i < kMax + kPad; i++) {
+                    a[i] = (uint8_t)nextRandom(&seed);
+                    b[i] = (uint8_t)nextRandom(&seed);
+                }
+                uint8_t t = (uint8_t)nextRandom(&seed);
+
+                memcpy(outK, a, sizeof(outK));
+                memcpy(outS, a, sizeof(outS));
+                frameAddSaturate(outK + offDst, b + offSrc, len);
+                frameAddSaturateScalar(outS + offDst, b + offSrc, len);
+                failures += memcmp(outK, outS, sizeof(outK)) != 0;
+
+                memcpy(outK, a, sizeof(outK));
+                memcpy(outS, a, sizeof(outS));
+                frameMax(outK + offDst, b + offSrc, len);
+                frameMaxScalar(outS + offDst, b + offSrc, len);
+                failures += memcmp(outK, outS, sizeof(outK)) != 0;
+
+                memcpy(outK, a, sizeof(outK));
+                memcpy(outS, a, sizeof(outS));
+                frameScale(outK + offDst, b + offSrc, t, len);
+                frameScaleScalar(outS + offDst, b + offSrc, t, len);
+                failures += memcmp(outK, outS, sizeof(outK)) != 0;
+
+                memcpy(outK, b, sizeof(outK));
+                memcpy(outS, b, sizeof(outS));
+                frameLerp(outK + offDst, a + offSrc, a + offDst, t, len);
+                frameLerpScalar(outS + offDst, a + offSrc, a + offDst, t, len);
+                failures += memcmp(outK, outS, sizeof(outK)) != 0;
+
+                memcpy(outK, a, sizeof(outK));
+                memcpy(outS, a, sizeof(outS));
+                frameLut(outK + offDst, b + offSrc, lut, len);
+                frameLutScalar(outS + offDst, b + offSrc, lut, len);
+                failures += memcmp(outK, outS, sizeof(outK)) != 0;
+
+                for (size_t i = 0; i < kMax + kPad; i++) {
+                    mask[i] = (nextRandom(&seed) & 1) ? 0xFF : 0;
+                    errK[i] = errS[i] = (uint8_t)nextRandom(&seed);
+                }
+                memcpy(outK, a, sizeof(outK));
+                memcpy(outS, a, sizeof(outS));
+                int offMask = offSrc == offDst ? offDst : (offDst + 1) % (int)kPad;
+                bool activeK = frameDither(outK + offDst, b + offSrc, mask + offMask, errK + offDst, len);
+                bool activeS = frameDitherScalar(outS + offDst, b + offSrc, mask + offMask, errS + offDst, len);
+                failures += memcmp(outK, outS, sizeof(outK)) != 0 || memcmp(errK, errS, sizeof(errK)) != 0 ||
+                            activeK != activeS;
+            }
+        }
+    }
+
+    // Every value pair for the arithmetic kernels, against the exact
+    // definitions (one aligned vector of 16 channels at a time)
+    for (int x = 0; x < 256; x++) {
+        for (int y = 0; y < 256; y += 16) {
+            uint8_t va[16] __attribute__((aligned(16)));
+            uint8_t vb[16] __attribute__((aligned(16)));
+            uint8_t out[16] __attribute__((aligned(16)));
+            uint8_t err[16] __attribute__((aligned(16)));
+            uint8_t msk[16] __attribute__((aligned(16)));
+            for (int k = 0; k < 16; k++) {
+                va[k] = (uint8_t)x;
+                vb[k] = (uint8_t)(y + k);
+            }
+
+            memcpy(out, va, 16);
+            frameAddSaturate(out, vb, 16);
+            for (int k = 0; k < 16; k++) {
+                int expect = x + vb[k] > 255 ? 255 : x + vb[k];
+                failures += out[k] != expect;
+            }
+
+            memcpy(out, va, 16);
+            frameMax(out, vb, 16);
+            for (int k = 0; k < 16; k++) {
+                failures += out[k] != (x > vb[k] ? x : vb[k]);
+            }
+
+            frameScale(out, vb, (uint8_t)x, 16);
+            for (int k = 0; k < 16; k++) {
+                failures += out[k] != (x * vb[k] * 2 + 255) / 510;
+            }
+
+            // Dither: value and error x, fraction y + k; odd x keeps the error
+            memcpy(out, va, 16);
+            memset(err, x, 16);
+            memset(msk, (x & 1) ? 0 : 0xFF, 16);
+            frameDither(out, vb, msk, err, 16);
+            for (int k = 0; k < 16; k++) {
+                int f = x + vb[k];
+                int expect = x + (f >> 8) > 255 ? 255 : x + (f >> 8);
+                failures += out[k] != expect;
+                failures += err[k] != (msk[k] ? (f & 0xFF) : x);
+            }
+        }
+    }
+
+    return failures;
+}
+
+// Time the kernels against their scalar references
+void frameKernelsBenchmark(unsigned long (*clockUs)(), int iterations, FrameKernelTiming* results) {
+    static uint8_t dst[512 + 16] __attribute__((aligned(16)));
+    static uint8_t a[512 + 16] __attribute__((aligned(16)));
+    static uint8_t b[512 + 16] __attribute__((aligned(16)));
+    static uint8_t mask[512 + 16] __attribute__((aligned(16)));
+    static uint8_t error[512 + 16] __attribute__((aligned(16)));
+    static uint8_t lut[256];
+    uint32_t seed = 1;
+    for (int i = 0; i < 512 + 16; i++) {
+        a[i] = (uint8_t)nextRandom(&seed);
+        b[i] = (uint8_t)nextRandom(&seed);
+    }
+    for (int i = 0; i < 256; i++) {
+        lut[i] = (uint8_t)(255 - i);
+    }
+    memset(mask, 0xFF, sizeof(mask));
+    memset(error, 0x80, sizeof(error));
+
+    // Channel 1 of a frame buffer sits one byte after the start code
+    uint8_t* d = dst + 1;
+    const uint8_t* s = a + 1;
+    const uint8_t* s2 = b + 1;
+    static const char* names[FRAME_KERNEL_COUNT] = { "add", "max", "scale", "lerp", "lut", "dither" };
+    static const bool scalarOnly[FRAME_KERNEL_COUNT] = {
+        true, false, !FRAME_KERNELS_PIE, true, false, !FRAME_KERNELS_PIE
+    };
+
+    for (int k = 0; k < FRAME_KERNEL_COUNT; k++) {
+        unsigned long start = clockUs();
+        for (int n = 0; n < iterations; n++) {
+            switch (k) {
+                case 0: frameAddSaturate(d, s, 512); break;
+                case 1: frameMax(d, s, 512); break;
+                case 2: frameScale(d, s, (uint8_t)n, 512); break;
+                case 3: frameLerp(d, s, s2, (uint8_t)n, 512); break;
+                case 4: frameLut(d, s, lut, 512); break;
+                default: frameDither(d, s, mask + 1, error + 1, 512); break;
+            }
+        }
+        unsigned long mid = clockUs();
+        for (int n = 0; n < iterations; n++) {
+            switch (k) {
+                case 0: frameAddSaturateScalar(d, s, 512); break;
+                case 1: frameMaxScalar(d, s, 512); break;
+                case 2: frameScaleScalar(d, s, (uint8_t)n, 512); break;
+                case 3: frameLerpScalar(d, s, s2, (uint8_t)n, 512); break;
+                case 4: frameLutScalar(d, s, lut, 512); break;
+                default: frameDitherScalar(d, s, mask + 1, error + 1, 512); break;
+            }
+        }
+        unsigned long end = clockUs();
+
+        results[k].name = names[k];
+        results[k].kernelUs = (uint32_t)(mid - start);
+        results[k].scalarUs = (uint32_t)(end - mid);
+        results[k].scalarOnly = scalarOnly[k];
+    }
+}
@@ -0,0 +1,107 @@
+/**
+ * FrameKernels.h - Byte-wise channel kernels for DMX frames
+ *
+ * Merging, master scaling, crossfades, curves and temporal dithering are
+ * all per-channel loops over up to 512 bytes. Each kernel uses whichever
+ * form measured fastest:
+ *
+ * - Scale and dither run on the ESP32-S3 PIE vector unit, 16 channels per
+ *   128-bit operation, when every array shares dst's alignment within 16
+ *   bytes (e.g. all at channel 1 of 16-byte aligned frame buffers). The
+ *   head, the tail and other targets use the scalar loop. Not every IDF
+ *   version saves the vector registers on a task switch, so two tasks on
+ *   one core must not run these kernels at the same time.
+ * - Max and LUT process four channels per 32-bit word (SWAR: carries and
+ *   borrows stay inside each byte lane) when dst and src share a word
+ *   alignment.
+ * - Add and lerp are the scalar loop: the word versions lost to it.
+ *
+ * Each kernel has a plain scalar reference with identical results.
+ * frameKernelsSelfTest() cross-checks the two and frameKernelsBenchmark()
+ * times them; tools/kernels runs both on a host, and the "kernels"
+ * console command on the board. dst may equal src.
+ *
+ * No Arduino dependencies.
+ */
+
+#ifndef FRAME_KERNELS_H
+#define FRAME_KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * dst[i] = min(dst[i] + src[i], 255)
+ */
+void frameAddSaturate(uint8_t* dst, const uint8_t* src, size_t count);
+
+/**
+ * dst[i] = max(dst[i], src[i]) (highest-takes-precedence merge)
+ */
+void frameMax(uint8_t* dst, const uint8_t* src, size_t count);
+
+/**
+ * dst[i] = src[i] * scale / 255, rounded (master / submaster)
+ */
+void frameScale(uint8_t* dst, const uint8_t* src, uint8_t scale, size_t count);
+
+/**
+ * dst[i] = (a[i] * (255 - t) + b[i] * t) / 255, rounded (crossfade)
+ */
+void frameLerp(uint8_t* dst, const uint8_t* a, const uint8_t* b, uint8_t t, size_t count);
+
+/**
+ * dst[i] = lut[src[i]] (dimmer curves, gamma)
+ */
+void frameLut(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t count);
+
+/**
+ * Temporal dither: adds the fraction below each 8-bit value plus the error
+ * carried from the previous frame, and keeps the new remainder (first-order
+ * error diffusion from frame to frame, so the average over frames is the
+ * 16-bit value):
+ *   f = fraction[i] + error[i]; dst[i] = min(dst[i] + (f >> 8), 255)
+ *   error[i] = f & 0xFF where mask[i] is 0xFF; elsewhere error[i] is kept
+ * A kept error of 0x80 rounds the fraction to nearest instead.
+ * fraction, mask and error must share dst's alignment for the vector path.
+ *
+ * @return True if any masked channel has a fraction (more frames differ)
+ */
+bool frameDither(uint8_t* dst, const uint8_t* fraction, const uint8_t* mask, uint8_t* error, size_t count);
+
+// Scalar references (same results, one channel at a time)
+void frameAddSaturateScalar(uint8_t* dst, const uint8_t* src, size_t count);
+void frameMaxScalar(uint8_t* dst, const uint8_t* src, size_t count);
+void frameScaleScalar(uint8_t* dst, const uint8_t* src, uint8_t scale, size_t count);
+void frameLerpScalar(uint8_t* dst, const uint8_t* a, const uint8_t* b, uint8_t t, size_t count);
+void frameLutScalar(uint8_t* dst, const uint8_t* src, const uint8_t* lut, size_t count);
+bool frameDitherScalar(uint8_t* dst, const uint8_t* fraction, const uint8_t* mask, uint8_t* error, size_t count);
+
+/**
+ * Cross-check every kernel against its scalar reference over every offset
+ * within a vector and a range of lengths
+ *
+ * @return Number of mismatching cases (0 = pass)
+ */
+int frameKernelsSelfTest();
+
+#define FRAME_KERNEL_COUNT 6
+
+// Per-kernel timing from frameKernelsBenchmark()
+struct FrameKernelTiming {
+    const char* name;
+    uint32_t kernelUs;   // Total for all iterations
+    uint32_t scalarUs;
+    bool scalarOnly;     // Kernel is the scalar loop on this target: the two times are the same code
+};
+
+/**
+ * Time each kernel and its scalar reference over a 512-channel frame
+ *
+ * @param clockUs Microsecond clock (micros on the device)
+ * @param iterations Frames per kernel
+ * @param results Array of FRAME_KERNEL_COUNT entries
+ */
+void frameKernelsBenchmark(unsigned long (*clockUs)(), int iterations, FrameKernelTiming* results);
+
+#endif // FRAME_KERNELS_H
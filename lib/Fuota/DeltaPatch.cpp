@@ -0,0 +1,199 @@
+/**
+ * DeltaPatch.cpp - Implementation of the delta patch applier
+ */
+
+#include "DeltaPatch.h"
+#include <string.h>
+
+// Read a little endian 32-bit value
+static uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Streaming cursor over the patch file
+struct PatchCursor {
+    DeltaReader* reader;
+    uint32_t offset;
+    uint32_t size;
+
+    bool readBytes(uint8_t* data, size_t length) {
+        if (length > size - offset) {
+            return false;
+        }
+        if (!reader->read(offset, data, length)) {
+            return false;
+        }
+        offset += length;
+        return true;
+    }
+
+    bool readVarint(uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b;
+            if (!readBytes(&b, 1)) {
+                return false;
+            }
+            value |= (uint32_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;  // Varint longer than 32 bits
+    }
+};
+
+// Incremental CRC-32 (IEEE 802.3), nibble table to keep flash use small
+uint32_t deltaCrc32(uint32_t crc, const uint8_t* data, size_t length) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+// Check whether a buffer starts with a delta patch header
+bool isDeltaPatch(const uint8_t* data, size_t length) {
+    return length >= DELTA_HEADER_SIZE && memcmp(data, DELTA_PATCH_MAGIC, 4) == 0;
+}
+
+// Parse the patch header
+DeltaResult readDeltaHeader(DeltaReader& patch, uint32_t patchSize, DeltaHeader& header) {
+    uint8_t raw[DELTA_HEADER_SIZE];
+    if (patchSize < DELTA_HEADER_SIZE || !patch.read(0, raw, sizeof(raw))) {
+        return DELTA_BAD_HEADER;
+    }
+    if (!isDeltaPatch(raw, sizeof(raw))) {
+        return DELTA_BAD_HEADER;
+    }
+
+    header.sourceSize = readLe32(raw + 4);
+    header.sourceCrc = readLe32(raw + 8);
+    header.targetSize = readLe32(raw + 12);
+    header.targetCrc = readLe32(raw + 16);
+    return DELTA_OK;
+}
+
+// Rebuild the target image from the source image and a patch
+DeltaResult applyDeltaPatch(DeltaReader& patch, uint32_t patchSize,
+                            DeltaReader& source, DeltaWriter& target) {
+    DeltaHeader header;
+    DeltaResult result = readDeltaHeader(patch, patchSize, header);
+    if (result != DELTA_OK) {
+        return result;
+    }
+
+    uint8_t chunk[DELTA_CHUNK_SIZE];
+    uint8_t literal[DELTA_CHUNK_SIZE];
+
+    // Refuse to touch the target unless we are patching the right image
+    uint32_t sourceCrc = 0;
+    for (uint32_t offset = 0; offset < header.sourceSize; offset += DELTA_CHUNK_SIZE) {
+        uint32_t length = header.sourceSize - offset;
+        if (length > DELTA_CHUNK_SIZE) length = DELTA_CHUNK_SIZE;
+        if (!source.read(offset, chunk, length)) {
+            return DELTA_IO_ERROR;
+        }
+        sourceCrc = deltaCrc32(sourceCrc, chunk, length);
+    }
+    if (sourceCrc != header.sourceCrc) {
+        return DELTA_SOURCE_MISMATCH;
+    }
+
+    PatchCursor cursor;
+    cursor.reader = &patch;
+    cursor.offset = DELTA_HEADER_SIZE;
+    cursor.size = patchSize;
+
+    uint32_t written = 0;
+    uint32_t targetCrc = 0;
+
+    while (true) {
+        uint8_t op;
+        if (!cursor.readBytes(&op, 1)) {
+            return DELTA_CORRUPT;
+        }
+        if (op == DELTA_OP_END) {
+            break;
+        }
+
+        uint32_t srcOffset = 0;
+        uint32_t length = 0;
+        if (op == DELTA_OP_COPY || op == DELTA_OP_DIFF) {
+            if (!cursor.readVarint(srcOffset)) {
+                return DELTA_CORRUPT;
+            }
+        } else if (op != DELTA_OP_ADD) {
+            return DELTA_CORRUPT;
+        }
+        if (!cursor.readVarint(length)) {
+            return DELTA_CORRUPT;
+        }
+
+        // Bounds against the header sizes before reading or writing anything
+        if (length > header.targetSize - written) {
+            return DELTA_CORRUPT;
+        }
+        if (op != DELTA_OP_ADD &&
+            (srcOffset > header.sourceSize || length > header.sourceSize - srcOffset)) {
+            return DELTA_CORRUPT;
+        }
+
+        while (length > 0) {
+            uint32_t step = length > DELTA_CHUNK_SIZE ? DELTA_CHUNK_SIZE : length;
+
+            if (op == DELTA_OP_ADD) {
+                if (!cursor.readBytes(chunk, step)) {
+                    return DELTA_CORRUPT;
+                }
+            } else {
+                if (!source.read(srcOffset, chunk, step)) {
+                    return DELTA_IO_ERROR;
+                }
+                if (op == DELTA_OP_DIFF) {
+                    if (!cursor.readBytes(literal, step)) {
+                        return DELTA_CORRUPT;
+                    }
+                    for (uint32_t i = 0; i < step; i++) {
+                        chunk[i] = (uint8_t)(chunk[i] + literal[i]);
+                    }
+                }
+                srcOffset += step;
+            }
+
+            if (!target.write(chunk, step)) {
+                return DELTA_IO_ERROR;
+            }
+            targetCrc = deltaCrc32(targetCrc, chunk, step);
+            written += step;
+            length -= step;
+        }
+    }
+
+    if (written != header.targetSize || targetCrc != header.targetCrc) {
+        return DELTA_TARGET_MISMATCH;
+    }
+    return DELTA_OK;
+}
+
+// Human readable name of a result code
+const char* deltaResultName(DeltaResult result) {
+    switch (result) {
+        case DELTA_OK: return "OK";
+        case DELTA_BAD_HEADER: return "BAD_HEADER";
+        case DELTA_SOURCE_MISMATCH: return "SOURCE_MISMATCH";
+        case DELTA_CORRUPT: return "CORRUPT";
+        case DELTA_IO_ERROR: return "IO_ERROR";
+        case DELTA_TARGET_MISMATCH: return "TARGET_MISMATCH";
+        default: return "UNKNOWN";
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * DeltaPatch.h - Apply binary delta patches against the running image
+ *
+ * A delta patch rebuilds a new firmware image from the running one, so an
+ * update only has to carry what actually changed. The format is a small
+ * header followed by a stream of operations:
+ *
+ *   Header (20 bytes, little endian):
+ *     "LDP1" | sourceSize | sourceCrc32 | targetSize | targetCrc32
+ *
+ *   Operations (lengths and offsets are LEB128 varints):
+ *     0x00                       END
+ *     0x01 srcOffset len         COPY  len bytes from the source image
+ *     0x02 len bytes...          ADD   len literal bytes
+ *     0x03 srcOffset len bytes...DIFF  len bytes of source + delta (mod 256)
+ *
+ * DIFF is what keeps patches small for recompiled code: a function that only
+ * moved shifts many embedded addresses by the same amount, and the byte-wise
+ * difference is mostly zeros.
+ *
+ * The target is written strictly sequentially. The source must match the
+ * CRC in the header before anything is written, and the target CRC is checked
+ * once the stream ends. No Arduino dependencies, so patches can be applied
+ * and verified on a host.
+ */
+
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DELTA_PATCH_MAGIC "LDP1"
+#define DELTA_HEADER_SIZE 20
+#define DELTA_CHUNK_SIZE 256  // Working buffer for streaming copies
+
+#define DELTA_OP_END 0x00
+#define DELTA_OP_COPY 0x01
+#define DELTA_OP_ADD 0x02
+#define DELTA_OP_DIFF 0x03
+
+/**
+ * Random access reader (patch file or source image)
+ */
+class DeltaReader {
+public:
+    virtual ~DeltaReader() {}
+    virtual bool read(uint32_t offset, uint8_t* data, size_t length) = 0;
+};
+
+/**
+ * Sequential writer for the target image
+ */
+class DeltaWriter {
+public:
+    virtual ~DeltaWriter() {}
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+};
+
+enum DeltaResult {
+    DELTA_OK = 0,
+    DELTA_BAD_HEADER,        // Magic missing or patch too short
+    DELTA_SOURCE_MISMATCH,   // Running image is not the one the patch was made against
+    DELTA_CORRUPT,           // Malformed operation stream
+    DELTA_IO_ERROR,          // Reader or writer failed
+    DELTA_TARGET_MISMATCH    // Rebuilt image does not match the expected CRC
+};
+
+struct DeltaHeader {
+    uint32_t sourceSize;
+    uint32_t sourceCrc;
+    uint32_t targetSize;
+    uint32_t targetCrc;
+};
+
+/**
+ * Check whether a buffer starts with a delta patch header
+ */
+bool isDeltaPatch(const uint8_t* data, size_t length);
+
+/**
+ * Parse the patch header
+ *
+ * @return DELTA_OK or DELTA_BAD_HEADER
+ */
+DeltaResult readDeltaHeader(DeltaReader& patch, uint32_t patchSize, DeltaHeader& header);
+
+/**
+ * Rebuild the target image from the source image and a patch
+ *
+ * @param patch Reader for the patch file
+ * @param patchSize Size of the patch file in bytes
+ * @param source Reader for the running image
+ * @param target Sequential writer for the new image
+ * @return DELTA_OK if the target was written and its CRC matched
+ */
+DeltaResult applyDeltaPatch(DeltaReader& patch, uint32_t patchSize,
+                            DeltaReader& source, DeltaWriter& target);
+
+/**
+ * Incremental CRC-32 (IEEE 802.3, as used by zlib)
+ *
+ * Start with crc = 0 and feed the previous result back in.
+ */
+uint32_t deltaCrc32(uint32_t crc, const uint8_t* data, size_t length);
+
+/**
+ * Human readable name of a result code
+ */
+const char* deltaResultName(DeltaResult result);
+
+#endif // DELTA_PATCH_H
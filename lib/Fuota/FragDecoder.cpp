@@ -0,0 +1,325 @@
+/**
+ * FragDecoder.cpp - Implementation of TS004 fragment reassembly with FEC
+ */
+
+#include "FragDecoder.h"
+#include <string.h>
+
+// PRBS23 step from the TS004 parity matrix definition
+static uint32_t prbs23(uint32_t x) {
+    uint32_t b0 = x & 1;
+    uint32_t b1 = (x & 32) >> 5;
+    return (x >> 1) + ((b0 ^ b1) << 22);
+}
+
+// Constructor
+FragDecoder::FragDecoder() {
+    _storage = NULL;
+    _nbFrag = 0;
+    _fragSize = 0;
+    _rowBytes = 0;
+    _maxRows = 0;
+    _status = FRAG_STATUS_ERROR;
+    _outOfRowMemory = false;
+    _receivedCount = 0;
+    _missingCount = 0;
+    _rowsUsed = 0;
+
+    _received = NULL;
+    _pivot = NULL;
+    _rowBits = NULL;
+    _rowData = NULL;
+    _scratchBits = NULL;
+    _scratchData = NULL;
+    _fragBuffer = NULL;
+}
+
+// Destructor
+FragDecoder::~FragDecoder() {
+    end();
+}
+
+// Start a new reassembly session
+bool FragDecoder::begin(FragStorage* storage, uint16_t nbFrag, uint8_t fragSize, uint16_t maxParityRows) {
+    end();
+
+    if (storage == NULL || nbFrag == 0 || nbFrag > FRAG_MAX_FRAGMENTS ||
+        fragSize == 0 || fragSize > FRAG_MAX_FRAG_SIZE) {
+        _status = FRAG_STATUS_ERROR;
+        return false;
+    }
+    if (maxParityRows > nbFrag) maxParityRows = nbFrag;
+
+    _storage = storage;
+    _nbFrag = nbFrag;
+    _fragSize = fragSize;
+    _rowBytes = (nbFrag + 7) / 8;
+    _maxRows = maxParityRows;
+
+    _received = new uint8_t[_rowBytes];
+    _pivot = new int16_t[nbFrag];
+    _rowBits = new uint8_t[(size_t)_maxRows * _rowBytes];
+    _rowData = new uint8_t[(size_t)_maxRows * fragSize];
+    _scratchBits = new uint8_t[_rowBytes];
+    _scratchData = new uint8_t[fragSize];
+    _fragBuffer = new uint8_t[fragSize];
+
+    memset(_received, 0, _rowBytes);
+    for (uint16_t i = 0; i < nbFrag; i++) {
+        _pivot[i] = -1;
+    }
+
+    _receivedCount = 0;
+    _missingCount = nbFrag;
+    _rowsUsed = 0;
+    _outOfRowMemory = false;
+    _status = FRAG_STATUS_IN_PROGRESS;
+    return true;
+}
+
+// Release the session buffers
+void FragDecoder::end() {
+    delete[] _received;
+    delete[] _pivot;
+    delete[] _rowBits;
+    delete[] _rowData;
+    delete[] _scratchBits;
+    delete[] _scratchData;
+    delete[] _fragBuffer;
+
+    _received = NULL;
+    _pivot = NULL;
+    _rowBits = NULL;
+    _rowData = NULL;
+    _scratchBits = NULL;
+    _scratchData = NULL;
+    _fragBuffer = NULL;
+    _storage = NULL;
+}
+
+// Generate one row of the TS004 parity matrix
+void FragDecoder::parityMatrixRow(uint16_t n, uint16_t m, uint8_t* row) {
+    memset(row, 0, (m + 7) / 8);
+    if (m == 0) {
+        return;
+    }
+
+    // The spec widens the modulus by one when M is a power of two
+    uint32_t mm = ((m & (m - 1)) == 0) ? 1 : 0;
+    uint32_t x = 1 + 1001u * n;
+
+    for (uint16_t nbCoeff = 0; nbCoeff < m / 2; nbCoeff++) {
+        uint32_t r = 1u << 16;
+        while (r >= m) {
+            x = prbs23(x);
+            r = x % (m + mm);
+        }
+        row[r >> 3] |= (uint8_t)(1 << (r & 7));
+    }
+
+    // M = 1 has no coefficients from the loop; the single fragment is repeated
+    if (m == 1) {
+        row[0] = 1;
+    }
+}
+
+// Mark an uncoded fragment as known
+void FragDecoder::setKnown(uint16_t frag) {
+    _received[frag >> 3] |= (uint8_t)(1 << (frag & 7));
+    _missingCount--;
+}
+
+// Lowest set bit of a row, or -1 if the row is empty
+int FragDecoder::lowestBit(const uint8_t* bits) const {
+    for (uint16_t byteIndex = 0; byteIndex < _rowBytes; byteIndex++) {
+        uint8_t b = bits[byteIndex];
+        if (b != 0) {
+            int bit = 0;
+            while (((b >> bit) & 1) == 0) bit++;
+            int frag = byteIndex * 8 + bit;
+            return frag < _nbFrag ? frag : -1;
+        }
+    }
+    return -1;
+}
+
+// XOR a stored fragment into a buffer
+bool FragDecoder::xorFragment(uint16_t frag, uint8_t* dest) {
+    if (!_storage->read((uint32_t)frag * _fragSize, _fragBuffer, _fragSize)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < _fragSize; i++) {
+        dest[i] ^= _fragBuffer[i];
+    }
+    return true;
+}
+
+// Process one fragment
+FragStatus FragDecoder::process(uint16_t index, const uint8_t* data) {
+    if (_status != FRAG_STATUS_IN_PROGRESS || index == 0 || data == NULL) {
+        return _status;
+    }
+
+    _receivedCount++;
+    if (index <= _nbFrag) {
+        _status = processUncoded(index - 1, data);
+    } else {
+        _status = processCoded(index - _nbFrag, data);
+    }
+
+    if (_status == FRAG_STATUS_IN_PROGRESS && _missingCount == 0) {
+        _status = FRAG_STATUS_COMPLETE;
+    }
+    return _status;
+}
+
+// Handle an uncoded fragment, substituting it into any stored rows
+FragStatus FragDecoder::processUncoded(uint16_t frag, const uint8_t* data) {
+    if (isKnown(frag)) {
+        return FRAG_STATUS_IN_PROGRESS;  // Duplicate
+    }
+    if (!_storage->write((uint32_t)frag * _fragSize, data, _fragSize)) {
+        return FRAG_STATUS_ERROR;
+    }
+    setKnown(frag);
+
+    if (_rowsUsed == 0) {
+        return FRAG_STATUS_IN_PROGRESS;
+    }
+
+    // Rows that referenced this fragment as a non-pivot just drop the term
+    uint8_t mask = (uint8_t)(1 << (frag & 7));
+    int16_t pivotSlot = _pivot[frag];
+    for (uint16_t slot = 0; slot < _rowsUsed; slot++) {
+        uint8_t* bits = _rowBits + (size_t)slot * _rowBytes;
+        if (slot != pivotSlot && (bits[frag >> 3] & mask)) {
+            bits[frag >> 3] &= ~mask;
+            uint8_t* rowData = _rowData + (size_t)slot * _fragSize;
+            for (uint8_t i = 0; i < _fragSize; i++) {
+                rowData[i] ^= data[i];
+            }
+        }
+    }
+
+    // The row pivoting on this fragment loses its pivot and is re-inserted
+    if (pivotSlot >= 0) {
+        _pivot[frag] = -1;
+        memcpy(_scratchBits, _rowBits + (size_t)pivotSlot * _rowBytes, _rowBytes);
+        memcpy(_scratchData, _rowData + (size_t)pivotSlot * _fragSize, _fragSize);
+        _scratchBits[frag >> 3] &= ~mask;
+        for (uint8_t i = 0; i < _fragSize; i++) {
+            _scratchData[i] ^= data[i];
+        }
+
+        // Move the last row into the freed slot to keep the table dense
+        uint16_t last = _rowsUsed - 1;
+        if ((uint16_t)pivotSlot != last) {
+            memcpy(_rowBits + (size_t)pivotSlot * _rowBytes, _rowBits + (size_t)last * _rowBytes, _rowBytes);
+            memcpy(_rowData + (size_t)pivotSlot * _fragSize, _rowData + (size_t)last * _fragSize, _fragSize);
+            int lastPivot = lowestBit(_rowBits + (size_t)pivotSlot * _rowBytes);
+            if (lastPivot >= 0) {
+                _pivot[lastPivot] = pivotSlot;
+            }
+        }
+        _rowsUsed--;
+        insertScratchRow();
+    }
+
+    if (_rowsUsed > 0 && _rowsUsed == _missingCount) {
+        return solve() ? FRAG_STATUS_IN_PROGRESS : FRAG_STATUS_ERROR;
+    }
+    return FRAG_STATUS_IN_PROGRESS;
+}
+
+// Handle a redundancy fragment
+FragStatus FragDecoder::processCoded(uint16_t n, const uint8_t* data) {
+    if (_missingCount == 0) {
+        return FRAG_STATUS_IN_PROGRESS;  // Nothing left to recover
+    }
+
+    parityMatrixRow(n, _nbFrag, _scratchBits);
+    memcpy(_scratchData, data, _fragSize);
+
+    // Substitute every fragment we already hold
+    for (uint16_t frag = 0; frag < _nbFrag; frag++) {
+        uint8_t mask = (uint8_t)(1 << (frag & 7));
+        if ((_scratchBits[frag >> 3] & mask) && isKnown(frag)) {
+            if (!xorFragment(frag, _scratchData)) {
+                return FRAG_STATUS_ERROR;
+            }
+            _scratchBits[frag >> 3] &= ~mask;
+        }
+    }
+
+    if (!insertScratchRow()) {
+        // Either redundant (fine) or dropped because every row slot is taken
+        if (_rowsUsed >= _maxRows && _missingCount > _rowsUsed) {
+            _outOfRowMemory = true;
+        }
+        return FRAG_STATUS_IN_PROGRESS;
+    }
+
+    if (_rowsUsed == _missingCount) {
+        return solve() ? FRAG_STATUS_IN_PROGRESS : FRAG_STATUS_ERROR;
+    }
+    return FRAG_STATUS_IN_PROGRESS;
+}
+
+// Reduce the scratch row by the stored pivots and keep it if independent
+bool FragDecoder::insertScratchRow() {
+    int frag = lowestBit(_scratchBits);
+    while (frag >= 0 && _pivot[frag] >= 0) {
+        const uint8_t* bits = _rowBits + (size_t)_pivot[frag] * _rowBytes;
+        const uint8_t* rowData = _rowData + (size_t)_pivot[frag] * _fragSize;
+        for (uint16_t i = 0; i < _rowBytes; i++) {
+            _scratchBits[i] ^= bits[i];
+        }
+        for (uint8_t i = 0; i < _fragSize; i++) {
+            _scratchData[i] ^= rowData[i];
+        }
+        frag = lowestBit(_scratchBits);
+    }
+
+    if (frag < 0 || _rowsUsed >= _maxRows) {
+        return false;  // Linearly dependent, or no room left
+    }
+
+    uint16_t slot = _rowsUsed++;
+    memcpy(_rowBits + (size_t)slot * _rowBytes, _scratchBits, _rowBytes);
+    memcpy(_rowData + (size_t)slot * _fragSize, _scratchData, _fragSize);
+    _pivot[frag] = slot;
+    return true;
+}
+
+// Back-substitute once every missing fragment has a pivot row
+bool FragDecoder::solve() {
+    // Highest pivot first: every other term in its row is already solved
+    for (int frag = _nbFrag - 1; frag >= 0; frag--) {
+        if (isKnown(frag)) {
+            continue;
+        }
+        int16_t slot = _pivot[frag];
+        if (slot < 0) {
+            return true;  // Not solvable yet; wait for more fragments
+        }
+
+        uint8_t* bits = _rowBits + (size_t)slot * _rowBytes;
+        memcpy(_scratchData, _rowData + (size_t)slot * _fragSize, _fragSize);
+        for (uint16_t other = frag + 1; other < _nbFrag; other++) {
+            if ((bits[other >> 3] >> (other & 7)) & 1) {
+                if (!xorFragment(other, _scratchData)) {
+                    return false;
+                }
+            }
+        }
+
+        if (!_storage->write((uint32_t)frag * _fragSize, _scratchData, _fragSize)) {
+            return false;
+        }
+        setKnown(frag);
+        _pivot[frag] = -1;
+    }
+
+    _rowsUsed = 0;
+    return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * FragDecoder.h - LoRaWAN fragmented data block reassembly with FEC
+ *
+ * Implements the receiving side of the LoRaWAN Fragmented Data Block
+ * Transport (TS004): M uncoded fragments followed by redundancy fragments,
+ * each an XOR of roughly M/2 uncoded fragments chosen by the spec's PRBS23
+ * parity matrix. Lost uncoded fragments are recovered by online Gaussian
+ * elimination over GF(2) as redundancy fragments arrive.
+ *
+ * Fragments are written straight to a FragStorage (the inactive OTA
+ * partition on target, a RAM buffer on the host), so the decoder itself only
+ * holds bitmaps and the parity rows that are still needed.
+ *
+ * This file has no Arduino dependencies so reassembly can be exercised on a
+ * host with simulated fragment loss.
+ */
+
+#ifndef FRAG_DECODER_H
+#define FRAG_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Decoder limits, sized for delta patches. A session holds at most
+// FRAG_MAX_FRAGMENTS x fragment size bytes (100 KB at 49-byte fragments,
+// 495 KB at 242), which is short of a full ~1 MB firmware image. At most
+// FRAG_MAX_PARITY_ROWS uncoded fragments can be recovered by redundancy, so
+// at 10% loss a session of more than about 600 fragments stalls.
+#define FRAG_MAX_FRAGMENTS 2048   // Max uncoded fragments per session (M)
+#define FRAG_MAX_FRAG_SIZE 242    // Max fragment size (largest LoRaWAN payload)
+#define FRAG_MAX_PARITY_ROWS 64   // Max stored equations for lost fragments
+
+/**
+ * Random access storage for the reassembled file
+ */
+class FragStorage {
+public:
+    virtual ~FragStorage() {}
+
+    /**
+     * Write bytes at an offset of the file
+     */
+    virtual bool write(uint32_t offset, const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Read bytes back from an offset of the file
+     */
+    virtual bool read(uint32_t offset, uint8_t* data, size_t length) = 0;
+};
+
+enum FragStatus {
+    FRAG_STATUS_IN_PROGRESS = 0,  // Waiting for more fragments
+    FRAG_STATUS_COMPLETE,         // All uncoded fragments present in storage
+    FRAG_STATUS_ERROR             // Bad parameters or storage failure
+};
+
+class FragDecoder {
+public:
+    FragDecoder();
+    ~FragDecoder();
+
+    /**
+     * Start a new reassembly session
+     *
+     * @param storage Destination for the file (must outlive the session)
+     * @param nbFrag Number of uncoded fragments (M)
+     * @param fragSize Size of each fragment in bytes
+     * @param maxParityRows Parity rows to reserve (caps the number of lost fragments)
+     * @return True if the session buffers were allocated
+     */
+    bool begin(FragStorage* storage, uint16_t nbFrag, uint8_t fragSize,
+               uint16_t maxParityRows = FRAG_MAX_PARITY_ROWS);
+
+    /**
+     * Release the session buffers
+     */
+    void end();
+
+    /**
+     * Process one fragment
+     *
+     * @param index Fragment number starting at 1; numbers above nbFrag are redundancy fragments
+     * @param data Fragment payload (fragSize bytes)
+     * @return Session status after this fragment
+     */
+    FragStatus process(uint16_t index, const uint8_t* data);
+
+    FragStatus getStatus() const { return _status; }
+    uint16_t getNbFrag() const { return _nbFrag; }
+    uint8_t getFragSize() const { return _fragSize; }
+
+    /**
+     * Number of fragments received (uncoded and redundancy)
+     */
+    uint16_t getReceivedCount() const { return _receivedCount; }
+
+    /**
+     * Uncoded fragments not yet received or recovered
+     */
+    uint16_t getMissingCount() const { return _missingCount; }
+
+    /**
+     * Parity rows currently held for lost fragments
+     */
+    uint16_t getParityRowsUsed() const { return _rowsUsed; }
+
+    /**
+     * True if a useful redundancy fragment was dropped for lack of row memory
+     */
+    bool isOutOfRowMemory() const { return _outOfRowMemory; }
+
+    /**
+     * Generate one row of the TS004 parity matrix
+     *
+     * Public so host tools can build redundancy fragments the way the
+     * server does.
+     *
+     * @param n Redundancy fragment number starting at 1 (index - nbFrag)
+     * @param m Number of uncoded fragments
+     * @param row Output bit vector of m bits (LSB first)
+     */
+    static void parityMatrixRow(uint16_t n, uint16_t m, uint8_t* row);
+
+private:
+    FragStorage* _storage;
+    uint16_t _nbFrag;
+    uint8_t _fragSize;
+    uint16_t _rowBytes;        // Bytes per bit vector over M
+    uint16_t _maxRows;
+    FragStatus _status;
+    bool _outOfRowMemory;
+
+    uint16_t _receivedCount;
+    uint16_t _missingCount;
+    uint16_t _rowsUsed;
+
+    uint8_t* _received;        // Bitmap of known uncoded fragments
+    int16_t* _pivot;           // Parity row slot whose lowest set bit is this fragment, or -1
+    uint8_t* _rowBits;         // _maxRows bit vectors
+    uint8_t* _rowData;         // _maxRows fragment payloads
+    uint8_t* _scratchBits;     // Working row
+    uint8_t* _scratchData;
+    uint8_t* _fragBuffer;      // One fragment read back from storage
+
+    bool isKnown(uint16_t frag) const { return (_received[frag >> 3] >> (frag & 7)) & 1; }
+    void setKnown(uint16_t frag);
+
+    // Handle an uncoded fragment, substituting it into any stored rows
+    FragStatus processUncoded(uint16_t frag, const uint8_t* data);
+
+    // Handle a redundancy fragment
+    FragStatus processCoded(uint16_t n, const uint8_t* data);
+
+    // Reduce the scratch row by the stored pivots and keep it if independent
+    bool insertScratchRow();
+
+    // Back-substitute once every missing fragment has a pivot row
+    bool solve();
+
+    // XOR a stored fragment into a buffer
+    bool xorFragment(uint16_t frag, uint8_t* dest);
+
+    // Lowest set bit of a row, or -1 if the row is empty
+    int lowestBit(const uint8_t* bits) const;
+};
+
+#endif // FRAG_DECODER_H
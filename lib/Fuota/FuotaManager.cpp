@@ -0,0 +1,187 @@
+/**
+ * FuotaManager.cpp - Implementation of the TS004 fragmentation package
+ */
+
+#include "FuotaManager.h"
+#include <string.h>
+
+// Constructor
+FuotaManager::FuotaManager(FuotaBackend* backend) {
+    _backend = backend;
+    _state = FUOTA_IDLE;
+    _fileSize = 0;
+    _fileType = FUOTA_FILE_FULL_IMAGE;
+}
+
+// Process one downlink of TS004 commands
+size_t FuotaManager::handleDownlink(const uint8_t* data, size_t size, uint8_t* answer) {
+    size_t answerLen = 0;
+    size_t pos = 0;
+
+    // Several commands may be packed into one downlink
+    while (pos < size) {
+        uint8_t cid = data[pos++];
+        size_t used = 0;
+
+        switch (cid) {
+            case FUOTA_CID_PACKAGE_VERSION:
+                if (answerLen + 3 <= FUOTA_MAX_ANSWER_SIZE) {
+                    answer[answerLen++] = FUOTA_CID_PACKAGE_VERSION;
+                    answer[answerLen++] = FUOTA_PACKAGE_IDENTIFIER;
+                    answer[answerLen++] = FUOTA_PACKAGE_VERSION;
+                }
+                break;
+            case FUOTA_CID_FRAG_SESSION_STATUS:
+                used = handleSessionStatus(data + pos, size - pos, answer, answerLen);
+                if (used == 0) return answerLen;
+                break;
+            case FUOTA_CID_FRAG_SESSION_SETUP:
+                used = handleSessionSetup(data + pos, size - pos, answer, answerLen);
+                if (used == 0) return answerLen;
+                break;
+            case FUOTA_CID_FRAG_SESSION_DELETE:
+                used = handleSessionDelete(data + pos, size - pos, answer, answerLen);
+                if (used == 0) return answerLen;
+                break;
+            case FUOTA_CID_DATA_FRAGMENT:
+                // A fragment always runs to the end of the downlink
+                handleDataFragment(data + pos, size - pos);
+                return answerLen;
+            default:
+                // Unknown command: the rest of the frame cannot be parsed
+                return answerLen;
+        }
+        pos += used;
+    }
+
+    return answerLen;
+}
+
+// FragSessionSetupReq: FragSession | NbFrag(2) | FragSize | Control | Padding | Descriptor(4)
+size_t FuotaManager::handleSessionSetup(const uint8_t* data, size_t size, uint8_t* answer, size_t& answerLen) {
+    if (size < 10) {
+        return 0;
+    }
+
+    uint8_t fragIndex = (data[0] >> 4) & 0x03;
+    uint16_t nbFrag = data[1] | (data[2] << 8);
+    uint8_t fragSize = data[3];
+    uint8_t fragAlgo = (data[4] >> 3) & 0x07;
+    uint8_t padding = data[5];
+    uint8_t fileType = data[6];
+
+    uint8_t status = (uint8_t)(fragIndex << 6);
+    if (fragAlgo != 0) {
+        status |= 0x01;  // Only the parity-check FEC is supported
+    }
+    if (nbFrag == 0 || nbFrag > FRAG_MAX_FRAGMENTS || fragSize == 0 ||
+        fragSize > FRAG_MAX_FRAG_SIZE || padding >= fragSize) {
+        status |= 0x02;  // Not enough memory
+    }
+    if (fragIndex != 0 || _state == FUOTA_VERIFYING) {
+        status |= 0x04;  // One session at a time, and not while one is being verified
+    }
+    if (fileType != FUOTA_FILE_FULL_IMAGE && fileType != FUOTA_FILE_DELTA_PATCH) {
+        status |= 0x08;  // Wrong descriptor
+    }
+
+    if ((status & 0x0F) == 0) {
+        uint32_t fileSize = (uint32_t)nbFrag * fragSize - padding;
+        if (!_backend->prepare(fileSize, fileType) || !_decoder.begin(_backend, nbFrag, fragSize)) {
+            status |= 0x02;
+            _state = FUOTA_IDLE;
+        } else {
+            _fileSize = fileSize;
+            _fileType = fileType;
+            _state = FUOTA_RECEIVING;
+        }
+    }
+
+    if (answerLen + 2 <= FUOTA_MAX_ANSWER_SIZE) {
+        answer[answerLen++] = FUOTA_CID_FRAG_SESSION_SETUP;
+        answer[answerLen++] = status;
+    }
+    return 10;
+}
+
+// FragSessionStatusReq: FragStatusReqParam (bit 0 = all participants, bits 2:1 = FragIndex)
+size_t FuotaManager::handleSessionStatus(const uint8_t* data, size_t size, uint8_t* answer, size_t& answerLen) {
+    if (size < 1) {
+        return 0;
+    }
+
+    uint8_t fragIndex = (data[0] >> 1) & 0x03;
+    bool allParticipants = (data[0] & 0x01) != 0;
+    uint16_t missing = _decoder.getMissingCount();
+
+    // Devices with nothing missing stay quiet unless everyone is asked
+    if (fragIndex != 0 || _state == FUOTA_IDLE || (!allParticipants && missing == 0)) {
+        return 1;
+    }
+
+    if (answerLen + 5 <= FUOTA_MAX_ANSWER_SIZE) {
+        uint16_t received = _decoder.getReceivedCount() & 0x3FFF;
+        uint16_t receivedAndIndex = received | ((uint16_t)fragIndex << 14);
+        answer[answerLen++] = FUOTA_CID_FRAG_SESSION_STATUS;
+        answer[answerLen++] = receivedAndIndex & 0xFF;
+        answer[answerLen++] = receivedAndIndex >> 8;
+        answer[answerLen++] = missing > 255 ? 255 : (uint8_t)missing;
+        answer[answerLen++] = _decoder.isOutOfRowMemory() ? 0x01 : 0x00;
+    }
+    return 1;
+}
+
+// FragSessionDeleteReq: Param (bits 1:0 = FragIndex)
+size_t FuotaManager::handleSessionDelete(const uint8_t* data, size_t size, uint8_t* answer, size_t& answerLen) {
+    if (size < 1) {
+        return 0;
+    }
+
+    uint8_t fragIndex = data[0] & 0x03;
+    uint8_t status = fragIndex;
+    if (fragIndex != 0 || _state == FUOTA_IDLE || _state == FUOTA_VERIFYING) {
+        status |= 0x04;  // Session does not exist (or can no longer be deleted)
+    } else {
+        _decoder.end();
+        _state = FUOTA_IDLE;
+    }
+
+    if (answerLen + 2 <= FUOTA_MAX_ANSWER_SIZE) {
+        answer[answerLen++] = FUOTA_CID_FRAG_SESSION_DELETE;
+        answer[answerLen++] = status;
+    }
+    return 1;
+}
+
+// DataFragment: IndexAndN(2) | payload
+size_t FuotaManager::handleDataFragment(const uint8_t* data, size_t size) {
+    if (size < 2 || _state != FUOTA_RECEIVING) {
+        return size;
+    }
+
+    uint16_t indexAndN = data[0] | (data[1] << 8);
+    uint8_t fragIndex = indexAndN >> 14;
+    uint16_t n = indexAndN & 0x3FFF;
+    if (fragIndex != 0 || size - 2 < _decoder.getFragSize()) {
+        return size;
+    }
+
+    FragStatus status = _decoder.process(n, data + 2);
+    if (status == FRAG_STATUS_ERROR) {
+        _state = FUOTA_FAILED;
+    } else if (status == FRAG_STATUS_COMPLETE) {
+        // Verification waits for finalize(), which can take seconds
+        _state = FUOTA_VERIFYING;
+    }
+    return size;
+}
+
+// Verify and activate a complete file
+bool FuotaManager::finalize() {
+    if (_state != FUOTA_VERIFYING) {
+        return false;
+    }
+    bool ok = _backend->finalize(_fileSize, _fileType);
+    _state = ok ? FUOTA_READY : FUOTA_FAILED;
+    return ok;
+}
@@ -0,0 +1,131 @@
+/**
+ * FuotaManager.h - Firmware update over LoRa (fragmented data block transport)
+ *
+ * Handles the LoRaWAN Fragmented Data Block Transport commands (TS004
+ * package 3, version 1): PackageVersion, FragSessionSetup, FragSessionStatus,
+ * FragSessionDelete and DataFragment. Fragments go through FragDecoder into a
+ * FuotaBackend. Once the file is complete the session waits in
+ * FUOTA_VERIFYING until finalize() has the backend verify it (applying it
+ * first when it is a delta patch) and select it for the next boot. That
+ * takes seconds on flash, so the firmware calls it from a worker task
+ * rather than the downlink path.
+ *
+ * The session Descriptor selects the file type: byte 0 = 0 for a full image,
+ * 1 for a delta patch against the running image (see DeltaPatch.h).
+ *
+ * The downlink callback does not report the FPort, so TS004 commands are sent
+ * on the application port behind a FUOTA_DOWNLINK_TAG byte. Answers go out
+ * untagged on FUOTA_PORT, as the spec expects.
+ */
+
+#ifndef FUOTA_MANAGER_H
+#define FUOTA_MANAGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "FragDecoder.h"
+
+#define FUOTA_PORT 201               // TS004 uplink port
+#define FUOTA_DOWNLINK_TAG 0xD0      // Prefix for TS004 commands on the application port
+#define FUOTA_MAX_ANSWER_SIZE 16     // Largest combined answer we build per downlink
+
+// TS004 command identifiers
+#define FUOTA_CID_PACKAGE_VERSION 0x00
+#define FUOTA_CID_FRAG_SESSION_STATUS 0x01
+#define FUOTA_CID_FRAG_SESSION_SETUP 0x02
+#define FUOTA_CID_FRAG_SESSION_DELETE 0x03
+#define FUOTA_CID_DATA_FRAGMENT 0x08
+
+#define FUOTA_PACKAGE_IDENTIFIER 3
+#define FUOTA_PACKAGE_VERSION 1
+
+// File types carried in descriptor byte 0
+#define FUOTA_FILE_FULL_IMAGE 0
+#define FUOTA_FILE_DELTA_PATCH 1
+
+enum FuotaState {
+    FUOTA_IDLE = 0,
+    FUOTA_RECEIVING,     // Session set up, fragments arriving
+    FUOTA_VERIFYING,     // File complete, backend verifying/applying
+    FUOTA_READY,         // New image selected for the next boot
+    FUOTA_FAILED         // Verification or storage failed
+};
+
+/**
+ * Storage and activation for a received file
+ */
+class FuotaBackend : public FragStorage {
+public:
+    /**
+     * Reserve room for a file of the given size
+     *
+     * Delta patches must be placed where rebuilding the target image
+     * cannot overwrite them.
+     */
+    virtual bool prepare(uint32_t fileSize, uint8_t fileType) = 0;
+
+    /**
+     * Verify the complete file, apply it if it is a delta patch, and
+     * select the new image for the next boot
+     */
+    virtual bool finalize(uint32_t fileSize, uint8_t fileType) = 0;
+};
+
+class FuotaManager {
+public:
+    /**
+     * Constructor
+     *
+     * @param backend Storage/activation backend (must outlive the manager)
+     */
+    FuotaManager(FuotaBackend* backend);
+
+    /**
+     * Process one downlink of TS004 commands (tag byte already stripped)
+     *
+     * @param data Command bytes
+     * @param size Number of bytes
+     * @param answer Buffer for the combined answers (FUOTA_MAX_ANSWER_SIZE bytes)
+     * @return Number of answer bytes to uplink on FUOTA_PORT (0 = nothing to send)
+     */
+    size_t handleDownlink(const uint8_t* data, size_t size, uint8_t* answer);
+
+    /**
+     * Verify and activate a complete file (state FUOTA_VERIFYING)
+     *
+     * Reads the whole file and, for a patch, the running image; call it
+     * off the downlink path. Commands that would touch the session are
+     * refused until it returns.
+     *
+     * @return True if the new image was selected for the next boot
+     */
+    bool finalize();
+
+    FuotaState getState() const { return _state; }
+
+    /**
+     * True once a verified image has been selected and the device should reboot
+     */
+    bool isRebootPending() const { return _state == FUOTA_READY; }
+
+    uint16_t getNbFrag() const { return _decoder.getNbFrag(); }
+    uint16_t getReceivedCount() const { return _decoder.getReceivedCount(); }
+    uint16_t getMissingCount() const { return _decoder.getMissingCount(); }
+    uint32_t getFileSize() const { return _fileSize; }
+    uint8_t getFileType() const { return _fileType; }
+
+private:
+    FuotaBackend* _backend;
+    FragDecoder _decoder;
+    volatile FuotaState _state;  // Set by finalize() on the worker task
+    uint32_t _fileSize;
+    uint8_t _fileType;
+
+    // Each handler returns the command length consumed, or 0 if malformed
+    size_t handleSessionSetup(const uint8_t* data, size_t size, uint8_t* answer, size_t& answerLen);
+    size_t handleSessionStatus(const uint8_t* data, size_t size, uint8_t* answer, size_t& answerLen);
+    size_t handleSessionDelete(const uint8_t* data, size_t size, uint8_t* answer, size_t& answerLen);
+    size_t handleDataFragment(const uint8_t* data, size_t size);
+};
+
+#endif // FUOTA_MANAGER_H
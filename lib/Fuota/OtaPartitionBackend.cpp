@@ -0,0 +1,191 @@
+/**
+ * OtaPartitionBackend.cpp - Implementation of the OTA partition backend
+ */
+
+#ifdef ARDUINO
+
+#include "OtaPartitionBackend.h"
+#include "DeltaPatch.h"
+#include <esp_ota_ops.h>
+
+#define OTA_SECTOR_SIZE 4096
+#define OTA_YIELD_BYTES 65536  // Read between yields, so the idle task can feed the watchdog
+
+// Reader over a region of a partition
+class PartitionReader : public DeltaReader {
+public:
+    PartitionReader(const esp_partition_t* partition, uint32_t base)
+        : _partition(partition), _base(base), _sinceYield(0) {}
+
+    bool read(uint32_t offset, uint8_t* data, size_t length) override {
+        _sinceYield += length;
+        if (_sinceYield >= OTA_YIELD_BYTES) {
+            _sinceYield = 0;
+            vTaskDelay(1);
+        }
+        return esp_partition_read(_partition, _base + offset, data, length) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* _partition;
+    uint32_t _base;
+    uint32_t _sinceYield;
+};
+
+// Sequential writer for the rebuilt image, erasing sectors as it goes
+class PartitionWriter : public DeltaWriter {
+public:
+    PartitionWriter(const esp_partition_t* partition, uint32_t limit)
+        : _partition(partition), _limit(limit), _offset(0), _erasedUpTo(0) {}
+
+    bool write(const uint8_t* data, size_t length) override {
+        if (length > _limit - _offset) {
+            return false;  // Would run into the patch
+        }
+        while (_erasedUpTo < _offset + length) {
+            if (esp_partition_erase_range(_partition, _erasedUpTo, OTA_SECTOR_SIZE) != ESP_OK) {
+                return false;
+            }
+            _erasedUpTo += OTA_SECTOR_SIZE;
+            vTaskDelay(1);  // An erase blocks for tens of ms; let the idle task run
+        }
+        if (esp_partition_write(_partition, _offset, data, length) != ESP_OK) {
+            return false;
+        }
+        _offset += length;
+        return true;
+    }
+
+private:
+    const esp_partition_t* _partition;
+    uint32_t _limit;
+    uint32_t _offset;
+    uint32_t _erasedUpTo;
+};
+
+// Constructor
+OtaPartitionBackend::OtaPartitionBackend() {
+    _partition = NULL;
+    _fileOffset = 0;
+    _erased = NULL;
+    _sectorCount = 0;
+}
+
+// Destructor
+OtaPartitionBackend::~OtaPartitionBackend() {
+    if (_erased != NULL) {
+        delete[] _erased;
+    }
+}
+
+// Reserve room for the file in the next OTA partition
+bool OtaPartitionBackend::prepare(uint32_t fileSize, uint8_t fileType) {
+    _partition = esp_ota_get_next_update_partition(NULL);
+    if (_partition == NULL) {
+        Serial.println("FUOTA: No OTA partition available");
+        return false;
+    }
+    if (fileSize == 0 || fileSize + FRAG_MAX_FRAG_SIZE > _partition->size) {
+        Serial.printf("FUOTA: File of %u bytes does not fit in partition %s\n",
+                      (unsigned)fileSize, _partition->label);
+        return false;
+    }
+
+    // Patches go at the end so the rebuilt image can grow from offset 0;
+    // the last fragment writes its padding past the end of the file
+    if (fileType == FUOTA_FILE_DELTA_PATCH) {
+        _fileOffset = (_partition->size - fileSize - FRAG_MAX_FRAG_SIZE) & ~(uint32_t)(OTA_SECTOR_SIZE - 1);
+    } else {
+        _fileOffset = 0;
+    }
+
+    if (_erased != NULL) {
+        delete[] _erased;
+    }
+    _sectorCount = _partition->size / OTA_SECTOR_SIZE;
+    _erased = new uint8_t[(_sectorCount + 7) / 8]();
+
+    Serial.printf("FUOTA: Receiving %u bytes into %s at 0x%X\n",
+                  (unsigned)fileSize, _partition->label, (unsigned)_fileOffset);
+    return true;
+}
+
+// Erase any sectors of a partition range that have not been erased yet
+bool OtaPartitionBackend::ensureErased(uint32_t start, size_t length) {
+    uint32_t first = start / OTA_SECTOR_SIZE;
+    uint32_t last = (start + length - 1) / OTA_SECTOR_SIZE;
+    for (uint32_t s = first; s <= last && s < _sectorCount; s++) {
+        if (_erased[s >> 3] & (1 << (s & 7))) {
+            continue;
+        }
+        if (esp_partition_erase_range(_partition, s * OTA_SECTOR_SIZE, OTA_SECTOR_SIZE) != ESP_OK) {
+            return false;
+        }
+        _erased[s >> 3] |= (1 << (s & 7));
+    }
+    return true;
+}
+
+// Write a reassembled fragment
+bool OtaPartitionBackend::write(uint32_t offset, const uint8_t* data, size_t length) {
+    if (_partition == NULL || _fileOffset + offset + length > _partition->size) {
+        return false;
+    }
+    if (!ensureErased(_fileOffset + offset, length)) {
+        return false;
+    }
+    return esp_partition_write(_partition, _fileOffset + offset, data, length) == ESP_OK;
+}
+
+// Read back part of the received file
+bool OtaPartitionBackend::read(uint32_t offset, uint8_t* data, size_t length) {
+    if (_partition == NULL || _fileOffset + offset + length > _partition->size) {
+        return false;
+    }
+    return esp_partition_read(_partition, _fileOffset + offset, data, length) == ESP_OK;
+}
+
+// Verify the file, apply it if it is a patch, and select the new image
+bool OtaPartitionBackend::finalize(uint32_t fileSize, uint8_t fileType) {
+    if (_partition == NULL) {
+        return false;
+    }
+
+    if (fileType == FUOTA_FILE_DELTA_PATCH) {
+        PartitionReader patch(_partition, _fileOffset);
+        DeltaHeader header;
+        DeltaResult result = readDeltaHeader(patch, fileSize, header);
+        if (result != DELTA_OK) {
+            Serial.printf("FUOTA: Bad patch header (%s)\n", deltaResultName(result));
+            return false;
+        }
+        if (header.targetSize > _fileOffset) {
+            Serial.println("FUOTA: Patched image would overlap the patch");
+            return false;
+        }
+
+        const esp_partition_t* running = esp_ota_get_running_partition();
+        PartitionReader source(running, 0);
+        PartitionWriter target(_partition, _fileOffset);
+
+        Serial.printf("FUOTA: Applying patch from %s (%u -> %u bytes)\n", running->label,
+                      (unsigned)header.sourceSize, (unsigned)header.targetSize);
+        result = applyDeltaPatch(patch, fileSize, source, target);
+        if (result != DELTA_OK) {
+            Serial.printf("FUOTA: Patch failed (%s)\n", deltaResultName(result));
+            return false;
+        }
+    }
+
+    // Validates the image before switching to it
+    esp_err_t err = esp_ota_set_boot_partition(_partition);
+    if (err != ESP_OK) {
+        Serial.printf("FUOTA: Image rejected (%s)\n", esp_err_to_name(err));
+        return false;
+    }
+
+    Serial.printf("FUOTA: New image selected in %s\n", _partition->label);
+    return true;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,44 @@
+/**
+ * OtaPartitionBackend.h - FUOTA storage in the inactive ESP32 OTA partition
+ *
+ * Full images are reassembled at offset 0 of the next OTA partition. Delta
+ * patches are reassembled at the sector-aligned end of that partition and
+ * applied from the running partition into offset 0, as long as the rebuilt
+ * image stays below the patch. Flash sectors are erased on first write.
+ *
+ * Once the image is in place, esp_ota_set_boot_partition() validates it
+ * (header, segments and the appended SHA-256) before it is selected.
+ */
+
+#ifndef OTA_PARTITION_BACKEND_H
+#define OTA_PARTITION_BACKEND_H
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include "FuotaManager.h"
+
+class OtaPartitionBackend : public FuotaBackend {
+public:
+    OtaPartitionBackend();
+    ~OtaPartitionBackend();
+
+    bool prepare(uint32_t fileSize, uint8_t fileType) override;
+    bool finalize(uint32_t fileSize, uint8_t fileType) override;
+    bool write(uint32_t offset, const uint8_t* data, size_t length) override;
+    bool read(uint32_t offset, uint8_t* data, size_t length) override;
+
+private:
+    const esp_partition_t* _partition;
+    uint32_t _fileOffset;      // Where the received file starts in the partition
+    uint8_t* _erased;          // Bitmap of erased sectors
+    uint32_t _sectorCount;
+
+    // Erase any sectors of a partition range that have not been erased yet
+    bool ensureErased(uint32_t start, size_t length);
+};
+
+#endif // ARDUINO
+
+#endif // OTA_PARTITION_BACKEND_H
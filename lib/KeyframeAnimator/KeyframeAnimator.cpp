@@ -0,0 +1,299 @@
+/**
+ * KeyframeAnimator.cpp - Implementation of the keyframe interpolator
+ */
+
+#include "KeyframeAnimator.h"
+#include <string.h>
+
+// Constructor
+KeyframeAnimator::KeyframeAnimator() {
+    _lookahead = KF_DEFAULT_LOOKAHEAD_MS;
+    _lateCount = 0;
+    _droppedCount = 0;
+    reset();
+}
+
+// Drop all tracks; the next keyframe starts a new stream
+void KeyframeAnimator::reset() {
+    memset(_tracks, 0, sizeof(_tracks));
+    _activeTracks = 0;
+    _streamStarted = false;
+    _origin = 0;
+    _lastWireTime = 0;
+    _lastStreamTime = 0;
+    _holding = false;
+    _holdUntil = 0;
+}
+
+// Parse a keyframe packet (opcode byte already stripped)
+int KeyframeAnimator::handlePacket(const uint8_t* data, size_t size, uint32_t nowMs) {
+    if (size < 3) {
+        return -1;
+    }
+
+    // Validate every run before touching any track
+    size_t pos = 3;
+    while (pos < size) {
+        if (size - pos < 3) {
+            return -1;
+        }
+        uint16_t start = data[pos] | (data[pos + 1] << 8);
+        uint8_t count = data[pos + 2];
+        if (start < 1 || count == 0 || start + count - 1 > KF_MAX_CHANNEL || size - pos - 3 < count) {
+            return -1;
+        }
+        pos += 3 + count;
+    }
+
+    uint8_t flags = data[0];
+    uint16_t wireTime = data[1] | (data[2] << 8);
+    uint32_t streamTime;
+
+    if ((flags & KF_FLAG_NEW_STREAM) || !_streamStarted) {
+        reset();
+        streamTime = (uint32_t)wireTime * KF_TIME_UNIT_MS;
+        _origin = nowMs + _lookahead - streamTime;
+        _streamStarted = true;
+    } else {
+        // Wire time wraps every ~11 minutes; step from the last one we saw
+        int16_t delta = (int16_t)(wireTime - _lastWireTime);
+        streamTime = _lastStreamTime + (int32_t)delta * KF_TIME_UNIT_MS;
+
+        // An idle stream re-anchors so a resumed stream gets the full look-ahead
+        if (_activeTracks == 0 && (int32_t)(streamTime - getPlayhead(nowMs)) < (int32_t)_lookahead) {
+            _origin = nowMs + _lookahead - streamTime;
+        }
+    }
+    _lastWireTime = wireTime;
+    _lastStreamTime = streamTime;
+
+    if ((int32_t)(streamTime - getPlayhead(nowMs)) < 0) {
+        _lateCount++;
+    }
+
+    KeyframeInterp interp = (flags & KF_FLAG_SPLINE) ? KF_INTERP_SPLINE : KF_INTERP_LINEAR;
+    int accepted = 0;
+    pos = 3;
+    while (pos < size) {
+        uint16_t start = data[pos] | (data[pos + 1] << 8);
+        uint8_t count = data[pos + 2];
+        for (uint8_t i = 0; i < count; i++) {
+            if (addKeyframe(streamTime, start + i, data[pos + 3 + i], interp)) {
+                accepted++;
+            }
+        }
+        pos += 3 + count;
+    }
+    return accepted;
+}
+
+// Find the track for a channel, optionally claiming a free one
+KeyframeTrack* KeyframeAnimator::findTrack(uint16_t channel, bool create) {
+    KeyframeTrack* freeTrack = NULL;
+    for (int i = 0; i < KF_MAX_TRACKS; i++) {
+        if (_tracks[i].channel == channel) {
+            return &_tracks[i];
+        }
+        if (freeTrack == NULL && _tracks[i].channel == 0) {
+            freeTrack = &_tracks[i];
+        }
+    }
+    if (!create || freeTrack == NULL) {
+        return NULL;
+    }
+
+    memset(freeTrack, 0, sizeof(KeyframeTrack));
+    freeTrack->channel = channel;
+    _activeTracks++;
+    return freeTrack;
+}
+
+// Return a track to the free pool
+void KeyframeAnimator::releaseTrack(KeyframeTrack& track) {
+    track.channel = 0;
+    track.count = 0;
+    _activeTracks--;
+}
+
+// Add one keyframe for one channel
+bool KeyframeAnimator::addKeyframe(uint32_t streamTime, uint16_t channel, uint8_t value, KeyframeInterp interp) {
+    if (channel < 1 || channel > KF_MAX_CHANNEL) {
+        return false;
+    }
+
+    KeyframeTrack* track = findTrack(channel, true);
+    if (track == NULL) {
+        _droppedCount++;
+        return false;
+    }
+    _holding = false;  // The next render must look at the new point
+
+    // Find the insert position (tracks stay sorted by time)
+    uint8_t pos = track->count;
+    while (pos > 0 && (int32_t)(track->points[pos - 1].time - streamTime) > 0) {
+        pos--;
+    }
+
+    // A repeated timestamp replaces the earlier value
+    if (pos > 0 && track->points[pos - 1].time == streamTime) {
+        track->points[pos - 1].value = value;
+        track->interp = interp;
+        return true;
+    }
+
+    if (track->count >= KF_TRACK_DEPTH) {
+        _droppedCount++;
+        return false;
+    }
+
+    memmove(&track->points[pos + 1], &track->points[pos], (track->count - pos) * sizeof(KeyframePoint));
+    track->points[pos].time = streamTime;
+    track->points[pos].value = value;
+    track->count++;
+    track->interp = interp;
+    return true;
+}
+
+// Drop points the playhead no longer needs (keeps one before it for the spline)
+void KeyframeAnimator::prune(KeyframeTrack& track, uint32_t t) {
+    uint8_t drop = 0;
+    while (track.count - drop > 2 && (int32_t)(t - track.points[drop + 2].time) >= 0) {
+        drop++;
+    }
+    if (drop > 0) {
+        memmove(&track.points[0], &track.points[drop], (track.count - drop) * sizeof(KeyframePoint));
+        track.count -= drop;
+    }
+}
+
+// Segment of a track that stream time t falls in (t lies inside the track)
+uint8_t KeyframeAnimator::findSegment(const KeyframeTrack& track, uint32_t t) const {
+    uint8_t i = 0;
+    while (i + 2 < track.count && (int32_t)(t - track.points[i + 1].time) >= 0) {
+        i++;
+    }
+    return i;
+}
+
+// Value of a track at stream time t in 8.8 fixed point (t lies inside the track)
+uint16_t KeyframeAnimator::evaluate(const KeyframeTrack& track, uint32_t t) const {
+    uint8_t i = findSegment(track, t);
+
+    const KeyframePoint& a = track.points[i];
+    const KeyframePoint& b = track.points[i + 1];
+    uint32_t span = b.time - a.time;
+    if (span == 0) {
+        return (uint16_t)(b.value << 8);
+    }
+
+    // Position within the segment in 16.16 fixed point
+    uint32_t u = (uint32_t)(((uint64_t)(t - a.time) << 16) / span);
+    if (u > 0xFFFF) u = 0xFFFF;
+
+    int32_t p1 = a.value;
+    int32_t p2 = b.value;
+
+    if (track.interp != KF_INTERP_SPLINE) {
+        int32_t v = (p1 << 16) + (p2 - p1) * (int32_t)u;
+        return (uint16_t)(v >> 8);
+    }
+
+    // Catmull-Rom, with the end points repeated where neighbours are missing
+    int32_t p0 = i > 0 ? track.points[i - 1].value : p1;
+    int32_t p3 = i + 2 < track.count ? track.points[i + 2].value : p2;
+
+    int32_t u2 = (int32_t)((u * u) >> 16);
+    int32_t u3 = (int32_t)(((uint32_t)u2 * u) >> 16);
+
+    int32_t sum = (2 * p1 << 16)
+                + (p2 - p0) * (int32_t)u
+                + (2 * p0 - 5 * p1 + 4 * p2 - p3) * u2
+                + (-p0 + 3 * p1 - 3 * p2 + p3) * u3;
+
+    // Halve and clamp the overshoot
+    if (sum <= 0) return 0;
+    int32_t v = sum >> 9;
+    return v > 0xFF00 ? 0xFF00 : (uint16_t)v;
+}
+
+// Evaluate all tracks at the current time
+void KeyframeAnimator::render(uint32_t nowMs, uint8_t* dmxData, uint8_t* fraction) {
+    if (_activeTracks == 0) {
+        return;
+    }
+
+    uint32_t t = getPlayhead(nowMs);
+
+    // Track the earliest point where a held value starts moving again
+    bool holding = true;
+    uint32_t holdUntil = 0;
+    bool bounded = false;
+
+    for (int i = 0; i < KF_MAX_TRACKS; i++) {
+        KeyframeTrack& track = _tracks[i];
+        if (track.channel == 0) {
+            continue;
+        }
+
+        // Ramp from whatever the channel shows now to the first keyframe
+        if (!track.seeded && track.count > 0 && (int32_t)(track.points[0].time - t) > 0 &&
+            track.count < KF_TRACK_DEPTH) {
+            memmove(&track.points[1], &track.points[0], track.count * sizeof(KeyframePoint));
+            track.points[0].time = t;
+            track.points[0].value = dmxData[track.channel];
+            track.count++;
+        }
+        track.seeded = true;
+
+        if (track.count == 0 || (int32_t)(t - track.points[0].time) < 0) {
+            if (track.count > 0 && (!bounded || (int32_t)(track.points[0].time - holdUntil) < 0)) {
+                holdUntil = track.points[0].time;
+                bounded = true;
+            }
+            continue;  // Not started yet
+        }
+
+        prune(track, t);
+
+        const KeyframePoint& last = track.points[track.count - 1];
+        if ((int32_t)(t - last.time) >= 0) {
+            dmxData[track.channel] = last.value;
+            if (fraction != NULL) {
+                fraction[track.channel] = 0;
+            }
+            releaseTrack(track);
+            continue;
+        }
+
+        // Rounded to the nearest step, or whole steps and the fraction
+        uint16_t value = evaluate(track, t);
+        if (fraction != NULL) {
+            dmxData[track.channel] = (uint8_t)(value >> 8);
+            fraction[track.channel] = (uint8_t)value;
+        } else {
+            dmxData[track.channel] = (uint8_t)((value + 0x80) >> 8);
+        }
+
+        // A segment between equal values (and, for the spline, equal
+        // neighbours) holds until its end point
+        if (holding) {
+            uint8_t seg = findSegment(track, t);
+            uint8_t value = track.points[seg].value;
+            bool flat = track.points[seg + 1].value == value;
+            if (flat && track.interp == KF_INTERP_SPLINE) {
+                flat = (seg == 0 || track.points[seg - 1].value == value) &&
+                       (seg + 2 >= track.count || track.points[seg + 2].value == value);
+            }
+            uint32_t end = track.points[seg + 1].time;
+            if (!flat) {
+                holding = false;
+            } else if (!bounded || (int32_t)(end - holdUntil) < 0) {
+                holdUntil = end;
+                bounded = true;
+            }
+        }
+    }
+
+    _holding = holding && bounded;
+    _holdUntil = holdUntil;
+}
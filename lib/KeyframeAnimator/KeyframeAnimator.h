@@ -0,0 +1,168 @@
+/**
+ * KeyframeAnimator.h - Smooth DMX motion from sparse, timestamped keyframes
+ *
+ * LoRa cannot carry frame-rate animation, so the server sends keyframes
+ * (a stream time plus values for a subset of channels) seconds apart and the
+ * node interpolates between them on every output frame. Each animated channel
+ * has a short track of keyframes, interpolated linearly or with a
+ * Catmull-Rom spline in 16.16 fixed point.
+ *
+ * Playback runs a configurable look-ahead behind the newest stream time the
+ * node has seen, so keyframes that arrive late or in bursts are still in the
+ * track by the time the playhead reaches them. New keyframes can be appended
+ * while the animation plays.
+ *
+ * Keyframe packet (after the KF_OPCODE_KEYFRAME byte):
+ *   flags (bit 0 = spline, bit 1 = new stream)
+ *   stream time, uint16 LE, in 10 ms units (wraps; unwrapped on the node)
+ *   runs of: start channel uint16 LE (1-512) | count | count values
+ *
+ * No Arduino dependencies, so streams can be replayed on a host.
+ */
+
+#ifndef KEYFRAME_ANIMATOR_H
+#define KEYFRAME_ANIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Downlink opcodes
+#define KF_OPCODE_KEYFRAME 0xE0      // Keyframe packet (see above)
+#define KF_OPCODE_STOP 0xE1          // Stop animating, channels keep their values
+#define KF_OPCODE_LOOKAHEAD 0xE2     // Set look-ahead: uint16 LE milliseconds
+
+#define KF_FLAG_SPLINE 0x01
+#define KF_FLAG_NEW_STREAM 0x02
+
+#define KF_MAX_TRACKS 64                // Channels animated at once
+#define KF_TRACK_DEPTH 6                // Keyframes buffered per channel
+#define KF_TIME_UNIT_MS 10              // Wire time resolution
+#define KF_DEFAULT_LOOKAHEAD_MS 3000    // Playback delay behind the newest keyframe
+#ifdef DMX_MAX_CHANNELS
+#define KF_MAX_CHANNEL DMX_MAX_CHANNELS  // Follows the DMX controller capacity
+#else
+#define KF_MAX_CHANNEL 512
+#endif
+
+enum KeyframeInterp {
+    KF_INTERP_LINEAR = 0,
+    KF_INTERP_SPLINE = 1
+};
+
+struct KeyframePoint {
+    uint32_t time;     // Stream time in ms
+    uint8_t value;
+};
+
+struct KeyframeTrack {
+    uint16_t channel;  // DMX channel (1-512), 0 = free
+    uint8_t interp;    // KeyframeInterp
+    uint8_t count;     // Points in use, sorted by time
+    bool seeded;       // Start point taken from the live frame
+    KeyframePoint points[KF_TRACK_DEPTH];
+};
+
+class KeyframeAnimator {
+public:
+    KeyframeAnimator();
+
+    /**
+     * Drop all tracks; the next keyframe starts a new stream
+     */
+    void reset();
+
+    /**
+     * Set how far playback runs behind the newest keyframe
+     *
+     * @param ms Look-ahead in milliseconds
+     */
+    void setLookahead(uint32_t ms) { _lookahead = ms; }
+    uint32_t getLookahead() const { return _lookahead; }
+
+    /**
+     * Parse a keyframe packet (opcode byte already stripped)
+     *
+     * @param data Packet bytes
+     * @param size Number of bytes
+     * @param nowMs Current time in ms
+     * @return Number of channel values accepted, or -1 if the packet is malformed
+     */
+    int handlePacket(const uint8_t* data, size_t size, uint32_t nowMs);
+
+    /**
+     * Add one keyframe for one channel
+     *
+     * @param streamTime Stream time of the keyframe in ms
+     * @param channel DMX channel (1-512)
+     * @param value Channel value at that time
+     * @param interp Interpolation towards this keyframe and beyond
+     * @return False if no track was free or the track is full of future keyframes
+     */
+    bool addKeyframe(uint32_t streamTime, uint16_t channel, uint8_t value, KeyframeInterp interp);
+
+    /**
+     * Evaluate all tracks at the current time
+     *
+     * Writes animated channels into a DMX buffer (index 0 = start code).
+     * Tracks that have played their last keyframe write that value once
+     * and are released.
+     *
+     * @param nowMs Current time in ms
+     * @param dmxData DMX buffer of KF_MAX_CHANNEL + 1 bytes
+     * @param fraction Set to the 1/256 steps below each animated channel,
+     *                 which is then rounded down (NULL = round to nearest)
+     */
+    void render(uint32_t nowMs, uint8_t* dmxData, uint8_t* fraction = NULL);
+
+    /**
+     * True while any channel still has keyframes to play
+     */
+    bool isActive() const { return _activeTracks > 0; }
+
+    /**
+     * True if render() would change the frame now. Between keyframes that
+     * hold the same value nothing moves, so the render can be skipped
+     * until the next keyframe is reached.
+     *
+     * @param nowMs Current time in ms
+     */
+    bool needsRender(uint32_t nowMs) const {
+        return _activeTracks > 0 && (!_holding || (int32_t)(getPlayhead(nowMs) - _holdUntil) >= 0);
+    }
+
+    /**
+     * Current playhead in stream time
+     */
+    uint32_t getPlayhead(uint32_t nowMs) const { return nowMs - _origin; }
+
+    uint8_t getActiveTracks() const { return _activeTracks; }
+    uint32_t getLateCount() const { return _lateCount; }
+    uint32_t getDroppedCount() const { return _droppedCount; }
+
+private:
+    KeyframeTrack _tracks[KF_MAX_TRACKS];
+    uint8_t _activeTracks;
+    uint32_t _lookahead;
+    bool _streamStarted;
+    uint32_t _origin;           // millis() at stream time 0
+    uint16_t _lastWireTime;
+    uint32_t _lastStreamTime;
+    uint32_t _lateCount;        // Keyframes that arrived behind the playhead
+    uint32_t _droppedCount;     // Keyframes with nowhere to go
+    bool _holding;              // The last render left every track on a flat segment
+    uint32_t _holdUntil;        // Stream time of the next keyframe after that render
+
+    KeyframeTrack* findTrack(uint16_t channel, bool create);
+    void releaseTrack(KeyframeTrack& track);
+
+    // Drop points the playhead no longer needs (keeps one before it for the spline)
+    void prune(KeyframeTrack& track, uint32_t t);
+
+    // Segment of a track that stream time t falls in
+    uint8_t findSegment(const KeyframeTrack& track, uint32_t t) const;
+
+    // Value of a track at stream time t, in 8.8 fixed point
+    uint16_t evaluate(const KeyframeTrack& track, uint32_t t) const;
+};
+
+#endif // KEYFRAME_ANIMATOR_H
@@ -0,0 +1,60 @@
+/**
+ * NodeCapability.cpp - Capability uplink encoding and US915 limits
+ */
+
+#include "NodeCapability.h"
+
+// US915 downlink payload limits, DR8-DR13 (RP002 N, no FOpts)
+static const uint8_t US915_DOWNLINK_LIMITS[] = { 53, 129, 242, 242, 242, 242 };
+
+// Write the uplink payload
+size_t capabilityEncode(const NodeCapability& capability, uint8_t* out) {
+    out[0] = CAPABILITY_UPLINK_TYPE;
+    out[1] = capability.version;
+    out[2] = capability.flags;
+    out[3] = (uint8_t)(capability.features >> 8);
+    out[4] = (uint8_t)capability.features;
+    out[5] = capability.uplinkDataRate;
+    out[6] = capability.downlinkDataRate;
+    out[7] = capability.maxDownlinkPayload;
+    out[8] = (uint8_t)(capability.fragmentSlots >> 8);
+    out[9] = (uint8_t)capability.fragmentSlots;
+    out[10] = capability.maxFragmentSize;
+    out[11] = capability.freeCueSlots;
+    out[12] = capability.freeScheduleRules;
+    return CAPABILITY_SIZE;
+}
+
+// Read an uplink payload
+bool capabilityDecode(const uint8_t* data, size_t length, NodeCapability& capability) {
+    if (length < CAPABILITY_SIZE || data[0] != CAPABILITY_UPLINK_TYPE || data[1] == 0) {
+        return false;
+    }
+    capability.version = data[1];
+    capability.flags = data[2];
+    capability.features = (uint16_t)((data[3] << 8) | data[4]);
+    capability.uplinkDataRate = data[5];
+    capability.downlinkDataRate = data[6];
+    capability.maxDownlinkPayload = data[7];
+    capability.fragmentSlots = (uint16_t)((data[8] << 8) | data[9]);
+    capability.maxFragmentSize = data[10];
+    capability.freeCueSlots = data[11];
+    capability.freeScheduleRules = data[12];
+    return true;
+}
+
+// US915 downlink payload limit of a data rate
+uint8_t capabilityUs915DownlinkLimit(uint8_t dataRate) {
+    if (dataRate < 8 || dataRate > 13) {
+        return 0;
+    }
+    return US915_DOWNLINK_LIMITS[dataRate - 8];
+}
+
+// US915 RX1 data rate (RX1DROffset 0)
+uint8_t capabilityUs915Rx1DataRate(uint8_t uplinkDataRate) {
+    if (uplinkDataRate <= 3) {
+        return (uint8_t)(uplinkDataRate + 10);
+    }
+    return uplinkDataRate == 4 ? 13 : CAPABILITY_US915_RX2_DATA_RATE;
+}
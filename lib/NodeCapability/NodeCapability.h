@@ -0,0 +1,98 @@
+/**
+ * NodeCapability.h - Capability and payload-limit uplink
+ *
+ * Tells the server what the node accepts right now, so encoders pick a
+ * downlink format that fits instead of queueing frames the network server
+ * will discard (ChirpStack drops queue items over the data rate's payload
+ * limit with DOWNLINK_PAYLOAD_SIZE). Sent on port 2 after each join and
+ * whenever the data rate changes. Shared by the firmware and server-side
+ * tools, so this file only uses the C library.
+ *
+ * Payload (CAPABILITY_SIZE bytes, big endian like the other uplinks):
+ *   0      0x06
+ *   1      protocol version
+ *   2      flags (CAPABILITY_FLAG_*)
+ *   3-4    downlink features (CAPABILITY_FEATURE_*)
+ *   5      uplink data rate
+ *   6      data rate of the Class C (RX2) window
+ *   7      largest application payload every receive window takes
+ *   8-9    FUOTA fragments a session can hold
+ *   10     largest FUOTA fragment that fits in one downlink
+ *   11     free cue slots (stored scenes)
+ *   12     free schedule rules
+ *
+ * The downlink callback does not report the FPort, so every feature is
+ * told apart by its opcode on the application port; FUOTA commands carry
+ * the 0xD0 tag.
+ */
+
+#ifndef NODE_CAPABILITY_H
+#define NODE_CAPABILITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CAPABILITY_UPLINK_TYPE 0x06
+#define CAPABILITY_PROTOCOL_VERSION 1
+#define CAPABILITY_SIZE 13
+
+// Flags
+#define CAPABILITY_FLAG_CLASS_C 0x01
+#define CAPABILITY_FLAG_ADR 0x02
+
+// Downlink features (opcode groups the node handles)
+#define CAPABILITY_FEATURE_PRESETS 0x0001         // 0x00-0x04 one-byte presets
+#define CAPABILITY_FEATURE_COMPACT_LIGHTS 0x0002  // Binary lights
+#define CAPABILITY_FEATURE_JSON 0x0004            // JSON commands
+#define CAPABILITY_FEATURE_PATTERNS 0x0008        // 0xF0 stop, 0xF1 start
+#define CAPABILITY_FEATURE_FIXTURES 0x0010        // 0xC0 fixture count
+#define CAPABILITY_FEATURE_PATCH_EDITS 0x0020     // 0xC1-0xC4
+#define CAPABILITY_FEATURE_KEYFRAMES 0x0040       // 0xE0-0xE2
+#define CAPABILITY_FEATURE_TRIGGERS 0x0080        // 0xB0-0xB2
+#define CAPABILITY_FEATURE_SCHEDULE 0x0100        // 0xA0-0xA2
+#define CAPABILITY_FEATURE_FUOTA 0x0200           // 0xD0-tagged TS004 commands
+
+#define CAPABILITY_US915_RX2_DATA_RATE 8    // Class C and RX2 downlinks
+
+struct NodeCapability {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t features;
+    uint8_t uplinkDataRate;
+    uint8_t downlinkDataRate;
+    uint8_t maxDownlinkPayload;
+    uint16_t fragmentSlots;
+    uint8_t maxFragmentSize;
+    uint8_t freeCueSlots;
+    uint8_t freeScheduleRules;
+};
+
+/**
+ * Write the uplink payload
+ *
+ * @param out Buffer of CAPABILITY_SIZE bytes
+ * @return Bytes written
+ */
+size_t capabilityEncode(const NodeCapability& capability, uint8_t* out);
+
+/**
+ * Read an uplink payload
+ *
+ * @return False if it is not a capability uplink (longer payloads from
+ *         newer versions are accepted; the extra bytes are ignored)
+ */
+bool capabilityDecode(const uint8_t* data, size_t length, NodeCapability& capability);
+
+/**
+ * US915 downlink application payload limit (N) of a data rate
+ *
+ * @return 0 for data rates without downlinks
+ */
+uint8_t capabilityUs915DownlinkLimit(uint8_t dataRate);
+
+/**
+ * US915 data rate of the RX1 window after an uplink at a data rate
+ */
+uint8_t capabilityUs915Rx1DataRate(uint8_t uplinkDataRate);
+
+#endif // NODE_CAPABILITY_H
@@ -0,0 +1,254 @@
+/**
+ * PatchEditor.cpp - Fixture patch edits and journal compaction
+ */
+
+#include "PatchEditor.h"
+#include <string.h>
+
+// Bytes of each edit, including the opcode
+static size_t editSize(uint8_t opcode) {
+    switch (opcode) {
+        case PATCH_OPCODE_ADD: return 5;
+        case PATCH_OPCODE_MOVE: return 5;
+        case PATCH_OPCODE_REMOVE: return 3;
+        case PATCH_OPCODE_RETYPE: return 5;
+        default: return 0;
+    }
+}
+
+// Constructor
+PatchEditor::PatchEditor() {
+    memset(_fixtures, 0, sizeof(_fixtures));
+    _count = 0;
+    _journalLength = 0;
+    reset(0);
+}
+
+// Channels a layout takes
+int PatchEditor::getFootprint(uint8_t layout) {
+    return layout == PATCH_LAYOUT_RGB ? 3 : 4;
+}
+
+// True if a fixture's channels are all inside the universe
+bool PatchEditor::fits(int start, uint8_t layout) {
+    return start >= 1 && start + getFootprint(layout) - 1 <= PATCH_MAX_CHANNEL;
+}
+
+// DMX channels of a layout placed at start
+static void layoutChannels(int s, uint8_t layout, int& red, int& green, int& blue, int& white) {
+    switch (layout) {
+        case PATCH_LAYOUT_RGB:  red = s;     green = s + 1; blue = s + 2; white = 0;     break;
+        case PATCH_LAYOUT_WRGB: red = s + 1; green = s + 2; blue = s + 3; white = s;     break;
+        case PATCH_LAYOUT_GRBW: red = s + 1; green = s;     blue = s + 2; white = s + 3; break;
+        default:                red = s;     green = s + 1; blue = s + 2; white = s + 3; break;
+    }
+}
+
+// DMX channels of a fixture by layout
+void PatchEditor::getChannels(int index, int& red, int& green, int& blue, int& white) const {
+    layoutChannels(_fixtures[index].start, _fixtures[index].layout, red, green, blue, white);
+}
+
+// Layout whose channel order matches a fixture
+int PatchEditor::findLayout(int start, int red, int green, int blue, int white) {
+    for (uint8_t layout = 0; layout < PATCH_LAYOUT_COUNT; layout++) {
+        int r, g, b, w;
+        layoutChannels(start, layout, r, g, b, w);
+        if (r == red && g == green && b == blue && w == white) {
+            return layout;
+        }
+    }
+    return -1;
+}
+
+// Rebuild the patch as count RGBW fixtures and restart the journal
+void PatchEditor::reset(uint8_t count) {
+    int limit = PATCH_MAX_CHANNEL / 4 < PATCH_MAX_FIXTURES ? PATCH_MAX_CHANNEL / 4 : PATCH_MAX_FIXTURES;
+    _count = count < limit ? count : limit;
+    for (int i = 0; i < _count; i++) {
+        _fixtures[i].start = (uint16_t)(1 + i * 4);
+        _fixtures[i].layout = PATCH_LAYOUT_RGBW;
+        _fixtures[i].profile = 0;
+    }
+    _journal[0] = PATCH_OPCODE_COUNT;
+    _journal[1] = (uint8_t)_count;
+    _journalLength = 2;
+}
+
+// Apply one edit
+size_t PatchEditor::applyOne(const uint8_t* data, size_t size, int& firstChanged) {
+    size_t length = editSize(data[0]);
+    if (length == 0 || size < length) {
+        return 0;
+    }
+
+    if (data[0] == PATCH_OPCODE_ADD) {
+        uint16_t start = data[1] | (data[2] << 8);
+        uint8_t count = data[3];
+        uint8_t layout = data[4];
+        if (count == 0 || _count + count > PATCH_MAX_FIXTURES || layout >= PATCH_LAYOUT_COUNT ||
+            start < 1 || start + count * getFootprint(layout) - 1 > PATCH_MAX_CHANNEL) {
+            return 0;
+        }
+        firstChanged = firstChanged < _count ? firstChanged : _count;
+        for (int i = 0; i < count; i++) {
+            PatchFixture& f = _fixtures[_count++];
+            f.start = (uint16_t)(start + i * getFootprint(layout));
+            f.layout = layout;
+            f.profile = 0;
+        }
+        return length;
+    }
+
+    // The rest act on a group of existing fixtures
+    int first = data[1];
+    int count = data[2];
+    if (count == 0 || first + count > _count) {
+        return 0;
+    }
+
+    if (data[0] == PATCH_OPCODE_MOVE) {
+        int delta = (int)(data[3] | (data[4] << 8)) - _fixtures[first].start;
+        for (int i = first; i < first + count; i++) {
+            int start = _fixtures[i].start + delta;
+            if (!fits(start, _fixtures[i].layout)) {
+                return 0;
+            }
+        }
+        for (int i = first; i < first + count; i++) {
+            _fixtures[i].start = (uint16_t)(_fixtures[i].start + delta);
+        }
+    } else if (data[0] == PATCH_OPCODE_REMOVE) {
+        memmove(&_fixtures[first], &_fixtures[first + count], (_count - first - count) * sizeof(PatchFixture));
+        _count -= count;
+    } else {
+        uint8_t layout = data[3];
+        uint8_t profile = data[4];
+        if ((layout != PATCH_KEEP && layout >= PATCH_LAYOUT_COUNT) ||
+            (profile != PATCH_KEEP && profile >= COLOR_MAX_PROFILES)) {
+            return 0;
+        }
+        for (int i = first; i < first + count; i++) {
+            if (layout != PATCH_KEEP && !fits(_fixtures[i].start, layout)) {
+                return 0;
+            }
+        }
+        for (int i = first; i < first + count; i++) {
+            _fixtures[i].layout = layout != PATCH_KEEP ? layout : _fixtures[i].layout;
+            _fixtures[i].profile = profile != PATCH_KEEP ? profile : _fixtures[i].profile;
+        }
+    }
+    firstChanged = firstChanged < first ? firstChanged : first;
+    return length;
+}
+
+// Apply a downlink of edits, all or nothing
+int PatchEditor::apply(const uint8_t* data, size_t size, int& firstChanged) {
+    PatchFixture saved[PATCH_MAX_FIXTURES];
+    memcpy(saved, _fixtures, sizeof(saved));
+    int savedCount = _count;
+
+    firstChanged = PATCH_MAX_FIXTURES;
+    int edits = 0;
+    size_t offset = 0;
+    while (offset < size) {
+        size_t used = applyOne(data + offset, size - offset, firstChanged);
+        if (used == 0) {
+            memcpy(_fixtures, saved, sizeof(saved));
+            _count = savedCount;
+            return -1;
+        }
+        offset += used;
+        edits++;
+    }
+    if (edits > 0) {
+        append(data, size);
+    }
+    return edits;
+}
+
+// Rebuild the patch from a stored journal
+bool PatchEditor::replay(const uint8_t* journal, size_t length) {
+    if (length < 2 || length > PATCH_JOURNAL_SIZE || journal[0] != PATCH_OPCODE_COUNT) {
+        reset(0);
+        return false;
+    }
+    reset(journal[1]);
+    int firstChanged = 0;
+    size_t offset = 2;
+    while (offset < length) {
+        size_t used = applyOne(journal + offset, length - offset, firstChanged);
+        if (used == 0) {
+            reset(0);
+            return false;
+        }
+        offset += used;
+    }
+    memcpy(_journal, journal, length);
+    _journalLength = length;
+    return true;
+}
+
+// Take over an existing patch and snapshot it into the journal
+bool PatchEditor::load(const PatchFixture* fixtures, int count) {
+    if (count < 0 || count > PATCH_MAX_FIXTURES) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (fixtures[i].layout >= PATCH_LAYOUT_COUNT || fixtures[i].profile >= COLOR_MAX_PROFILES ||
+            !fits(fixtures[i].start, fixtures[i].layout)) {
+            return false;
+        }
+    }
+    memcpy(_fixtures, fixtures, count * sizeof(PatchFixture));
+    _count = count;
+    compact();
+    return true;
+}
+
+// Append applied edits to the journal
+void PatchEditor::append(const uint8_t* data, size_t size) {
+    if (_journalLength + size > PATCH_JOURNAL_SIZE) {
+        // The snapshot already contains these edits
+        compact();
+        return;
+    }
+    memcpy(_journal + _journalLength, data, size);
+    _journalLength += size;
+}
+
+// Replace the journal with an empty base, one add per run of adjacent
+// fixtures of the same layout, and a retype per run of the same profile
+void PatchEditor::compact() {
+    size_t length = 0;
+    _journal[length++] = PATCH_OPCODE_COUNT;
+    _journal[length++] = 0;
+    for (int i = 0; i < _count;) {
+        int run = 1;
+        while (i + run < _count && _fixtures[i + run].layout == _fixtures[i].layout &&
+               _fixtures[i + run].start == _fixtures[i + run - 1].start + getFootprint(_fixtures[i].layout)) {
+            run++;
+        }
+        _journal[length++] = PATCH_OPCODE_ADD;
+        _journal[length++] = (uint8_t)_fixtures[i].start;
+        _journal[length++] = (uint8_t)(_fixtures[i].start >> 8);
+        _journal[length++] = (uint8_t)run;
+        _journal[length++] = _fixtures[i].layout;
+        i += run;
+    }
+    for (int i = 0; i < _count;) {
+        int run = 1;
+        while (i + run < _count && _fixtures[i + run].profile == _fixtures[i].profile) {
+            run++;
+        }
+        if (_fixtures[i].profile != 0) {
+            _journal[length++] = PATCH_OPCODE_RETYPE;
+            _journal[length++] = (uint8_t)i;
+            _journal[length++] = (uint8_t)run;
+            _journal[length++] = PATCH_KEEP;
+            _journal[length++] = _fixtures[i].profile;
+        }
+        i += run;
+    }
+    _journalLength = length;
+}
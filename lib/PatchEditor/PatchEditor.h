@@ -0,0 +1,151 @@
+/**
+ * PatchEditor.h - Incremental fixture patch edits and their journal
+ *
+ * The 0xC0 config downlink rebuilds the whole patch as N RGBW fixtures at
+ * 4-channel strides from channel 1. The edit opcodes below change single
+ * fixtures or groups of them in a few bytes instead:
+ *
+ *   0xC1 add      start (u16 LE), count, layout
+ *                 Appends count fixtures of one layout, back to back from start
+ *   0xC2 move     first, count, start (u16 LE)
+ *                 Shifts fixtures [first, first + count) so the first one
+ *                 starts at start; the group keeps its spacing
+ *   0xC3 remove   first, count
+ *                 Removes fixtures; the ones after them move down
+ *   0xC4 retype   first, count, layout, profile
+ *                 Changes the channel layout and color profile (fixture
+ *                 type); PATCH_KEEP leaves either unchanged
+ *
+ * Several edits may be sent back to back in one downlink. They are applied
+ * all or nothing. Applied edits are appended to a journal that is
+ * persisted and replayed at boot. The journal starts with the last 0xC0
+ * record and is compacted into a snapshot of the patch when it fills up.
+ *
+ * No Arduino dependencies.
+ */
+
+#ifndef PATCH_EDITOR_H
+#define PATCH_EDITOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ColorPipeline.h"
+
+// Downlink opcodes
+#define PATCH_OPCODE_COUNT 0xC0      // Number of lights (rebuilds the patch)
+#define PATCH_OPCODE_ADD 0xC1
+#define PATCH_OPCODE_MOVE 0xC2
+#define PATCH_OPCODE_REMOVE 0xC3
+#define PATCH_OPCODE_RETYPE 0xC4
+
+// Channel layouts
+#define PATCH_LAYOUT_RGBW 0
+#define PATCH_LAYOUT_RGB 1
+#define PATCH_LAYOUT_WRGB 2
+#define PATCH_LAYOUT_GRBW 3
+#define PATCH_LAYOUT_COUNT 4
+#define PATCH_KEEP 0xFF              // Retype: leave the layout or profile as it is
+
+// Capacity follows the DMX controller build
+#ifdef DMX_MAX_FIXTURES
+#define PATCH_MAX_FIXTURES DMX_MAX_FIXTURES
+#else
+#define PATCH_MAX_FIXTURES 32
+#endif
+#ifdef DMX_MAX_CHANNELS
+#define PATCH_MAX_CHANNEL DMX_MAX_CHANNELS
+#else
+#define PATCH_MAX_CHANNEL 512
+#endif
+
+// A snapshot is one add and at most one retype per fixture; the journal
+// holds one and room for as many edits again
+#define PATCH_SNAPSHOT_SIZE (2 + PATCH_MAX_FIXTURES * 10)
+#define PATCH_JOURNAL_SIZE (2 * PATCH_SNAPSHOT_SIZE)
+
+// One patched fixture
+struct PatchFixture {
+    uint16_t start;      // First DMX channel
+    uint8_t layout;      // PATCH_LAYOUT_*
+    uint8_t profile;     // Color profile (fixture type)
+};
+
+class PatchEditor {
+public:
+    PatchEditor();
+
+    /**
+     * Rebuild the patch as count RGBW fixtures at 4-channel strides (0xC0)
+     * The journal restarts with this record.
+     */
+    void reset(uint8_t count);
+
+    /**
+     * Apply a downlink of one or more edits, all or nothing
+     *
+     * @param firstChanged Set to the lowest fixture index whose entry changed
+     * @return Number of edits applied, or -1 if any was malformed or invalid
+     */
+    int apply(const uint8_t* data, size_t size, int& firstChanged);
+
+    /**
+     * Rebuild the patch from a stored journal
+     *
+     * @return False if the journal does not replay cleanly (the patch is then empty)
+     */
+    bool replay(const uint8_t* journal, size_t length);
+
+    /**
+     * Take over an existing patch, such as the live controller one
+     * The journal restarts as a snapshot of it.
+     *
+     * @return False if a fixture does not fit (the editor is then unchanged)
+     */
+    bool load(const PatchFixture* fixtures, int count);
+
+    int getCount() const { return _count; }
+    const PatchFixture& getFixture(int index) const { return _fixtures[index]; }
+
+    /**
+     * DMX channels of a fixture (white is 0 for layouts without one)
+     */
+    void getChannels(int index, int& red, int& green, int& blue, int& white) const;
+
+    /**
+     * Channels a layout takes
+     */
+    static int getFootprint(uint8_t layout);
+
+    /**
+     * Layout whose channel order matches a fixture, or -1 if none does
+     */
+    static int findLayout(int start, int red, int green, int blue, int white);
+
+    /**
+     * True if the byte starts an edit (0xC1-0xC4)
+     */
+    static bool isEditOpcode(uint8_t opcode) { return opcode >= PATCH_OPCODE_ADD && opcode <= PATCH_OPCODE_RETYPE; }
+
+    const uint8_t* getJournal() const { return _journal; }
+    size_t getJournalLength() const { return _journalLength; }
+
+private:
+    PatchFixture _fixtures[PATCH_MAX_FIXTURES];
+    int _count;
+    uint8_t _journal[PATCH_JOURNAL_SIZE];
+    size_t _journalLength;
+
+    // Apply one edit; returns the bytes it took or 0 if it is invalid
+    size_t applyOne(const uint8_t* data, size_t size, int& firstChanged);
+
+    // True if a fixture's channels are all inside the universe
+    static bool fits(int start, uint8_t layout);
+
+    // Append applied edits, compacting the journal first if they do not fit
+    void append(const uint8_t* data, size_t size);
+
+    // Replace the journal with a snapshot of the patch
+    void compact();
+};
+
+#endif // PATCH_EDITOR_H
@@ -0,0 +1,88 @@
+/**
+ * RenderQos.cpp - Deadline accounting and level changes
+ */
+
+#include "RenderQos.h"
+
+// Constructor
+RenderQos::RenderQos() {
+    _budgetUs = QOS_DEFAULT_BUDGET_US;
+    _level = QOS_LEVEL_FULL;
+    _peakLevel = QOS_LEVEL_FULL;
+    _changedMs = 0;
+    _calmSinceMs = 0;
+    _misses = 0;
+    _passes = 0;
+    _passCostUs = 0;
+    _renderCostUs = 0;
+    _maxPassUs = 0;
+}
+
+// Record one pass and adjust the level
+bool RenderQos::endPass(uint32_t nowMs, uint32_t passUs, uint32_t renderUs, bool rendering) {
+    uint8_t before = _level;
+
+    // With nothing to render no frame can be late; the stretch counts as calm
+    if (!rendering) {
+        if (_level > QOS_LEVEL_FULL && nowMs - _calmSinceMs >= QOS_RECOVER_MS &&
+            nowMs - _changedMs >= QOS_RECOVER_MS) {
+            setLevel(_level - 1, nowMs);
+        }
+        return _level != before;
+    }
+
+    _passes++;
+    _passCostUs = _passCostUs == 0 ? passUs : (_passCostUs * 7 + passUs) / 8;
+    _renderCostUs = _renderCostUs == 0 ? renderUs : (_renderCostUs * 7 + renderUs) / 8;
+    if (passUs > _maxPassUs) {
+        _maxPassUs = passUs;
+    }
+
+    bool missed = passUs > _budgetUs;
+    bool atRisk = (uint64_t)_passCostUs * 100 > (uint64_t)_budgetUs * QOS_RISK_PERCENT;
+    bool headroom = (uint64_t)_passCostUs * 100 <= (uint64_t)_budgetUs * QOS_HEADROOM_PERCENT;
+    if (missed) {
+        _misses++;
+    }
+
+    if (missed || atRisk) {
+        // A miss sheds a level at once; a risk only after the last change has had time to show
+        _calmSinceMs = nowMs;
+        if (_level < QOS_LEVEL_MAX && (missed || nowMs - _changedMs >= QOS_ESCALATE_MS)) {
+            setLevel(_level + 1, nowMs);
+        }
+    } else if (!headroom) {
+        _calmSinceMs = nowMs;
+    } else if (_level > QOS_LEVEL_FULL && nowMs - _calmSinceMs >= QOS_RECOVER_MS &&
+               nowMs - _changedMs >= QOS_RECOVER_MS) {
+        setLevel(_level - 1, nowMs);
+    }
+    return _level != before;
+}
+
+// Highest level since the previous call
+uint8_t RenderQos::takePeakLevel() {
+    uint8_t peak = _peakLevel;
+    _peakLevel = _level;
+    return peak;
+}
+
+// Short name of a level for logs
+const char* RenderQos::getLevelName(uint8_t level) {
+    switch (level) {
+        case QOS_LEVEL_FULL: return "full";
+        case QOS_LEVEL_HOLD: return "hold";
+        case QOS_LEVEL_NO_DITHER: return "no dither";
+        default: return "half rate";
+    }
+}
+
+// Change level and restart the timers
+void RenderQos::setLevel(uint8_t level, uint32_t nowMs) {
+    _level = level;
+    _changedMs = nowMs;
+    _calmSinceMs = nowMs;
+    if (level > _peakLevel) {
+        _peakLevel = level;
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * RenderQos.h - Render deadline tracking and graceful degradation
+ *
+ * The output task sends a frame every period whatever happens, but the
+ * frame is only new if loop() published one in time. A long JSON parse, a
+ * flash write or a heavy effect step delays the publish, and the output
+ * repeats the previous frame. loop() reports how long each pass took and
+ * how much of it was rendering; a pass that runs past the frame period
+ * while something is animating is a deadline miss.
+ *
+ * When a pass misses, or the running average cost comes close to the
+ * budget, work is shed in stages, one level at a time:
+ *   1 hold       low-priority consumers of the frame (Art-Net mirror,
+ *                black-box recorder) reuse the last frame instead of
+ *                taking every new one
+ *   2 no dither  temporal dithering is suspended (channels round)
+ *   3 half rate  effect steps and keyframe renders run at half rate
+ * Once passes have stayed well inside the budget for a while, levels are
+ * given back one at a time.
+ *
+ * No Arduino dependencies, so the renderer can drive it on a virtual clock.
+ */
+
+#ifndef RENDER_QOS_H
+#define RENDER_QOS_H
+
+#include <stdint.h>
+
+// Degradation levels (each includes the ones below it)
+#define QOS_LEVEL_FULL 0
+#define QOS_LEVEL_HOLD 1
+#define QOS_LEVEL_NO_DITHER 2
+#define QOS_LEVEL_HALF_RATE 3
+#define QOS_LEVEL_MAX QOS_LEVEL_HALF_RATE
+
+#define QOS_DEFAULT_BUDGET_US 25000     // One DMX frame period
+#define QOS_RISK_PERCENT 75             // Average pass cost that puts the deadline at risk
+#define QOS_HEADROOM_PERCENT 40         // Average pass cost that lets a level go
+#define QOS_ESCALATE_MS 250             // Least time between levels taken on risk alone
+#define QOS_RECOVER_MS 3000             // Time with headroom before a level is given back
+#define QOS_HOLD_DIVIDER 4              // At QOS_LEVEL_HOLD, consumers take every 4th frame
+
+class RenderQos {
+public:
+    RenderQos();
+
+    /**
+     * Set the time a pass may take before the next frame boundary
+     */
+    void setBudget(uint32_t budgetUs) { _budgetUs = budgetUs; }
+    uint32_t getBudget() const { return _budgetUs; }
+
+    /**
+     * Record one loop() pass and adjust the level
+     *
+     * @param nowMs End of the pass
+     * @param passUs Time the pass took (all work that delays the next publish)
+     * @param renderUs The part of it spent rendering and publishing
+     * @param rendering True if a frame was due (an effect or animation runs)
+     * @return True if the level changed
+     */
+    bool endPass(uint32_t nowMs, uint32_t passUs, uint32_t renderUs, bool rendering);
+
+    /**
+     * Current level (QOS_LEVEL_*); safe to read from any task
+     */
+    uint8_t getLevel() const { return _level; }
+
+    /**
+     * Highest level since the previous call (for periodic reports)
+     */
+    uint8_t takePeakLevel();
+
+    static const char* getLevelName(uint8_t level);
+
+    uint32_t getMisses() const { return _misses; }          // Passes over the budget
+    uint32_t getPasses() const { return _passes; }          // Passes with a frame due
+    uint32_t getPassCostUs() const { return _passCostUs; }  // Running average
+    uint32_t getRenderCostUs() const { return _renderCostUs; }
+    uint32_t getMaxPassUs() const { return _maxPassUs; }
+
+private:
+    uint32_t _budgetUs;
+    volatile uint8_t _level;
+    uint8_t _peakLevel;
+    uint32_t _changedMs;        // Last level change
+    uint32_t _calmSinceMs;      // Start of the current stretch with headroom
+    uint32_t _misses;
+    uint32_t _passes;
+    uint32_t _passCostUs;
+    uint32_t _renderCostUs;
+    uint32_t _maxPassUs;
+
+    void setLevel(uint8_t level, uint32_t nowMs);
+};
+
+#endif // RENDER_QOS_H
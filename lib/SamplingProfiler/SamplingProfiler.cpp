@@ -0,0 +1,302 @@
+/**
+ * SamplingProfiler.cpp - Implementation of the sampling profiler
+ */
+
+#include "SamplingProfiler.h"
+#include <driver/timer.h>
+#include <esp_heap_caps.h>
+
+#define PROFILER_TIMER_GROUP TIMER_GROUP_1
+#define PROFILER_TIMER_DIVIDER 80          // 1 MHz counter from the 80 MHz APB clock
+#define PROFILER_TABLE_LIMIT (PROFILER_TABLE_SIZE * 7 / 8)
+#define PROFILER_MAX_TASKS 24              // Rows of the per-task summary
+
+// Arguments of the task that installs a timer on the other core
+struct ProfilerInstall {
+    SamplingProfiler* profiler;
+    int core;
+    bool ok;
+    SemaphoreHandle_t done;
+};
+
+// Task name without spaces, so "PRF" lines split on whitespace
+static const char* taskName(TaskHandle_t task, char* buffer, size_t size) {
+    const char* name = task != NULL ? pcTaskGetName(task) : NULL;
+    if (name == NULL || name[0] == '\0') {
+        return "-";
+    }
+    size_t i = 0;
+    for (; name[i] != '\0' && i + 1 < size; i++) {
+        buffer[i] = name[i] == ' ' ? '_' : name[i];
+    }
+    buffer[i] = '\0';
+    return buffer;
+}
+
+// Constructor
+SamplingProfiler::SamplingProfiler() {
+    memset(_rings, 0, sizeof(_rings));
+    _table = NULL;
+    _entries = 0;
+    _samples = 0;
+    _dropped = 0;
+    _hz = PROFILER_DEFAULT_HZ;
+    _periodUs = 1000000 / PROFILER_DEFAULT_HZ;
+    _startedMs = 0;
+    _elapsedMs = 0;
+    _running = false;
+    for (int core = 0; core < PROFILER_CORES; core++) {
+        _installed[core] = false;
+    }
+}
+
+// Timer interrupt (level 3): EPC3 holds the PC the interrupt was taken at
+bool IRAM_ATTR SamplingProfiler::onTimer(void* arg) {
+    SamplingProfiler* self = (SamplingProfiler*)arg;
+    uint32_t pc;
+    __asm__ __volatile__("rsr %0, epc3" : "=r"(pc));
+    int core = xPortGetCoreID();
+    Ring& ring = self->_rings[core];
+
+    uint16_t head = ring.head;
+    uint16_t next = (head + 1) & (PROFILER_RING_SIZE - 1);
+    if (next == ring.tail) {
+        ring.overflows++;
+    } else {
+        ring.samples[head].pc = pc;
+        ring.samples[head].task = xTaskGetCurrentTaskHandleForCPU(core);
+        ring.head = next;
+    }
+
+    // Next period anywhere in 3/4 to 5/4 of the nominal one (xorshift32)
+    uint32_t x = ring.seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ring.seed = x;
+    uint32_t period = self->_periodUs;
+    timer_group_set_alarm_value_in_isr(PROFILER_TIMER_GROUP, (timer_idx_t)core,
+                                       period - period / 4 + x % (period / 2 + 1));
+    return false;
+}
+
+// Set up the timer of the calling core; its interrupt is allocated there
+bool SamplingProfiler::installTimer(int core) {
+    timer_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.divider = PROFILER_TIMER_DIVIDER;
+    config.counter_dir = TIMER_COUNT_UP;
+    config.counter_en = TIMER_PAUSE;
+    config.alarm_en = TIMER_ALARM_EN;
+    config.auto_reload = TIMER_AUTORELOAD_EN;
+    config.intr_type = TIMER_INTR_LEVEL;
+
+    timer_idx_t timer = (timer_idx_t)core;
+    if (timer_init(PROFILER_TIMER_GROUP, timer, &config) != ESP_OK ||
+        timer_enable_intr(PROFILER_TIMER_GROUP, timer) != ESP_OK ||
+        timer_isr_callback_add(PROFILER_TIMER_GROUP, timer, onTimer, this,
+                               ESP_INTR_FLAG_IRAM | ESP_INTR_FLAG_LEVEL3) != ESP_OK) {
+        return false;
+    }
+    _installed[core] = true;
+    return true;
+}
+
+// Install the timer of the core this task is pinned to, then exit
+void SamplingProfiler::installTask(void* arg) {
+    ProfilerInstall* install = (ProfilerInstall*)arg;
+    install->ok = install->profiler->installTimer(install->core);
+    xSemaphoreGive(install->done);
+    vTaskDelete(NULL);
+}
+
+// Clear the histogram and start sampling both cores
+bool SamplingProfiler::start(uint32_t hz) {
+    stop();
+    if (_table == NULL) {
+        _table = (ProfileEntry*)heap_caps_calloc(PROFILER_TABLE_SIZE, sizeof(ProfileEntry),
+                                                 MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (_table == NULL) {
+            Serial.println("[Profile] Not enough memory for the sample table");
+            return false;
+        }
+    }
+
+    for (int core = 0; core < PROFILER_CORES; core++) {
+        if (_installed[core]) {
+            continue;
+        }
+        bool ok;
+        if (core == xPortGetCoreID()) {
+            ok = installTimer(core);
+        } else {
+            ProfilerInstall install = { this, core, false, xSemaphoreCreateBinary() };
+            ok = install.done != NULL &&
+                 xTaskCreatePinnedToCore(installTask, "ProfInstall", 2048, &install,
+                                         configMAX_PRIORITIES - 1, NULL, core) == pdPASS &&
+                 xSemaphoreTake(install.done, portMAX_DELAY) == pdTRUE && install.ok;
+            if (install.done != NULL) {
+                vSemaphoreDelete(install.done);
+            }
+        }
+        if (!ok) {
+            Serial.printf("[Profile] Could not install the sampling timer on core %d\n", core);
+            return false;
+        }
+    }
+
+    memset(_table, 0, PROFILER_TABLE_SIZE * sizeof(ProfileEntry));
+    _entries = 0;
+    _samples = 0;
+    _dropped = 0;
+    _elapsedMs = 0;
+    _hz = max((uint32_t)PROFILER_MIN_HZ, min(hz, (uint32_t)PROFILER_MAX_HZ));
+    _periodUs = 1000000 / _hz;
+
+    for (int core = 0; core < PROFILER_CORES; core++) {
+        _rings[core].head = 0;
+        _rings[core].tail = 0;
+        _rings[core].overflows = 0;
+        _rings[core].seed = esp_random() | 1;
+        timer_set_counter_value(PROFILER_TIMER_GROUP, (timer_idx_t)core, 0);
+        timer_set_alarm_value(PROFILER_TIMER_GROUP, (timer_idx_t)core, _periodUs);
+        timer_start(PROFILER_TIMER_GROUP, (timer_idx_t)core);
+    }
+    _startedMs = millis();
+    _running = true;
+    return true;
+}
+
+// Stop sampling
+void SamplingProfiler::stop() {
+    if (!_running) {
+        return;
+    }
+    for (int core = 0; core < PROFILER_CORES; core++) {
+        timer_pause(PROFILER_TIMER_GROUP, (timer_idx_t)core);
+    }
+    _elapsedMs += millis() - _startedMs;
+    _running = false;
+    poll();
+}
+
+// Move samples from the interrupt rings into the histogram
+void SamplingProfiler::poll() {
+    if (_table == NULL) {
+        return;
+    }
+    for (int core = 0; core < PROFILER_CORES; core++) {
+        Ring& ring = _rings[core];
+        uint16_t tail = ring.tail;
+        while (tail != ring.head) {
+            record(core, ring.samples[tail]);
+            tail = (tail + 1) & (PROFILER_RING_SIZE - 1);
+            ring.tail = tail;
+        }
+    }
+}
+
+// Add a sample to the histogram (open addressing, linear probing)
+void SamplingProfiler::record(uint8_t core, const ProfileSample& sample) {
+    _samples++;
+    uint32_t hash = ((sample.pc * 2654435761UL) >> 12) ^ ((uint32_t)(uintptr_t)sample.task >> 3) ^ core;
+    for (uint16_t probe = 0; probe < PROFILER_TABLE_SIZE; probe++) {
+        ProfileEntry& entry = _table[(hash + probe) & (PROFILER_TABLE_SIZE - 1)];
+        if (entry.count == 0) {
+            if (_entries >= PROFILER_TABLE_LIMIT) {
+                break;
+            }
+            entry.pc = sample.pc;
+            entry.task = sample.task;
+            entry.core = core;
+            entry.count = 1;
+            _entries++;
+            return;
+        }
+        if (entry.pc == sample.pc && entry.task == sample.task && entry.core == core) {
+            entry.count++;
+            return;
+        }
+    }
+    _dropped++;
+}
+
+// Samples lost to full rings or a full histogram
+uint32_t SamplingProfiler::getDropped() const {
+    uint32_t dropped = _dropped;
+    for (int core = 0; core < PROFILER_CORES; core++) {
+        dropped += _rings[core].overflows;
+    }
+    return dropped;
+}
+
+// Print the per-task summary and the histogram
+void SamplingProfiler::printReport(Print& out) {
+    poll();
+    if (_table == NULL) {
+        out.println("[Profile] No profile recorded");
+        return;
+    }
+    uint32_t elapsedMs = _elapsedMs + (_running ? millis() - _startedMs : 0);
+    out.printf("[Profile] %lu samples in %lu.%lu s at %lu Hz per core, %lu dropped%s\n",
+               (unsigned long)_samples, (unsigned long)(elapsedMs / 1000), (unsigned long)(elapsedMs % 1000 / 100),
+               (unsigned long)_hz, (unsigned long)getDropped(), _running ? " (running)" : "");
+
+    // Share of each core's samples per task
+    struct TaskShare {
+        TaskHandle_t task;
+        uint8_t core;
+        uint32_t count;
+    };
+    TaskShare tasks[PROFILER_MAX_TASKS];
+    int taskCount = 0;
+    uint32_t coreSamples[PROFILER_CORES] = { 0 };
+    for (int i = 0; i < PROFILER_TABLE_SIZE; i++) {
+        const ProfileEntry& entry = _table[i];
+        if (entry.count == 0) {
+            continue;
+        }
+        coreSamples[entry.core] += entry.count;
+        int t = 0;
+        while (t < taskCount && (tasks[t].task != entry.task || tasks[t].core != entry.core)) {
+            t++;
+        }
+        if (t == taskCount) {
+            if (taskCount == PROFILER_MAX_TASKS) {
+                continue;
+            }
+            tasks[taskCount].task = entry.task;
+            tasks[taskCount].core = entry.core;
+            tasks[taskCount].count = 0;
+            taskCount++;
+        }
+        tasks[t].count += entry.count;
+    }
+    for (int i = 1; i < taskCount; i++) {
+        TaskShare share = tasks[i];
+        int j = i;
+        while (j > 0 && (tasks[j - 1].core > share.core ||
+                         (tasks[j - 1].core == share.core && tasks[j - 1].count < share.count))) {
+            tasks[j] = tasks[j - 1];
+            j--;
+        }
+        tasks[j] = share;
+    }
+    char name[24];
+    for (int i = 0; i < taskCount; i++) {
+        out.printf("[Profile] core %u  %-16s %5.1f%%\n", tasks[i].core, taskName(tasks[i].task, name, sizeof(name)),
+                   100.0f * tasks[i].count / coreSamples[tasks[i].core]);
+    }
+
+    // Raw histogram for tools/profile
+    out.printf("PRF begin %lu %lu %lu %lu\n", (unsigned long)_hz, (unsigned long)elapsedMs,
+               (unsigned long)_samples, (unsigned long)getDropped());
+    for (int i = 0; i < PROFILER_TABLE_SIZE; i++) {
+        const ProfileEntry& entry = _table[i];
+        if (entry.count != 0) {
+            out.printf("PRF %u %s %08lx %lu\n", entry.core, taskName(entry.task, name, sizeof(name)),
+                       (unsigned long)entry.pc, (unsigned long)entry.count);
+        }
+    }
+    out.println("PRF end");
+}
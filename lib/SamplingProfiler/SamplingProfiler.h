@@ -0,0 +1,123 @@
+/**
+ * SamplingProfiler.h - Timer-interrupt sampling profiler for both cores
+ *
+ * A general-purpose timer on each core interrupts at the sampling rate, at
+ * level 3 so the interrupted program counter is still in EPC3 when the
+ * handler runs. The handler stores that PC and the task running on its
+ * core in a per-core ring buffer; poll() drains the rings from loop() into
+ * a histogram of (core, task, PC) counts, so a profile can run for minutes
+ * in fixed memory. Each period is jittered by up to a quarter so the
+ * samples do not lock onto the 25 ms frame cycle.
+ *
+ * Only the interrupted PC is recorded, not the call stack: code that
+ * runs with interrupts masked at level 3 or above (critical sections, flash
+ * writes) cannot be sampled and shows up under whatever runs next.
+ *
+ * printReport() writes "PRF" lines that tools/profile symbolizes against
+ * the firmware ELF into a flat profile or folded stacks for a flame graph.
+ */
+
+#ifndef SAMPLING_PROFILER_H
+#define SAMPLING_PROFILER_H
+
+#include <Arduino.h>
+
+#ifndef PROFILER_TABLE_SIZE
+#define PROFILER_TABLE_SIZE 1024       // Distinct (core, task, PC) entries (power of two)
+#endif
+#define PROFILER_RING_SIZE 512         // Samples per core between two poll() calls (power of two)
+#define PROFILER_DEFAULT_HZ 1000
+#define PROFILER_MIN_HZ 10
+#define PROFILER_MAX_HZ 2000           // A 100 ms loop() drains 200 samples per core
+#define PROFILER_CORES 2
+
+// One sample as the interrupt stores it
+struct ProfileSample {
+    uint32_t pc;
+    TaskHandle_t task;
+};
+
+// One histogram entry
+struct ProfileEntry {
+    uint32_t pc;
+    TaskHandle_t task;
+    uint32_t count;
+    uint8_t core;
+};
+
+class SamplingProfiler {
+public:
+    SamplingProfiler();
+
+    /**
+     * Clear the histogram and start sampling both cores
+     *
+     * The timers are installed on the first start (group 1, one timer per
+     * core) and only paused and resumed afterwards.
+     *
+     * @param hz Samples per second on each core
+     * @return True if sampling started
+     */
+    bool start(uint32_t hz = PROFILER_DEFAULT_HZ);
+
+    /**
+     * Stop sampling; the histogram is kept for printReport()
+     */
+    void stop();
+
+    /**
+     * Move samples from the interrupt rings into the histogram; call from
+     * loop() at least every PROFILER_RING_SIZE sampling periods
+     */
+    void poll();
+
+    /**
+     * Print the share of samples per task, then one "PRF" line per
+     * histogram entry for tools/profile
+     */
+    void printReport(Print& out);
+
+    bool isRunning() const { return _running; }
+    uint32_t getRate() const { return _hz; }
+    uint32_t getSamples() const { return _samples; }
+
+    /**
+     * Samples lost to full rings or a full histogram
+     */
+    uint32_t getDropped() const;
+
+private:
+    struct Ring {
+        ProfileSample samples[PROFILER_RING_SIZE];
+        volatile uint16_t head;   // Written by the interrupt
+        volatile uint16_t tail;   // Written by poll()
+        volatile uint32_t overflows;
+        uint32_t seed;            // Jitter generator state
+    };
+
+    Ring _rings[PROFILER_CORES];
+    ProfileEntry* _table;
+    uint16_t _entries;
+    uint32_t _samples;
+    uint32_t _dropped;            // Samples that found the histogram full
+    uint32_t _hz;
+    uint32_t _periodUs;
+    uint32_t _startedMs;
+    uint32_t _elapsedMs;
+    bool _running;
+    bool _installed[PROFILER_CORES];
+
+    // Timer interrupt: record the interrupted PC and task, re-arm with jitter
+    static bool IRAM_ATTR onTimer(void* arg);
+
+    // Set up the timer of the calling core
+    bool installTimer(int core);
+
+    // Run installTimer() in a short task pinned to the other core
+    static void installTask(void* arg);
+
+    // Add a sample to the histogram
+    void record(uint8_t core, const ProfileSample& sample);
+};
+
+#endif // SAMPLING_PROFILER_H
@@ -0,0 +1,351 @@
+/**
+ * SceneScheduler.cpp - Schedule planning and the sunrise equation
+ */
+
+#include "SceneScheduler.h"
+#include <math.h>
+
+#define SCHEDULE_SECONDS_PER_DAY 86400L
+#define SCHEDULE_LOOKAHEAD_DAYS 8           // A day mask repeats within a week
+#define SCHEDULE_UNIX_EPOCH_JD 2440587.5    // Julian date of 1970-01-01 00:00 UTC
+#define SCHEDULE_J2000 2451545.0
+
+static const double DEG = M_PI / 180.0;
+
+// Day number of a civil date (days since 1970-01-01, proleptic Gregorian)
+static int32_t daysFromCivil(int32_t year, int month, int day) {
+    year -= month <= 2;
+    int32_t era = (year >= 0 ? year : year - 399) / 400;
+    int32_t yearOfEra = year - era * 400;
+    int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// Year of a day number
+static int32_t yearOfDay(int32_t days) {
+    days += 719468;
+    int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int32_t dayOfEra = days - era * 146097;
+    int32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int32_t monthIndex = (5 * dayOfYear + 2) / 153;
+    return yearOfEra + era * 400 + (monthIndex >= 10);
+}
+
+// Local standard time of a daylight saving change in a year
+static int64_t changeTime(const ScheduleDstChange& change, int32_t year) {
+    int32_t day;
+    if (change.week >= 5) {
+        // Last such weekday: step back from the last day of the month
+        int32_t last = change.month == 12 ? daysFromCivil(year + 1, 1, 1) - 1
+                                          : daysFromCivil(year, change.month + 1, 1) - 1;
+        day = last - ((last + 4) % 7 - change.weekday + 7) % 7;
+    } else {
+        int32_t first = daysFromCivil(year, change.month, 1);
+        day = first + (change.weekday - (first + 4) % 7 + 7) % 7 + (change.week - 1) * 7;
+    }
+    return (int64_t)day * SCHEDULE_SECONDS_PER_DAY + change.hour * 3600L;
+}
+
+// True if a change is in range
+static bool isValidChange(const ScheduleDstChange& change) {
+    return change.month >= 1 && change.month <= 12 && change.week >= 1 && change.week <= 5 &&
+           change.weekday <= 6 && change.hour <= 23;
+}
+
+// True if a daylight saving rule is off or in range
+static bool isValidDst(const ScheduleDst& dst) {
+    return dst.shift == 0 || (isValidChange(dst.start) && isValidChange(dst.end) && dst.shift <= 120);
+}
+
+// True if a rule's days, time and action are in range
+static bool isValidRule(const ScheduleRule& rule) {
+    bool timeValid = rule.anchor == SCHEDULE_ANCHOR_TIME ? rule.minutes >= 0 && rule.minutes < 24 * 60
+                                                         : abs(rule.minutes) <= 12 * 60;
+    return rule.days <= SCHEDULE_EVERY_DAY && rule.anchor <= SCHEDULE_ANCHOR_SUNSET && timeValid &&
+           TriggerEngine::isValidAction(rule.action, rule.args);
+}
+
+// Constructor
+SceneScheduler::SceneScheduler() {
+    memset(&_config, 0, sizeof(_config));
+    _config.version = SCHEDULE_CONFIG_VERSION;
+    _action = NULL;
+    _actionContext = NULL;
+    _nextFire = SCHEDULE_NEVER;
+    _nextRule = -1;
+    _lastNow = 0;
+    _clockSet = false;
+    _fired = 0;
+    for (int i = 0; i < SCHEDULE_MAX_RULES; i++) {
+        _ruleNext[i] = SCHEDULE_NEVER;
+    }
+}
+
+// Set the callback for rules that fire
+void SceneScheduler::begin(ScheduleActionFn action, void* context) {
+    _action = action;
+    _actionContext = context;
+}
+
+// Apply a site or rules downlink
+bool SceneScheduler::configure(const uint8_t* data, size_t size) {
+    if (size < 1 || !isConfigOpcode(data[0])) {
+        return false;
+    }
+    ScheduleConfig config = _config;
+
+    if (data[0] == SCHEDULE_OPCODE_SITE) {
+        if (size != 7 && size != 7 + SCHEDULE_DST_SIZE) {
+            return false;
+        }
+        int16_t latitude = (int16_t)(data[1] | (data[2] << 8));
+        int16_t longitude = (int16_t)(data[3] | (data[4] << 8));
+        int16_t utcOffset = (int16_t)(data[5] | (data[6] << 8));
+        if (abs(latitude) > 9000 || abs(longitude) > 18000 || abs(utcOffset) > 14 * 60) {
+            return false;
+        }
+        config.latitude = latitude;
+        config.longitude = longitude;
+        config.utcOffset = utcOffset;
+
+        // Without a daylight saving rule the offset is fixed
+        memset(&config.dst, 0, sizeof(config.dst));
+        if (size == 7 + SCHEDULE_DST_SIZE) {
+            const uint8_t* bytes = data + 7;
+            ScheduleDstChange* changes[2] = { &config.dst.start, &config.dst.end };
+            for (int c = 0; c < 2; c++) {
+                changes[c]->month = bytes[c * 4];
+                changes[c]->week = bytes[c * 4 + 1];
+                changes[c]->weekday = bytes[c * 4 + 2];
+                changes[c]->hour = bytes[c * 4 + 3];
+            }
+            config.dst.shift = bytes[8];
+            if (!isValidDst(config.dst)) {
+                return false;
+            }
+        }
+    } else {
+        if (size < 2 || (size - 2) % SCHEDULE_RULE_SIZE != 0) {
+            return false;
+        }
+        size_t first = data[1];
+        size_t count = (size - 2) / SCHEDULE_RULE_SIZE;
+        if (first > config.numRules || first + count > SCHEDULE_MAX_RULES) {
+            return false;
+        }
+        for (size_t r = 0; r < count; r++) {
+            const uint8_t* bytes = data + 2 + r * SCHEDULE_RULE_SIZE;
+            ScheduleRule& rule = config.rules[first + r];
+            rule.days = bytes[0];
+            rule.anchor = bytes[1];
+            rule.minutes = (int16_t)(bytes[2] | (bytes[3] << 8));
+            rule.action = bytes[4];
+            memcpy(rule.args, bytes + 5, 4);
+            if (!isValidRule(rule)) {
+                return false;
+            }
+        }
+        config.numRules = (uint8_t)(first + count);
+    }
+    return loadConfig(config);
+}
+
+// Take a stored or edited configuration
+bool SceneScheduler::loadConfig(const ScheduleConfig& config) {
+    if (config.version != SCHEDULE_CONFIG_VERSION || config.numRules > SCHEDULE_MAX_RULES) {
+        return false;
+    }
+    // A stored blob gets the same checks as the downlinks that built it
+    if (abs(config.latitude) > 9000 || abs(config.longitude) > 18000 || abs(config.utcOffset) > 14 * 60 ||
+        !isValidDst(config.dst)) {
+        return false;
+    }
+    for (int i = 0; i < config.numRules; i++) {
+        if (!isValidRule(config.rules[i])) {
+            return false;
+        }
+    }
+    _config = config;
+    if (_clockSet) {
+        plan(_lastNow);
+    }
+    return true;
+}
+
+// Fire the rules that are due
+void SceneScheduler::update(uint32_t now) {
+    if (now < SCHEDULE_MIN_EPOCH) {
+        return;
+    }
+
+    // First set clock: plan, then restore the latest look of the past week
+    if (!_clockSet) {
+        _clockSet = true;
+        _lastNow = now;
+        plan(now);
+        int latest = -1;
+        uint32_t latestAt = 0;
+        for (int i = 0; i < _config.numRules; i++) {
+            uint32_t at = lastFireBefore(_config.rules[i], now);
+            if (at != 0 && at >= latestAt) {
+                latest = i;
+                latestAt = at;
+            }
+        }
+        if (latest >= 0) {
+            fire(latest);
+        }
+        return;
+    }
+
+    // The clock was stepped: what it skipped is not caught up
+    if (now + SCHEDULE_MAX_SLIP_S < _lastNow || now > _lastNow + SCHEDULE_MAX_SLIP_S) {
+        _lastNow = now;
+        plan(now);
+        return;
+    }
+    _lastNow = now;
+
+    while (_nextFire <= now) {
+        int index = _nextRule;
+        fire(index);
+        _ruleNext[index] = nextFireAfter(_config.rules[index], now);
+        pickNext();
+    }
+}
+
+// True if a local standard time falls in daylight saving time
+bool SceneScheduler::isDst(int64_t standardTime) const {
+    if (_config.dst.shift == 0) {
+        return false;
+    }
+    int32_t year = yearOfDay((int32_t)(standardTime / SCHEDULE_SECONDS_PER_DAY));
+    int64_t start = changeTime(_config.dst.start, year);
+    int64_t end = changeTime(_config.dst.end, year);
+    // A start after the end spans the new year (southern hemisphere)
+    return start < end ? standardTime >= start && standardTime < end
+                       : standardTime >= start || standardTime < end;
+}
+
+// UTC offset at a Unix time, daylight saving included
+int SceneScheduler::getUtcOffset(uint32_t now) const {
+    int64_t standardTime = (int64_t)now + _config.utcOffset * 60;
+    return _config.utcOffset + (isDst(standardTime) ? _config.dst.shift : 0);
+}
+
+// Local day number of a Unix time
+int32_t SceneScheduler::getLocalDay(uint32_t now) const {
+    return (int32_t)(((int64_t)now + getUtcOffset(now) * 60) / SCHEDULE_SECONDS_PER_DAY);
+}
+
+// Sunrise equation: solar noon from the mean anomaly and the equation of
+// center, then the hour angle at which the sun's upper limb meets the
+// horizon (refraction included). Good to about a minute.
+bool SceneScheduler::getSunEvent(int32_t day, bool sunrise, uint32_t& at) const {
+    double latitude = _config.latitude / 100.0 * DEG;
+    double longitude = _config.longitude / 100.0;
+
+    // Days since J2000 at noon of this date, moved to the site's longitude
+    double n = (day + SCHEDULE_UNIX_EPOCH_JD + 0.5) - SCHEDULE_J2000 + 0.0008 - longitude / 360.0;
+    double anomaly = fmod(357.5291 + 0.98560028 * n, 360.0) * DEG;
+    double center = 1.9148 * sin(anomaly) + 0.0200 * sin(2 * anomaly) + 0.0003 * sin(3 * anomaly);
+    double ecliptic = fmod(anomaly / DEG + center + 180.0 + 102.9372, 360.0) * DEG;
+    double transit = SCHEDULE_J2000 + n + 0.0053 * sin(anomaly) - 0.0069 * sin(2 * ecliptic);
+
+    double sinDeclination = sin(ecliptic) * sin(23.4397 * DEG);
+    double cosDeclination = sqrt(1.0 - sinDeclination * sinDeclination);
+    double cosHour = (sin(-0.833 * DEG) - sin(latitude) * sinDeclination) / (cos(latitude) * cosDeclination);
+    if (!(cosHour >= -1.0 && cosHour <= 1.0)) {
+        return false;
+    }
+    double halfDay = acos(cosHour) / (2 * M_PI);
+    double event = sunrise ? transit - halfDay : transit + halfDay;
+    at = (uint32_t)((event - SCHEDULE_UNIX_EPOCH_JD) * SCHEDULE_SECONDS_PER_DAY + 0.5);
+    return true;
+}
+
+// Time a rule fires on a local day
+bool SceneScheduler::fireTime(const ScheduleRule& rule, int32_t day, uint32_t& at) const {
+    int weekday = (int)((day + 4) % 7);     // 1970-01-01 was a Thursday
+    if (!(rule.days & (1 << weekday))) {
+        return false;
+    }
+    int64_t time;
+    if (rule.anchor == SCHEDULE_ANCHOR_TIME) {
+        // Wall time on the shifted clock maps back to standard time; one
+        // in the spring gap fires at the change
+        int64_t wall = (int64_t)day * SCHEDULE_SECONDS_PER_DAY + rule.minutes * 60;
+        int64_t standardTime = wall;
+        if (isDst(wall - _config.dst.shift * 60)) {
+            standardTime = wall - _config.dst.shift * 60;
+        } else if (isDst(wall)) {
+            standardTime = changeTime(_config.dst.start, yearOfDay(day));
+        }
+        time = standardTime - _config.utcOffset * 60;
+    } else {
+        uint32_t sun;
+        if (!getSunEvent(day, rule.anchor == SCHEDULE_ANCHOR_SUNRISE, sun)) {
+            return false;
+        }
+        time = (int64_t)sun + rule.minutes * 60;
+    }
+    if (time <= 0 || time >= (int64_t)SCHEDULE_NEVER) {
+        return false;
+    }
+    at = (uint32_t)time;
+    return true;
+}
+
+// First fire time of a rule after a time (an offset may move it a day)
+uint32_t SceneScheduler::nextFireAfter(const ScheduleRule& rule, uint32_t after) const {
+    int32_t today = getLocalDay(after);
+    for (int32_t day = today - 1; day <= today + SCHEDULE_LOOKAHEAD_DAYS; day++) {
+        uint32_t at;
+        if (fireTime(rule, day, at) && at > after) {
+            return at;
+        }
+    }
+    return SCHEDULE_NEVER;
+}
+
+// Last fire time of a rule at or before a time
+uint32_t SceneScheduler::lastFireBefore(const ScheduleRule& rule, uint32_t now) const {
+    int32_t today = getLocalDay(now);
+    for (int32_t day = today + 1; day >= today - SCHEDULE_LOOKAHEAD_DAYS; day--) {
+        uint32_t at;
+        if (fireTime(rule, day, at) && at <= now) {
+            return at;
+        }
+    }
+    return 0;
+}
+
+// Work out every rule's next fire time from now
+void SceneScheduler::plan(uint32_t now) {
+    for (int i = 0; i < SCHEDULE_MAX_RULES; i++) {
+        _ruleNext[i] = i < _config.numRules ? nextFireAfter(_config.rules[i], now) : SCHEDULE_NEVER;
+    }
+    pickNext();
+}
+
+// Earliest rule to fire; the lower index goes first at equal times
+void SceneScheduler::pickNext() {
+    _nextFire = SCHEDULE_NEVER;
+    _nextRule = -1;
+    for (int i = 0; i < _config.numRules; i++) {
+        if (_ruleNext[i] < _nextFire) {
+            _nextFire = _ruleNext[i];
+            _nextRule = i;
+        }
+    }
+}
+
+// Hand a rule to the callback
+void SceneScheduler::fire(int index) {
+    _fired++;
+    if (_action != NULL) {
+        _action(_config.rules[index], _actionContext);
+    }
+}
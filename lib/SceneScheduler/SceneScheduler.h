@@ -0,0 +1,199 @@
+/**
+ * SceneScheduler.h - Time-of-day and sunrise/sunset scene schedule
+ *
+ * Runs routine looks (on at sunset, off at midnight) from the node's own
+ * clock, so the server does not have to send them every day. Each rule
+ * has a day mask and fires at a fixed local time or at an offset from
+ * sunrise or sunset. Sun times are computed on the node from the
+ * configured latitude and longitude. The next fire time of every rule is
+ * worked out ahead, so until something is due a check is one comparison.
+ *
+ * Downlinks (the site and rules are saved to flash by the caller):
+ *   0xA0 clock    Unix time, u32 LE (UTC); sets the system clock
+ *   0xA1 site     latitude, longitude (i16 LE, 1/100 degree, north and
+ *                 east positive), UTC offset (i16 LE, minutes), then
+ *                 optionally a daylight saving rule of 9 bytes:
+ *                 start month, week, weekday, hour, end month, week,
+ *                 weekday, hour, shift (minutes); without it the offset
+ *                 is fixed
+ *   0xA2 rules    first index, then rules of 9 bytes written from there;
+ *                 the table ends after the last one ("A2 00" clears it):
+ *                 days, anchor, minutes (i16 LE), action, 4 argument bytes
+ *
+ * Days are a mask with bit 0 = Sunday ... bit 6 = Saturday, in local time.
+ * Minutes are the local time of day for SCHEDULE_ANCHOR_TIME, or an offset
+ * (-720 to 720) from the sun event. Actions are the trigger actions
+ * (TriggerAction), carried out by the caller's callback.
+ *
+ * Daylight saving starts and ends on a weekday of a week of a month
+ * (week 1-4, or 5 for the last), at an hour of local standard time; the
+ * shift is added to the UTC offset in between. The start month may come
+ * after the end month (southern hemisphere). Rules at a wall time that the
+ * spring change skips fire at the change; times the autumn change repeats
+ * fire once, on the first pass.
+ */
+
+#ifndef SCENE_SCHEDULER_H
+#define SCENE_SCHEDULER_H
+
+#include "TriggerEngine.h"
+
+// Downlink opcodes
+#define SCHEDULE_OPCODE_CLOCK 0xA0
+#define SCHEDULE_OPCODE_SITE 0xA1
+#define SCHEDULE_OPCODE_RULES 0xA2
+
+#define SCHEDULE_MAX_RULES 16
+#define SCHEDULE_RULE_SIZE 9                // Bytes of one rule on the wire
+#define SCHEDULE_MIN_EPOCH 1704067200UL     // 2024-01-01: earlier clocks are not set yet
+#define SCHEDULE_MAX_SLIP_S 300             // Larger clock steps replan instead of catching up
+#define SCHEDULE_NEVER 0xFFFFFFFFUL
+#define SCHEDULE_DST_SIZE 9                 // Bytes of the daylight saving rule on the wire
+#define SCHEDULE_CONFIG_VERSION 2
+
+// Rule anchors
+#define SCHEDULE_ANCHOR_TIME 0              // Minutes after local midnight
+#define SCHEDULE_ANCHOR_SUNRISE 1
+#define SCHEDULE_ANCHOR_SUNSET 2
+
+#define SCHEDULE_EVERY_DAY 0x7F
+
+struct ScheduleRule {
+    uint8_t days;           // Bit 0 = Sunday
+    uint8_t anchor;         // SCHEDULE_ANCHOR_*
+    int16_t minutes;
+    uint8_t action;         // TriggerAction
+    uint8_t args[4];
+};
+
+// One daylight saving change: a weekday of a week of a month
+struct ScheduleDstChange {
+    uint8_t month;          // 1-12
+    uint8_t week;           // 1-4, or 5 for the last
+    uint8_t weekday;        // 0 = Sunday
+    uint8_t hour;           // Local standard time
+};
+
+// Daylight saving rule; a shift of 0 keeps the UTC offset fixed
+struct ScheduleDst {
+    ScheduleDstChange start;
+    ScheduleDstChange end;
+    uint8_t shift;          // Minutes added between start and end
+};
+
+// Everything the downlinks set but the clock; stored as one blob
+struct ScheduleConfig {
+    uint8_t version;
+    uint8_t numRules;
+    int16_t latitude;       // 1/100 degree
+    int16_t longitude;
+    int16_t utcOffset;      // Minutes, standard time
+    ScheduleDst dst;
+    ScheduleRule rules[SCHEDULE_MAX_RULES];
+};
+
+/**
+ * Carry out a rule that fired
+ */
+typedef void (*ScheduleActionFn)(const ScheduleRule& rule, void* context);
+
+class SceneScheduler {
+public:
+    SceneScheduler();
+
+    /**
+     * Set the callback for rules that fire
+     */
+    void begin(ScheduleActionFn action, void* context);
+
+    /**
+     * Apply a 0xA1 or 0xA2 downlink
+     *
+     * @return False if it was malformed (nothing changes)
+     */
+    bool configure(const uint8_t* data, size_t size);
+
+    /**
+     * True if the byte starts a site or rules downlink (the clock is set by the caller)
+     */
+    static bool isConfigOpcode(uint8_t opcode) {
+        return opcode == SCHEDULE_OPCODE_SITE || opcode == SCHEDULE_OPCODE_RULES;
+    }
+
+    /**
+     * Configuration to save, and to restore at boot
+     *
+     * loadConfig() checks the site and every rule as configure() does.
+     */
+    const ScheduleConfig& getConfig() const { return _config; }
+    bool loadConfig(const ScheduleConfig& config);
+
+    /**
+     * Fire the rules that are due (call often; cheap until one is)
+     *
+     * The first call with a set clock also fires the latest rule that was
+     * due in the past week, so the look the schedule asks for is restored
+     * after a reboot. A clock step of more than SCHEDULE_MAX_SLIP_S replans
+     * without firing the rules it skipped.
+     *
+     * @param now Unix time in seconds (UTC)
+     */
+    void update(uint32_t now);
+
+    bool isClockSet() const { return _clockSet; }
+    uint32_t getNextFire() const { return _nextFire; }     // SCHEDULE_NEVER if nothing is due
+    int getNextRule() const { return _nextRule; }           // -1 if nothing is due
+    uint32_t getFiredCount() const { return _fired; }
+
+    /**
+     * Sunrise or sunset on a local day
+     *
+     * @param day Local day number (days since 1970-01-01)
+     * @param at Set to the Unix time of the event
+     * @return False if the sun does not rise or set that day (polar day or night)
+     */
+    bool getSunEvent(int32_t day, bool sunrise, uint32_t& at) const;
+
+    /**
+     * Local day number of a Unix time
+     */
+    int32_t getLocalDay(uint32_t now) const;
+
+    /**
+     * UTC offset in minutes at a Unix time, daylight saving included
+     */
+    int getUtcOffset(uint32_t now) const;
+
+private:
+    ScheduleConfig _config;
+    ScheduleActionFn _action;
+    void* _actionContext;
+    uint32_t _ruleNext[SCHEDULE_MAX_RULES];    // Next fire time of each rule
+    uint32_t _nextFire;                         // Earliest of them
+    int _nextRule;
+    uint32_t _lastNow;
+    bool _clockSet;
+    uint32_t _fired;
+
+    // True if a local standard time falls in daylight saving time
+    bool isDst(int64_t standardTime) const;
+
+    // Time a rule fires on a local day, false if it does not that day
+    bool fireTime(const ScheduleRule& rule, int32_t day, uint32_t& at) const;
+
+    // First fire time of a rule after a time, or SCHEDULE_NEVER
+    uint32_t nextFireAfter(const ScheduleRule& rule, uint32_t after) const;
+
+    // Last fire time of a rule at or before a time, or 0
+    uint32_t lastFireBefore(const ScheduleRule& rule, uint32_t now) const;
+
+    // Work out every rule's next fire time from now
+    void plan(uint32_t now);
+
+    // Pick the earliest rule to fire
+    void pickNext();
+
+    void fire(int index);
+};
+
+#endif // SCENE_SCHEDULER_H
@@ -0,0 +1,207 @@
+/**
+ * SerialLink.cpp - Framing, checksums and input splitting for the serial link
+ */
+
+#include "SerialLink.h"
+#include <string.h>
+
+// Little-endian field helpers
+static void putU16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void putU32(uint8_t* out, uint32_t value) {
+    putU16(out, (uint16_t)value);
+    putU16(out + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t getU16(const uint8_t* data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t* data) {
+    return getU16(data) | ((uint32_t)getU16(data + 2) << 16);
+}
+
+// CRC-16/CCITT-FALSE, bitwise (messages are short)
+uint16_t serialLinkCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Build 0x00, COBS(type, sequence, payload, CRC), 0x00
+size_t serialLinkEncode(uint8_t type, uint8_t sequence, const uint8_t* payload, size_t length, uint8_t* out) {
+    if (length > SERIAL_LINK_MAX_PAYLOAD) {
+        return 0;
+    }
+    uint8_t message[SERIAL_LINK_MAX_MESSAGE];
+    message[0] = type;
+    message[1] = sequence;
+    if (length > 0) {
+        memcpy(message + 2, payload, length);
+    }
+    putU16(message + 2 + length, serialLinkCrc16(message, 2 + length));
+    size_t messageLength = length + 4;
+
+    // Each block is a code byte (distance to the next zero) and up to 254
+    // non-zero bytes
+    size_t written = 0;
+    out[written++] = 0x00;
+    size_t code = written++;
+    uint8_t run = 1;
+    for (size_t i = 0; i < messageLength; i++) {
+        if (message[i] != 0) {
+            out[written++] = message[i];
+            run++;
+        }
+        if (message[i] == 0 || run == 0xFF) {
+            out[code] = run;
+            code = written++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    out[written++] = 0x00;
+    return written;
+}
+
+// Undo COBS in place and check the CRC
+bool serialLinkDecode(uint8_t* data, size_t length, SerialLinkMessage& message) {
+    size_t read = 0;
+    size_t written = 0;
+    while (read < length) {
+        uint8_t code = data[read++];
+        if (code == 0 || read + code - 1 > length) {
+            return false;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            data[written++] = data[read++];
+        }
+        if (code != 0xFF && read < length) {
+            data[written++] = 0;
+        }
+    }
+    if (written < 4 || serialLinkCrc16(data, written - 2) != getU16(data + written - 2)) {
+        return false;
+    }
+    message.type = data[0];
+    message.sequence = data[1];
+    message.payload = data + 2;
+    message.length = written - 4;
+    return true;
+}
+
+// Store the telemetry reply payload
+void serialLinkPutTelemetry(const SerialLinkTelemetry& telemetry, uint8_t* out) {
+    putU32(out, telemetry.uptimeMs);
+    putU32(out + 4, telemetry.freeHeap);
+    putU32(out + 8, telemetry.framesSent);
+    putU32(out + 12, telemetry.framesSkipped);
+    putU32(out + 16, telemetry.linkMessages);
+    putU32(out + 20, telemetry.linkErrors);
+    putU32(out + 24, telemetry.linkFrames);
+    putU16(out + 28, telemetry.highestChannel);
+    out[30] = telemetry.fixtures;
+    out[31] = telemetry.flags;
+    putU16(out + 32, (uint16_t)telemetry.rssi);
+    out[34] = (uint8_t)telemetry.snr;
+    out[35] = 0;
+}
+
+// Load the telemetry reply payload
+bool serialLinkGetTelemetry(const uint8_t* data, size_t length, SerialLinkTelemetry& telemetry) {
+    if (length < SERIAL_LINK_TELEMETRY_SIZE) {
+        return false;
+    }
+    telemetry.uptimeMs = getU32(data);
+    telemetry.freeHeap = getU32(data + 4);
+    telemetry.framesSent = getU32(data + 8);
+    telemetry.framesSkipped = getU32(data + 12);
+    telemetry.linkMessages = getU32(data + 16);
+    telemetry.linkErrors = getU32(data + 20);
+    telemetry.linkFrames = getU32(data + 24);
+    telemetry.highestChannel = getU16(data + 28);
+    telemetry.fixtures = data[30];
+    telemetry.flags = data[31];
+    telemetry.rssi = (int16_t)getU16(data + 32);
+    telemetry.snr = (int8_t)data[34];
+    telemetry.reserved = 0;
+    return true;
+}
+
+// Constructor
+SerialLinkDecoder::SerialLinkDecoder(SerialLinkHandler* handler) {
+    _handler = handler;
+    _length = 0;
+    _overflow = false;
+    _binary = false;
+    _lastByteMs = 0;
+    _lastMessageMs = 0;
+    _messages = 0;
+    _errors = 0;
+}
+
+// Split received bytes into lines (text mode) or frames (binary mode)
+void SerialLinkDecoder::feed(const uint8_t* data, size_t length, uint32_t nowMs) {
+    if (length == 0) {
+        return;
+    }
+    if (_binary && nowMs - _lastByteMs >= SERIAL_LINK_IDLE_MS) {
+        _binary = false;
+        _length = 0;
+        _overflow = false;
+    }
+    _lastByteMs = nowMs;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+        if (c == 0x00) {
+            // A delimiter ends a frame, and in text mode drops the partial line
+            if (_binary) {
+                endFrame();
+            }
+            _binary = true;
+            _length = 0;
+            _overflow = false;
+        } else if (!_binary && (c == '\n' || c == '\r')) {
+            endLine();
+            _length = 0;
+            _overflow = false;
+        } else if (_length < (_binary ? sizeof(_buffer) : (size_t)SERIAL_LINK_MAX_LINE)) {
+            _buffer[_length++] = c;
+        } else {
+            _overflow = true;
+        }
+    }
+}
+
+// Decode the frame collected before a delimiter
+void SerialLinkDecoder::endFrame() {
+    if (_length == 0) {
+        return;
+    }
+    SerialLinkMessage message;
+    if (_overflow || !serialLinkDecode(_buffer, _length, message)) {
+        _errors++;
+        return;
+    }
+    _messages++;
+    _lastMessageMs = _lastByteMs;
+    _handler->onMessage(message);
+}
+
+// Pass on a complete text line if it is a JSON command
+void SerialLinkDecoder::endLine() {
+    if (_overflow || _length == 0 || _buffer[0] != '{') {
+        return;
+    }
+    _buffer[_length] = '\0';
+    _handler->onLine((const char*)_buffer);
+}
@@ -0,0 +1,166 @@
+/**
+ * SerialLink.h - Binary control protocol for the USB serial port
+ *
+ * Lets a laptop drive the node at frame rate over the USB cable: the same
+ * commands as a LoRa downlink, full DMX frames, and telemetry readback.
+ * Shared by the firmware and the host tool (tools/seriallink), so this
+ * file only uses the C library.
+ *
+ * Each message is COBS-encoded and sent between two 0x00 bytes:
+ *
+ *   type (1 byte), sequence (1 byte), payload, CRC-16/CCITT-FALSE (LE)
+ *
+ * The CRC covers type, sequence and payload. A reply has the request's
+ * type with bit 7 set and its sequence number, and starts with a status
+ * byte. Multi-byte fields are little endian.
+ *
+ *   0x01 ping       any payload; echoed back
+ *   0x02 command    a downlink payload, handled as if it came over LoRa
+ *   0x03 frame      start channel (u16), slot values; no reply
+ *   0x04 telemetry  no payload; reply is a SerialLinkTelemetry
+ *   0x05 read       start channel (u16), count (u16); reply is the start
+ *                   channel and the on-air slot values
+ *   0x06 baud       rate (u32); the reply goes out at the old rate
+ *
+ * The console stays usable: until the first 0x00 arrives, input is read
+ * as text and lines starting with '{' are JSON commands. After that the
+ * port is in binary mode until it has been quiet for SERIAL_LINK_IDLE_MS.
+ * Log output is not framed; the host skips anything between frames that
+ * does not decode.
+ */
+
+#ifndef SERIAL_LINK_H
+#define SERIAL_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SERIAL_LINK_MAX_PAYLOAD 516      // Frame message: start channel + 512 slots + 2 spare
+#define SERIAL_LINK_MAX_MESSAGE (SERIAL_LINK_MAX_PAYLOAD + 4)
+#define SERIAL_LINK_MAX_ENCODED (SERIAL_LINK_MAX_MESSAGE + SERIAL_LINK_MAX_MESSAGE / 254 + 3)
+#define SERIAL_LINK_MAX_LINE 512         // Longest JSON line in text mode
+#define SERIAL_LINK_IDLE_MS 3000         // Quiet time that returns the port to text mode
+
+// Message types
+#define SERIAL_LINK_PING 0x01
+#define SERIAL_LINK_COMMAND 0x02
+#define SERIAL_LINK_FRAME 0x03
+#define SERIAL_LINK_TELEMETRY 0x04
+#define SERIAL_LINK_READ 0x05
+#define SERIAL_LINK_BAUD 0x06
+#define SERIAL_LINK_REPLY 0x80           // Set in the type of every reply
+
+// Reply status
+#define SERIAL_LINK_OK 0
+#define SERIAL_LINK_FAILED 1             // Command was rejected or failed
+#define SERIAL_LINK_BAD_REQUEST 2        // Malformed payload or out-of-range channels
+#define SERIAL_LINK_UNKNOWN 3            // Unknown message type
+#define SERIAL_LINK_NOT_READY 4          // DMX output not running
+
+#define SERIAL_LINK_TELEMETRY_SIZE 36
+
+// A decoded message; payload points into the decoder's buffer
+struct SerialLinkMessage {
+    uint8_t type;
+    uint8_t sequence;
+    const uint8_t* payload;
+    size_t length;
+};
+
+// Telemetry reply, after the status byte
+struct SerialLinkTelemetry {
+    uint32_t uptimeMs;
+    uint32_t freeHeap;
+    uint32_t framesSent;       // DMX frames put on the wire
+    uint32_t framesSkipped;    // Idle frames not sent
+    uint32_t linkMessages;     // Messages received on this link
+    uint32_t linkErrors;       // Frames that failed COBS or CRC checks
+    uint32_t linkFrames;       // Frame messages applied
+    uint16_t highestChannel;
+    uint8_t fixtures;
+    uint8_t flags;             // Bit 0: DMX running, bit 1: LoRa joined, bit 2: pattern active
+    int16_t rssi;              // Last downlink
+    int8_t snr;
+    uint8_t reserved;
+};
+
+/**
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF)
+ */
+uint16_t serialLinkCrc16(const uint8_t* data, size_t length);
+
+/**
+ * Build a framed message: 0x00, COBS(type, sequence, payload, CRC), 0x00
+ *
+ * @param out Buffer of at least SERIAL_LINK_MAX_ENCODED bytes
+ * @return Bytes written, or 0 if the payload is too long
+ */
+size_t serialLinkEncode(uint8_t type, uint8_t sequence, const uint8_t* payload, size_t length, uint8_t* out);
+
+/**
+ * Decode the bytes between two delimiters in place and check the CRC
+ *
+ * @param data Encoded bytes without the delimiters; overwritten
+ * @param message Filled in on success; the payload points into data
+ * @return True if the frame is a valid message
+ */
+bool serialLinkDecode(uint8_t* data, size_t length, SerialLinkMessage& message);
+
+/**
+ * Store and load the telemetry reply payload (without the status byte)
+ */
+void serialLinkPutTelemetry(const SerialLinkTelemetry& telemetry, uint8_t* out);
+bool serialLinkGetTelemetry(const uint8_t* data, size_t length, SerialLinkTelemetry& telemetry);
+
+// Receiver of decoded messages and text lines
+class SerialLinkHandler {
+public:
+    virtual ~SerialLinkHandler() {}
+
+    /**
+     * A valid message arrived
+     */
+    virtual void onMessage(const SerialLinkMessage& message) = 0;
+
+    /**
+     * A text line starting with '{' arrived (text mode only)
+     */
+    virtual void onLine(const char* line) = 0;
+};
+
+/**
+ * Splits the serial input into text lines and framed messages
+ */
+class SerialLinkDecoder {
+public:
+    SerialLinkDecoder(SerialLinkHandler* handler);
+
+    /**
+     * Consume received bytes
+     *
+     * @param nowMs Current time, for the return to text mode
+     */
+    void feed(const uint8_t* data, size_t length, uint32_t nowMs);
+
+    bool isBinary() const { return _binary; }
+    uint32_t getMessages() const { return _messages; }
+    uint32_t getErrors() const { return _errors; }
+    uint32_t getLastMessageMs() const { return _lastMessageMs; }
+
+private:
+    SerialLinkHandler* _handler;
+    uint8_t _buffer[SERIAL_LINK_MAX_ENCODED];
+    size_t _length;
+    bool _overflow;              // Current frame or line is too long and is dropped
+    bool _binary;
+    uint32_t _lastByteMs;
+    uint32_t _lastMessageMs;
+    uint32_t _messages;
+    uint32_t _errors;
+
+    // Handle the bytes collected before a delimiter
+    void endFrame();
+    void endLine();
+};
+
+#endif // SERIAL_LINK_H
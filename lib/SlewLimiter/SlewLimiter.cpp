@@ -0,0 +1,114 @@
+/**
+ * SlewLimiter.cpp - Implementation of the slew-rate limiting stage
+ */
+
+#include "SlewLimiter.h"
+#include <string.h>
+
+// Constructor
+SlewLimiter::SlewLimiter(uint16_t* rates, uint16_t* position, uint16_t frameSize) {
+    _rates = rates;
+    _position = position;
+    _frameSize = frameSize;
+    memset(_position, 0, frameSize * sizeof(uint16_t));
+    clear();
+}
+
+// Remove all limits
+void SlewLimiter::clear() {
+    memset(_rates, 0, _frameSize * sizeof(uint16_t));
+    _first = _frameSize;
+    _last = 0;
+}
+
+// Set the limit for one channel
+void SlewLimiter::setLimit(uint16_t channel, uint16_t rate) {
+    setLimitRange(channel, 1, rate);
+}
+
+// Set the same limit for a range of channels
+void SlewLimiter::setLimitRange(uint16_t start, uint16_t count, uint16_t rate) {
+    if (start < 1 || start >= _frameSize) {
+        return;
+    }
+    if (count > _frameSize - start) {
+        count = _frameSize - start;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        _rates[start + i] = rate;
+    }
+    updateRange();
+}
+
+// Restore a saved rate table
+void SlewLimiter::setRates(const uint16_t* rates) {
+    memcpy(_rates, rates, _frameSize * sizeof(uint16_t));
+    _rates[0] = 0;  // Never hold back the start code
+    updateRange();
+}
+
+// Recompute the limited range after a change
+void SlewLimiter::updateRange() {
+    _first = _frameSize;
+    _last = 0;
+    for (uint16_t i = 1; i < _frameSize; i++) {
+        if (_rates[i] != 0) {
+            if (_first == _frameSize) _first = i;
+            _last = i;
+        }
+    }
+}
+
+// Snap the current output to a frame
+void SlewLimiter::reset(const uint8_t* frame) {
+    for (uint16_t i = 0; i < _frameSize; i++) {
+        _position[i] = (uint16_t)frame[i] << 8;
+    }
+}
+
+// Move the output towards the target frame
+bool SlewLimiter::process(const uint8_t* target, uint8_t* out, uint32_t dtMs,
+                          const uint8_t* targetFraction, uint8_t* outFraction) {
+    if (outFraction != NULL) {
+        if (targetFraction != NULL) {
+            memcpy(outFraction, targetFraction, _frameSize);
+        } else {
+            memset(outFraction, 0, _frameSize);
+        }
+    }
+    if (!isEnabled()) {
+        memcpy(out, target, _frameSize);
+        return false;
+    }
+    if (dtMs > SLEW_MAX_FRAME_MS) {
+        dtMs = SLEW_MAX_FRAME_MS;
+    }
+
+    // Unlimited channels outside the range pass straight through
+    memcpy(out, target, _first);
+    memcpy(out + _last + 1, target + _last + 1, _frameSize - _last - 1);
+
+    bool settling = false;
+    for (uint16_t i = _first; i <= _last; i++) {
+        int32_t goal = ((int32_t)target[i] << 8) | (targetFraction != NULL ? targetFraction[i] : 0);
+        int32_t pos = _position[i];
+        uint32_t rate = _rates[i];
+
+        // Allowed step this frame in 8.8; unlimited channels jump straight there
+        int32_t step = rate ? (int32_t)((rate * dtMs * 256 + 999) / 1000) : 0x10000;
+        int32_t diff = goal - pos;
+        if (diff > step) diff = step;
+        if (diff < -step) diff = -step;
+        pos += diff;
+
+        _position[i] = (uint16_t)pos;
+        if (outFraction != NULL) {
+            out[i] = (uint8_t)(pos >> 8);
+            outFraction[i] = (uint8_t)pos;
+        } else {
+            out[i] = (uint8_t)((pos + 0x80) >> 8);
+        }
+        settling |= (pos != goal);
+    }
+    return settling;
+}
@@ -0,0 +1,133 @@
+/**
+ * SlewLimiter.h - Per-channel maximum rate of change for DMX output
+ *
+ * Sits between the composed DMX frame and the wire. Channels with a limit
+ * move towards their target by at most `rate` DMX steps per second, so
+ * abrupt jumps from lights commands or strobe patterns turn into short ramps
+ * that mechanical fixtures (pan/tilt, dimmer curves) can follow. It also
+ * smooths irregular downlink updates for free.
+ *
+ * Positions are kept in 8.8 fixed point so slow rates (under one step per
+ * frame) still advance. Only the range between the lowest and highest
+ * limited channel is processed; everything outside it is copied through,
+ * and with no limits set the stage is skipped entirely. The fixed-point
+ * position can be handed on instead of rounded, for temporal dithering.
+ *
+ * The stage is scalar on every target, the ESP32-S3 included. Its PIE
+ * vector unit only has signed 16-bit min/max, so the unsigned 8.8
+ * positions would need biasing in and out, and every channel's step is
+ * its own rate times the frame time. The limited span is usually a few
+ * fixtures, so the per-frame cost stays in the low microseconds.
+ *
+ * The logic works on a frame of any size; SlewLimiterT<FrameSize> holds
+ * the tables, so each controller instance sizes its own limiter.
+ *
+ * No Arduino dependencies.
+ */
+
+#ifndef SLEW_LIMITER_H
+#define SLEW_LIMITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLEW_MAX_FRAME_MS 50       // Longest step applied at once (after idle gaps)
+
+class SlewLimiter {
+public:
+    /**
+     * Set the limit for one channel
+     *
+     * @param channel DMX channel (1 to frame size - 1)
+     * @param rate Maximum change in DMX steps per second (0 = unlimited)
+     */
+    void setLimit(uint16_t channel, uint16_t rate);
+
+    /**
+     * Set the same limit for a range of channels
+     *
+     * @param start First DMX channel (1 to frame size - 1)
+     * @param count Number of channels
+     * @param rate Maximum change in DMX steps per second (0 = unlimited)
+     */
+    void setLimitRange(uint16_t start, uint16_t count, uint16_t rate);
+
+    /**
+     * Remove all limits
+     */
+    void clear();
+
+    uint16_t getLimit(uint16_t channel) const { return channel < _frameSize ? _rates[channel] : 0; }
+
+    /**
+     * True if any channel has a limit
+     */
+    bool isEnabled() const { return _first <= _last; }
+
+    /**
+     * Snap the current output to a frame (no ramp)
+     *
+     * @param frame DMX frame (frame size bytes)
+     */
+    void reset(const uint8_t* frame);
+
+    /**
+     * Move the output towards the target frame
+     *
+     * @param target Composed DMX frame (frame size bytes)
+     * @param out Frame to put on the wire (frame size bytes)
+     * @param dtMs Time since the previous frame
+     * @param targetFraction 1/256 steps below the target (NULL = none)
+     * @param outFraction Set to the 1/256 steps below out, which is then
+     *                    truncated instead of rounded (NULL = round)
+     * @return True while any limited channel has not reached its target
+     */
+    bool process(const uint8_t* target, uint8_t* out, uint32_t dtMs,
+                 const uint8_t* targetFraction = NULL, uint8_t* outFraction = NULL);
+
+    /**
+     * Rate table for persistence (frame size entries, index = channel)
+     */
+    const uint16_t* getRates() const { return _rates; }
+
+    /**
+     * Restore a rate table saved with getRates()
+     */
+    void setRates(const uint16_t* rates);
+
+    /**
+     * Start code + channels handled
+     */
+    uint16_t getFrameSize() const { return _frameSize; }
+
+protected:
+    /**
+     * Bind the limiter to its tables (frameSize entries each)
+     */
+    SlewLimiter(uint16_t* rates, uint16_t* position, uint16_t frameSize);
+
+private:
+    uint16_t* _rates;                     // Steps per second, 0 = unlimited
+    uint16_t* _position;                  // Current output in 8.8 fixed point
+    uint16_t _frameSize;                  // Start code + channels
+    uint16_t _first;                      // Lowest limited channel
+    uint16_t _last;                       // Highest limited channel
+
+    // Recompute the limited range after a change
+    void updateRange();
+};
+
+/**
+ * Slew limiter with tables for FrameSize bytes (start code + channels)
+ */
+template <int FrameSize>
+class SlewLimiterT : public SlewLimiter {
+public:
+    SlewLimiterT() : SlewLimiter(_rateTable, _positionTable, FrameSize) {}
+
+private:
+    uint16_t _rateTable[FrameSize];
+    uint16_t _positionTable[FrameSize];
+};
+
+#endif // SLEW_LIMITER_H
@@ -0,0 +1,166 @@
+/**
+ * StrobeGenerator.cpp - Implementation of the hardware-timed strobe
+ */
+
+#include "StrobeGenerator.h"
+
+// Constructor
+StrobeGenerator::StrobeGenerator() {
+    _dmx = NULL;
+    _mutex = NULL;
+    _timer = NULL;
+    _task = NULL;
+    _active = false;
+    _on = false;
+    _flash = 0;
+    _flashes = 0;
+    _nextEdgeUs = 0;
+    _onUs = 0;
+    _offUs = 0;
+    _r = _g = _b = _w = 0;
+    _alternate = false;
+    _slots = DmxController::MAX_CHANNELS;
+    _maxLateUs = 0;
+    _edges = 0;
+}
+
+// Create the edge timer and task
+bool StrobeGenerator::begin(DmxController* dmx, SemaphoreHandle_t dmxMutex) {
+    _dmx = dmx;
+    _mutex = dmxMutex;
+
+    esp_timer_create_args_t args = {};
+    args.callback = &StrobeGenerator::timerCallback;
+    args.arg = this;
+    args.name = "strobe";
+    if (esp_timer_create(&args, &_timer) != ESP_OK) {
+        Serial.println("Failed to create strobe timer");
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(taskEntry, "Strobe", STROBE_TASK_STACK, this,
+                                STROBE_TASK_PRIORITY, &_task, STROBE_TASK_CORE) != pdPASS) {
+        Serial.println("Failed to create strobe task");
+        return false;
+    }
+    return true;
+}
+
+// Start strobing all fixtures
+bool StrobeGenerator::start(uint8_t r, uint8_t g, uint8_t b, uint8_t w,
+                            uint32_t onMs, uint32_t offMs, uint16_t flashes, bool alternate) {
+    if (_dmx == NULL || _task == NULL || _dmx->getNumFixtures() == 0) {
+        return false;
+    }
+
+    stop();
+
+    _r = r;
+    _g = g;
+    _b = b;
+    _w = w;
+    _onUs = max(onMs, (uint32_t)STROBE_MIN_PHASE_MS) * 1000;
+    _offUs = max(offMs, (uint32_t)STROBE_MIN_PHASE_MS) * 1000;
+    _flashes = flashes;
+    _alternate = alternate;
+    _flash = 0;
+    _on = false;
+    _maxLateUs = 0;
+    _edges = 0;
+
+    // Short frames: stop after the highest channel any fixture uses. Regular
+    // refresh frames are shortened too, so the UART is idle at each edge.
+    _slots = _dmx->getHighestChannel();
+    if (_slots <= 0) {
+        _slots = DmxController::MAX_CHANNELS;
+    }
+    _dmx->setFrameSlots(_slots);
+
+    // First edge (on) right away
+    _nextEdgeUs = esp_timer_get_time();
+    _active = true;
+    xTaskNotifyGive(_task);
+    return true;
+}
+
+// Stop strobing
+void StrobeGenerator::stop() {
+    _active = false;
+    if (_timer != NULL) {
+        esp_timer_stop(_timer);
+    }
+    if (_dmx != NULL) {
+        _dmx->setFrameSlots(0);
+    }
+}
+
+// esp_timer callback: wake the edge task
+void StrobeGenerator::timerCallback(void* arg) {
+    StrobeGenerator* self = (StrobeGenerator*)arg;
+    xTaskNotifyGive(self->_task);
+}
+
+// Edge task body
+void StrobeGenerator::taskEntry(void* arg) {
+    StrobeGenerator* self = (StrobeGenerator*)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->handleEdge();
+    }
+}
+
+// Apply the next phase and send it
+void StrobeGenerator::handleEdge() {
+    if (!_active) {
+        return;
+    }
+
+    int64_t scheduled = _nextEdgeUs;
+    bool turnOn = !_on;
+
+    // Arm the following edge first, against the absolute deadline, so the
+    // frame send time never stretches the phase
+    _nextEdgeUs = scheduled + (turnOn ? _onUs : _offUs);
+    bool lastEdge = !turnOn && _flashes > 0 && _flash + 1 >= _flashes;
+    if (!lastEdge) {
+        int64_t wait = _nextEdgeUs - esp_timer_get_time();
+        esp_timer_start_once(_timer, wait > 0 ? (uint64_t)wait : 1);
+    }
+
+    if (xSemaphoreTake(_mutex, portMAX_DELAY) == pdTRUE) {
+        applyPhase(turnOn);
+
+        int64_t late = esp_timer_get_time() - scheduled;
+        if (late > (int64_t)_maxLateUs) {
+            _maxLateUs = (uint32_t)late;
+        }
+
+        _dmx->sendFrameNow(_slots);
+        xSemaphoreGive(_mutex);
+    }
+
+    _on = turnOn;
+    _edges++;
+    if (!turnOn) {
+        _flash++;
+    }
+    if (lastEdge) {
+        _active = false;
+        _dmx->setFrameSlots(0);
+    }
+}
+
+// Set the fixture colours for a phase
+void StrobeGenerator::applyPhase(bool on) {
+    int numFixtures = _dmx->getNumFixtures();
+    bool evenFlash = (_flash % 2) == 0;
+
+    for (int f = 0; f < numFixtures; f++) {
+        bool lit = on && (!_alternate || ((f % 2) == 0) == evenFlash);
+        if (lit) {
+            _dmx->setFixtureColor(f, _r, _g, _b, _w);
+        } else {
+            _dmx->setFixtureColor(f, 0, 0, 0, 0);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/**
+ * StrobeGenerator.h - Hardware-timed strobe independent of the frame rate
+ *
+ * On/off edges are scheduled on the ESP32 high-resolution timer against
+ * absolute deadlines, so the strobe rate does not drift with loop() timing
+ * or frame send time. At each edge a dedicated high-priority task updates
+ * the fixtures and pushes an immediate out-of-cycle DMX frame, truncated
+ * after the highest fixture channel so it is on the wire well within a
+ * millisecond of the edge.
+ *
+ * Edge frames bypass slew limiting: a strobe is meant to be abrupt.
+ */
+
+#ifndef STROBE_GENERATOR_H
+#define STROBE_GENERATOR_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "DmxController.h"
+
+#define STROBE_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define STROBE_TASK_STACK 3072
+#define STROBE_TASK_CORE 1
+#define STROBE_MIN_PHASE_MS 5  // Shorter phases cannot fit a frame
+
+class StrobeGenerator {
+public:
+    StrobeGenerator();
+
+    /**
+     * Create the edge timer and task
+     *
+     * @param dmx DMX controller to drive
+     * @param dmxMutex Mutex guarding the DMX buffer and UART
+     * @return True if the timer and task were created
+     */
+    bool begin(DmxController* dmx, SemaphoreHandle_t dmxMutex);
+
+    /**
+     * Start strobing all fixtures
+     *
+     * @param r Red value during the on phase
+     * @param g Green value during the on phase
+     * @param b Blue value during the on phase
+     * @param w White value during the on phase
+     * @param onMs Length of the on phase in milliseconds
+     * @param offMs Length of the off phase in milliseconds
+     * @param flashes Number of flashes (0 = until stopped)
+     * @param alternate Alternate even and odd fixtures on successive flashes
+     * @return True if the strobe started
+     */
+    bool start(uint8_t r, uint8_t g, uint8_t b, uint8_t w,
+               uint32_t onMs, uint32_t offMs, uint16_t flashes, bool alternate = false);
+
+    /**
+     * Stop strobing (fixtures keep the last phase)
+     */
+    void stop();
+
+    /**
+     * True while the strobe is running
+     */
+    bool isActive() const { return _active; }
+
+    /**
+     * Worst delay seen between a scheduled edge and its frame going out (µs)
+     */
+    uint32_t getMaxLatenessUs() const { return _maxLateUs; }
+
+    /**
+     * Edges generated since start()
+     */
+    uint32_t getEdgeCount() const { return _edges; }
+
+private:
+    DmxController* _dmx;
+    SemaphoreHandle_t _mutex;
+    esp_timer_handle_t _timer;
+    TaskHandle_t _task;
+
+    volatile bool _active;
+    bool _on;                  // Current phase
+    uint16_t _flash;           // Flashes completed
+    uint16_t _flashes;         // Flashes requested (0 = forever)
+    int64_t _nextEdgeUs;       // Absolute deadline of the next edge
+    uint32_t _onUs;
+    uint32_t _offUs;
+    uint8_t _r, _g, _b, _w;
+    bool _alternate;
+    int _slots;                // Slots per edge frame
+
+    volatile uint32_t _maxLateUs;
+    volatile uint32_t _edges;
+
+    // esp_timer callback: wake the edge task
+    static void timerCallback(void* arg);
+
+    // Edge task body
+    static void taskEntry(void* arg);
+
+    // Apply the next phase and send it
+    void handleEdge();
+
+    // Set the fixture colours for a phase
+    void applyPhase(bool on);
+};
+
+#endif // STROBE_GENERATOR_H
@@ -0,0 +1,374 @@
+/**
+ * TriggerEngine.cpp - Implementation of the local trigger inputs
+ */
+
+#include "TriggerEngine.h"
+#include <driver/gpio.h>
+#include <esp_timer.h>
+
+#define TRIGGER_NO_DEADLINE INT64_MAX
+#define TRIGGER_MAX_FIRED (TRIGGER_MAX_RULES * 4)   // Rules fired in one service() pass
+
+// Constructor
+TriggerEngine::TriggerEngine() {
+    memset(&_config, 0, sizeof(_config));
+    _config.version = TRIGGER_CONFIG_VERSION;
+    _action = NULL;
+    _actionContext = NULL;
+    _reader = &TriggerEngine::defaultReader;
+    _readerContext = NULL;
+    _task = NULL;
+    _lock = NULL;
+    _reservedPins = TRIGGER_RESERVED_PINS;
+    _head = 0;
+    _tail = 0;
+    _nextSampleUs = 0;
+    _fired = 0;
+    _dropped = 0;
+    _lastLatencyUs = 0;
+    _maxLatencyUs = 0;
+    for (int i = 0; i < TRIGGER_MAX_INPUTS; i++) {
+        _isrArgs[i].engine = this;
+        _isrArgs[i].input = (uint8_t)i;
+        _attached[i] = false;
+        _active[i] = false;
+        _lockedUntil[i] = 0;
+    }
+}
+
+// Start the trigger task
+bool TriggerEngine::begin(TriggerActionFn action, void* context) {
+    _action = action;
+    _actionContext = context;
+    _lock = xSemaphoreCreateMutex();
+    gpio_install_isr_service(0);  // Already installed by attachInterrupt() is fine
+
+    if (xTaskCreatePinnedToCore(taskEntry, "Triggers", TRIGGER_TASK_STACK, this,
+                                TRIGGER_TASK_PRIORITY, &_task, TRIGGER_TASK_CORE) != pdPASS) {
+        _task = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Replace how inputs are read
+void TriggerEngine::setReader(TriggerReadFn reader, void* context) {
+    _reader = reader != NULL ? reader : &TriggerEngine::defaultReader;
+    _readerContext = context;
+}
+
+// Keep inputs off a pin the firmware uses
+void TriggerEngine::reservePin(uint8_t pin) {
+    if (pin < 64) {
+        _reservedPins |= 1ULL << pin;
+    }
+}
+
+// digitalRead / analogRead of the input's pin
+int TriggerEngine::defaultReader(uint8_t input, const TriggerInput& config, void* context) {
+    return (config.flags & TRIGGER_INPUT_ANALOG) ? analogRead(config.pin) : digitalRead(config.pin);
+}
+
+// Debounced level of an input from a raw reading
+bool TriggerEngine::readActive(uint8_t input) {
+    const TriggerInput& config = _config.inputs[input];
+    int raw = _reader(input, config, _readerContext);
+    if (config.flags & TRIGGER_INPUT_ANALOG) {
+        int on = config.threshold * 16;
+        int off = max(0, (int)config.threshold - (int)config.hysteresis) * 16;
+        return _active[input] ? raw >= off : raw >= on;
+    }
+    bool high = raw != 0;
+    return (config.flags & TRIGGER_INPUT_ACTIVE_LOW) ? !high : high;
+}
+
+// Hook the configured digital inputs to the edge interrupt
+void TriggerEngine::attachInputs() {
+    for (int i = 0; i < TRIGGER_MAX_INPUTS; i++) {
+        const TriggerInput& config = _config.inputs[i];
+        _lockedUntil[i] = 0;
+        if (!(config.flags & TRIGGER_INPUT_ENABLED)) {
+            _active[i] = false;
+            continue;
+        }
+        if (!(config.flags & TRIGGER_INPUT_ANALOG)) {
+            pinMode(config.pin, (config.flags & TRIGGER_INPUT_PULLUP) ? INPUT_PULLUP : INPUT);
+            gpio_set_intr_type((gpio_num_t)config.pin, GPIO_INTR_ANYEDGE);
+            _attached[i] = gpio_isr_handler_add((gpio_num_t)config.pin, &TriggerEngine::isrEntry, &_isrArgs[i]) == ESP_OK;
+            if (_attached[i]) {
+                gpio_intr_enable((gpio_num_t)config.pin);
+            }
+        }
+        // Start from the current level, so configuring does not fire
+        _active[i] = false;
+        _active[i] = readActive((uint8_t)i);
+    }
+}
+
+// Release the pins of the configured inputs and return them to their reset state
+void TriggerEngine::detachInputs() {
+    for (int i = 0; i < TRIGGER_MAX_INPUTS; i++) {
+        gpio_num_t pin = (gpio_num_t)_config.inputs[i].pin;
+        if (_attached[i]) {
+            gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+            gpio_isr_handler_remove(pin);
+            _attached[i] = false;
+        }
+        if (_config.inputs[i].flags & TRIGGER_INPUT_ENABLED) {
+            gpio_reset_pin(pin);
+        }
+    }
+}
+
+// True if an input's pin exists, is free and suits the input
+bool TriggerEngine::isValidInput(const TriggerConfig& config, int index) const {
+    const TriggerInput& input = config.inputs[index];
+    if (!(input.flags & TRIGGER_INPUT_ENABLED)) {
+        return true;
+    }
+    if (input.pin >= GPIO_PIN_COUNT || !GPIO_IS_VALID_GPIO(input.pin) || (_reservedPins & (1ULL << input.pin))) {
+        return false;
+    }
+    if ((input.flags & TRIGGER_INPUT_ANALOG) && digitalPinToAnalogChannel(input.pin) < 0) {
+        return false;
+    }
+    // Two inputs on one pin would share (and replace) one interrupt handler
+    for (int i = 0; i < index; i++) {
+        if ((config.inputs[i].flags & TRIGGER_INPUT_ENABLED) && config.inputs[i].pin == input.pin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if every input, rule and cue can be used
+bool TriggerEngine::isValidConfig(const TriggerConfig& config) const {
+    if (config.version != TRIGGER_CONFIG_VERSION || config.numRules > TRIGGER_MAX_RULES) {
+        return false;
+    }
+    for (int i = 0; i < TRIGGER_MAX_INPUTS; i++) {
+        if (!isValidInput(config, i)) {
+            return false;
+        }
+    }
+    for (int r = 0; r < config.numRules; r++) {
+        const TriggerRule& rule = config.rules[r];
+        if (rule.input >= TRIGGER_MAX_INPUTS || rule.edge < TRIGGER_EDGE_ACTIVATE ||
+            rule.edge > TRIGGER_EDGE_BOTH || !isValidAction(rule.action, rule.args)) {
+            return false;
+        }
+    }
+    for (int c = 0; c < TRIGGER_MAX_CUES; c++) {
+        if (config.cues[c].size > TRIGGER_CUE_SIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if an action and its arguments can be carried out
+bool TriggerEngine::isValidAction(uint8_t action, const uint8_t* args) {
+    return action < TRIGGER_ACTION_COUNT &&
+           !(action == TRIGGER_ACTION_PRESET && args[0] > 4) &&
+           !(action == TRIGGER_ACTION_CUE && args[0] >= TRIGGER_MAX_CUES);
+}
+
+// Apply a configuration downlink
+bool TriggerEngine::configure(const uint8_t* data, size_t size) {
+    if (size < 1 || !isConfigOpcode(data[0])) {
+        return false;
+    }
+    TriggerConfig config = _config;
+
+    if (data[0] == TRIGGER_OPCODE_INPUT) {
+        if (size != 7 || data[1] >= TRIGGER_MAX_INPUTS) {
+            return false;
+        }
+        TriggerInput& input = config.inputs[data[1]];
+        input.pin = data[2];
+        input.flags = data[3];
+        input.debounceMs = data[4];
+        input.threshold = data[5];
+        input.hysteresis = data[6];
+    } else if (data[0] == TRIGGER_OPCODE_RULES) {
+        size_t count = (size - 1) / 6;
+        if ((size - 1) % 6 != 0 || count > TRIGGER_MAX_RULES) {
+            return false;
+        }
+        for (size_t r = 0; r < count; r++) {
+            const uint8_t* bytes = data + 1 + r * 6;
+            TriggerRule& rule = config.rules[r];
+            rule.input = bytes[0] & 0x0F;
+            rule.edge = bytes[0] >> 4;
+            rule.action = bytes[1];
+            memcpy(rule.args, bytes + 2, 4);
+        }
+        config.numRules = (uint8_t)count;
+    } else {
+        if (size < 2 || data[1] >= TRIGGER_MAX_CUES || size - 2 > TRIGGER_CUE_SIZE) {
+            return false;
+        }
+        TriggerCue& cue = config.cues[data[1]];
+        cue.size = (uint8_t)(size - 2);
+        memcpy(cue.data, data + 2, cue.size);
+    }
+    // Pins, rules and cues are checked with the rest of the table
+    return loadConfig(config);
+}
+
+// Take a stored or edited configuration
+bool TriggerEngine::loadConfig(const TriggerConfig& config) {
+    if (!isValidConfig(config)) {
+        return false;
+    }
+    if (_lock != NULL) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+    }
+    detachInputs();
+    _config = config;
+    attachInputs();
+    if (_lock != NULL) {
+        xSemaphoreGive(_lock);
+    }
+    if (_task != NULL) {
+        xTaskNotifyGive(_task);  // Analog inputs may need sampling now
+    }
+    return true;
+}
+
+// Edge interrupt: timestamp and hand over
+void IRAM_ATTR TriggerEngine::isrEntry(void* arg) {
+    IsrArg* isrArg = (IsrArg*)arg;
+    isrArg->engine->onEdge(isrArg->input, esp_timer_get_time());
+}
+
+// Queue an edge for the task
+void IRAM_ATTR TriggerEngine::onEdge(uint8_t input, int64_t atUs) {
+    if (input >= TRIGGER_MAX_INPUTS) {
+        return;
+    }
+    uint8_t head = _head;
+    uint8_t next = (uint8_t)((head + 1) % TRIGGER_QUEUE_SIZE);
+    if (next == _tail) {
+        _dropped++;
+        return;
+    }
+    _queue[head].input = input;
+    _queue[head].atUs = atUs;
+    __atomic_store_n(&_head, next, __ATOMIC_RELEASE);
+
+    if (_task != NULL) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+// Take a new level and collect the rules it fires
+void TriggerEngine::change(uint8_t input, bool active, int64_t atUs, int64_t nowUs, TriggerRule* fired, int& count) {
+    _active[input] = active;
+    uint8_t edge = active ? TRIGGER_EDGE_ACTIVATE : TRIGGER_EDGE_RELEASE;
+    for (int r = 0; r < _config.numRules; r++) {
+        const TriggerRule& rule = _config.rules[r];
+        if (rule.input == input && (rule.edge & edge) && count < TRIGGER_MAX_FIRED) {
+            fired[count++] = rule;
+        }
+    }
+    uint32_t latency = (uint32_t)max((int64_t)0, nowUs - atUs);
+    _lastLatencyUs = latency;
+    if (latency > _maxLatencyUs) {
+        _maxLatencyUs = latency;
+    }
+}
+
+// Handle queued edges, ended debounce windows and analog samples
+int64_t TriggerEngine::service(int64_t nowUs) {
+    TriggerRule fired[TRIGGER_MAX_FIRED];
+    int count = 0;
+    int64_t deadline = TRIGGER_NO_DEADLINE;
+
+    if (_lock != NULL) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+    }
+
+    // Edges: the first one outside a debounce window flips the input at once
+    while (_tail != __atomic_load_n(&_head, __ATOMIC_ACQUIRE)) {
+        Edge edge = _queue[_tail];
+        _tail = (uint8_t)((_tail + 1) % TRIGGER_QUEUE_SIZE);
+        const TriggerInput& config = _config.inputs[edge.input];
+        if ((config.flags & (TRIGGER_INPUT_ENABLED | TRIGGER_INPUT_ANALOG)) != TRIGGER_INPUT_ENABLED ||
+            _lockedUntil[edge.input] != 0) {
+            continue;
+        }
+        // Without a window there is no later check, so trust the level
+        bool active = config.debounceMs > 0 ? !_active[edge.input] : readActive(edge.input);
+        if (active == _active[edge.input]) {
+            continue;
+        }
+        if (config.debounceMs > 0) {
+            _lockedUntil[edge.input] = edge.atUs + config.debounceMs * 1000;
+        }
+        change(edge.input, active, edge.atUs, nowUs, fired, count);
+    }
+
+    bool sample = nowUs >= _nextSampleUs;
+    bool anyAnalog = false;
+    for (int i = 0; i < TRIGGER_MAX_INPUTS; i++) {
+        const TriggerInput& config = _config.inputs[i];
+        if (!(config.flags & TRIGGER_INPUT_ENABLED)) {
+            continue;
+        }
+
+        // End of a debounce window: catch a change the window hid
+        if (_lockedUntil[i] != 0 && nowUs >= _lockedUntil[i]) {
+            int64_t endedUs = _lockedUntil[i];
+            _lockedUntil[i] = 0;
+            bool active = readActive((uint8_t)i);
+            if (active != _active[i]) {
+                _lockedUntil[i] = nowUs + config.debounceMs * 1000;
+                change((uint8_t)i, active, endedUs, nowUs, fired, count);
+            }
+        }
+        if (_lockedUntil[i] != 0) {
+            deadline = min(deadline, _lockedUntil[i]);
+        }
+
+        if (config.flags & TRIGGER_INPUT_ANALOG) {
+            anyAnalog = true;
+            bool active = sample ? readActive((uint8_t)i) : _active[i];
+            if (active != _active[i]) {
+                change((uint8_t)i, active, nowUs, nowUs, fired, count);
+            }
+        }
+    }
+    if (sample) {
+        _nextSampleUs = nowUs + TRIGGER_ADC_PERIOD_MS * 1000;
+    }
+    if (anyAnalog) {
+        deadline = min(deadline, _nextSampleUs);
+    }
+
+    if (_lock != NULL) {
+        xSemaphoreGive(_lock);
+    }
+
+    // Act outside the lock, so an action may reconfigure the triggers
+    for (int f = 0; f < count; f++) {
+        _fired++;
+        if (_action != NULL) {
+            _action(fired[f], _actionContext);
+        }
+    }
+    return deadline == TRIGGER_NO_DEADLINE ? TRIGGER_NO_DEADLINE : max((int64_t)0, deadline - nowUs);
+}
+
+// Trigger task: sleep until an edge, a window end or a sample is due
+void TriggerEngine::taskEntry(void* arg) {
+    TriggerEngine* self = (TriggerEngine*)arg;
+    while (true) {
+        int64_t waitUs = self->service(esp_timer_get_time());
+        TickType_t ticks = waitUs == TRIGGER_NO_DEADLINE ? portMAX_DELAY :
+                           max((TickType_t)1, (TickType_t)pdMS_TO_TICKS((waitUs + 999) / 1000));
+        ulTaskNotifyTake(pdTRUE, ticks);
+    }
+}
@@ -0,0 +1,246 @@
+/**
+ * TriggerEngine.h - Local trigger inputs (buttons, PIRs, analog sensors)
+ *
+ * Maps input edges to actions through a small rule table, so a wall button
+ * changes the look at once instead of waiting for a downlink. Digital
+ * inputs interrupt on every edge; the interrupt only timestamps the edge
+ * and wakes a high-priority task. The task debounces by lockout: the first
+ * edge acts at once and the input is ignored for its debounce time, after
+ * which its level is read again so a release inside the window is not lost.
+ * Analog inputs are sampled by the same task and cross a threshold with
+ * hysteresis. Nothing runs in loop().
+ *
+ * Configuration downlinks (saved to flash by the caller):
+ *   0xB0 input    index, pin, flags, debounce_ms, threshold, hysteresis
+ *                 flags 0 disables the input; thresholds are 8-bit and
+ *                 compared with the 12-bit ADC reading / 16
+ *   0xB1 rules    0-TRIGGER_MAX_RULES rules of 6 bytes, replacing the table:
+ *                 input | edge << 4, action, 4 argument bytes
+ *   0xB2 cue      slot, then the downlink it replays (empty clears it)
+ *
+ * Actions are carried out by the caller's callback, which runs on the
+ * trigger task.
+ *
+ * An input may only use a GPIO that exists, is not reserved (the flash and
+ * PSRAM pins, plus every pin the firmware claims with reservePin()) and is
+ * not taken by another input; analog inputs need an ADC pin. Downlinks and
+ * stored configurations that break these rules are refused whole.
+ */
+
+#ifndef TRIGGER_ENGINE_H
+#define TRIGGER_ENGINE_H
+
+#include <Arduino.h>
+
+// Downlink opcodes
+#define TRIGGER_OPCODE_INPUT 0xB0
+#define TRIGGER_OPCODE_RULES 0xB1
+#define TRIGGER_OPCODE_CUE 0xB2
+
+#define TRIGGER_MAX_INPUTS 8
+#define TRIGGER_MAX_RULES 8
+#define TRIGGER_MAX_CUES 4
+#define TRIGGER_CUE_SIZE 24                 // Bytes of one stored downlink
+#define TRIGGER_QUEUE_SIZE 16               // Edges buffered between the interrupt and the task
+#define TRIGGER_ADC_PERIOD_MS 20            // Analog input sampling
+#define TRIGGER_TASK_PRIORITY (configMAX_PRIORITIES - 3)   // Just below the strobe
+#define TRIGGER_TASK_STACK 4096
+#define TRIGGER_TASK_CORE 1
+#define TRIGGER_CONFIG_VERSION 1
+
+// GPIOs no input may use: the ESP32-S3 SPI flash / PSRAM pins 26-32
+#ifndef TRIGGER_RESERVED_PINS
+#define TRIGGER_RESERVED_PINS 0x1FC000000ULL
+#endif
+
+// Input flags
+#define TRIGGER_INPUT_ENABLED 0x01
+#define TRIGGER_INPUT_ANALOG 0x02
+#define TRIGGER_INPUT_PULLUP 0x04
+#define TRIGGER_INPUT_ACTIVE_LOW 0x08
+
+// Rule edges
+#define TRIGGER_EDGE_ACTIVATE 1             // Pressed / motion / above threshold
+#define TRIGGER_EDGE_RELEASE 2
+#define TRIGGER_EDGE_BOTH 3
+
+// Rule actions (arguments in brackets)
+enum TriggerAction {
+    TRIGGER_ACTION_NONE = 0,
+    TRIGGER_ACTION_PRESET = 1,      // [preset 0-4]: off, red, green, blue, white
+    TRIGGER_ACTION_EFFECT = 2,      // [effect id, cycles, speed_ms u16 LE]
+    TRIGGER_ACTION_STOP = 3,        // Stop effects and keyframes
+    TRIGGER_ACTION_CUE = 4,         // [cue slot]: replay a stored downlink
+    TRIGGER_ACTION_MASTER = 5,      // [level 0-255]
+    TRIGGER_ACTION_COUNT = 6
+};
+
+struct TriggerInput {
+    uint8_t pin;
+    uint8_t flags;          // TRIGGER_INPUT_*
+    uint8_t debounceMs;
+    uint8_t threshold;      // Analog: active above threshold * 16
+    uint8_t hysteresis;     // Analog: inactive below (threshold - hysteresis) * 16
+};
+
+struct TriggerRule {
+    uint8_t input;
+    uint8_t edge;           // TRIGGER_EDGE_*
+    uint8_t action;         // TriggerAction
+    uint8_t args[4];
+};
+
+struct TriggerCue {
+    uint8_t size;
+    uint8_t data[TRIGGER_CUE_SIZE];
+};
+
+// Everything the downlinks set; stored as one blob
+struct TriggerConfig {
+    uint8_t version;
+    uint8_t numRules;
+    TriggerInput inputs[TRIGGER_MAX_INPUTS];
+    TriggerRule rules[TRIGGER_MAX_RULES];
+    TriggerCue cues[TRIGGER_MAX_CUES];
+};
+
+/**
+ * Carry out a rule that fired
+ */
+typedef void (*TriggerActionFn)(const TriggerRule& rule, void* context);
+
+/**
+ * Read an input's raw level: 0/1 for digital, 0-4095 for analog
+ */
+typedef int (*TriggerReadFn)(uint8_t input, const TriggerInput& config, void* context);
+
+class TriggerEngine {
+public:
+    TriggerEngine();
+
+    /**
+     * Start the trigger task
+     *
+     * @param action Called for each rule that fires
+     * @param context Passed through to action
+     * @return True if the task was created (false on a host: call service() instead)
+     */
+    bool begin(TriggerActionFn action, void* context);
+
+    /**
+     * Replace how inputs are read (default: digitalRead / analogRead)
+     */
+    void setReader(TriggerReadFn reader, void* context);
+
+    /**
+     * Keep inputs off a pin the firmware uses (DMX, radio, LED, console)
+     *
+     * Call before loading a stored configuration.
+     */
+    void reservePin(uint8_t pin);
+
+    /**
+     * Apply a 0xB0-0xB2 downlink
+     *
+     * @return False if it was malformed (nothing changes)
+     */
+    bool configure(const uint8_t* data, size_t size);
+
+    /**
+     * True if the byte starts a trigger configuration downlink
+     */
+    static bool isConfigOpcode(uint8_t opcode) {
+        return opcode >= TRIGGER_OPCODE_INPUT && opcode <= TRIGGER_OPCODE_CUE;
+    }
+
+    /**
+     * True if an action and its 4 argument bytes can be carried out
+     */
+    static bool isValidAction(uint8_t action, const uint8_t* args);
+
+    /**
+     * Configuration to save, and to restore at boot
+     *
+     * loadConfig() checks every input, rule and cue as configure() does
+     * and refuses the whole configuration if one fails.
+     */
+    const TriggerConfig& getConfig() const { return _config; }
+    bool loadConfig(const TriggerConfig& config);
+
+    /**
+     * Record an edge on an input (the interrupt handler; hosts call it to mock one)
+     *
+     * @param atUs Time of the edge on the service() clock
+     */
+    void IRAM_ATTR onEdge(uint8_t input, int64_t atUs);
+
+    /**
+     * Handle queued edges, ended debounce windows and analog samples
+     *
+     * @param nowUs Current time (esp_timer_get_time() on the device)
+     * @return Microseconds until the next debounce window ends or sample is due
+     */
+    int64_t service(int64_t nowUs);
+
+    bool isActive(uint8_t input) const { return input < TRIGGER_MAX_INPUTS && _active[input]; }
+    uint32_t getFiredCount() const { return _fired; }
+    uint32_t getDroppedEdges() const { return _dropped; }
+    uint32_t getLastLatencyUs() const { return _lastLatencyUs; }   // Edge to action
+    uint32_t getMaxLatencyUs() const { return _maxLatencyUs; }
+
+private:
+    struct Edge {
+        uint8_t input;
+        int64_t atUs;
+    };
+    struct IsrArg {
+        TriggerEngine* engine;
+        uint8_t input;
+    };
+
+    TriggerConfig _config;
+    TriggerActionFn _action;
+    void* _actionContext;
+    TriggerReadFn _reader;
+    void* _readerContext;
+    TaskHandle_t _task;
+    SemaphoreHandle_t _lock;        // Config against the task
+    IsrArg _isrArgs[TRIGGER_MAX_INPUTS];
+    bool _attached[TRIGGER_MAX_INPUTS];
+    uint64_t _reservedPins;         // Bit per GPIO no input may use
+
+    // Interrupt to task
+    Edge _queue[TRIGGER_QUEUE_SIZE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+
+    // Debounced state (task only)
+    bool _active[TRIGGER_MAX_INPUTS];
+    int64_t _lockedUntil[TRIGGER_MAX_INPUTS];   // 0 = not in a debounce window
+    int64_t _nextSampleUs;
+
+    volatile uint32_t _fired;
+    volatile uint32_t _dropped;
+    volatile uint32_t _lastLatencyUs;
+    volatile uint32_t _maxLatencyUs;
+
+    // Hook up or release the pins of the configured inputs
+    void attachInputs();
+    void detachInputs();
+
+    // True if every input, rule and cue can be used
+    bool isValidConfig(const TriggerConfig& config) const;
+    bool isValidInput(const TriggerConfig& config, int index) const;
+
+    // Debounced level of an input from a raw reading
+    bool readActive(uint8_t input);
+
+    // Take a new level and collect the rules it fires
+    void change(uint8_t input, bool active, int64_t atUs, int64_t nowUs, TriggerRule* fired, int& count);
+
+    static void isrEntry(void* arg);
+    static void taskEntry(void* arg);
+    static int defaultReader(uint8_t input, const TriggerInput& config, void* context);
+};
+
+#endif // TRIGGER_ENGINE_H
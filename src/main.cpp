@@ -71,6 +71,19 @@
  * - LoRaManager2: LoRaWAN Class C communication library for ESP32 + SX1262
  * - ArduinoJson: JSON parsing
  * - DmxController: DMX output control
+ * - ArtNetOutput: Optional Art-Net re-emission of the DMX frame over WiFi
+ * - Fuota: Firmware update over LoRa (TS004 fragmentation, delta patches)
+ * - KeyframeAnimator: On-device interpolation of streamed keyframes
+ * - PatchEditor: Incremental fixture patch edits, journaled to flash
+ * - TriggerEngine: Button / sensor inputs mapped to local actions
+ * - SceneScheduler: Time-of-day and sunrise/sunset actions from the node's clock
+ * - StrobeGenerator: Hardware-timed strobe edges with immediate frames
+ * - DmxPattern: Effect registry and pattern player (also built by tools/render)
+ * - RenderQos: Render deadline tracking and staged degradation under load
+ * - NodeCapability: Capability and payload-limit uplink for server-side encoders
+ * - BlackBox: Flash-ring recorder of the output frame and downlinks (decoded by tools/blackbox)
+ * - SamplingProfiler: Timer-interrupt CPU profiler (symbolized by tools/profile)
+ * - SerialLink: COBS-framed binary control over the USB serial port (tools/seriallink)
  * - Ticker: Hardware-timed uplinks
  */
 
@@ -80,7 +93,24 @@
 #include <vector>
 #include <LoRaManager.h>  // LoRaManager2 library
 #include "DmxController.h"
+#include "ArtNetOutput.h"
+#include "FuotaManager.h"
+#include "OtaPartitionBackend.h"
+#include "KeyframeAnimator.h"
+#include "PatchEditor.h"
+#include "TriggerEngine.h"
+#include "SceneScheduler.h"
+#include "StrobeGenerator.h"
+#include "FrameKernels.h"
+#include "DmxPattern.h"
+#include "RenderQos.h"
+#include "NodeCapability.h"
+#include "BlackBox.h"
+#include "SamplingProfiler.h"
+#include "SerialLink.h"
 #include <esp_task_wdt.h>  // Watchdog
+#include <time.h>
+#include <sys/time.h>  // settimeofday() for the scheduler clock
 #include "secrets.h"  // Include the secrets.h file for LoRaWAN credentials
 #include <WiFi.h>
 #include <esp_dmx.h>
@@ -101,11 +131,45 @@
 #define DMX_RX_PIN 20  // RX pin for DMX
 #define DMX_DIR_PIN 5  // DIR pin for DMX (connect to both DE and RE on MAX485)
 
+// Output pipeline: loop() renders on core 1 while the DMX task transmits on core 0
+#define DMX_TASK_CORE 0
+#define DMX_TASK_PRIORITY 3       // Above loop() and the FUOTA task so frames never wait on them
+#define DMX_FRAME_PERIOD_MS 25    // Regular refresh (40 Hz)
+
 // DMX configuration - we'll use dynamic configuration from JSON
-#define MAX_FIXTURES 32           // Maximum number of fixtures supported
-#define MAX_CHANNELS_PER_FIXTURE 16 // Maximum channels per fixture
+// Fixture and channel capacity come from the DmxController typedef (DMX_MAX_FIXTURES / DMX_MAX_CHANNELS build flags)
 #define MAX_JSON_SIZE 1024        // Maximum size of JSON document
 
+// Art-Net bridge configuration (enabled when WIFI_SSID is set in secrets.h)
+#define ARTNET_TARGET_IP 255, 255, 255, 255  // Broadcast; set a node IP for unicast
+#define ARTNET_START_UNIVERSE 0            // Port-address of the re-emitted universe
+#define ARTNET_KEEPALIVE_MS 1000           // Re-send an unchanged frame this often
+#define SNTP_SERVER "pool.ntp.org"          // Sets the clock for the scheduler once WiFi is up
+
+// LoRaWAN data rate and capability advertisement (US915)
+#define LORA_DATA_RATE 4                // Uplinks; ADR is off, so only a new image changes it
+#define CAPABILITY_RETRY_MS 30000       // Wait after a capability uplink failed to queue
+
+// Firmware update over LoRa
+#define FUOTA_REBOOT_DELAY_MS 5000  // Let the last answer go out before rebooting
+#define FUOTA_TASK_STACK 8192       // Verification and patch apply run in their own task
+#define FUOTA_TASK_PRIORITY 1       // Below the DMX task
+#define FUOTA_FRAGMENT_OVERHEAD 4   // 0xD0 tag, DataFragment CID and index
+
+// Keyframe animation
+#define KEYFRAME_FRAME_MS 25  // Loop period while a keyframe animation plays (40 fps)
+
+// Black-box dumps
+#define BLACKBOX_UPLINK_FRAGMENT 48          // Data bytes per uplink (53-byte payload fits US915 DR1)
+#define BLACKBOX_UPLINK_INTERVAL_MS 10000    // Spacing between dump uplinks
+#define BLACKBOX_SERIAL_FRAGMENT 240         // Data bytes per "BBX" line on the console
+#define BLACKBOX_SERIAL_BURST 4              // Console lines per loop() pass
+
+// USB serial port (console and binary link)
+#define SERIAL_RX_BUFFER 4096      // UART driver ring filled by its ISR: ~150 ms of 44 Hz frames
+#define SERIAL_MIN_BAUD 9600
+#define SERIAL_MAX_BAUD 3000000    // CP2102N limit
+
 // Global variables
 bool dmxInitialized = false;
 bool loraInitialized = false;
@@ -115,6 +179,65 @@ LoraManager lora;  // Fixed case-sensitive class name
 // Add Ticker for hardware-timed periodic uplinks (like working example)
 Ticker uplinkTicker;
 
+// Art-Net bridge (only active when WiFi credentials are configured)
+WiFiUdpArtNetTransport* artnetTransport = NULL;
+ArtNetOutput artnetOutput;
+bool artnetEnabled = false;
+
+// Firmware update over LoRa (session state lives in FuotaManager)
+OtaPartitionBackend fuotaBackend;
+FuotaManager fuota(&fuotaBackend);
+unsigned long fuotaRebootAt = 0;
+
+// Keyframe animation streamed from the server
+KeyframeAnimator keyframes;
+
+// Fixture patch as edited over LoRa; the journal is replayed at boot
+#define PATCH_JOURNAL_KEY "patch_journal"
+PatchEditor patchEditor;
+uint32_t patchSyncedVersion = 0;  // Controller patch version the editor matches
+
+// Local trigger inputs; commands they start are handed to loop()
+#define TRIGGER_CONFIG_KEY "triggers"
+#define TRIGGER_COMMAND_QUEUE 4
+struct TriggerCommand {
+  uint8_t size;
+  uint8_t data[TRIGGER_CUE_SIZE];
+};
+TriggerEngine triggers;
+QueueHandle_t triggerCommands = NULL;
+
+// Scheduled actions; the clock comes from a 0xA0 downlink or SNTP
+#define SCHEDULE_CONFIG_KEY "schedule"
+SceneScheduler scheduler;
+
+// Hardware-timed strobe (used by the strobe pattern and the strobe test)
+StrobeGenerator strobeGenerator;
+
+// Render deadline: each loop() pass should finish within one output frame
+RenderQos renderQos;
+
+// Black-box recorder (output frames and downlinks in a flash ring)
+BlackBox blackBox;
+bool blackBoxUplinkDump = false;
+unsigned long lastBlackBoxUplink = 0;
+
+// Sampling CPU profiler (reports over serial)
+SamplingProfiler profiler;
+unsigned long profilerStopAt = 0;  // millis() of a timed profile's end (0 = untimed)
+
+// Binary control link and JSON lines on the serial port
+class SerialLinkCommands : public SerialLinkHandler {
+public:
+  void onMessage(const SerialLinkMessage& message) override;
+  void onLine(const char* line) override;
+};
+SerialLinkCommands serialLinkCommands;
+SerialLinkDecoder serialLink(&serialLinkCommands);
+uint32_t serialLinkFrames = 0;       // Frame messages applied
+uint32_t serialBaud = SERIAL_BAUD;   // Rate set by a baud message
+TaskHandle_t loopTaskHandle = NULL;  // Woken when serial data arrives
+
 // Add mutex for thread-safe DMX data access
 SemaphoreHandle_t dmxMutex = NULL;
 
@@ -133,6 +256,32 @@ volatile bool settingsChanged = false;
 // Forward declarations
 void handleDownlinkCallback(const uint8_t* data, size_t size, int rssi, int snr);
 void processDownlink(const uint8_t* data, size_t size, int rssi, int snr); // Added forward declaration
+void handleFuotaDownlink(const uint8_t* data, size_t size);
+void fuotaFinalizeTask(void* parameter);
+void handleKeyframeDownlink(const uint8_t* data, size_t size);
+void handlePatchEdit(const uint8_t* data, size_t size);
+bool seedPatch();
+void syncPatch(int first);
+void savePatchJournal();
+void restorePatch();
+void handleTriggerConfig(const uint8_t* data, size_t size);
+void applyTrigger(const TriggerRule& rule, void* context);
+void applySceneAction(uint8_t action, const uint8_t* args);
+void postTriggerCommand(const uint8_t* data, size_t size);
+void runTriggerCommands();
+void restoreTriggers();
+void handleClockSet(const uint8_t* data, size_t size);
+void handleScheduleConfig(const uint8_t* data, size_t size);
+void applySchedule(const ScheduleRule& rule, void* context);
+void restoreSchedule();
+void reportSelfTest(const DmxLoopbackResult& result);
+void endRenderPass(int64_t passStartUs, uint32_t renderUs);
+uint8_t currentDataRate();
+void updateCapability(unsigned long now);
+bool sendCapability(uint8_t dataRate);
+void updateBlackBoxDump(unsigned long now);
+bool processJsonPayload(const String& jsonString);
+void pollSerialLink();
 bool processLightsJson(JsonArray lightsArray);
 void processMessageQueue();  // Add this forward declaration
 void send_lora_frame();  // Add this forward declaration for Ticker callback
@@ -156,6 +305,11 @@ bool rainbowStaggered = true;     // Whether to stagger colors across fixtures
 unsigned long lastHeartbeat = 0;  // Timestamp for heartbeat messages
 unsigned long lastStatusUpdate = 0; // Timestamp for status updates
 
+// Capability uplink: due after each join and whenever the data rate changes
+bool capabilityDue = false;
+uint8_t advertisedDataRate = 0xFF;          // 0xFF = nothing advertised yet
+unsigned long capabilityFailedAt = 0;
+
 // Connection state tracking for LoRaManager2
 bool isConnected = false;
 uint32_t lastConnectionAttempt = 0;
@@ -173,6 +327,10 @@ void printDmxValues(int startAddr, int numChannels) {
     Serial.println("DMX not initialized, cannot print values");
     return;
   }
+  if (startAddr < 1 || startAddr > DmxController::MAX_CHANNELS) {
+    return;
+  }
+  numChannels = min(numChannels, DmxController::FRAME_SIZE - startAddr);
   
   Serial.print("DMX values from address ");
   Serial.print(startAddr);
@@ -191,352 +349,6 @@ void printDmxValues(int startAddr, int numChannels) {
   Serial.println();
 }
 
-// Add pattern state persistence structure before DmxPattern class
-struct PatternState {
-  bool isActive;
-  uint8_t patternType;
-  int speed;
-  int maxCycles;
-  bool staggered;
-  uint32_t step;
-};
-
-// Add pattern handler class before the main setup() function
-class DmxPattern {
-public:
-  enum PatternType {
-    NONE,
-    COLOR_FADE,
-    RAINBOW,
-    STROBE,
-    CHASE,
-    ALTERNATE
-  };
-
-  DmxPattern() : active(false), patternType(NONE), speed(50), step(0), lastUpdate(0), cycleCount(0), maxCycles(5), staggered(true) {}
-
-  void start(PatternType type, int patternSpeed, int cycles = 5) {
-    active = true;
-    patternType = type;
-    speed = patternSpeed;
-    step = 0;
-    cycleCount = 0;
-    maxCycles = cycles;
-    lastUpdate = millis();
-    staggered = true;
-    
-    Serial.print("Pattern started: ");
-    switch (patternType) {
-      case COLOR_FADE: Serial.println("COLOR_FADE"); break;
-      case RAINBOW: Serial.println("RAINBOW"); break;
-      case STROBE: Serial.println("STROBE"); break;
-      case CHASE: Serial.println("CHASE"); break;
-      case ALTERNATE: Serial.println("ALTERNATE"); break;
-      default: Serial.println("UNKNOWN");
-    }
-
-    // Save pattern state when started
-    savePatternState();
-  }
-
-  void stop() {
-    active = false;
-    patternType = NONE;
-    Serial.println("Pattern stopped");
-    
-    // Clear saved pattern state when stopped
-    clearSavedPatternState();
-  }
-  
-  bool isActive() {
-    return active;
-  }
-
-  // Add save pattern state function
-  void savePatternState() {
-    if (!dmxInitialized || dmx == NULL) return;
-    
-    PatternState state;
-    state.isActive = active;
-    state.patternType = (uint8_t)patternType;
-    state.speed = speed;
-    state.maxCycles = maxCycles;
-    state.staggered = staggered;
-    state.step = step;
-
-    // Use DMX controller's persistent storage to save pattern state
-    dmx->saveCustomData("pattern_state", (uint8_t*)&state, sizeof(PatternState));
-    Serial.println("Pattern state saved to persistent storage");
-  }
-
-  // Add restore pattern state function
-  void restorePatternState() {
-    if (!dmxInitialized || dmx == NULL) return;
-    
-    PatternState state;
-    if (dmx->loadCustomData("pattern_state", (uint8_t*)&state, sizeof(PatternState))) {
-      Serial.println("Restoring saved pattern state");
-      
-      if (state.isActive) {
-        active = true;
-        patternType = (PatternType)state.patternType;
-        speed = state.speed;
-        maxCycles = state.maxCycles;
-        staggered = state.staggered;
-        step = state.step;
-        lastUpdate = millis();
-        cycleCount = 0;  // Reset cycle count on restore
-        
-        Serial.print("Restored pattern: ");
-        switch (patternType) {
-          case COLOR_FADE: Serial.println("COLOR_FADE"); break;
-          case RAINBOW: Serial.println("RAINBOW"); break;
-          case STROBE: Serial.println("STROBE"); break;
-          case CHASE: Serial.println("CHASE"); break;
-          case ALTERNATE: Serial.println("ALTERNATE"); break;
-          default: Serial.println("UNKNOWN");
-        }
-        Serial.print("Speed: "); Serial.println(speed);
-        Serial.print("Staggered: "); Serial.println(staggered ? "Yes" : "No");
-      }
-    } else {
-      Serial.println("No saved pattern state found");
-      active = false;
-      patternType = NONE;
-    }
-  }
-
-  // Add function to clear saved pattern state
-  void clearSavedPatternState() {
-    if (!dmxInitialized || dmx == NULL) return;
-    
-    PatternState state;
-    memset(&state, 0, sizeof(PatternState));  // Clear all data
-    dmx->saveCustomData("pattern_state", (uint8_t*)&state, sizeof(PatternState));
-    Serial.println("Pattern state cleared from persistent storage");
-  }
-  
-  void update() {
-    if (!active || !dmxInitialized || dmx == NULL) {
-      return;
-    }
-    
-    unsigned long now = millis();
-    if (now - lastUpdate < speed) {
-      return;
-    }
-    
-    // Take mutex before updating DMX data
-    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
-      Serial.println("Failed to take DMX mutex for pattern update");
-      return;
-    }
-    
-    lastUpdate = now;
-    
-    switch (patternType) {
-      case COLOR_FADE:
-        updateColorFade();
-        break;
-      case RAINBOW:
-        updateRainbow();
-        break;
-      case STROBE:
-        updateStrobe();
-        break;
-      case CHASE:
-        updateChase();
-        break;
-      case ALTERNATE:
-        updateAlternate();
-        break;
-      default:
-        break;
-    }
-    
-    // Send the DMX data
-    dmx->sendData();
-
-    // Save pattern state periodically (every 10 steps)
-    if (step % 10 == 0) {
-      savePatternState();
-    }
-    
-    // Release the mutex
-    xSemaphoreGive(dmxMutex);
-  }
-
-private:
-  bool active;
-  PatternType patternType;
-  int speed;  // Time in ms between updates
-  uint32_t step;   // Current step in the pattern
-  unsigned long lastUpdate;
-  int cycleCount;
-  int maxCycles;
-  bool staggered;
-  
-  // HSV to RGB conversion for color effects
-  void hsvToRgb(float h, float s, float v, uint8_t& r, uint8_t& g, uint8_t& b) {
-    float c = v * s;
-    float x = c * (1 - abs(fmod(h / 60.0, 2) - 1));
-    float m = v - c;
-    
-    float r1, g1, b1;
-    if (h < 60) {
-      r1 = c; g1 = x; b1 = 0;
-    } else if (h < 120) {
-      r1 = x; g1 = c; b1 = 0;
-    } else if (h < 180) {
-      r1 = 0; g1 = c; b1 = x;
-    } else if (h < 240) {
-      r1 = 0; g1 = x; b1 = c;
-    } else if (h < 300) {
-      r1 = x; g1 = 0; b1 = c;
-    } else {
-      r1 = c; g1 = 0; b1 = x;
-    }
-    
-    r = (r1 + m) * 255;
-    g = (g1 + m) * 255;
-    b = (b1 + m) * 255;
-  }
-  
-  // Color fade pattern (gradually cycles through colors)
-  void updateColorFade() {
-    float hue = (step % 360);
-    step = (step + 2) % 360;
-    
-    uint8_t r, g, b;
-    hsvToRgb(hue, 1.0, 1.0, r, g, b);
-    
-    // Set all fixtures to the same color
-    int numFixtures = dmx->getNumFixtures();
-    for (int i = 0; i < numFixtures; i++) {
-      dmx->setFixtureColor(i, r, g, b, 0);
-    }
-    
-    // Check if we've completed a cycle
-    if (step == 0) {
-      cycleCount++;
-      if (cycleCount >= maxCycles && maxCycles > 0) {
-        stop();
-      }
-    }
-  }
-  
-  // Rainbow pattern (different color on each fixture)
-  void updateRainbow() {
-    int numFixtures = dmx->getNumFixtures();
-    if (numFixtures == 0) return;
-    
-    // Calculate hue offset for this step
-    int baseHue = step % 360;
-    step = (step + 5) % 360;
-    
-    // Distribute colors across fixtures
-    for (int i = 0; i < numFixtures; i++) {
-      float hue = fmod(baseHue + (360.0 * i / numFixtures), 360);
-      
-      uint8_t r, g, b;
-      hsvToRgb(hue, 1.0, 1.0, r, g, b);
-      
-      dmx->setFixtureColor(i, r, g, b, 0);
-    }
-    
-    // Check if we've completed a cycle
-    if (step == 0) {
-      cycleCount++;
-      if (cycleCount >= maxCycles && maxCycles > 0) {
-        stop();
-      }
-    }
-  }
-  
-  // Strobe pattern (flash on and off)
-  void updateStrobe() {
-    bool isOn = (step % 2) == 0;
-    step++;
-    
-    int numFixtures = dmx->getNumFixtures();
-    for (int i = 0; i < numFixtures; i++) {
-      if (isOn) {
-        dmx->setFixtureColor(i, 255, 255, 255, 255);  // White when on
-      } else {
-        dmx->setFixtureColor(i, 0, 0, 0, 0);  // Off
-      }
-    }
-    
-    // Count each on-off cycle as one complete cycle
-    if (step % 2 == 0) {
-      cycleCount++;
-      if (cycleCount >= maxCycles && maxCycles > 0) {
-        stop();
-      }
-    }
-  }
-  
-  // Chase pattern (one light at a time)
-  void updateChase() {
-    int numFixtures = dmx->getNumFixtures();
-    if (numFixtures == 0) return;
-    
-    int activeFixture = step % numFixtures;
-    step = (step + 1) % numFixtures;
-    
-    // Turn all fixtures off first
-    for (int i = 0; i < numFixtures; i++) {
-      if (i == activeFixture) {
-        // This fixture gets the color - use a rotating hue
-        uint8_t r, g, b;
-        float hue = (cycleCount * 30) % 360;  // Change color every full chase cycle
-        hsvToRgb(hue, 1.0, 1.0, r, g, b);
-        
-        dmx->setFixtureColor(i, r, g, b, 0);
-      } else {
-        dmx->setFixtureColor(i, 0, 0, 0, 0);
-      }
-    }
-    
-    // Count a full chase sequence as one complete cycle
-    if (step == 0) {
-      cycleCount++;
-      if (cycleCount >= maxCycles && maxCycles > 0) {
-        stop();
-      }
-    }
-  }
-  
-  // Alternating pattern (every other fixture)
-  void updateAlternate() {
-    int numFixtures = dmx->getNumFixtures();
-    bool flipState = (step % 2) == 0;
-    step++;
-    
-    for (int i = 0; i < numFixtures; i++) {
-      bool isOn = (i % 2 == 0) ? flipState : !flipState;
-      
-      if (isOn) {
-        uint8_t r, g, b;
-        float hue = (cycleCount * 40) % 360;  // Change color every flip
-        hsvToRgb(hue, 1.0, 1.0, r, g, b);
-        
-        dmx->setFixtureColor(i, r, g, b, 0);
-      } else {
-        dmx->setFixtureColor(i, 0, 0, 0, 0);
-      }
-    }
-    
-    // Count each on-off alternation as one complete cycle
-    if (step % 2 == 0) {
-      cycleCount++;
-      if (cycleCount >= maxCycles && maxCycles > 0) {
-        stop();
-      }
-    }
-  }
-};
-
 // Create a global pattern handler
 DmxPattern patternHandler;
 
@@ -736,29 +548,16 @@ bool processJsonPayload(const String& jsonString) {
       JsonObject pattern = doc["pattern"];
       if (pattern.containsKey("type")) {
         String type = pattern["type"];
-        int speed = pattern["speed"] | 50;  // Default 50ms
-        int cycles = pattern["cycles"] | 5;  // Default 5 cycles
-        
-        DmxPattern::PatternType patternType = DmxPattern::NONE;
-        
-        if (type == "colorFade") {
-          patternType = DmxPattern::COLOR_FADE;
-        } else if (type == "rainbow") {
-          patternType = DmxPattern::RAINBOW;
-        } else if (type == "strobe") {
-          patternType = DmxPattern::STROBE;
-          speed = pattern["speed"] | 100;  // Slower default for strobe
-        } else if (type == "chase") {
-          patternType = DmxPattern::CHASE;
-        } else if (type == "alternate") {
-          patternType = DmxPattern::ALTERNATE;
-        } else if (type == "stop") {
+        if (type == "stop") {
           patternHandler.stop();
           return true;
         }
         
-        if (patternType != DmxPattern::NONE) {
-          patternHandler.start(patternType, speed, cycles);
+        const EffectInfo* effect = DmxPattern::findEffect(type.c_str());
+        if (effect != NULL) {
+          int speed = pattern["speed"] | (int)effect->defaultSpeed;
+          int cycles = pattern["cycles"] | (int)effect->defaultCycles;
+          patternHandler.start(effect, speed, cycles);
           return true;
         }
       }
@@ -768,36 +567,16 @@ bool processJsonPayload(const String& jsonString) {
       Serial.print("Simple pattern format detected: ");
       Serial.println(patternType);
       
-      // Default values for each pattern
-      int speed = 50;
-      int cycles = 5;
-      DmxPattern::PatternType type = DmxPattern::NONE;
-      
-      if (patternType == "colorFade") {
-        type = DmxPattern::COLOR_FADE;
-      } else if (patternType == "rainbow") {
-        type = DmxPattern::RAINBOW;
-        cycles = 3;
-      } else if (patternType == "strobe") {
-        type = DmxPattern::STROBE;
-        speed = 100;
-        cycles = 10;
-      } else if (patternType == "chase") {
-        type = DmxPattern::CHASE;
-        speed = 200;
-        cycles = 3;
-      } else if (patternType == "alternate") {
-        type = DmxPattern::ALTERNATE;
-        speed = 300;
-        cycles = 5;
-      } else if (patternType == "stop") {
+      if (patternType == "stop") {
         patternHandler.stop();
         return true;
       }
       
-      if (type != DmxPattern::NONE) {
+      // Each effect's default speed and cycles come from the registry
+      const EffectInfo* effect = DmxPattern::findEffect(patternType.c_str());
+      if (effect != NULL) {
         Serial.println("Starting pattern...");
-        patternHandler.start(type, speed, cycles);
+        patternHandler.start(effect, effect->defaultSpeed, effect->defaultCycles);
         return true;
       }
     }
@@ -851,6 +630,7 @@ bool processJsonPayload(const String& jsonString) {
         dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
         dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
         dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+        dmx->publishFixtures();
       }
       
       // Run the rainbow chase pattern
@@ -899,10 +679,21 @@ bool processJsonPayload(const String& jsonString) {
         dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
         dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
         dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+        dmx->publishFixtures();
       }
       
-      // Run the strobe test pattern
-      dmx->runStrobeTest(color, count, onTime, offTime, alternate);
+      // Run the strobe test pattern on the hardware timer (returns immediately)
+      static const uint8_t strobeColors[4][4] = {
+        {255, 255, 255, 255},  // White
+        {255, 0, 0, 0},        // Red
+        {0, 255, 0, 0},        // Green
+        {0, 0, 255, 0}         // Blue
+      };
+      if (patternHandler.isActive()) {
+        patternHandler.stop();
+      }
+      const uint8_t* c = strobeColors[color];
+      strobeGenerator.start(c[0], c[1], c[2], c[3], onTime, offTime, count, alternate);
       
       // Save the final state after the pattern completes
       // dmx->saveSettings(); // MOVED TO LOOP
@@ -944,6 +735,7 @@ bool processJsonPayload(const String& jsonString) {
         dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
         dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
         dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+        dmx->publishFixtures();
       }
       
       if (enabled) {
@@ -987,93 +779,423 @@ bool processJsonPayload(const String& jsonString) {
       return false;
     }
   }
-  // Finally check for direct light control
-  if (doc.containsKey("lights")) {
-    // Get the lights array
-    JsonArray lightsArray = doc["lights"];
-    
-    // Process the lights array
-    bool success = processLightsJson(lightsArray);
-    
-    // If processing was successful, send the data
-    if (success) {
-      // Save settings to persistent storage (already called in processLightsJson)
-      return true;
-    } else {
-      Serial.println("Failed to process lights array");
+  // Slew limits: {"slew": {"rate": 300}}, {"slew": {"role": "white", "rate": 200}},
+  // {"slew": {"start": 10, "count": 2, "rate": 100}} or {"slew": "off"}
+  if (doc.containsKey("slew")) {
+    if (!dmxInitialized || dmx == NULL) {
       return false;
     }
-  }
 
-  // If we got here, no valid command objects were found
-  Serial.println("JSON format error: missing 'lights', 'pattern', or 'test' object");
-  return false;
-}
+    if (doc["slew"].is<String>()) {
+      if (doc["slew"].as<String>() != "off") {
+        Serial.println("Unknown slew command");
+        return false;
+      }
+      dmx->clearSlewLimits();
+      Serial.println("Slew limits cleared");
+    } else {
+      JsonObject slew = doc["slew"];
+      uint16_t rate = slew["rate"] | 0;
 
-// Improved JSON light processing
-bool processLightsJson(JsonArray lightsArray) {
-  if (!dmxInitialized || dmx == NULL) {
-    Serial.println("DMX not initialized, cannot process lights array");
-    return false;
+      if (slew.containsKey("start")) {
+        int start = slew["start"];
+        int count = slew["count"] | 1;
+        dmx->setSlewLimit(start, count, rate);
+        Serial.printf("Slew limit %u/s on channels %d-%d\n", rate, start, start + count - 1);
+      } else if (slew.containsKey("role")) {
+        String role = slew["role"].as<String>();
+        int roleId = -1;
+        if (role == "red") roleId = FIXTURE_ROLE_RED;
+        else if (role == "green") roleId = FIXTURE_ROLE_GREEN;
+        else if (role == "blue") roleId = FIXTURE_ROLE_BLUE;
+        else if (role == "white") roleId = FIXTURE_ROLE_WHITE;
+        if (roleId < 0) {
+          Serial.print("Unknown slew role: ");
+          Serial.println(role);
+          return false;
+        }
+        dmx->setSlewLimitForRole(roleId, rate);
+        Serial.printf("Slew limit %u/s on %s channels\n", rate, role.c_str());
+      } else {
+        for (int role = FIXTURE_ROLE_RED; role <= FIXTURE_ROLE_WHITE; role++) {
+          dmx->setSlewLimitForRole(role, rate);
+        }
+        Serial.printf("Slew limit %u/s on all fixture channels\n", rate);
+      }
+    }
+
+    settingsChanged = true;
+    return true;
   }
-  
-  Serial.println("\n===== PROCESSING DOWNLINK LIGHTS COMMAND =====");
-  Serial.println("Starting DMX values:");
-  // Print current values for first 20 channels
-  printDmxValues(1, 20);
-  
-  bool atLeastOneValid = false;
-  
-  // Take mutex before modifying DMX data
-  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
-    Serial.println("Failed to take DMX mutex, aborting light update");
-    return false;
+
+  // Temporal dithering: {"dither": "on"}, {"dither": "off"} or
+  // {"dither": {"role": "white", "enabled": true}}
+  if (doc.containsKey("dither")) {
+    if (!dmxInitialized || dmx == NULL) {
+      return false;
+    }
+
+    int roleId = -1;
+    bool enabled;
+    if (doc["dither"].is<String>()) {
+      String mode = doc["dither"].as<String>();
+      if (mode != "on" && mode != "off") {
+        Serial.println("Unknown dither command");
+        return false;
+      }
+      enabled = mode == "on";
+    } else {
+      JsonObject dither = doc["dither"];
+      String role = dither["role"] | "";
+      enabled = dither["enabled"] | true;
+      if (role == "red") roleId = FIXTURE_ROLE_RED;
+      else if (role == "green") roleId = FIXTURE_ROLE_GREEN;
+      else if (role == "blue") roleId = FIXTURE_ROLE_BLUE;
+      else if (role == "white") roleId = FIXTURE_ROLE_WHITE;
+      if (roleId < 0) {
+        Serial.print("Unknown dither role: ");
+        Serial.println(role);
+        return false;
+      }
+    }
+
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
+      return false;
+    }
+    for (int role = FIXTURE_ROLE_RED; role <= FIXTURE_ROLE_WHITE; role++) {
+      if (roleId < 0 || role == roleId) {
+        dmx->setDitherForRole(role, enabled);
+      }
+    }
+    xSemaphoreGive(dmxMutex);
+    Serial.printf("Dithering %s (roles 0x%X)\n", enabled ? "on" : "off", dmx->getDitherRoles());
+
+    settingsChanged = true;
+    return true;
   }
-  
-  // Iterate through each light in the array
-  for (JsonObject light : lightsArray) {
-    // Check if the light has an address field
-    if (!light.containsKey("address")) {
-      Serial.println("Light missing 'address' field, skipping");
-      continue;
+
+  // Idle keepalive: {"keepalive": 500} repeats an unchanged frame every 500 ms
+  if (doc.containsKey("keepalive")) {
+    if (!dmxInitialized || dmx == NULL) {
+      return false;
     }
-    
-    // Get the DMX address
-    int address = light["address"].as<int>();
-    
-    // Check if address is valid
-    if (address < 1 || address > 512) {
-      Serial.print("Invalid DMX address: ");
-      Serial.println(address);
-      continue;
+
+    uint32_t intervalMs = doc["keepalive"] | 0;
+    if (intervalMs == 0) {
+      Serial.println("Invalid keepalive interval");
+      return false;
     }
-    
-    // Check if the light has a channels array
-    if (!light.containsKey("channels")) {
-      Serial.println("Light missing 'channels' array, skipping");
-      continue;
+    dmx->setKeepaliveInterval(intervalMs);
+    Serial.printf("Keepalive %u ms\n", dmx->getKeepaliveInterval());
+
+    settingsChanged = true;
+    return true;
+  }
+
+  // Color profiles: {"color": {"profile": 0, "extract": 255, "whitePoint": [255, 220, 180],
+  // "matrix": [[1,0,0,0],[0,1,0,0],[0,0,1,0]], "whiteGain": 1.0, "fixtures": [0, 1]}}
+  // or {"color": "off"}. Without "fixtures" the profile is assigned to every fixture.
+  if (doc.containsKey("color")) {
+    if (!dmxInitialized || dmx == NULL) {
+      return false;
     }
-    
-    // Get the channels array
-    JsonArray channelsArray = light["channels"];
-    
-    // Check if it's not empty
-    if (channelsArray.size() == 0) {
-      Serial.println("Empty channels array, skipping");
-      continue;
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
+      return false;
     }
-    
-    Serial.print("Setting light at address ");
-    Serial.print(address);
-    Serial.print(" with ");
-    Serial.print(channelsArray.size());
-    Serial.println(" channels:");
-    
-    // Set the channels
-    int channelIndex = 0;
-    for (JsonVariant channelValue : channelsArray) {
-      int value = channelValue.as<int>();
-      
+
+    bool ok = true;
+    if (doc["color"].is<String>()) {
+      if (doc["color"].as<String>() == "off") {
+        dmx->clearColorProfiles();
+        Serial.println("Color profiles cleared");
+      } else {
+        Serial.println("Unknown color command");
+        ok = false;
+      }
+    } else {
+      JsonObject color = doc["color"];
+      uint8_t index = color["profile"] | 0;
+      const ColorProfile* current = dmx->getColorProfile(index);
+      if (current == NULL) {
+        Serial.println("Invalid color profile index");
+        ok = false;
+      } else {
+        // Start from the stored profile so fields can be changed one at a time
+        ColorProfile profile = *current;
+        if (color.containsKey("extract")) {
+          profile.whiteExtract = color["extract"];
+        }
+        if (color.containsKey("whiteGain")) {
+          profile.whiteGain = (uint16_t)(color["whiteGain"].as<float>() * COLOR_Q_ONE + 0.5f);
+        }
+        JsonArray whitePoint = color["whitePoint"];
+        for (int c = 0; c < 3 && c < (int)whitePoint.size(); c++) {
+          profile.whitePoint[c] = whitePoint[c];
+        }
+        JsonArray matrix = color["matrix"];
+        for (int row = 0; row < 3 && row < (int)matrix.size(); row++) {
+          JsonArray cols = matrix[row];
+          for (int col = 0; col < 4 && col < (int)cols.size(); col++) {
+            float v = cols[col].as<float>();
+            v = v < -7.9f ? -7.9f : (v > 7.9f ? 7.9f : v);  // Q12 range of int16_t
+            profile.matrix[row][col] = (int16_t)lroundf(v * COLOR_Q_ONE);
+          }
+        }
+        dmx->setColorProfile(index, profile);
+
+        if (color.containsKey("fixtures")) {
+          for (JsonVariant f : color["fixtures"].as<JsonArray>()) {
+            dmx->setFixtureColorProfile(f.as<int>(), index);
+          }
+        } else {
+          dmx->setFixtureColorProfile(-1, index);
+        }
+        Serial.printf("Color profile %u set (%d fixtures in the color pass)\n", index, dmx->getColorFixtureCount());
+      }
+    }
+
+    if (ok) {
+      dmx->sendData();
+      settingsChanged = true;
+    }
+    xSemaphoreGive(dmxMutex);
+    return ok;
+  }
+
+  // Color temperature: {"cct": 3200} or {"cct": {"kelvin": 3200, "level": 200}}
+  // sets every fixture; RGBW fixtures get the white share through their color profile
+  if (doc.containsKey("cct")) {
+    if (!dmxInitialized || dmx == NULL) {
+      return false;
+    }
+    uint16_t kelvin = doc["cct"].is<JsonObject>() ? (doc["cct"]["kelvin"] | 3200) : (doc["cct"] | 3200);
+    uint8_t level = doc["cct"].is<JsonObject>() ? (doc["cct"]["level"] | 255) : 255;
+    uint8_t r, g, b;
+    ColorPipeline::kelvinToRgb(kelvin, level, r, g, b);
+
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      for (int i = 0; i < dmx->getNumFixtures(); i++) {
+        dmx->setFixtureColor(i, r, g, b, 0);
+      }
+      dmx->sendData();
+      xSemaphoreGive(dmxMutex);
+    }
+    Serial.printf("Color temperature %uK (level %u) -> RGB %u,%u,%u\n", kelvin, level, r, g, b);
+    settingsChanged = true;
+    return true;
+  }
+
+  // DMX loopback self-test: {"selftest": true} or
+  // {"selftest": {"mode": "line", "frames": 10, "pattern": true}}
+  // The result is printed and sent as an uplink once the output task has run it.
+  if (doc.containsKey("selftest")) {
+    if (!dmxInitialized || dmx == NULL) {
+      return false;
+    }
+    JsonObject options = doc["selftest"].as<JsonObject>();
+    String mode = options["mode"] | "internal";
+    uint8_t frames = options["frames"] | 5;
+    bool pattern = options["pattern"] | false;
+
+    if (!dmx->requestSelfTest(mode == "line" ? LOOPBACK_LINE : LOOPBACK_INTERNAL, frames, pattern)) {
+      Serial.println("Self-test already queued");
+      return false;
+    }
+    Serial.printf("DMX self-test queued (%s, %u frames%s)\n", mode.c_str(), frames, pattern ? ", test pattern" : "");
+    return true;
+  }
+
+  // Frame kernel check: {"kernels": "test"} cross-checks the kernels against
+  // their scalar references and times them. Holds the DMX mutex (publishes
+  // wait) for a second or two.
+  if (doc.containsKey("kernels")) {
+    if (doc["kernels"].as<String>() != "test") {
+      Serial.println("Unknown kernels command");
+      return false;
+    }
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
+      return false;
+    }
+    int failures = frameKernelsSelfTest();
+    if (failures != 0) {
+      Serial.printf("[Kernels] ❌ Self-test failed: %d mismatches\n", failures);
+    } else {
+      Serial.println("[Kernels] ✅ Self-test passed");
+    }
+    if (dmxInitialized && dmx != NULL && dmx->getColorFixtureCount() > 0) {
+      Serial.printf("[Kernels] color  %6.1f us/frame (%d fixtures)\n",
+                    dmx->benchmarkColorPass(micros, 200) / 200.0f, dmx->getColorFixtureCount());
+    }
+    FrameKernelTiming timings[FRAME_KERNEL_COUNT];
+    frameKernelsBenchmark(micros, 200, timings);
+    xSemaphoreGive(dmxMutex);
+    for (int k = 0; k < FRAME_KERNEL_COUNT; k++) {
+      if (timings[k].scalarOnly) {
+        Serial.printf("[Kernels] %-6s %6.1f us/frame (scalar loop)\n", timings[k].name, timings[k].kernelUs / 200.0f);
+        continue;
+      }
+      Serial.printf("[Kernels] %-6s %6.1f us/frame (scalar %6.1f us/frame)\n", timings[k].name,
+                    timings[k].kernelUs / 200.0f, timings[k].scalarUs / 200.0f);
+    }
+    return failures == 0;
+  }
+
+  // Black-box recorder: {"blackbox": "dump" | "uplink" | "stop" | "status"} or
+  // {"blackbox": {"dump": "serial" | "uplink", "sectors": 4, "rate": 500}}
+  // "rate" is the sample interval in ms (0 = off) and is kept across reboots.
+  if (doc.containsKey("blackbox")) {
+    if (!blackBox.isReady()) {
+      Serial.println("Black-box recorder not available");
+      return false;
+    }
+    JsonVariant request = doc["blackbox"];
+    String action = request.is<const char*>() ? String(request.as<const char*>()) : String(request["dump"] | "");
+
+    if (request["rate"].is<int>()) {
+      blackBox.setSampleInterval(request["rate"].as<int>());
+      Serial.printf("[BlackBox] Sampling every %u ms\n", blackBox.getSampleInterval());
+    }
+
+    if (action == "stop") {
+      blackBox.stopDump();
+      Serial.println("[BlackBox] Dump stopped");
+    } else if (action == "dump" || action == "serial" || action == "uplink") {
+      bool uplink = action == "uplink";
+      uint16_t sectors = request["sectors"] | (uplink ? 1 : 0);
+      uint16_t fragments = blackBox.startDump(sectors, uplink ? BLACKBOX_UPLINK_FRAGMENT : BLACKBOX_SERIAL_FRAGMENT,
+                                              millis());
+      if (fragments == 0) {
+        return false;
+      }
+      blackBoxUplinkDump = uplink;
+      lastBlackBoxUplink = millis() - BLACKBOX_UPLINK_INTERVAL_MS;
+      Serial.printf("[BlackBox] Dumping %u fragments over %s\n", fragments, uplink ? "uplinks" : "serial");
+    }
+
+    Serial.printf("[BlackBox] boot %lu, sector %lu of %lu, %lu bytes logged, %lu sectors erased, sampling every %u ms\n",
+                  (unsigned long)blackBox.getBootSequence(),
+                  (unsigned long)(blackBox.getSequence() % blackBox.getSectorCount()),
+                  (unsigned long)blackBox.getSectorCount(), (unsigned long)blackBox.getBytesLogged(),
+                  (unsigned long)blackBox.getSectorsErased(), blackBox.getSampleInterval());
+    return true;
+  }
+
+  // CPU profiler: {"profile": "start" | "stop" | "report"} or
+  // {"profile": {"rate": 1000, "seconds": 10}}, which reports when the time is up.
+  // The report goes to the serial console; decode it with tools/profile.
+  if (doc.containsKey("profile")) {
+    JsonVariant request = doc["profile"];
+    String action = request.is<const char*>() ? String(request.as<const char*>()) : String("start");
+
+    if (action == "start") {
+      uint32_t rate = request["rate"] | PROFILER_DEFAULT_HZ;
+      uint32_t seconds = request["seconds"] | 0;
+      if (!profiler.start(rate)) {
+        return false;
+      }
+      profilerStopAt = seconds > 0 ? max(millis() + seconds * 1000, 1UL) : 0;
+      Serial.printf("[Profile] Sampling at %lu Hz per core%s\n", (unsigned long)profiler.getRate(),
+                    seconds > 0 ? " (timed)" : "");
+    } else if (action == "stop") {
+      profiler.stop();
+      profilerStopAt = 0;
+      profiler.printReport(Serial);
+    } else if (action == "report") {
+      profiler.printReport(Serial);
+    } else {
+      Serial.println("Unknown profile action: " + action);
+      return false;
+    }
+    return true;
+  }
+
+  // Finally check for direct light control
+  if (doc.containsKey("lights")) {
+    // Get the lights array
+    JsonArray lightsArray = doc["lights"];
+    
+    // Process the lights array
+    bool success = processLightsJson(lightsArray);
+    
+    // If processing was successful, send the data
+    if (success) {
+      // Save settings to persistent storage (already called in processLightsJson)
+      return true;
+    } else {
+      Serial.println("Failed to process lights array");
+      return false;
+    }
+  }
+
+  // If we got here, no valid command objects were found
+  Serial.println("JSON format error: missing 'lights', 'pattern', or 'test' object");
+  return false;
+}
+
+// Improved JSON light processing
+bool processLightsJson(JsonArray lightsArray) {
+  if (!dmxInitialized || dmx == NULL) {
+    Serial.println("DMX not initialized, cannot process lights array");
+    return false;
+  }
+  
+  Serial.println("\n===== PROCESSING DOWNLINK LIGHTS COMMAND =====");
+  Serial.println("Starting DMX values:");
+  // Print current values for first 20 channels
+  printDmxValues(1, 20);
+  
+  bool atLeastOneValid = false;
+  
+  // Take mutex before modifying DMX data
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) != pdTRUE) {
+    Serial.println("Failed to take DMX mutex, aborting light update");
+    return false;
+  }
+  
+  // Iterate through each light in the array
+  for (JsonObject light : lightsArray) {
+    // Check if the light has an address field
+    if (!light.containsKey("address")) {
+      Serial.println("Light missing 'address' field, skipping");
+      continue;
+    }
+    
+    // Get the DMX address
+    int address = light["address"].as<int>();
+    
+    // Check if address is valid
+    if (address < 1 || address > DmxController::MAX_CHANNELS) {
+      Serial.print("Invalid DMX address: ");
+      Serial.println(address);
+      continue;
+    }
+    
+    // Check if the light has a channels array
+    if (!light.containsKey("channels")) {
+      Serial.println("Light missing 'channels' array, skipping");
+      continue;
+    }
+    
+    // Get the channels array
+    JsonArray channelsArray = light["channels"];
+    
+    // Check if it's not empty
+    if (channelsArray.size() == 0) {
+      Serial.println("Empty channels array, skipping");
+      continue;
+    }
+    
+    Serial.print("Setting light at address ");
+    Serial.print(address);
+    Serial.print(" with ");
+    Serial.print(channelsArray.size());
+    Serial.println(" channels:");
+    
+    // Set the channels
+    int channelIndex = 0;
+    for (JsonVariant channelValue : channelsArray) {
+      int value = channelValue.as<int>();
+      
       // Validate channel value (0-255)
       value = max(0, min(value, 255));
       
@@ -1086,8 +1208,8 @@ bool processLightsJson(JsonArray lightsArray) {
       Serial.print(" = ");
       Serial.println(value);
       
-      // Don't exceed DMX_PACKET_SIZE
-      if (dmxChannel < DMX_PACKET_SIZE) {
+      // Don't exceed the controller's frame buffer
+      if (dmxChannel < DmxController::FRAME_SIZE) {
         dmx->getDmxData()[dmxChannel] = value;
         channelIndex++;
       } else {
@@ -1104,7 +1226,7 @@ bool processLightsJson(JsonArray lightsArray) {
     Serial.print("Set DMX address ");
     Serial.print(address);
     Serial.print(" to values: [");
-    for (int i = 0; i < channelsArray.size(); i++) {
+    for (int i = 0; i < channelsArray.size() && address + i < DmxController::FRAME_SIZE; i++) {
       if (i > 0) Serial.print(", ");
       Serial.print(dmx->getDmxData()[address + i]);
     }
@@ -1201,6 +1323,44 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
   Serial.print("Free heap at start of downlink handler: ");
   Serial.println(ESP.getFreeHeap());
   
+  // Every downlink goes into the black box, whatever it turns out to be
+  blackBox.logEvent(BLACKBOX_EVENT_DOWNLINK, data, size, millis());
+  
+  // FUOTA commands are tagged because the callback does not report the FPort
+  if (size >= 2 && data[0] == FUOTA_DOWNLINK_TAG) {
+    handleFuotaDownlink(data + 1, size - 1);
+    return;
+  }
+  
+  // Keyframe animation commands
+  if (size >= 1 && (data[0] == KF_OPCODE_KEYFRAME || data[0] == KF_OPCODE_STOP ||
+                    data[0] == KF_OPCODE_LOOKAHEAD)) {
+    handleKeyframeDownlink(data, size);
+    return;
+  }
+  
+  // Incremental fixture patch edits
+  if (size >= 3 && PatchEditor::isEditOpcode(data[0])) {
+    handlePatchEdit(data, size);
+    return;
+  }
+  
+  // Trigger inputs, rules and cues
+  if (size >= 1 && TriggerEngine::isConfigOpcode(data[0])) {
+    handleTriggerConfig(data, size);
+    return;
+  }
+  
+  // Clock, site and rules of the scheduler
+  if (size == 5 && data[0] == SCHEDULE_OPCODE_CLOCK) {
+    handleClockSet(data, size);
+    return;
+  }
+  if (size >= 1 && SceneScheduler::isConfigOpcode(data[0])) {
+    handleScheduleConfig(data, size);
+    return;
+  }
+  
   // Handle basic binary commands (values 0-4) first before any other processing
   if (size == 1) {
     uint8_t cmd = data[0];
@@ -1224,6 +1384,7 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
               dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
               dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
               dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+              dmx->publishFixtures();
               Serial.print("DEBUG: Now have ");
               Serial.print(dmx->getNumFixtures());
               Serial.println(" fixtures configured");
@@ -1249,6 +1410,7 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
               dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
               dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
               dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+              dmx->publishFixtures();
               Serial.print("DEBUG: Now have ");
               Serial.print(dmx->getNumFixtures());
               Serial.println(" fixtures configured");
@@ -1274,6 +1436,7 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
               dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
               dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
               dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+              dmx->publishFixtures();
               Serial.print("DEBUG: Now have ");
               Serial.print(dmx->getNumFixtures());
               Serial.println(" fixtures configured");
@@ -1299,6 +1462,7 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
               dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
               dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
               dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+              dmx->publishFixtures();
               Serial.print("DEBUG: Now have ");
               Serial.print(dmx->getNumFixtures());
               Serial.println(" fixtures configured");
@@ -1324,6 +1488,7 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
               dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
               dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
               dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+              dmx->publishFixtures();
               Serial.print("DEBUG: Now have ");
               Serial.print(dmx->getNumFixtures());
               Serial.println(" fixtures configured");
@@ -1493,9 +1658,9 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
             Serial.println("]");
             
             // Validate address (1-512 for DMX)
-            if (address >= 1 && address <= 512) {
+            if (address >= 1 && address <= DmxController::MAX_CHANNELS) {
               // Set DMX channels directly (DMX uses 1-based addressing)
-              if (address + 3 < DMX_PACKET_SIZE) {
+              if (address + 3 < DmxController::FRAME_SIZE) {
                 dmx->getDmxData()[address] = ch1;
                 dmx->getDmxData()[address + 1] = ch2;
                 dmx->getDmxData()[address + 2] = ch3;
@@ -1583,34 +1748,14 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
     Serial.print(patternType);
     Serial.print(" (");
     
-    DmxPattern::PatternType enumType;
+    // Unknown type bytes fall back to the first effect
+    const EffectInfo* effect = DmxPattern::findEffect(patternType);
     String typeName;
-    
-    switch (patternType) {
-      case 0:
-        enumType = DmxPattern::COLOR_FADE;
-        typeName = "COLOR_FADE";
-        break;
-      case 1:
-        enumType = DmxPattern::RAINBOW;
-        typeName = "RAINBOW";
-        break;
-      case 2:
-        enumType = DmxPattern::STROBE;
-        typeName = "STROBE";
-        break;
-      case 3:
-        enumType = DmxPattern::CHASE;
-        typeName = "CHASE";
-        break;
-      case 4:
-        enumType = DmxPattern::ALTERNATE;
-        typeName = "ALTERNATE";
-        break;
-      default:
-        enumType = DmxPattern::COLOR_FADE;
-        typeName = "COLOR_FADE (default)";
-        break;
+    if (effect != NULL) {
+      typeName = effect->name;
+    } else {
+      effect = &DmxPattern::EFFECTS[0];
+      typeName = String(effect->name) + " (default)";
     }
     
     Serial.print(typeName);
@@ -1628,13 +1773,14 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
         dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
         dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
         dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+        dmx->publishFixtures();
         Serial.print("DEBUG: Now have ");
         Serial.print(dmx->getNumFixtures());
         Serial.println(" fixtures configured for patterns");
       }
       
       // Start the pattern
-      patternHandler.start(enumType, speed, cycles);
+      patternHandler.start(effect, speed, cycles);
       Serial.print("🎨 Pattern started: ");
       Serial.print(typeName);
       Serial.print(" at ");
@@ -1706,9 +1852,9 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
             Serial.println("]");
             
             // Validate address (1-512 for DMX)
-            if (address >= 1 && address <= 512) {
+            if (address >= 1 && address <= DmxController::MAX_CHANNELS) {
               // Set DMX channels directly (DMX uses 1-based addressing)
-              if (address + 3 < DMX_PACKET_SIZE) {
+              if (address + 3 < DmxController::FRAME_SIZE) {
                 dmx->getDmxData()[address] = ch1;
                 dmx->getDmxData()[address + 1] = ch2;
                 dmx->getDmxData()[address + 2] = ch3;
@@ -1856,6 +2002,7 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
           dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
           dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
           dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+          dmx->publishFixtures();
         }
         
         // Process the example JSON
@@ -2147,18 +2294,18 @@ void processDownlink(const uint8_t* data, size_t size, int rssi, int snr) {
   // Handle config downlink to set number of lights
   if (size == 2 && data[0] == 0xC0) {
     uint8_t requested = data[1];
+    int maxLights = min(25, min(DmxController::MAX_FIXTURES, DmxController::MAX_CHANNELS / 4));
     if (requested < 1) requested = 1;
-    if (requested > 25) requested = 25;
+    if (requested > maxLights) requested = maxLights;
     numLights = requested;
     Serial.print("[CONFIG] Number of lights set via downlink: ");
     Serial.println(numLights);
     // Optionally, re-initialize fixtures if needed
     if (dmxInitialized && dmx != NULL) {
-      dmx->initializeFixtures(numLights, 4);
-      for (int i = 0; i < numLights; i++) {
-        int addr = 1 + i * 4;
-        dmx->setFixtureConfig(i, "Fixture", addr, addr, addr+1, addr+2, addr+3);
-      }
+      // Restarts the edit journal from this count
+      patchEditor.reset(numLights);
+      syncPatch(0);
+      savePatchJournal();
       // dmx->saveSettings(); // MOVED TO LOOP
       settingsChanged = true;
       Serial.println("[CONFIG] Fixtures re-initialized for new light count");
@@ -2187,7 +2334,7 @@ void initializeLoRaWAN() {
   loraConfig.deviceClass = LORA_CLASS_C;  // Start in Class C mode for immediate downlinks
   loraConfig.subBand = 2;  // TTN US915 uses subband 2
   loraConfig.adrEnabled = false;
-  loraConfig.dataRate = 4;  // DR4 for US915 - max payload 129 bytes
+  loraConfig.dataRate = LORA_DATA_RATE;  // DR4 for US915; downlinks go by the RX2 limit (see sendCapability())
   loraConfig.txPower = 14;
   loraConfig.joinTrials = 5;
   loraConfig.publicNetwork = true;
@@ -2221,6 +2368,10 @@ void initializeLoRaWAN() {
     // Reset heartbeat timing for any remaining software-based timing
     lastHeartbeat = millis();
     
+    // Tell the server what fits (sent from loop())
+    capabilityDue = true;
+    capabilityFailedAt = 0;
+    
     // Send an immediate status message to confirm Class C operation
     String statusMsg = "{\"status\":\"joined\",\"class\":\"C\",\"dmx_fixtures\":" + String(dmx ? dmx->getNumFixtures() : 0) + "}";
     if (lora.send((const uint8_t*)statusMsg.c_str(), statusMsg.length(), 1)) {
@@ -2277,13 +2428,25 @@ void initializeLoRaWAN() {
     
     // Send status response with DMX info
     if (loraInitialized && lora.isJoined()) {
-      String response = "{\"status\":\"ok\",\"class\":\"C\",\"dmx_fixtures\":" + String(dmx ? dmx->getNumFixtures() : 0) + "}";
+      String response = "{\"status\":\"ok\",\"class\":\"C\",\"dmx_fixtures\":" + String(dmx ? dmx->getNumFixtures() : 0) +
+                        ",\"frames_skipped\":" + String(dmx ? dmx->getFramesSkipped() : 0) +
+                        ",\"cpu_saved_ms\":" + String(dmx ? dmx->getCpuSavedMs() : 0) +
+                        ",\"keepalive_ms\":" + String(dmx ? dmx->getKeepaliveInterval() : 0) +
+                        ",\"deadline_misses\":" + String(renderQos.getMisses()) +
+                        ",\"late_frames\":" + String(dmx ? dmx->getFramesLate() : 0) +
+                        ",\"qos_level\":" + String(renderQos.getLevel()) + "}";
       if (lora.send((const uint8_t*)response.c_str(), response.length(), 1)) {
         Serial.println("[LoRaWAN] Status response sent");
       }
     }
   });
   
+  lora.onCommand("capability", [](const String& command, const JsonObject& payload) {
+    Serial.println("[LoRaWAN] Capability requested");
+    capabilityDue = true;
+    capabilityFailedAt = 0;
+  });
+  
   lora.onCommand("test", [](const String& command, const JsonObject& payload) {
     Serial.println("[LoRaWAN] Test command received - setting all fixtures to green");
     
@@ -2296,6 +2459,7 @@ void initializeLoRaWAN() {
         dmx->setFixtureConfig(1, "Fixture 2", 5, 5, 6, 7, 8);
         dmx->setFixtureConfig(2, "Fixture 3", 9, 9, 10, 11, 12);
         dmx->setFixtureConfig(3, "Fixture 4", 13, 13, 14, 15, 16);
+        dmx->publishFixtures();
       }
       
       // Set all fixtures to green
@@ -2337,8 +2501,743 @@ void initializeLoRaWAN() {
   loraInitialized = true;
 }
 
+// Bring up WiFi and the Art-Net bridge if credentials are configured
+void initializeArtNet() {
+  if (strlen(WIFI_SSID) == 0) {
+    Serial.println("[ArtNet] No WiFi SSID configured, Art-Net output disabled");
+    return;
+  }
+
+  Serial.print("[ArtNet] Connecting to WiFi: ");
+  Serial.println(WIFI_SSID);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  configTime(0, 0, SNTP_SERVER);  // The scheduler's clock, synced in the background
+
+  // Connection completes in the background; update() is skipped until it does
+  artnetTransport = new WiFiUdpArtNetTransport(IPAddress(ARTNET_TARGET_IP), ARTNET_PORT);
+  artnetOutput.begin(artnetTransport, ARTNET_START_UNIVERSE, 1);
+  artnetOutput.setKeepaliveInterval(ARTNET_KEEPALIVE_MS);
+  artnetEnabled = true;
+
+  Serial.print("[ArtNet] Re-emitting DMX frame on universe ");
+  Serial.println(ARTNET_START_UNIVERSE);
+}
+
+// Mirror the frame just transmitted to Art-Net (sends only on change or keepalive)
+// Runs on the DMX output task, which owns the output frame between transmits
+void updateArtNet() {
+  if (!artnetEnabled || !dmxInitialized || dmx == NULL) {
+    return;
+  }
+
+  if (WiFi.status() != WL_CONNECTED) {
+    // Nodes that come back get a full refresh straight away
+    artnetOutput.invalidate();
+    return;
+  }
+
+  // Under load the mirror holds its last frame between every few output frames
+  if (renderQos.getLevel() >= QOS_LEVEL_HOLD && dmx->getFramesSent() % QOS_HOLD_DIVIDER != 0) {
+    return;
+  }
+
+  artnetOutput.update(dmx->getOutputData() + 1, DmxController::MAX_CHANNELS, millis());
+}
+
+// DMX output task (core 0): transmits the front frame at a steady rate while
+// loop() renders the next one into the back buffer on core 1. A published
+// frame is swapped in at the next frame boundary; sendFrameNow() wakes the
+// task early for strobe edges. When nothing changes the task drops to the
+// keepalive rate, and the next publish wakes it straight away.
+void dmxTask(void* parameter) {
+  for (;;) {
+    unsigned long frameStart = millis();
+
+    if (dmxInitialized && dmx != NULL) {
+      dmx->transmitFrame(DMX_FRAME_PERIOD_MS);
+      updateArtNet();
+    }
+
+    uint32_t waitMs;
+    if (dmx != NULL && dmx->isOutputIdle()) {
+      waitMs = dmx->getKeepaliveWaitMs();
+    } else {
+      unsigned long elapsed = millis() - frameStart;
+      waitMs = elapsed < DMX_FRAME_PERIOD_MS ? DMX_FRAME_PERIOD_MS - elapsed : 1;
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+  }
+}
+
+// Run TS004 commands and uplink any answers on the FUOTA port
+void handleFuotaDownlink(const uint8_t* data, size_t size) {
+  uint8_t answer[FUOTA_MAX_ANSWER_SIZE];
+  FuotaState before = fuota.getState();
+  size_t answerLen = fuota.handleDownlink(data, size, answer);
+
+  if (fuota.getState() == FUOTA_RECEIVING) {
+    Serial.printf("[FUOTA] %u/%u fragments received, %u missing\n",
+                  fuota.getReceivedCount(), fuota.getNbFrag(), fuota.getMissingCount());
+  } else if (fuota.getState() != before) {
+    Serial.printf("[FUOTA] Session state %d -> %d\n", before, fuota.getState());
+  }
+  
+  // The image CRC and patch apply take seconds: keep them off the downlink path
+  if (before == FUOTA_RECEIVING && fuota.getState() == FUOTA_VERIFYING) {
+    if (xTaskCreatePinnedToCore(fuotaFinalizeTask, "FUOTA", FUOTA_TASK_STACK, NULL,
+                                FUOTA_TASK_PRIORITY, NULL, DMX_TASK_CORE) != pdPASS) {
+      Serial.println("[FUOTA] No memory for the verify task, verifying inline");
+      fuota.finalize();
+    }
+  }
+
+  if (answerLen > 0 && loraInitialized && lora.isJoined()) {
+    if (lora.send(answer, answerLen, FUOTA_PORT)) {
+      Serial.println("[FUOTA] Answer queued");
+    } else {
+      Serial.println("[FUOTA] Failed to queue answer");
+    }
+  }
+}
+
+// Verify (and patch) the received file, then exit; loop() schedules the reboot
+void fuotaFinalizeTask(void* parameter) {
+  unsigned long start = millis();
+  bool ok = fuota.finalize();
+  Serial.printf("[FUOTA] Verification %s after %lu ms\n", ok ? "passed" : "failed", millis() - start);
+  vTaskDelete(NULL);
+}
+
+// Queue keyframes, stop the animation, or change its look-ahead
+void handleKeyframeDownlink(const uint8_t* data, size_t size) {
+  if (data[0] == KF_OPCODE_STOP) {
+    keyframes.reset();
+    Serial.println("[Keyframe] Animation stopped");
+    return;
+  }
+
+  if (data[0] == KF_OPCODE_LOOKAHEAD) {
+    if (size < 3) {
+      Serial.println("[Keyframe] Look-ahead command too short");
+      return;
+    }
+    keyframes.setLookahead(data[1] | (data[2] << 8));
+    Serial.printf("[Keyframe] Look-ahead set to %u ms\n", keyframes.getLookahead());
+    return;
+  }
+
+  // Keyframes take over the channels they touch, so stop any running pattern
+  if (patternHandler.isActive()) {
+    patternHandler.stop();
+  }
+
+  int accepted = keyframes.handlePacket(data + 1, size - 1, millis());
+  if (accepted < 0) {
+    Serial.println("[Keyframe] Malformed keyframe packet");
+    return;
+  }
+  Serial.printf("[Keyframe] %d values queued, %u channels animating, %u late, %u dropped\n",
+                accepted, keyframes.getActiveTracks(), keyframes.getLateCount(),
+                keyframes.getDroppedCount());
+}
+
+// Apply fixture add/move/remove/retype edits and store them in the journal
+void handlePatchEdit(const uint8_t* data, size_t size) {
+  if (!dmxInitialized || dmx == NULL) {
+    Serial.println("[Patch] DMX not initialized, edit ignored");
+    return;
+  }
+  // Another handler re-patched the controller: edit what it left live
+  if (dmx->getPatchVersion() != patchSyncedVersion && !seedPatch()) {
+    Serial.println("[Patch] Live patch has channel maps the edits cannot express, send 0xC0 first");
+    return;
+  }
+  int first;
+  int edits = patchEditor.apply(data, size, first);
+  if (edits < 0) {
+    Serial.println("[Patch] Malformed or out-of-range edit, patch unchanged");
+    return;
+  }
+  syncPatch(first);
+  savePatchJournal();
+  Serial.printf("[Patch] %d edit(s) applied from fixture %d, %d fixtures, journal %u bytes\n",
+                edits, first + 1, patchEditor.getCount(), (unsigned)patchEditor.getJournalLength());
+}
+
+// Take over the live controller patch, so edits start from what is on the wire
+bool seedPatch() {
+  static PatchFixture fixtures[PATCH_MAX_FIXTURES];
+  const DmxController::FixturePatch* patch = dmx->getPatch();
+  if (patch->numFixtures > PATCH_MAX_FIXTURES) {
+    return false;
+  }
+  for (int i = 0; i < patch->numFixtures; i++) {
+    const FixtureConfig& f = patch->fixtures[i];
+    int layout = PatchEditor::findLayout(f.startAddr, f.redChannel, f.greenChannel, f.blueChannel, f.whiteChannel);
+    if (layout < 0) {
+      return false;
+    }
+    fixtures[i].start = (uint16_t)f.startAddr;
+    fixtures[i].layout = (uint8_t)layout;
+    fixtures[i].profile = dmx->getFixtureColorProfile(i);
+  }
+  if (!patchEditor.load(fixtures, patch->numFixtures)) {
+    return false;
+  }
+  patchSyncedVersion = patch->version;
+  return true;
+}
+
+// Copy fixtures [first, end) of the edited patch into a new controller
+// patch; the entries before first are kept from the live one, which the
+// editor matches (handlePatchEdit re-seeds it after any other re-patch)
+void syncPatch(int first) {
+  dmx->editFixtures(patchEditor.getCount());
+  for (int i = first; i < patchEditor.getCount(); i++) {
+    int red, green, blue, white;
+    patchEditor.getChannels(i, red, green, blue, white);
+    dmx->setFixtureConfig(i, "Fixture", patchEditor.getFixture(i).start, red, green, blue, white);
+    dmx->setFixtureColorProfile(i, patchEditor.getFixture(i).profile);
+  }
+  // Swap it in between render steps so no frame mixes the old and new layouts
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    dmx->publishFixtures();
+    patchSyncedVersion = dmx->getPatchVersion();
+    xSemaphoreGive(dmxMutex);
+  }
+}
+
+// Persist the journal (length, then the used part only)
+void savePatchJournal() {
+  static uint8_t record[2 + PATCH_JOURNAL_SIZE];
+  size_t length = patchEditor.getJournalLength();
+  record[0] = (uint8_t)length;
+  record[1] = (uint8_t)(length >> 8);
+  memcpy(record + 2, patchEditor.getJournal(), length);
+  dmx->saveCustomData(PATCH_JOURNAL_KEY, record, 2 + length);
+}
+
+// Rebuild the patch from the stored journal at boot, or take over the
+// controller's own patch when there is none
+void restorePatch() {
+  static uint8_t record[2 + PATCH_JOURNAL_SIZE];
+  size_t stored = dmx->loadCustomDataUpTo(PATCH_JOURNAL_KEY, record, sizeof(record));
+  size_t length = stored >= 2 ? (size_t)(record[0] | (record[1] << 8)) : 0;
+  if (stored < 2 || 2 + length > stored || !patchEditor.replay(record + 2, length)) {
+    if (stored > 0) {
+      Serial.println("[Patch] Stored journal is invalid, ignored");
+    }
+    if (seedPatch()) {
+      Serial.printf("[Patch] Editing the live patch of %d fixtures\n", patchEditor.getCount());
+    } else {
+      Serial.println("[Patch] Live patch has channel maps the edits cannot express");
+    }
+    return;
+  }
+  numLights = (uint8_t)patchEditor.getCount();
+  syncPatch(0);
+  Serial.printf("[Patch] Restored %d fixtures from a %u byte journal\n",
+                patchEditor.getCount(), (unsigned)length);
+}
+
+// Apply a trigger configuration downlink and save the result
+void handleTriggerConfig(const uint8_t* data, size_t size) {
+  if (!triggers.configure(data, size)) {
+    Serial.println("[Trigger] Malformed configuration or unusable pin, ignored");
+    return;
+  }
+  if (dmxInitialized && dmx != NULL) {
+    dmx->saveCustomData(TRIGGER_CONFIG_KEY, (uint8_t*)&triggers.getConfig(), sizeof(TriggerConfig));
+  }
+  Serial.printf("[Trigger] Configuration 0x%02X applied, %d rules\n", data[0], triggers.getConfig().numRules);
+}
+
+// Carry out a rule (trigger task)
+void applyTrigger(const TriggerRule& rule, void* context) {
+  applySceneAction(rule.action, rule.args);
+  Serial.printf("[Trigger] Input %d action %d, %u us after the edge\n",
+                rule.input, rule.action, (unsigned)triggers.getLastLatencyUs());
+}
+
+// Carry out a trigger or schedule action. Looks that only set channels go
+// out at once; anything that needs the command handlers is queued for loop().
+void applySceneAction(uint8_t action, const uint8_t* args) {
+  static const uint8_t PRESETS[5][4] = {
+    { 0, 0, 0, 0 }, { 255, 0, 0, 0 }, { 0, 255, 0, 0 }, { 0, 0, 255, 0 }, { 0, 0, 0, 255 }
+  };
+  static const uint8_t STOP_PATTERN = 0xF0;
+  static const uint8_t STOP_KEYFRAMES = KF_OPCODE_STOP;
+  if (!dmxInitialized || dmx == NULL) {
+    return;
+  }
+
+  switch (action) {
+    case TRIGGER_ACTION_PRESET:
+    case TRIGGER_ACTION_MASTER:
+      if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+        if (action == TRIGGER_ACTION_MASTER) {
+          dmx->setMaster(args[0]);
+        } else {
+          const uint8_t* c = PRESETS[args[0]];
+          for (int i = 0; i < dmx->getNumFixtures(); i++) {
+            dmx->setFixtureColor(i, c[0], c[1], c[2], c[3]);
+          }
+        }
+        dmx->sendFrameNow(dmx->getHighestChannel());
+        xSemaphoreGive(dmxMutex);
+      }
+      // A running effect would paint over the preset: stop it, then
+      // apply the preset again after it
+      if (action == TRIGGER_ACTION_PRESET && (patternHandler.isActive() || keyframes.isActive())) {
+        postTriggerCommand(&STOP_PATTERN, 1);
+        postTriggerCommand(&STOP_KEYFRAMES, 1);
+        postTriggerCommand(args, 1);
+      }
+      break;
+    case TRIGGER_ACTION_EFFECT: {
+      uint8_t command[6] = { 0xF1, args[0], args[2], args[3], args[1], 0 };
+      postTriggerCommand(command, sizeof(command));
+      break;
+    }
+    case TRIGGER_ACTION_STOP:
+      postTriggerCommand(&STOP_PATTERN, 1);
+      postTriggerCommand(&STOP_KEYFRAMES, 1);
+      break;
+    case TRIGGER_ACTION_CUE: {
+      const TriggerCue& cue = triggers.getConfig().cues[args[0]];
+      if (cue.size > 0) {
+        postTriggerCommand(cue.data, cue.size);
+      }
+      break;
+    }
+  }
+}
+
+// Queue a command for loop() and wake it
+void postTriggerCommand(const uint8_t* data, size_t size) {
+  TriggerCommand command;
+  command.size = (uint8_t)min(size, (size_t)TRIGGER_CUE_SIZE);
+  memcpy(command.data, data, command.size);
+  if (triggerCommands != NULL && xQueueSend(triggerCommands, &command, 0) == pdTRUE) {
+    xTaskNotifyGive(loopTaskHandle);
+  }
+}
+
+// Run commands queued by triggers through the downlink handler
+void runTriggerCommands() {
+  TriggerCommand command;
+  while (triggerCommands != NULL && xQueueReceive(triggerCommands, &command, 0) == pdTRUE) {
+    processDownlink(command.data, command.size, 0, 0);
+  }
+}
+
+// Start the trigger task with the stored configuration
+void restoreTriggers() {
+  triggerCommands = xQueueCreate(TRIGGER_COMMAND_QUEUE, sizeof(TriggerCommand));
+  triggers.begin(applyTrigger, NULL);
+
+  // A trigger input on one of these would take the node down
+  HardwareConfig radio;  // Same defaults initializeLoRaWAN() uses
+  const int usedPins[] = { DMX_TX_PIN, DMX_RX_PIN, DMX_DIR_PIN, LED_PIN, TX, RX,
+                           radio.resetPin, radio.nssPin, radio.sckPin, radio.misoPin,
+                           radio.mosiPin, radio.dio1Pin, radio.busyPin };
+  for (size_t i = 0; i < sizeof(usedPins) / sizeof(usedPins[0]); i++) {
+    if (usedPins[i] >= 0) {
+      triggers.reservePin((uint8_t)usedPins[i]);
+    }
+  }
+
+  TriggerConfig stored;
+  if (!dmx->loadCustomData(TRIGGER_CONFIG_KEY, (uint8_t*)&stored, sizeof(stored))) {
+    return;
+  }
+  if (triggers.loadConfig(stored)) {
+    Serial.printf("[Trigger] Restored %d rules\n", stored.numRules);
+  } else {
+    Serial.println("[Trigger] ❌ Stored configuration is invalid, inputs left off");
+  }
+}
+
+// Set the system clock from a 0xA0 downlink (Unix time, u32 LE)
+void handleClockSet(const uint8_t* data, size_t size) {
+  struct timeval tv;
+  tv.tv_sec = (time_t)(data[1] | (data[2] << 8) | (data[3] << 16) | ((uint32_t)data[4] << 24));
+  tv.tv_usec = 0;
+  settimeofday(&tv, NULL);
+  Serial.printf("[Schedule] Clock set to %lu\n", (unsigned long)tv.tv_sec);
+}
+
+// Apply and save a site or rules downlink
+void handleScheduleConfig(const uint8_t* data, size_t size) {
+  if (!scheduler.configure(data, size)) {
+    Serial.println("[Schedule] Malformed configuration, ignored");
+    return;
+  }
+  if (dmxInitialized && dmx != NULL) {
+    dmx->saveCustomData(SCHEDULE_CONFIG_KEY, (uint8_t*)&scheduler.getConfig(), sizeof(ScheduleConfig));
+  }
+  Serial.printf("[Schedule] Configuration 0x%02X applied, %d rules, next at %lu\n", data[0],
+                scheduler.getConfig().numRules, (unsigned long)scheduler.getNextFire());
+}
+
+// Carry out a scheduled rule (loop())
+void applySchedule(const ScheduleRule& rule, void* context) {
+  applySceneAction(rule.action, rule.args);
+  Serial.printf("[Schedule] Action %d fired, next at %lu\n", rule.action, (unsigned long)scheduler.getNextFire());
+}
+
+// Load the stored site and rules; they run once the clock is set
+void restoreSchedule() {
+  scheduler.begin(applySchedule, NULL);
+  ScheduleConfig stored;
+  if (dmx->loadCustomData(SCHEDULE_CONFIG_KEY, (uint8_t*)&stored, sizeof(stored)) && scheduler.loadConfig(stored)) {
+    Serial.printf("[Schedule] Restored %d rules\n", stored.numRules);
+  }
+}
+
+// Account a loop() pass against the frame deadline and shed or restore work
+void endRenderPass(int64_t passStartUs, uint32_t renderUs) {
+  bool rendering = patternHandler.isActive() || keyframes.isActive() || runningRainbowDemo;
+  uint32_t passUs = (uint32_t)(esp_timer_get_time() - passStartUs);
+  if (!renderQos.endPass(millis(), passUs, renderUs, rendering)) {
+    return;
+  }
+
+  uint8_t level = renderQos.getLevel();
+  patternHandler.setRateDivider(level >= QOS_LEVEL_HALF_RATE ? 2 : 1);
+  if (dmxInitialized && dmx != NULL && dmx->isDitherSuspended() != (level >= QOS_LEVEL_NO_DITHER)) {
+    // Republish so the pending frame follows the change
+    if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+      dmx->setDitherSuspended(level >= QOS_LEVEL_NO_DITHER);
+      dmx->sendData();
+      xSemaphoreGive(dmxMutex);
+    }
+  }
+  Serial.printf("[QoS] Level %d (%s): pass %lu us avg, render %lu us avg, %lu misses\n", level,
+                RenderQos::getLevelName(level), (unsigned long)renderQos.getPassCostUs(),
+                (unsigned long)renderQos.getRenderCostUs(), (unsigned long)renderQos.getMisses());
+}
+
+// Uplink data rate in use. LoRaManager2 does not report it, and with ADR
+// off it stays at the configured rate.
+uint8_t currentDataRate() {
+  return LORA_DATA_RATE;
+}
+
+// Send the capability uplink when it is due or the data rate has changed
+void updateCapability(unsigned long now) {
+  if (!loraInitialized || !lora.isJoined()) {
+    return;
+  }
+  uint8_t dataRate = currentDataRate();
+  if (dataRate != advertisedDataRate) {
+    capabilityDue = true;
+  }
+  if (!capabilityDue || (capabilityFailedAt != 0 && now - capabilityFailedAt < CAPABILITY_RETRY_MS)) {
+    return;
+  }
+  if (sendCapability(dataRate)) {
+    advertisedDataRate = dataRate;
+    capabilityDue = false;
+    capabilityFailedAt = 0;
+  } else {
+    capabilityFailedAt = now ? now : 1;
+  }
+}
+
+// Uplink what the node accepts at a data rate (type 0x06, see NodeCapability.h)
+bool sendCapability(uint8_t dataRate) {
+  NodeCapability capability;
+  capability.version = CAPABILITY_PROTOCOL_VERSION;
+  capability.flags = CAPABILITY_FLAG_CLASS_C;
+  capability.features = CAPABILITY_FEATURE_PRESETS | CAPABILITY_FEATURE_COMPACT_LIGHTS | CAPABILITY_FEATURE_JSON |
+                        CAPABILITY_FEATURE_PATTERNS | CAPABILITY_FEATURE_FIXTURES | CAPABILITY_FEATURE_PATCH_EDITS |
+                        CAPABILITY_FEATURE_KEYFRAMES | CAPABILITY_FEATURE_TRIGGERS | CAPABILITY_FEATURE_SCHEDULE |
+                        CAPABILITY_FEATURE_FUOTA;
+  capability.uplinkDataRate = dataRate;
+  
+  // Class C downlinks use RX2, and RX1 follows the uplink: advertise what fits both
+  capability.downlinkDataRate = CAPABILITY_US915_RX2_DATA_RATE;
+  capability.maxDownlinkPayload = min(capabilityUs915DownlinkLimit(CAPABILITY_US915_RX2_DATA_RATE),
+                                      capabilityUs915DownlinkLimit(capabilityUs915Rx1DataRate(dataRate)));
+  capability.fragmentSlots = FRAG_MAX_FRAGMENTS;
+  capability.maxFragmentSize = (uint8_t)min(FRAG_MAX_FRAG_SIZE, capability.maxDownlinkPayload - FUOTA_FRAGMENT_OVERHEAD);
+  
+  const TriggerConfig& triggerConfig = triggers.getConfig();
+  capability.freeCueSlots = 0;
+  for (int i = 0; i < TRIGGER_MAX_CUES; i++) {
+    capability.freeCueSlots += triggerConfig.cues[i].size == 0 ? 1 : 0;
+  }
+  capability.freeScheduleRules = SCHEDULE_MAX_RULES - scheduler.getConfig().numRules;
+  
+  uint8_t payload[CAPABILITY_SIZE];
+  capabilityEncode(capability, payload);
+  bool sent = lora.send(payload, sizeof(payload), 2);
+  Serial.printf("[Capability] DR%u, downlinks up to %u bytes at DR%u, %u free cues, %u free rules: %s\n",
+                dataRate, capability.maxDownlinkPayload, capability.downlinkDataRate, capability.freeCueSlots,
+                capability.freeScheduleRules, sent ? "queued" : "failed to queue");
+  return sent;
+}
+
+// Print a DMX self-test result and uplink it (type 0x04, big endian):
+// 0x04 flags frames missing errors16 firstBad16 break16 mab16 refresh16 slots16
+// flags: bit 0 pass, bit 1 line mode, bit 2 test pattern, bit 3 edges not seen
+void reportSelfTest(const DmxLoopbackResult& result) {
+  Serial.printf("[SelfTest] %s: %u/%u frames read back, %u slot errors (first %d), %u untimed\n",
+                result.passed ? "PASS" : "FAIL", result.frames - result.framesMissing, result.frames,
+                result.slotErrors, result.firstBadSlot, result.framesUntimed);
+  Serial.printf("[SelfTest] break %u us, MAB %u us, refresh %lu us, %u slots, %lu ms (%s%s)\n",
+                result.breakUs, result.mabUs, (unsigned long)result.refreshUs, result.slots,
+                (unsigned long)result.durationMs, result.mode == LOOPBACK_LINE ? "line" : "internal",
+                result.pattern ? ", test pattern" : "");
+
+  uint16_t firstBad = result.firstBadSlot < 0 ? 0xFFFF : (uint16_t)result.firstBadSlot;
+  uint16_t refresh = (uint16_t)min(result.refreshUs, (uint32_t)0xFFFF);
+  uint8_t flags = (result.passed ? 0x01 : 0) |
+                  (result.mode == LOOPBACK_LINE ? 0x02 : 0) |
+                  (result.pattern ? 0x04 : 0) |
+                  (result.framesUntimed > 0 ? 0x08 : 0);
+  uint8_t payload[16] = {
+    0x04, flags, result.frames, result.framesMissing,
+    (uint8_t)(result.slotErrors >> 8), (uint8_t)result.slotErrors,
+    (uint8_t)(firstBad >> 8), (uint8_t)firstBad,
+    (uint8_t)(result.breakUs >> 8), (uint8_t)result.breakUs,
+    (uint8_t)(result.mabUs >> 8), (uint8_t)result.mabUs,
+    (uint8_t)(refresh >> 8), (uint8_t)refresh,
+    (uint8_t)(result.slots >> 8), (uint8_t)result.slots
+  };
+  blackBox.logEvent(BLACKBOX_EVENT_SELFTEST, payload, sizeof(payload), millis());
+
+  if (!loraInitialized || !lora.isJoined()) {
+    return;
+  }
+  if (lora.send(payload, sizeof(payload), 2)) {
+    Serial.println("[SelfTest] Result uplink queued");
+  }
+}
+
+// Send the next black-box dump fragments: a burst of hex lines on the
+// console, or one uplink per BLACKBOX_UPLINK_INTERVAL_MS
+void updateBlackBoxDump(unsigned long now) {
+  if (!blackBox.isDumping()) {
+    return;
+  }
+
+  uint8_t fragment[BLACKBOX_FRAGMENT_HEADER + BLACKBOX_SERIAL_FRAGMENT];
+  if (!blackBoxUplinkDump) {
+    for (int i = 0; i < BLACKBOX_SERIAL_BURST; i++) {
+      size_t length = blackBox.nextDumpFragment(fragment);
+      if (length == 0) {
+        Serial.println("[BlackBox] Dump complete");
+        return;
+      }
+      Serial.print("BBX ");
+      for (size_t j = 0; j < length; j++) {
+        Serial.printf("%02X", fragment[j]);
+      }
+      Serial.println();
+    }
+    return;
+  }
+
+  if (!loraInitialized || !lora.isJoined() || now - lastBlackBoxUplink < BLACKBOX_UPLINK_INTERVAL_MS) {
+    return;
+  }
+  lastBlackBoxUplink = now;
+  uint16_t index = blackBox.getDumpIndex();
+  uint16_t total = blackBox.getDumpTotal();
+  size_t length = blackBox.nextDumpFragment(fragment);
+  if (length == 0) {
+    Serial.println("[BlackBox] Uplink dump complete");
+    return;
+  }
+  if (lora.send(fragment, length, 2)) {
+    Serial.printf("[BlackBox] Dump fragment %u/%u queued\n", index + 1, total);
+  } else {
+    Serial.printf("[BlackBox] Dump fragment %u/%u failed\n", index + 1, total);
+  }
+}
+
+// Send a reply on the serial link: status byte, then data
+void sendSerialLinkReply(const SerialLinkMessage& request, uint8_t status, const uint8_t* data, size_t length) {
+  static uint8_t payload[SERIAL_LINK_MAX_PAYLOAD];
+  static uint8_t frame[SERIAL_LINK_MAX_ENCODED];
+  length = min(length, (size_t)SERIAL_LINK_MAX_PAYLOAD - 1);
+  payload[0] = status;
+  if (length > 0) {
+    memcpy(payload + 1, data, length);
+  }
+  size_t encoded = serialLinkEncode(request.type | SERIAL_LINK_REPLY, request.sequence, payload, length + 1, frame);
+  Serial.write(frame, encoded);
+}
+
+// Write streamed slot values into the frame; the stream takes over the
+// output from patterns and animations
+bool applySerialLinkFrame(const uint8_t* data, size_t length) {
+  if (length < 2 || !dmxInitialized || dmx == NULL) {
+    return false;
+  }
+  uint16_t start = data[0] | (data[1] << 8);
+  size_t count = length - 2;
+  if (start < 1 || start + count - 1 > DmxController::MAX_CHANNELS) {
+    return false;
+  }
+
+  if (patternHandler.isActive()) {
+    patternHandler.stop();
+  }
+  if (strobeGenerator.isActive()) {
+    strobeGenerator.stop();
+  }
+  if (keyframes.isActive()) {
+    keyframes.reset();
+  }
+  runningRainbowDemo = false;
+
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    memcpy(dmx->getDmxData() + start, data + 2, count);
+    dmx->sendData();
+    xSemaphoreGive(dmxMutex);
+  }
+  serialLinkFrames++;
+  return true;
+}
+
+// Handle a binary message from the serial link
+void SerialLinkCommands::onMessage(const SerialLinkMessage& message) {
+  switch (message.type) {
+    case SERIAL_LINK_PING:
+      sendSerialLinkReply(message, SERIAL_LINK_OK, message.payload, message.length);
+      break;
+
+    case SERIAL_LINK_COMMAND:
+      if (message.length == 0 || message.length > MAX_JSON_SIZE) {
+        sendSerialLinkReply(message, SERIAL_LINK_BAD_REQUEST, NULL, 0);
+        break;
+      }
+      processDownlink(message.payload, message.length, 0, 0);
+      sendSerialLinkReply(message, SERIAL_LINK_OK, NULL, 0);
+      break;
+
+    case SERIAL_LINK_FRAME:
+      // Streamed at frame rate, so no reply; rejected frames are not counted
+      applySerialLinkFrame(message.payload, message.length);
+      break;
+
+    case SERIAL_LINK_TELEMETRY: {
+      SerialLinkTelemetry telemetry;
+      telemetry.uptimeMs = millis();
+      telemetry.freeHeap = ESP.getFreeHeap();
+      telemetry.framesSent = dmx ? dmx->getFramesSent() : 0;
+      telemetry.framesSkipped = dmx ? dmx->getFramesSkipped() : 0;
+      telemetry.linkMessages = serialLink.getMessages();
+      telemetry.linkErrors = serialLink.getErrors();
+      telemetry.linkFrames = serialLinkFrames;
+      telemetry.highestChannel = dmx ? dmx->getHighestChannel() : 0;
+      telemetry.fixtures = dmx ? dmx->getNumFixtures() : 0;
+      telemetry.flags = (dmxInitialized ? 0x01 : 0) | (loraInitialized && lora.isJoined() ? 0x02 : 0) |
+                        (patternHandler.isActive() ? 0x04 : 0);
+      telemetry.rssi = receivedRssi;
+      telemetry.snr = receivedSnr;
+      uint8_t data[SERIAL_LINK_TELEMETRY_SIZE];
+      serialLinkPutTelemetry(telemetry, data);
+      sendSerialLinkReply(message, SERIAL_LINK_OK, data, sizeof(data));
+      break;
+    }
+
+    case SERIAL_LINK_READ: {
+      if (!dmxInitialized || dmx == NULL) {
+        sendSerialLinkReply(message, SERIAL_LINK_NOT_READY, NULL, 0);
+        break;
+      }
+      uint16_t start = message.length >= 4 ? message.payload[0] | (message.payload[1] << 8) : 0;
+      uint16_t count = message.length >= 4 ? message.payload[2] | (message.payload[3] << 8) : 0;
+      if (start < 1 || count == 0 || start + count - 1 > DmxController::MAX_CHANNELS) {
+        sendSerialLinkReply(message, SERIAL_LINK_BAD_REQUEST, NULL, 0);
+        break;
+      }
+      static uint8_t data[2 + DmxController::MAX_CHANNELS];
+      data[0] = message.payload[0];
+      data[1] = message.payload[1];
+      memcpy(data + 2, dmx->getOutputData() + start, count);
+      sendSerialLinkReply(message, SERIAL_LINK_OK, data, 2 + count);
+      break;
+    }
+
+    case SERIAL_LINK_BAUD: {
+      uint32_t baud = message.length >= 4 ? message.payload[0] | (message.payload[1] << 8) |
+                      (message.payload[2] << 16) | ((uint32_t)message.payload[3] << 24) : 0;
+      if (baud < SERIAL_MIN_BAUD || baud > SERIAL_MAX_BAUD) {
+        sendSerialLinkReply(message, SERIAL_LINK_BAD_REQUEST, NULL, 0);
+        break;
+      }
+      sendSerialLinkReply(message, SERIAL_LINK_OK, NULL, 0);
+      Serial.flush();
+      Serial.updateBaudRate(baud);
+      serialBaud = baud;
+      break;
+    }
+
+    default:
+      sendSerialLinkReply(message, SERIAL_LINK_UNKNOWN, NULL, 0);
+      break;
+  }
+}
+
+// JSON typed on the console goes to the downlink command handler
+void SerialLinkCommands::onLine(const char* line) {
+  processJsonPayload(String(line));
+}
+
+// Feed received serial bytes to the link, and go back to the console rate
+// once the host has gone quiet
+void pollSerialLink() {
+  uint8_t chunk[128];
+  int available;
+  while ((available = Serial.available()) > 0) {
+    size_t got = Serial.readBytes(chunk, min((size_t)available, sizeof(chunk)));
+    serialLink.feed(chunk, got, millis());
+  }
+
+  if (serialBaud != SERIAL_BAUD && millis() - serialLink.getLastMessageMs() >= SERIAL_LINK_IDLE_MS) {
+    Serial.flush();
+    Serial.updateBaudRate(SERIAL_BAUD);
+    serialBaud = SERIAL_BAUD;
+    Serial.printf("[SerialLink] Link idle, back to %d baud\n", SERIAL_BAUD);
+  }
+}
+
+// Interpolate the keyframe animation into the DMX frame and send it
+void updateKeyframes() {
+  if (!keyframes.isActive() || !dmxInitialized || dmx == NULL) {
+    return;
+  }
+
+  // Every channel is holding a value: the frame would come out unchanged
+  if (!keyframes.needsRender(millis())) {
+    return;
+  }
+
+  // At half rate every other pass keeps the previous frame
+  static uint32_t passes = 0;
+  if (renderQos.getLevel() >= QOS_LEVEL_HALF_RATE && (passes++ & 1)) {
+    return;
+  }
+
+  if (xSemaphoreTake(dmxMutex, portMAX_DELAY) == pdTRUE) {
+    keyframes.render(millis(), dmx->getDmxData(), dmx->getDmxFraction());
+    dmx->sendData();
+    xSemaphoreGive(dmxMutex);
+  }
+}
+
 void setup() {
-    Serial.begin(115200);
+    Serial.setRxBufferSize(SERIAL_RX_BUFFER);
+    Serial.begin(SERIAL_BAUD);
+    loopTaskHandle = xTaskGetCurrentTaskHandle();
+    Serial.onReceive([]() { xTaskNotifyGive(loopTaskHandle); });
     delay(3000);
     Serial.println("Starting up...");
     
@@ -2351,6 +3250,9 @@ void setup() {
     dmx->begin();
     dmxInitialized = true;
     
+    // Black-box recorder; logs why the previous run ended
+    blackBox.begin((uint8_t)esp_reset_reason());
+    
     // Create mutex for thread-safe DMX data access
     dmxMutex = xSemaphoreCreateMutex();
     if (dmxMutex == NULL) {
@@ -2358,19 +3260,39 @@ void setup() {
         return;
     }
     
+    // Hardware-timed strobe generator
+    strobeGenerator.begin(dmx, dmxMutex);
+    
+    // Pattern player renders through the controller and strobe
+    patternHandler.begin(dmx, dmxMutex, &strobeGenerator);
+    renderQos.setBudget(DMX_FRAME_PERIOD_MS * 1000UL);
+    
+    // Fixture patch from the last config downlink and edits
+    restorePatch();
+    
+    // Trigger inputs and their rules from flash
+    restoreTriggers();
+    
+    // Scheduled actions from flash
+    restoreSchedule();
+    
     // Initialize LoRaWAN with credentials from secrets.h
     initializeLoRaWAN();
     
-    // Start DMX task on Core 0
+    // Optional Art-Net bridge over WiFi
+    initializeArtNet();
+    
+    // Start DMX output task on Core 0
     xTaskCreatePinnedToCore(
         dmxTask,     // Task function
         "DMX Task",  // Name
         4096,        // Stack size
         NULL,        // Parameters
-        1,           // Priority
+        DMX_TASK_PRIORITY, // Priority
         &dmxTaskHandle, // Task handle
-        0            // Core (0)
+        DMX_TASK_CORE   // Core (0)
     );
+    dmx->setOutputTask(dmxTaskHandle);
     
     // Initialize watchdog timer
     esp_task_wdt_init(WDT_TIMEOUT, true);
@@ -2380,6 +3302,7 @@ void setup() {
 void loop() {
   // Get current time
   unsigned long currentMillis = millis();
+  int64_t passStartUs = esp_timer_get_time();
   
   // Reset the watchdog timer
   esp_task_wdt_reset();
@@ -2393,6 +3316,9 @@ void loop() {
     
     // Process message queue periodically
     processMessageQueue();
+    
+    // Advertise the payload limit after a join or a data rate change
+    updateCapability(currentMillis);
   }
 
   // Handle received downlink data (deferred from ISR)
@@ -2403,6 +3329,15 @@ void loop() {
     dataReceived = false;
   }
   
+  // Scheduled actions that are due (one comparison until one is)
+  scheduler.update((uint32_t)time(NULL));
+  
+  // Commands started by trigger inputs and the schedule
+  runTriggerCommands();
+  
+  // Serial link messages and console commands
+  pollSerialLink();
+  
   // Handle DMX patterns and rainbow demo (still needed for local control)
   if (runningRainbowDemo && dmxInitialized && dmx != NULL) {
     if (currentMillis - lastRainbowStep >= rainbowStepDelay) {
@@ -2428,12 +3363,56 @@ void loop() {
   }
   
   // Update pattern (if active)
+  int64_t renderStartUs = esp_timer_get_time();
   if (patternHandler.isActive()) {
     patternHandler.update();
   }
   
-  // Small delay to prevent watchdog issues (like working example)
-  delay(100);
+  // Advance the keyframe animation (if playing)
+  updateKeyframes();
+  uint32_t renderUs = (uint32_t)(esp_timer_get_time() - renderStartUs);
+  
+  // Report a finished DMX self-test
+  DmxLoopbackResult selfTest;
+  if (dmxInitialized && dmx != NULL && dmx->getSelfTestResult(selfTest)) {
+    reportSelfTest(selfTest);
+  }
+  
+  // Record the on-air frame (read without a lock: a frame caught mid-swap
+  // mixes two consecutive frames) and advance any black-box dump. Under
+  // load the recorder keeps its last sample.
+  if (dmxInitialized && dmx != NULL && renderQos.getLevel() < QOS_LEVEL_HOLD) {
+    blackBox.sample(dmx->getOutputData() + 1, dmx->getHighestChannel(), currentMillis);
+  }
+  blackBox.poll(currentMillis);
+  updateBlackBoxDump(currentMillis);
+  
+  // Drain the profiler's sample rings and end a timed profile
+  profiler.poll();
+  if (profilerStopAt != 0 && (long)(currentMillis - profilerStopAt) >= 0) {
+    profilerStopAt = 0;
+    profiler.stop();
+    profiler.printReport(Serial);
+  }
+  
+  // Boot into the new image once the FUOTA task has selected it
+  if (fuota.isRebootPending() && fuotaRebootAt == 0) {
+    Serial.println("[FUOTA] New firmware ready, rebooting shortly");
+    fuotaRebootAt = currentMillis + FUOTA_REBOOT_DELAY_MS;
+  }
+  if (fuotaRebootAt != 0 && (long)(currentMillis - fuotaRebootAt) >= 0) {
+    Serial.println("[FUOTA] Rebooting into new firmware...");
+    delay(100);
+    ESP.restart();
+  }
+  
+  // Everything above delays the next publish
+  endRenderPass(passStartUs, renderUs);
+  
+  // Small delay to prevent watchdog issues (like working example);
+  // shorter while animating so interpolation stays smooth. Serial input
+  // ends the wait early so streamed frames go out without delay.
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(keyframes.isActive() ? KEYFRAME_FRAME_MS : 100));
 }
 
 void send_lora_frame() {
@@ -2448,8 +3427,28 @@ void send_lora_frame() {
     count++;
     Serial.printf("[App] 📡 Sending heartbeat frame #%d\\n", count);
     
-    // Create payload matching working example exactly
-    uint8_t payload[6];
+    // Idle-output telemetry since the previous heartbeat
+    static uint32_t lastSent = 0;
+    static uint32_t lastSkipped = 0;
+    static uint32_t lastSavedMs = 0;
+    uint32_t sent = dmx ? dmx->getFramesSent() : 0;
+    uint32_t skipped = dmx ? dmx->getFramesSkipped() : 0;
+    uint32_t savedMs = dmx ? dmx->getCpuSavedMs() : 0;
+    uint32_t intervalFrames = (sent - lastSent) + (skipped - lastSkipped);
+    uint8_t idlePercent = intervalFrames ? (uint8_t)((skipped - lastSkipped) * 100 / intervalFrames) : 0;
+    uint32_t intervalSavedMs = min(savedMs - lastSavedMs, (uint32_t)0xFFFF);
+    lastSent = sent;
+    lastSkipped = skipped;
+    lastSavedMs = savedMs;
+    
+    // Render deadline misses since the previous heartbeat and the worst QoS level
+    static uint32_t lastMisses = 0;
+    uint32_t misses = renderQos.getMisses();
+    uint8_t intervalMisses = (uint8_t)min(misses - lastMisses, (uint32_t)255);
+    lastMisses = misses;
+    
+    // Create payload matching working example, plus idle-output and QoS telemetry
+    uint8_t payload[11];
     uint32_t i = 0;
     payload[i++] = (uint8_t)(count >> 24);
     payload[i++] = (uint8_t)(count >> 16);
@@ -2457,6 +3456,11 @@ void send_lora_frame() {
     payload[i++] = (uint8_t)count;
     payload[i++] = 0xC5; // Class C indicator
     payload[i++] = (uint8_t)(dmx ? dmx->getNumFixtures() : 0); // DMX fixture count
+    payload[i++] = idlePercent;                     // Output frames skipped as idle (%)
+    payload[i++] = (uint8_t)(intervalSavedMs >> 8); // CPU time saved (ms)
+    payload[i++] = (uint8_t)intervalSavedMs;
+    payload[i++] = intervalMisses;                  // Render deadline misses
+    payload[i++] = renderQos.takePeakLevel();       // Highest QoS level (0 = full)
     
     Serial.print("[App] Payload: ");
     for (uint8_t j = 0; j < sizeof(payload); j++) {
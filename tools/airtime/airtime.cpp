@@ -0,0 +1,373 @@
+/**
+ * airtime.cpp - Downlink size and airtime benchmark
+ *
+ * Runs a set of typical scene changes on a test rig through
+ * lib/DownlinkEncoder and compares the result with what a server sends
+ * today: one JSON lights entry per changed fixture, or the codec's compact
+ * format (one light per changed fixture, split to fit the data rate).
+ * Every plan is replayed with DownlinkEncoder::apply() and checked against
+ * the target frame; the exit status is 1 if an encoder plan fails.
+ *
+ * Usage: airtime [options]
+ *   -d RATE     US915 downlink data rate, DR8-DR13 (default DR8)
+ *   -c HEX      Capability uplink from the node (type 0x06); its data
+ *               rate and payload limit replace -d
+ *   -f COUNT    RGBW fixtures in the rig (default 20; the last quarter
+ *               is patched above channel 255)
+ *   -v          Print the chosen payloads
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "DownlinkEncoder.h"
+
+#define RIG_MAX_FIXTURES 64
+#define RIG_HIGH_ADDRESS 301     // First channel of the high fixtures
+
+// A scene change and how the benchmark builds it
+struct Scene {
+    const char* name;
+    bool patternActive;
+    uint8_t current[DOWNLINK_SLOTS];
+    uint8_t target[DOWNLINK_SLOTS];
+};
+
+// Totals of one encoding across the scenes
+struct Totals {
+    size_t bytes;
+    size_t packets;
+    double airtimeMs;
+};
+
+static std::vector<DownlinkFixture> rig;
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "airtime: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Set one fixture's RGBW values
+static void setFixture(uint8_t* frame, size_t fixture, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+    frame[rig[fixture].red - 1] = r;
+    frame[rig[fixture].green - 1] = g;
+    frame[rig[fixture].blue - 1] = b;
+    frame[rig[fixture].white - 1] = w;
+}
+
+// Set every fixture to one color
+static void setAll(uint8_t* frame, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
+    for (size_t i = 0; i < rig.size(); i++) {
+        setFixture(frame, i, r, g, b, w);
+    }
+}
+
+// Fixtures whose values differ between two frames
+static std::vector<size_t> changedFixtures(const uint8_t* current, const uint8_t* target) {
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < rig.size(); i++) {
+        if (memcmp(current + rig[i].red - 1, target + rig[i].red - 1, 4) != 0) {
+            changed.push_back(i);
+        }
+    }
+    return changed;
+}
+
+// Today's JSON: one {"address","channels"} entry per changed fixture,
+// as many entries per packet as fit
+static DownlinkPlan baselineJson(const DownlinkEncoder& encoder, const Scene& scene) {
+    DownlinkPlan plan;
+    std::vector<size_t> changed = changedFixtures(scene.current, scene.target);
+    size_t room = encoder.getDataRate().maxPayload - strlen("{\"lights\":[]}");
+    std::string body;
+    for (size_t i = 0; i <= changed.size(); i++) {
+        std::string entry;
+        if (i < changed.size()) {
+            const uint8_t* values = scene.target + rig[changed[i]].red - 1;
+            char text[80];
+            snprintf(text, sizeof(text), "{\"address\":%u,\"channels\":[%u,%u,%u,%u]}",
+                     rig[changed[i]].red, values[0], values[1], values[2], values[3]);
+            entry = text;
+        }
+        if (!body.empty() && (i == changed.size() || body.size() + 1 + entry.size() > room)) {
+            std::string json = "{\"lights\":[" + body + "]}";
+            Downlink downlink;
+            downlink.format = "json";
+            downlink.payload.assign(json.begin(), json.end());
+            plan.downlinks.push_back(downlink);
+            body.clear();
+        }
+        body += (body.empty() || entry.empty() ? "" : ",") + entry;
+    }
+    return plan;
+}
+
+// The codec's compact lights: one light per changed fixture; fixtures above
+// channel 255 cannot be addressed and fall back to JSON
+static DownlinkPlan baselineCompact(const DownlinkEncoder& encoder, const Scene& scene) {
+    DownlinkPlan plan;
+    Scene high = scene;
+    memcpy(high.target, high.current, DOWNLINK_SLOTS);
+    std::vector<size_t> changed = changedFixtures(scene.current, scene.target);
+    std::vector<size_t> compact;
+    for (size_t i = 0; i < changed.size(); i++) {
+        if (rig[changed[i]].red <= DOWNLINK_MAX_COMPACT_ADDRESS) {
+            compact.push_back(changed[i]);
+        } else {
+            memcpy(high.target + rig[changed[i]].red - 1, scene.target + rig[changed[i]].red - 1, 4);
+        }
+    }
+    size_t perPacket = std::min((size_t)DOWNLINK_MAX_LIGHTS, (size_t)(encoder.getDataRate().maxPayload - 1) / 5);
+    for (size_t i = 0; i < compact.size(); i += perPacket) {
+        size_t count = std::min(perPacket, compact.size() - i);
+        Downlink downlink;
+        downlink.format = "lights";
+        downlink.payload.push_back((uint8_t)count);
+        for (size_t j = i; j < i + count; j++) {
+            uint16_t address = rig[compact[j]].red;
+            downlink.payload.push_back((uint8_t)address);
+            downlink.payload.insert(downlink.payload.end(), scene.target + address - 1, scene.target + address + 3);
+        }
+        plan.downlinks.push_back(downlink);
+    }
+    DownlinkPlan json = baselineJson(encoder, high);
+    plan.downlinks.insert(plan.downlinks.end(), json.downlinks.begin(), json.downlinks.end());
+    return plan;
+}
+
+// Cost a plan, replay it and check the result
+static bool finish(const DownlinkEncoder& encoder, const Scene& scene, DownlinkPlan& plan, Totals& totals) {
+    uint8_t frame[DOWNLINK_SLOTS];
+    memcpy(frame, scene.current, DOWNLINK_SLOTS);
+    bool ok = true;
+    plan.airtimeMs = 0;
+    for (size_t i = 0; i < plan.downlinks.size(); i++) {
+        const std::vector<uint8_t>& payload = plan.downlinks[i].payload;
+        plan.airtimeMs += encoder.airtimeMs(payload.size());
+        ok = ok && payload.size() <= encoder.getDataRate().maxPayload &&
+             encoder.apply(&payload[0], payload.size(), frame);
+    }
+    ok = ok && memcmp(frame, scene.target, DOWNLINK_SLOTS) == 0;
+    totals.bytes += plan.getBytes();
+    totals.packets += plan.downlinks.size();
+    totals.airtimeMs += plan.airtimeMs;
+    return ok;
+}
+
+// Print the payloads of a plan
+static void printPlan(const DownlinkPlan& plan) {
+    for (size_t i = 0; i < plan.downlinks.size(); i++) {
+        const Downlink& downlink = plan.downlinks[i];
+        printf("      %-8s", downlink.format);
+        if (strcmp(downlink.format, "json") == 0) {
+            printf("%.*s\n", (int)downlink.payload.size(), (const char*)&downlink.payload[0]);
+        } else {
+            for (size_t j = 0; j < downlink.payload.size(); j++) {
+                printf("%02X", downlink.payload[j]);
+            }
+            printf("\n");
+        }
+    }
+}
+
+// The scene changes of the benchmark
+static std::vector<Scene> buildScenes() {
+    std::vector<Scene> scenes;
+    Scene scene;
+    size_t n = rig.size();
+    size_t firstHigh = n - n / 4;
+
+    scene = Scene();
+    scene.name = "blackout to all red";
+    setAll(scene.target, 255, 0, 0, 0);
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "one fixture to amber";
+    setAll(scene.current, 255, 0, 0, 0);
+    memcpy(scene.target, scene.current, DOWNLINK_SLOTS);
+    setFixture(scene.target, 2, 255, 120, 0, 0);
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "three fixtures change";
+    setAll(scene.current, 255, 0, 0, 0);
+    memcpy(scene.target, scene.current, DOWNLINK_SLOTS);
+    setFixture(scene.target, 0, 0, 0, 255, 0);
+    setFixture(scene.target, 4, 0, 255, 0, 0);
+    setFixture(scene.target, 9 % n, 255, 0, 255, 40);
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "rainbow across the rig";
+    for (size_t i = 0; i < n; i++) {
+        int hue = (int)(i * 1536 / n);
+        int rise = hue % 256;
+        uint8_t r = hue < 256 ? 255 : hue < 512 ? 255 - rise : hue < 1024 ? 0 : hue < 1280 ? rise : 255;
+        uint8_t g = hue < 256 ? rise : hue < 768 ? 255 : hue < 1024 ? 255 - rise : 0;
+        uint8_t b = hue < 512 ? 0 : hue < 768 ? rise : hue < 1280 ? 255 : 255 - rise;
+        setFixture(scene.target, i, r, g, b, 0);
+    }
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "all white, two blue";
+    setAll(scene.current, 255, 0, 0, 0);
+    setAll(scene.target, 0, 0, 0, 255);
+    setFixture(scene.target, 1, 0, 0, 255, 0);
+    setFixture(scene.target, n - 1, 0, 0, 255, 0);
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "dim all to half";
+    setAll(scene.current, 255, 140, 0, 60);
+    setAll(scene.target, 128, 70, 0, 30);
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "high fixture change";
+    setAll(scene.current, 0, 0, 255, 0);
+    memcpy(scene.target, scene.current, DOWNLINK_SLOTS);
+    setFixture(scene.target, firstHigh < n ? firstHigh : n - 1, 255, 255, 255, 255);
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "single channel";
+    setAll(scene.current, 200, 200, 200, 0);
+    memcpy(scene.target, scene.current, DOWNLINK_SLOTS);
+    scene.target[rig[n / 2].white - 1] = 90;
+    scenes.push_back(scene);
+
+    scene = Scene();
+    scene.name = "all green over pattern";
+    scene.patternActive = true;
+    setAll(scene.current, 10, 20, 30, 0);
+    setAll(scene.target, 0, 255, 0, 0);
+    scenes.push_back(scene);
+
+    return scenes;
+}
+
+int main(int argc, char** argv) {
+    const char* rateName = "DR8";
+    const char* capabilityHex = NULL;
+    long fixtures = 20;
+    bool verbose = false;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (argv[arg][0] != '-' || argv[arg][1] == '\0' || argv[arg][1] == 'h') {
+            fprintf(stderr, "usage: airtime [-d DR8-DR13] [-c capability hex] [-f fixtures] [-v]\n");
+            return argv[arg][0] == '-' && argv[arg][1] == 'h' ? 0 : 1;
+        }
+        char option = argv[arg][1];
+        if (option == 'v') {
+            verbose = true;
+            continue;
+        }
+        if (arg + 1 >= argc) {
+            fail("missing value for ", argv[arg]);
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'd': rateName = value; break;
+            case 'c': capabilityHex = value; break;
+            case 'f': fixtures = atol(value); break;
+            default: fail("unknown option ", argv[arg - 1]);
+        }
+    }
+
+    const LoraDataRate* rate = NULL;
+    for (int i = 0; i < US915_DOWNLINK_RATE_COUNT; i++) {
+        if (strcmp(US915_DOWNLINK_RATES[i].name, rateName) == 0) {
+            rate = &US915_DOWNLINK_RATES[i];
+        }
+    }
+    if (rate == NULL) {
+        fail("unknown data rate ", rateName);
+    }
+    if (fixtures < 4 || fixtures > RIG_MAX_FIXTURES) {
+        fail("fixture count must be 4-64");
+    }
+
+    // RGBW fixtures from channel 1, the last quarter from RIG_HIGH_ADDRESS
+    long high = fixtures - fixtures / 4;
+    for (long i = 0; i < fixtures; i++) {
+        uint16_t start = (uint16_t)(i < high ? 1 + i * 4 : RIG_HIGH_ADDRESS + (i - high) * 4);
+        DownlinkFixture fixture = { start, (uint16_t)(start + 1), (uint16_t)(start + 2), (uint16_t)(start + 3) };
+        rig.push_back(fixture);
+    }
+
+    DownlinkEncoder encoder(*rate);
+    if (capabilityHex != NULL) {
+        uint8_t uplink[CAPABILITY_SIZE * 2];
+        size_t length = strlen(capabilityHex) / 2;
+        NodeCapability capability;
+        bool valid = strlen(capabilityHex) % 2 == 0 && length <= sizeof(uplink);
+        for (size_t i = 0; valid && i < length; i++) {
+            unsigned byte;
+            valid = sscanf(capabilityHex + i * 2, "%2x", &byte) == 1;
+            uplink[i] = (uint8_t)byte;
+        }
+        if (!valid || !capabilityDecode(uplink, length, capability) || !encoder.applyCapability(capability)) {
+            fail("not a capability uplink: ", capabilityHex);
+        }
+        rate = &encoder.getDataRate();
+    }
+    encoder.setFixtures(&rig[0], rig.size());
+    std::vector<Scene> scenes = buildScenes();
+
+    printf("%s (SF%u, %u kHz, %u byte payloads), %ld RGBW fixtures, %ld above channel 255\n",
+           rate->name, rate->spreadingFactor, rate->bandwidthKhz, rate->maxPayload, fixtures, fixtures - high);
+    printf("%-24s %20s %20s %20s\n", "scene", "JSON per fixture", "compact per fixture", "encoder");
+    printf("%-24s %20s %20s %20s\n", "", "bytes pkts ms", "bytes pkts ms", "bytes pkts ms");
+
+    Totals totals[3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+    bool allOk = true;
+    for (size_t s = 0; s < scenes.size(); s++) {
+        Scene& scene = scenes[s];
+        DownlinkPlan plans[3] = {
+            baselineJson(encoder, scene),
+            baselineCompact(encoder, scene),
+            encoder.encodeFrame(scene.current, scene.target, scene.patternActive)
+        };
+        printf("%-24s", scene.name);
+        for (int p = 0; p < 3; p++) {
+            // The baselines stop a running pattern the same way
+            if (p < 2 && scene.patternActive) {
+                Downlink stop;
+                stop.format = "stop";
+                stop.payload.push_back(DOWNLINK_PATTERN_STOP);
+                plans[p].downlinks.insert(plans[p].downlinks.begin(), stop);
+            }
+            bool ok = finish(encoder, scene, plans[p], totals[p]);
+            allOk = allOk && (ok || p < 2);
+            printf(" %7zu %4zu %6.0f%s", plans[p].getBytes(), plans[p].downlinks.size(), plans[p].airtimeMs,
+                   ok ? " " : "!");
+        }
+        printf("\n");
+        if (verbose) {
+            printPlan(plans[2]);
+        }
+    }
+
+    DownlinkPlan pattern = encoder.encodePattern(1, 100, 0);
+    printf("%-24s %20s %20s %7zu %4zu %6.0f\n", "pattern start", "", "", pattern.getBytes(),
+           pattern.downlinks.size(), pattern.airtimeMs);
+
+    printf("%-24s", "total");
+    for (int p = 0; p < 3; p++) {
+        printf(" %7zu %4zu %6.0f ", totals[p].bytes, totals[p].packets, totals[p].airtimeMs);
+    }
+    printf("\nencoder airtime: %.0f%% of JSON, %.0f%% of compact\n",
+           100.0 * totals[2].airtimeMs / totals[0].airtimeMs, 100.0 * totals[2].airtimeMs / totals[1].airtimeMs);
+    printf("! = a packet exceeds the payload limit or the plan does not reproduce the target\n");
+    if (!allOk) {
+        fprintf(stderr, "airtime: encoder plan failed\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,415 @@
+/**
+ * artnet.cpp - Art-Net listener and loopback check for lib/ArtNetOutput
+ *
+ * Binds the Art-Net UDP port, parses ArtDmx and ArtSync and checks what
+ * arrives: packet layout, universes, sequence numbers (1-255, no gaps),
+ * ArtSync after every batch when syncs are in use, the packet rate per
+ * universe and the keepalive refresh of unchanged universes.
+ *
+ * "loopback" (the default) runs ArtNetOutput over PosixUdpArtNetTransport
+ * to 127.0.0.1 on a virtual 40 Hz clock, with stretches of animated and
+ * static frames, and also checks every universe's slot data against the
+ * frame that was emitted. "listen" checks a real sender (a node on the
+ * same network) on the wall clock until the time runs out.
+ *
+ * Usage: artnet [options] [loopback|listen]
+ *   -p PORT     UDP port (default 6454)
+ *   -u UNIVERSE First port-address expected (default 0)
+ *   -n COUNT    Universes expected (default 1, up to 4)
+ *   -t SECONDS  Run time (default 10)
+ *   -r HZ       Highest packet rate per universe (default 44)
+ *   -k MS       Keepalive interval of the sender (default 1000)
+ *   -v          Print every packet
+ *
+ * The exit status is 1 if any check failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <deque>
+#include "ArtNetOutput.h"
+
+#define CHECK_FRAME_MS 25               // Loopback update period (the firmware's 40 Hz)
+#define CHECK_GAP_SLACK_MS 250          // Lateness allowed on top of the keepalive interval
+#define CHECK_PHASE_MS 2000             // Loopback alternates animated and static stretches
+#define CHECK_MAX_DATAGRAM 1024
+
+static bool verbose = false;
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "artnet: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Monotonic milliseconds
+static uint32_t nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+// What one universe received
+struct UniverseStats {
+    uint32_t packets;
+    uint32_t sequenceErrors;     // Gap, repeat or reordering
+    uint32_t contentErrors;      // Slots differ from what was emitted (loopback)
+    uint32_t rateErrors;         // Packets over the rate limit within one second
+    uint32_t lateRefreshes;      // Gaps longer than the keepalive allows
+    uint32_t unsynced;           // Sent twice without an ArtSync in between
+    uint32_t maxGapMs;
+    uint32_t lastMs;
+    uint8_t lastSequence;
+    bool pendingSync;            // Received since the last ArtSync
+    std::deque<uint32_t> recent; // Receive times within the last second
+};
+
+// Checks a stream of Art-Net datagrams
+class ArtNetChecker {
+public:
+    ArtNetChecker(uint16_t firstUniverse, int numUniverses, uint32_t maxRate, uint32_t keepaliveMs)
+        : _firstUniverse(firstUniverse), _numUniverses(numUniverses), _maxRate(maxRate),
+          _keepaliveMs(keepaliveMs), _syncs(0), _emptySyncs(0), _malformed(0), _foreign(0), _syncSeen(false) {
+        for (int u = 0; u < ARTNET_MAX_UNIVERSES; u++) {
+            UniverseStats& stats = _universes[u];
+            stats.packets = stats.sequenceErrors = stats.contentErrors = stats.rateErrors = 0;
+            stats.lateRefreshes = stats.unsynced = stats.maxGapMs = stats.lastMs = 0;
+            stats.lastSequence = 0;
+            stats.pendingSync = false;
+        }
+    }
+
+    /**
+     * Check one datagram
+     *
+     * @param expected Slots the sender emitted, universes back to back (NULL
+     *                 if unknown)
+     */
+    void onPacket(const uint8_t* data, size_t length, uint32_t now, const uint8_t* expected, size_t expectedSlots) {
+        if (length < 12 || memcmp(data, "Art-Net", 8) != 0 || data[11] < ARTNET_PROTOCOL_VERSION) {
+            _malformed++;
+            return;
+        }
+        uint16_t opcode = (uint16_t)(data[8] | (data[9] << 8));
+        if (opcode == ARTNET_OP_SYNC) {
+            onSync(length);
+        } else if (opcode == ARTNET_OP_DMX) {
+            onDmx(data, length, now, expected, expectedSlots);
+        }
+    }
+
+    /**
+     * Check the refresh of every universe up to the end of the run
+     */
+    void finish(uint32_t now) {
+        for (int u = 0; u < _numUniverses; u++) {
+            UniverseStats& stats = _universes[u];
+            if (stats.packets > 0) {
+                noteGap(stats, now - stats.lastMs);
+            }
+        }
+    }
+
+    /**
+     * Print the summary
+     *
+     * @return True if every check passed
+     */
+    bool report(uint32_t runMs) const {
+        bool ok = _malformed == 0 && _foreign == 0 && _emptySyncs == 0;
+        printf("%-8s %8s %7s %7s %5s %6s %6s %6s %8s\n", "universe", "packets", "rate", "max gap", "seq",
+               "slots", "rate!", "late", "unsynced");
+        for (int u = 0; u < _numUniverses; u++) {
+            const UniverseStats& stats = _universes[u];
+            printf("%-8u %8lu %5.1fHz %5lums %5lu %6lu %6lu %6lu %8lu\n", _firstUniverse + u,
+                   (unsigned long)stats.packets, runMs > 0 ? stats.packets * 1000.0 / runMs : 0.0,
+                   (unsigned long)stats.maxGapMs, (unsigned long)stats.sequenceErrors,
+                   (unsigned long)stats.contentErrors, (unsigned long)stats.rateErrors,
+                   (unsigned long)stats.lateRefreshes, (unsigned long)stats.unsynced);
+            ok = ok && stats.packets > 0 && stats.sequenceErrors == 0 && stats.contentErrors == 0 &&
+                 stats.rateErrors == 0 && stats.lateRefreshes == 0 && stats.unsynced == 0;
+        }
+        printf("ArtSync: %lu (%lu empty); malformed: %lu; other universes: %lu\n", (unsigned long)_syncs,
+               (unsigned long)_emptySyncs, (unsigned long)_malformed, (unsigned long)_foreign);
+        return ok;
+    }
+
+    uint32_t getDmxPackets() const {
+        uint32_t total = 0;
+        for (int u = 0; u < _numUniverses; u++) {
+            total += _universes[u].packets;
+        }
+        return total;
+    }
+    uint32_t getSyncs() const { return _syncs; }
+
+private:
+    uint16_t _firstUniverse;
+    int _numUniverses;
+    uint32_t _maxRate;
+    uint32_t _keepaliveMs;
+    uint32_t _syncs;
+    uint32_t _emptySyncs;        // ArtSync with nothing received since the last one
+    uint32_t _malformed;
+    uint32_t _foreign;           // ArtDmx for a universe outside the expected range
+    bool _syncSeen;
+    UniverseStats _universes[ARTNET_MAX_UNIVERSES];
+
+    // ArtSync: latches every universe received since the previous one
+    void onSync(size_t length) {
+        if (length != ARTNET_SYNC_SIZE) {
+            _malformed++;
+            return;
+        }
+        _syncs++;
+        _syncSeen = true;
+        bool any = false;
+        for (int u = 0; u < _numUniverses; u++) {
+            any = any || _universes[u].pendingSync;
+            _universes[u].pendingSync = false;
+        }
+        if (!any) {
+            _emptySyncs++;
+        }
+        if (verbose) {
+            printf("sync\n");
+        }
+    }
+
+    // ArtDmx: layout, universe, sequence, rate and content
+    void onDmx(const uint8_t* data, size_t length, uint32_t now, const uint8_t* expected, size_t expectedSlots) {
+        if (length < ARTNET_DMX_HEADER_SIZE) {
+            _malformed++;
+            return;
+        }
+        uint8_t sequence = data[12];
+        uint16_t universe = (uint16_t)(data[14] | ((data[15] & 0x7F) << 8));
+        size_t slots = (size_t)((data[16] << 8) | data[17]);
+        if (slots < 2 || slots > ARTNET_UNIVERSE_SIZE || slots % 2 != 0 || length != ARTNET_DMX_HEADER_SIZE + slots) {
+            _malformed++;
+            return;
+        }
+        int index = universe - _firstUniverse;
+        if (index < 0 || index >= _numUniverses) {
+            _foreign++;
+            return;
+        }
+        const uint8_t* payload = data + ARTNET_DMX_HEADER_SIZE;
+        if (verbose) {
+            printf("%6lu ms  universe %u  seq %3u  %3zu slots  %3u %3u %3u %3u ...\n", (unsigned long)now, universe,
+                   sequence, slots, payload[0], payload[1], slots > 2 ? payload[2] : 0, slots > 3 ? payload[3] : 0);
+        }
+
+        UniverseStats& stats = _universes[index];
+        if (stats.packets > 0) {
+            noteGap(stats, now - stats.lastMs);
+            uint8_t next = stats.lastSequence == 255 ? 1 : (uint8_t)(stats.lastSequence + 1);
+            if (sequence != 0 && stats.lastSequence != 0 && sequence != next) {
+                stats.sequenceErrors++;
+            }
+        }
+        if (_syncSeen && stats.pendingSync) {
+            stats.unsynced++;
+        }
+        stats.pendingSync = true;
+        stats.packets++;
+        stats.lastMs = now;
+        stats.lastSequence = sequence;
+
+        // Packets within the last second
+        stats.recent.push_back(now);
+        while (now - stats.recent.front() >= 1000) {
+            stats.recent.pop_front();
+        }
+        if (stats.recent.size() > _maxRate) {
+            stats.rateErrors++;
+        }
+
+        if (expected != NULL) {
+            size_t offset = (size_t)index * ARTNET_UNIVERSE_SIZE;
+            size_t want = offset < expectedSlots ? (expectedSlots - offset) : 0;
+            want = want > ARTNET_UNIVERSE_SIZE ? ARTNET_UNIVERSE_SIZE : want;
+            // An odd-length universe arrives with one zero pad slot
+            size_t padded = want < 2 ? 2 : (want + 1) & ~(size_t)1;
+            if (slots != padded || memcmp(payload, expected + offset, want) != 0 ||
+                (padded > want && payload[padded - 1] != 0)) {
+                stats.contentErrors++;
+            }
+        }
+    }
+
+    // Longest silence of a universe against the keepalive
+    void noteGap(UniverseStats& stats, uint32_t gapMs) {
+        if (gapMs > stats.maxGapMs) {
+            stats.maxGapMs = gapMs;
+        }
+        if (gapMs > _keepaliveMs + CHECK_GAP_SLACK_MS) {
+            stats.lateRefreshes++;
+        }
+    }
+};
+
+// Bind the Art-Net port
+static int openListener(uint16_t port, bool loopbackOnly) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        fail("cannot open a UDP socket: ", strerror(errno));
+    }
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fail("cannot bind the Art-Net port: ", strerror(errno));
+    }
+    return sock;
+}
+
+// Hand every queued datagram to the checker
+static void drain(int sock, ArtNetChecker& checker, uint32_t now, const uint8_t* expected, size_t expectedSlots) {
+    uint8_t datagram[CHECK_MAX_DATAGRAM];
+    for (;;) {
+        ssize_t length = recv(sock, datagram, sizeof(datagram), MSG_DONTWAIT);
+        if (length < 0) {
+            break;
+        }
+        checker.onPacket(datagram, (size_t)length, now, expected, expectedSlots);
+    }
+}
+
+// Loopback frame: a moving ramp per universe; in every other stretch only
+// the first universe moves, and in the rest nothing does
+static void fillFrame(uint8_t* frame, int numUniverses, uint32_t timeMs) {
+    uint32_t phase = timeMs / CHECK_PHASE_MS;
+    if (phase % 2 == 1) {
+        return;
+    }
+    int moving = phase % 4 == 2 ? 1 : numUniverses;
+    uint32_t step = timeMs / CHECK_FRAME_MS;
+    for (int u = 0; u < moving; u++) {
+        for (int i = 0; i < ARTNET_UNIVERSE_SIZE; i++) {
+            frame[u * ARTNET_UNIVERSE_SIZE + i] = (uint8_t)(i + step * (u + 1));
+        }
+    }
+}
+
+// Emit a scripted run through ArtNetOutput and check it on the other end
+static bool runLoopback(uint16_t port, uint16_t firstUniverse, int numUniverses, uint32_t runMs, ArtNetChecker& checker) {
+    int sock = openListener(port, true);
+    PosixUdpArtNetTransport transport("127.0.0.1", port);
+    if (!transport.isOpen()) {
+        fail("cannot open the sending socket");
+    }
+    ArtNetOutput output;
+    output.begin(&transport, firstUniverse, (uint8_t)numUniverses);
+
+    // The last universe is cut short to check odd-length frames
+    size_t numSlots = (size_t)numUniverses * ARTNET_UNIVERSE_SIZE - 37;
+    uint8_t frame[ARTNET_MAX_UNIVERSES * ARTNET_UNIVERSE_SIZE];
+    memset(frame, 0, sizeof(frame));
+    uint32_t time = 0;
+    for (; time < runMs; time += CHECK_FRAME_MS) {
+        fillFrame(frame, numUniverses, time);
+        output.update(frame, numSlots, time);
+        drain(sock, checker, time, frame, numSlots);
+    }
+    checker.finish(time);
+    close(sock);
+
+    bool ok = checker.getDmxPackets() == output.getDmxPacketsSent() &&
+              checker.getSyncs() == output.getSyncPacketsSent() && output.getSendFailures() == 0;
+    printf("Sent %lu ArtDmx and %lu ArtSync, %lu send failures\n", (unsigned long)output.getDmxPacketsSent(),
+           (unsigned long)output.getSyncPacketsSent(), (unsigned long)output.getSendFailures());
+    return ok;
+}
+
+// Check a real sender until the time runs out
+static void runListen(uint16_t port, uint32_t runMs, ArtNetChecker& checker) {
+    int sock = openListener(port, false);
+    uint32_t start = nowMs();
+    printf("Listening on UDP %u for %lu s\n", port, (unsigned long)(runMs / 1000));
+    for (;;) {
+        uint32_t elapsed = nowMs() - start;
+        if (elapsed >= runMs) {
+            break;
+        }
+        struct pollfd waiter = { sock, POLLIN, 0 };
+        if (poll(&waiter, 1, (int)(runMs - elapsed)) > 0) {
+            drain(sock, checker, nowMs() - start, NULL, 0);
+        }
+    }
+    checker.finish(runMs);
+    close(sock);
+}
+
+int main(int argc, char** argv) {
+    long port = ARTNET_PORT;
+    long firstUniverse = 0;
+    long numUniverses = 1;
+    long seconds = 10;
+    long maxRate = 44;
+    long keepaliveMs = ARTNET_DEFAULT_KEEPALIVE_MS;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'v') {
+            verbose = true;
+            continue;
+        }
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: artnet [-p port] [-u universe] [-n count] [-t seconds] [-r hz] [-k keepalive_ms] "
+                            "[-v] [loopback|listen]\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'p': port = atol(value); break;
+            case 'u': firstUniverse = atol(value); break;
+            case 'n': numUniverses = atol(value); break;
+            case 't': seconds = atol(value); break;
+            case 'r': maxRate = atol(value); break;
+            case 'k': keepaliveMs = atol(value); break;
+            default: fail("unknown option ", argv[arg - 1]);
+        }
+    }
+    const char* mode = arg < argc ? argv[arg] : "loopback";
+    if (port < 1 || port > 65535 || firstUniverse < 0 || firstUniverse > 0x7FFF || seconds < 1 || maxRate < 1 ||
+        keepaliveMs < 1) {
+        fail("option out of range");
+    }
+    if (numUniverses < 1 || numUniverses > ARTNET_MAX_UNIVERSES) {
+        fail("universe count must be 1-4");
+    }
+
+    ArtNetChecker checker((uint16_t)firstUniverse, (int)numUniverses, (uint32_t)maxRate, (uint32_t)keepaliveMs);
+    uint32_t runMs = (uint32_t)seconds * 1000;
+    bool ok = true;
+    if (strcmp(mode, "loopback") == 0) {
+        if (keepaliveMs != ARTNET_DEFAULT_KEEPALIVE_MS) {
+            fail("loopback runs ArtNetOutput with its default keepalive; -k is for listen");
+        }
+        ok = runLoopback((uint16_t)port, (uint16_t)firstUniverse, (int)numUniverses, runMs, checker);
+        if (!ok) {
+            printf("Received packet counts differ from what was sent\n");
+        }
+    } else if (strcmp(mode, "listen") == 0) {
+        runListen((uint16_t)port, runMs, checker);
+    } else {
+        fail("unknown mode ", mode);
+    }
+    ok = checker.report(runMs) && ok;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,372 @@
+/**
+ * blackbox.cpp - Host decoder for black-box recorder dumps
+ *
+ * Reads a dump in any of the forms the device produces and prints the
+ * event timeline; the recorded frames can be written as CSV:
+ *   - a serial log containing "BBX <hex>" lines ({"blackbox": "dump"})
+ *   - uplink fragments ({"blackbox": "uplink"}), one hex payload per line
+ *     or the decoded uplinks with their "fragment" field
+ *   - a raw image of the flash partition, e.g. from
+ *     esptool.py read_flash <offset> <size> blackbox.bin
+ *
+ * Usage: blackbox [options] [dump|-]
+ *   -o FILE    Write every recorded frame as CSV (boot, time, channels)
+ *   -a EPOCH   Unix time at which the dump was requested, to print wall
+ *              clock times for the boot that was running then
+ *   -b BOOT    Only show this boot
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "BlackBoxFormat.h"
+
+// Printable names of esp_reset_reason_t
+static const char* RESET_REASONS[] = {
+    "unknown", "power-on", "external pin", "software", "panic", "interrupt watchdog",
+    "task watchdog", "other watchdog", "deep sleep", "brownout", "SDIO"
+};
+
+// Decoded records, printed as a timeline and written as CSV
+class TimelineSink : public BlackBoxSink {
+public:
+    TimelineSink(FILE* csv, long boot, uint32_t anchorBoot, uint32_t anchorUptime, time_t anchorEpoch)
+        : _csv(csv), _boot(boot), _anchorBoot(anchorBoot), _anchorUptime(anchorUptime), _anchorEpoch(anchorEpoch),
+          _frames(0), _events(0), _lastBoot(0xFFFFFFFFUL) {}
+
+    void onFrame(uint32_t boot, uint32_t timeMs, const uint8_t* frame, uint16_t slots) override {
+        if (_boot >= 0 && boot != (uint32_t)_boot) {
+            return;
+        }
+        noteBoot(boot);
+        _frames++;
+        if (_csv == NULL) {
+            return;
+        }
+        fprintf(_csv, "%lu,%lu,%u", (unsigned long)boot, (unsigned long)timeMs, slots);
+        for (uint16_t i = 0; i < slots; i++) {
+            fprintf(_csv, ",%u", frame[i]);
+        }
+        fprintf(_csv, "\n");
+    }
+
+    void onEvent(uint32_t boot, uint32_t timeMs, uint8_t kind, const uint8_t* data, uint8_t length) override {
+        if (_boot >= 0 && boot != (uint32_t)_boot) {
+            return;
+        }
+        noteBoot(boot);
+        _events++;
+        printf("  %s  ", formatTime(boot, timeMs).c_str());
+
+        if (kind == BLACKBOX_EVENT_BOOT && length >= 1) {
+            printf("boot      reset: %s\n", data[0] < sizeof(RESET_REASONS) / sizeof(RESET_REASONS[0]) ?
+                   RESET_REASONS[data[0]] : "?");
+        } else if (kind == BLACKBOX_EVENT_SELFTEST && length >= 2) {
+            printf("selftest  %s  %s\n", (data[1] & 0x01) ? "PASS" : "FAIL", toHex(data, length).c_str());
+        } else if (kind == BLACKBOX_EVENT_DOWNLINK) {
+            bool printable = length > 0;
+            for (uint8_t i = 0; i < length; i++) {
+                printable = printable && data[i] >= 0x20 && data[i] < 0x7F;
+            }
+            printf("downlink  %s%s\n", printable ? std::string((const char*)data, length).c_str() : toHex(data, length).c_str(),
+                   length == BLACKBOX_MAX_EVENT ? " ..." : "");
+        } else {
+            printf("event %u   %s\n", kind, toHex(data, length).c_str());
+        }
+    }
+
+    uint32_t getFrames() const { return _frames; }
+    uint32_t getEvents() const { return _events; }
+
+private:
+    FILE* _csv;
+    long _boot;
+    uint32_t _anchorBoot;
+    uint32_t _anchorUptime;
+    time_t _anchorEpoch;
+    uint32_t _frames;
+    uint32_t _events;
+    uint32_t _lastBoot;
+
+    // Print a heading when the records move to another boot
+    void noteBoot(uint32_t boot) {
+        if (boot != _lastBoot) {
+            printf("boot %lu%s\n", (unsigned long)boot, boot == _anchorBoot && _anchorEpoch != 0 ? " (running at dump time)" : "");
+            _lastBoot = boot;
+        }
+    }
+
+    // Uptime, or wall clock time when the boot is anchored to the dump
+    std::string formatTime(uint32_t boot, uint32_t timeMs) const {
+        char text[48];
+        if (_anchorEpoch != 0 && boot == _anchorBoot) {
+            time_t at = _anchorEpoch - (time_t)((_anchorUptime - timeMs) / 1000);
+            strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", localtime(&at));
+        } else {
+            snprintf(text, sizeof(text), "%3lu:%02lu:%02lu.%03lu", (unsigned long)(timeMs / 3600000),
+                     (unsigned long)(timeMs / 60000 % 60), (unsigned long)(timeMs / 1000 % 60),
+                     (unsigned long)(timeMs % 1000));
+        }
+        return text;
+    }
+
+    static std::string toHex(const uint8_t* data, size_t length) {
+        std::string hex;
+        char byte[3];
+        for (size_t i = 0; i < length; i++) {
+            snprintf(byte, sizeof(byte), "%02X", data[i]);
+            hex += byte;
+        }
+        return hex;
+    }
+};
+
+// Widest frame in the dump, for the CSV header
+class SlotsSink : public BlackBoxSink {
+public:
+    SlotsSink() : slots(0) {}
+    void onFrame(uint32_t boot, uint32_t timeMs, const uint8_t* frame, uint16_t count) override {
+        slots = std::max(slots, count);
+    }
+    void onEvent(uint32_t boot, uint32_t timeMs, uint8_t kind, const uint8_t* data, uint8_t length) override {}
+    uint16_t slots;
+};
+
+// A sector taken from a dump or an image
+struct Sector {
+    uint32_t sequence;
+    std::vector<uint8_t> bytes;
+};
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "blackbox: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Read a whole file ("-" = stdin)
+static std::vector<uint8_t> readFile(const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == NULL) {
+        fail("cannot open ", path);
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    return data;
+}
+
+// Parse a hex string; false if it is not one
+static bool parseHex(const std::string& text, std::vector<uint8_t>& out) {
+    if (text.empty() || text.size() % 2 != 0) {
+        return false;
+    }
+    out.clear();
+    for (size_t i = 0; i < text.size(); i += 2) {
+        char pair[3] = { text[i], text[i + 1], 0 };
+        char* end;
+        long value = strtol(pair, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+        out.push_back((uint8_t)value);
+    }
+    return true;
+}
+
+// Collect fragments from the lines of a log or export; returns the
+// reassembled stream, with missing fragments filled with erased bytes
+static std::vector<uint8_t> reassemble(const std::vector<uint8_t>& text) {
+    std::map<uint16_t, std::vector<uint8_t> > fragments;
+    uint16_t total = 0;
+    size_t fragmentSize = 0;
+
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = start;
+        while (end < text.size() && text[end] != '\n') {
+            end++;
+        }
+        std::string line((const char*)&text[start], end - start);
+        start = end + 1;
+
+        // "BBX <hex>" console lines, decoded uplinks ("fragment": "<hex>") or bare hex
+        std::string hex = line;
+        size_t tag = line.find("BBX ");
+        size_t field = line.find("\"fragment\"");
+        if (tag != std::string::npos) {
+            hex = line.substr(tag + 4);
+        } else if (field != std::string::npos) {
+            size_t open = line.find('"', line.find(':', field));
+            size_t close = open != std::string::npos ? line.find('"', open + 1) : std::string::npos;
+            hex = close != std::string::npos ? line.substr(open + 1, close - open - 1) : "";
+        }
+        while (!hex.empty() && (hex.back() == '\r' || hex.back() == ' ')) {
+            hex.erase(hex.size() - 1);
+        }
+        while (!hex.empty() && hex[0] == ' ') {
+            hex.erase(0, 1);
+        }
+
+        std::vector<uint8_t> fragment;
+        if (!parseHex(hex, fragment) || fragment.size() <= BLACKBOX_FRAGMENT_HEADER ||
+            fragment[0] != BLACKBOX_FRAGMENT_TYPE) {
+            continue;
+        }
+        uint16_t index = (fragment[1] << 8) | fragment[2];
+        uint16_t count = (fragment[3] << 8) | fragment[4];
+        if (count != total || (index == 0 && !fragments.empty() && fragments.count(0))) {
+            fragments.clear();  // A new dump: keep only the latest one
+            total = count;
+            fragmentSize = 0;
+        }
+        if (index >= total) {
+            continue;
+        }
+        fragments[index].assign(fragment.begin() + BLACKBOX_FRAGMENT_HEADER, fragment.end());
+        if (index + 1 < total) {
+            fragmentSize = fragment.size() - BLACKBOX_FRAGMENT_HEADER;
+        }
+    }
+
+    if (total == 0) {
+        return std::vector<uint8_t>();
+    }
+    if (fragmentSize == 0) {
+        fragmentSize = fragments.begin()->second.size();
+    }
+    std::vector<uint8_t> stream;
+    uint16_t missing = 0;
+    for (uint16_t i = 0; i < total; i++) {
+        std::map<uint16_t, std::vector<uint8_t> >::iterator it = fragments.find(i);
+        if (it != fragments.end()) {
+            stream.insert(stream.end(), it->second.begin(), it->second.end());
+        } else {
+            stream.insert(stream.end(), fragmentSize, 0xFF);
+            missing++;
+        }
+    }
+    fprintf(stderr, "blackbox: %u/%u fragments", total - missing, total);
+    if (missing > 0) {
+        fprintf(stderr, ", %u missing (sectors after a gap may be lost; request the dump again)", missing);
+    }
+    fprintf(stderr, "\n");
+    return stream;
+}
+
+int main(int argc, char** argv) {
+    const char* csvPath = NULL;
+    time_t anchorEpoch = 0;
+    long boot = -1;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: blackbox [-o frames.csv] [-a dump_epoch] [-b boot] [dump|-]\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'o': csvPath = value; break;
+            case 'a': anchorEpoch = (time_t)atoll(value); break;
+            case 'b': boot = atol(value); break;
+            default: fail("unknown option ", argv[arg - 1]);
+        }
+    }
+    std::vector<uint8_t> input = readFile(arg < argc ? argv[arg] : "-");
+
+    // Raw partition image, or a stream reassembled from fragments
+    std::vector<Sector> sectors;
+    uint32_t dumpUptime = 0;
+    uint32_t dumpBoot = 0xFFFFFFFFUL;
+    uint32_t sequence;
+    bool image = false;
+    for (size_t offset = 0; offset + BLACKBOX_HEADER_SIZE <= input.size() && !image; offset += BLACKBOX_SECTOR_SIZE) {
+        image = BlackBoxDecoder::readHeader(&input[offset], BLACKBOX_HEADER_SIZE, sequence);
+    }
+    if (image) {
+        for (size_t offset = 0; offset + BLACKBOX_HEADER_SIZE <= input.size(); offset += BLACKBOX_SECTOR_SIZE) {
+            size_t length = std::min((size_t)BLACKBOX_SECTOR_SIZE, input.size() - offset);
+            if (BlackBoxDecoder::readHeader(&input[offset], length, sequence)) {
+                Sector sector = { sequence, std::vector<uint8_t>(&input[offset], &input[offset] + length) };
+                sectors.push_back(sector);
+            }
+        }
+    } else {
+        std::vector<uint8_t> stream = reassemble(input);
+        if (stream.size() < BLACKBOX_DUMP_HEADER) {
+            fail("no black-box data found (expected BBX lines, hex fragments or a partition image)");
+        }
+        dumpUptime = stream[0] | (stream[1] << 8) | (stream[2] << 16) | ((uint32_t)stream[3] << 24);
+        dumpBoot = stream[4] | (stream[5] << 8) | (stream[6] << 16) | ((uint32_t)stream[7] << 24);
+        size_t offset = BLACKBOX_DUMP_HEADER;
+        while (offset + 2 <= stream.size()) {
+            size_t length = stream[offset] | (stream[offset + 1] << 8);
+            offset += 2;
+            if (length > BLACKBOX_SECTOR_SIZE) {
+                fprintf(stderr, "blackbox: stream damaged at byte %zu, later sectors skipped\n", offset);
+                break;
+            }
+            length = std::min(length, stream.size() - offset);
+            if (BlackBoxDecoder::readHeader(&stream[offset], length, sequence)) {
+                Sector sector = { sequence, std::vector<uint8_t>(&stream[offset], &stream[offset] + length) };
+                sectors.push_back(sector);
+            }
+            offset += length;
+        }
+        printf("Dump taken %lu.%03lu s into boot %lu\n", (unsigned long)(dumpUptime / 1000),
+               (unsigned long)(dumpUptime % 1000), (unsigned long)dumpBoot);
+    }
+    if (sectors.empty()) {
+        fail("no valid sectors in the dump");
+    }
+    std::sort(sectors.begin(), sectors.end(),
+              [](const Sector& a, const Sector& b) { return a.sequence < b.sequence; });
+
+    FILE* csv = NULL;
+    if (csvPath != NULL) {
+        csv = strcmp(csvPath, "-") == 0 ? stdout : fopen(csvPath, "w");
+        if (csv == NULL) {
+            fail("cannot write ", csvPath);
+        }
+        SlotsSink widest;
+        BlackBoxDecoder scan;
+        for (size_t i = 0; i < sectors.size(); i++) {
+            scan.decodeSector(sectors[i].bytes.data(), sectors[i].bytes.size(), &widest);
+        }
+        fprintf(csv, "boot,time_ms,slots");
+        for (uint16_t ch = 1; ch <= widest.slots; ch++) {
+            fprintf(csv, ",ch%u", ch);
+        }
+        fprintf(csv, "\n");
+    }
+
+    TimelineSink sink(csv, boot, dumpBoot, dumpUptime, anchorEpoch);
+    BlackBoxDecoder decoder;
+    for (size_t i = 0; i < sectors.size(); i++) {
+        decoder.decodeSector(sectors[i].bytes.data(), sectors[i].bytes.size(), &sink);
+    }
+    if (csv != NULL && csv != stdout) {
+        fclose(csv);
+    }
+
+    printf("%zu sectors (%lu-%lu), %lu frames, %lu events", sectors.size(), (unsigned long)sectors.front().sequence,
+           (unsigned long)sectors.back().sequence, (unsigned long)sink.getFrames(), (unsigned long)sink.getEvents());
+    if (decoder.getErrors() > 0) {
+        printf(", %lu sectors cut short by damaged or partly written records", (unsigned long)decoder.getErrors());
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,825 @@
+/**
+ * fleet.cpp - Many firmware instances behind one simulated gateway
+ *
+ * Runs a fleet of nodes in one process, each built from the firmware
+ * libraries (DmxController, DmxPattern, KeyframeAnimator, PatchEditor)
+ * against the host stand-ins in tools/render/shim. Every node has its own
+ * shim context, so it keeps its own virtual clock, running fast or slow by
+ * its crystal drift, and its own Preferences flash. Its loop() and output
+ * frames tick on that clock from a random boot phase.
+ *
+ * A timed script sends downlinks through a gateway with one radio. Each
+ * transmission waits for the radio and for the duty-cycle budget of every
+ * node it addresses. Its airtime follows the LoRa formula at the chosen
+ * data rate (DownlinkEncoder). Each node then receives it after its own
+ * delay plus jitter, unless it is lost. A multicast is one transmission
+ * to all nodes; "each" sends the same payload unicast to every node.
+ *
+ * The report gives, per command and for the whole run: airtime of the
+ * transmissions that started within the run (later ones count as
+ * queued), delivery latency (from the script time to reception), and
+ * onset skew (spread between the nodes' first output frames that changed
+ * after reception).
+ * It also gives how often the nodes' on-air frames matched, sampled on a
+ * common clock. Runs are repeatable for a given seed.
+ *
+ * Usage: fleet [options] [script|-]
+ *   -n COUNT     Nodes (default 4)
+ *   -x COUNT     RGBW fixtures per node at channels 1, 5, 9, ... (default 8)
+ *   -t SECONDS   Simulated time (default 30)
+ *   -r DR        US915 downlink data rate, 8-13 (default 8)
+ *   -d PPM       Clock drift: each node gets a value in [-PPM, PPM] (default 20)
+ *   -D MS        Delivery delay after the transmission ends (default 50)
+ *   -j MS        Extra random delay in [0, MS] per delivery (default 100)
+ *   -L PERCENT   Loss per delivery (default 0)
+ *   -c PERCENT   Duty-cycle limit per node, 0 = none (default 0)
+ *   -s SEED      Random seed (default 1)
+ *   -f MS        Output frame period (default 25)
+ *   -l MS        Render loop period (default 100)
+ *   -v           Echo the firmware's Serial output to stderr
+ *
+ * Script lines are "<ms> <target> <command> [args]"; # starts a comment.
+ * The target is a node number (from 0), "all" (multicast) or "each".
+ * Downlinks:
+ *   send <hex bytes>                       preset <0-4>
+ *   pattern <name> [speed_ms] [cycles]     stop
+ *   light <address> <v1> <v2> <v3> <v4>    patch <count>
+ *   keyframe [new] [spline] <stream_ms> <channel> <values...>
+ *   lookahead <ms>
+ * Local to the nodes (no airtime):
+ *   set <delay|jitter|loss|duty|drift> <value>
+ *   reboot
+ *
+ * JSON downlinks are not simulated.
+ */
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <vector>
+#include "DmxController.h"
+#include "DmxPattern.h"
+#include "StrobeGenerator.h"
+#include "KeyframeAnimator.h"
+#include "PatchEditor.h"
+#include "DownlinkEncoder.h"
+
+#define FLEET_DEFAULT_NODES 4
+#define FLEET_DEFAULT_FIXTURES 8
+#define FLEET_DEFAULT_SECONDS 30
+#define FLEET_DEFAULT_DR 8
+#define FLEET_DEFAULT_DRIFT_PPM 20
+#define FLEET_DEFAULT_DELAY_MS 50
+#define FLEET_DEFAULT_JITTER_MS 100
+#define FLEET_DEFAULT_FRAME_MS 25
+#define FLEET_DEFAULT_LOOP_MS 100
+#define FLEET_MAX_UPTIME_US 10000000ULL  // Nodes have been up for 0-10 s at the start
+#define FLEET_PATCH_JOURNAL_KEY "patch_journal"
+
+#define TARGET_ALL -1       // One multicast transmission
+#define TARGET_EACH -2      // One unicast transmission per node
+
+// One script command
+struct Command {
+    uint64_t atUs;
+    int target;
+    std::vector<std::string> args;
+    std::vector<uint8_t> payload;   // Empty for local commands
+};
+
+// What happened to one command across the fleet
+struct CommandStats {
+    int transmissions;             // Started within the run
+    int queued;                    // Still waiting for the radio or duty cycle at the end
+    uint64_t airtimeUs;
+    int targets;
+    int lost;
+    std::vector<uint64_t> latenciesUs;
+    std::vector<uint64_t> onsetsUs;   // Global time of each node's first changed frame
+
+    CommandStats() : transmissions(0), queued(0), airtimeUs(0), targets(0), lost(0) {}
+};
+
+// A downlink in flight to one node
+struct Delivery {
+    uint64_t atUs;
+    int node;
+    size_t command;
+};
+
+// One firmware instance and its link
+struct Node {
+    ShimContext* context;
+    DmxController* dmx;
+    DmxPattern patterns;
+    StrobeGenerator strobe;        // Never started: edges come from a hardware timer
+    KeyframeAnimator keyframes;
+    PatchEditor patch;
+    SemaphoreHandle_t dmxMutex;
+
+    // Local clock: local = anchorLocalUs + (global - anchorGlobalUs) * rate
+    double driftPpm;
+    uint64_t anchorGlobalUs;
+    uint64_t anchorLocalUs;
+    uint64_t nextLoopUs;           // Local times
+    uint64_t nextFrameUs;
+
+    // Link
+    int delayMs;
+    int jitterMs;
+    double lossPercent;
+    double dutyPercent;
+    uint64_t dutyFreeUs;           // Global time its duty-cycle budget allows the next downlink
+
+    // Output
+    std::vector<uint8_t> onAir;    // Last transmitted frame
+    long pendingOnset;             // Command whose onset is still to be seen, or -1
+
+    // Counters
+    int received;
+    int lost;
+    int ignored;
+    uint64_t dutyWaitUs;
+};
+
+static std::vector<Node*> nodes;
+static std::vector<Command> commands;
+static std::vector<CommandStats> stats;
+static int numFixtures = FLEET_DEFAULT_FIXTURES;
+static int frameMs = FLEET_DEFAULT_FRAME_MS;
+static int loopMs = FLEET_DEFAULT_LOOP_MS;
+static uint64_t rngState = 1;
+
+// Print an error and exit
+static void fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "fleet: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+// Uniform random value in [0, 1) (xorshift64*, the same on every host)
+static double random01() {
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (double)((rngState * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+// Split a line on whitespace
+static std::vector<std::string> splitWords(const char* line) {
+    std::vector<std::string> words;
+    std::string word;
+    for (const char* p = line; ; p++) {
+        if (*p == '\0' || *p == '#' || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+            if (*p == '\0' || *p == '#') {
+                break;
+            }
+        } else {
+            word += *p;
+        }
+    }
+    return words;
+}
+
+// Integer argument or a default
+static int argInt(const Command& command, size_t index, int defaultValue) {
+    return index < command.args.size() ? atoi(command.args[index].c_str()) : defaultValue;
+}
+
+// Append a little-endian 16-bit value
+static void putU16(std::vector<uint8_t>& out, int value) {
+    out.push_back((uint8_t)value);
+    out.push_back((uint8_t)(value >> 8));
+}
+
+// Build the downlink for a script command; local commands leave it empty
+static void buildPayload(Command& command, const char* where) {
+    const std::string& name = command.args[0];
+    std::vector<uint8_t>& out = command.payload;
+
+    if (name == "set" || name == "reboot") {
+        if (name == "set" && command.args.size() < 3) {
+            fail("%s: set needs <delay|jitter|loss|duty|drift> <value>", where);
+        }
+        return;
+    }
+    if (name == "send") {
+        for (size_t i = 1; i < command.args.size(); i++) {
+            const std::string& hex = command.args[i];
+            if (hex.size() % 2 != 0) {
+                fail("%s: odd number of hex digits in %s", where, hex.c_str());
+            }
+            for (size_t j = 0; j < hex.size(); j += 2) {
+                char* end;
+                std::string pair = hex.substr(j, 2);
+                long value = strtol(pair.c_str(), &end, 16);
+                if (*end != '\0') {
+                    fail("%s: bad hex byte %s", where, pair.c_str());
+                }
+                out.push_back((uint8_t)value);
+            }
+        }
+    } else if (name == "preset") {
+        out.push_back((uint8_t)min(4, max(0, argInt(command, 1, 0))));
+    } else if (name == "pattern") {
+        if (command.args.size() < 2) {
+            fail("%s: pattern needs a name", where);
+        }
+        const EffectInfo* effect = DmxPattern::findEffect(command.args[1].c_str());
+        if (effect == NULL) {
+            fail("%s: unknown pattern %s", where, command.args[1].c_str());
+        }
+        out.push_back(DOWNLINK_PATTERN_START);
+        out.push_back(effect->binaryId);
+        putU16(out, argInt(command, 2, effect->defaultSpeed));
+        putU16(out, argInt(command, 3, effect->defaultCycles));
+    } else if (name == "stop") {
+        out.push_back(DOWNLINK_PATTERN_STOP);
+    } else if (name == "light") {
+        if (command.args.size() < 6) {
+            fail("%s: light needs <address> <v1> <v2> <v3> <v4>", where);
+        }
+        out.push_back(1);
+        for (size_t i = 1; i < 6; i++) {
+            out.push_back((uint8_t)argInt(command, i, 0));
+        }
+    } else if (name == "patch") {
+        out.push_back(PATCH_OPCODE_COUNT);
+        out.push_back((uint8_t)argInt(command, 1, FLEET_DEFAULT_FIXTURES));
+    } else if (name == "lookahead") {
+        out.push_back(KF_OPCODE_LOOKAHEAD);
+        putU16(out, argInt(command, 1, KF_DEFAULT_LOOKAHEAD_MS));
+    } else if (name == "keyframe") {
+        uint8_t flags = 0;
+        size_t i = 1;
+        for (; i < command.args.size(); i++) {
+            if (command.args[i] == "new") {
+                flags |= KF_FLAG_NEW_STREAM;
+            } else if (command.args[i] == "spline") {
+                flags |= KF_FLAG_SPLINE;
+            } else {
+                break;
+            }
+        }
+        if (command.args.size() < i + 3) {
+            fail("%s: keyframe needs <stream_ms> <channel> <values...>", where);
+        }
+        out.push_back(KF_OPCODE_KEYFRAME);
+        out.push_back(flags);
+        putU16(out, argInt(command, i, 0) / KF_TIME_UNIT_MS);
+        putU16(out, argInt(command, i + 1, 1));
+        out.push_back((uint8_t)(command.args.size() - i - 2));
+        for (size_t v = i + 2; v < command.args.size(); v++) {
+            out.push_back((uint8_t)argInt(command, v, 0));
+        }
+    } else {
+        fail("%s: unknown command %s", where, name.c_str());
+    }
+    if (out.empty()) {
+        fail("%s: empty downlink", where);
+    }
+}
+
+// Read a scenario script ("-" = stdin)
+static void readScript(const char* path, int numNodes) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        fail("cannot open %s", path);
+    }
+
+    char line[512];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        std::vector<std::string> words = splitWords(line);
+        if (words.empty()) {
+            continue;
+        }
+        char where[300];
+        snprintf(where, sizeof(where), "%s:%d", path, lineNumber);
+        if (words.size() < 3) {
+            fail("%s: expected \"<ms> <target> <command> [args]\"", where);
+        }
+        Command command;
+        command.atUs = (uint64_t)strtoull(words[0].c_str(), NULL, 10) * 1000;
+        if (words[1] == "all") {
+            command.target = TARGET_ALL;
+        } else if (words[1] == "each") {
+            command.target = TARGET_EACH;
+        } else {
+            command.target = atoi(words[1].c_str());
+            if (command.target < 0 || command.target >= numNodes) {
+                fail("%s: no node %s (0-%d)", where, words[1].c_str(), numNodes - 1);
+            }
+        }
+        command.args.assign(words.begin() + 2, words.end());
+        buildPayload(command, where);
+        commands.push_back(command);
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+}
+
+// A node's local time at a global time
+static uint64_t localTime(const Node& node, uint64_t globalUs) {
+    return node.anchorLocalUs + (uint64_t)((globalUs - node.anchorGlobalUs) * (1.0 + node.driftPpm * 1e-6));
+}
+
+// First global time at which a node's clock reaches a local time
+static uint64_t globalTime(const Node& node, uint64_t localUs) {
+    if (localUs <= node.anchorLocalUs) {
+        return node.anchorGlobalUs;
+    }
+    double elapsed = (localUs - node.anchorLocalUs) / (1.0 + node.driftPpm * 1e-6);
+    return node.anchorGlobalUs + (uint64_t)ceil(elapsed);
+}
+
+// Make a node current: its shim context, with its clock at a global time
+static void selectNode(Node& node, uint64_t globalUs) {
+    shimSelectContext(node.context);
+    shimSetTimeUs(localTime(node, globalUs));
+}
+
+// Copy fixtures [first, end) of the edited patch into the controller, as
+// syncPatch() does on the device
+static void syncPatch(Node& node, int first) {
+    node.dmx->editFixtures(node.patch.getCount());
+    for (int i = first; i < node.patch.getCount(); i++) {
+        int red, green, blue, white;
+        node.patch.getChannels(i, red, green, blue, white);
+        node.dmx->setFixtureConfig(i, "Fixture", node.patch.getFixture(i).start, red, green, blue, white);
+        node.dmx->setFixtureColorProfile(i, node.patch.getFixture(i).profile);
+    }
+    node.dmx->publishFixtures();
+}
+
+// Persist the patch journal, as savePatchJournal() does on the device
+static void savePatchJournal(Node& node) {
+    static uint8_t record[2 + PATCH_JOURNAL_SIZE];
+    size_t length = node.patch.getJournalLength();
+    memset(record, 0, sizeof(record));
+    record[0] = (uint8_t)length;
+    record[1] = (uint8_t)(length >> 8);
+    memcpy(record + 2, node.patch.getJournal(), length);
+    node.dmx->saveCustomData(FLEET_PATCH_JOURNAL_KEY, record, sizeof(record));
+}
+
+// Same bring-up as setup(): controller, player, then the patch from flash
+// (or the default patch on a node that has none)
+static void bootNode(Node& node) {
+    node.dmx = new DmxController(1, 19, 20, 5);
+    node.dmx->begin();
+    node.patterns.begin(node.dmx, node.dmxMutex, &node.strobe);
+    node.keyframes.reset();
+
+    static uint8_t record[2 + PATCH_JOURNAL_SIZE];
+    if (!node.dmx->loadCustomData(FLEET_PATCH_JOURNAL_KEY, record, sizeof(record)) ||
+        !node.patch.replay(record + 2, record[0] | (record[1] << 8))) {
+        node.patch.reset((uint8_t)numFixtures);
+    }
+    syncPatch(node, 0);
+    node.onAir.assign(node.dmx->getOutputData(), node.dmx->getOutputData() + DmxController::FRAME_SIZE);
+}
+
+// Handle a downlink the way processDownlink() does for binary commands
+static void handleDownlink(Node& node, const std::vector<uint8_t>& payload) {
+    const uint8_t* data = payload.data();
+    size_t size = payload.size();
+    DmxController* dmx = node.dmx;
+
+    if (data[0] == KF_OPCODE_STOP) {
+        node.keyframes.reset();
+    } else if (data[0] == KF_OPCODE_LOOKAHEAD && size >= 3) {
+        node.keyframes.setLookahead(data[1] | (data[2] << 8));
+    } else if (data[0] == KF_OPCODE_KEYFRAME) {
+        if (node.patterns.isActive()) {
+            node.patterns.stop();
+        }
+        node.keyframes.handlePacket(data + 1, size - 1, millis());
+    } else if (size >= 3 && PatchEditor::isEditOpcode(data[0])) {
+        int first;
+        if (node.patch.apply(data, size, first) >= 0) {
+            syncPatch(node, first);
+            savePatchJournal(node);
+        }
+    } else if (size == 1 && data[0] <= 4) {
+        static const uint8_t PRESETS[5][4] = {
+            { 0, 0, 0, 0 }, { 255, 0, 0, 0 }, { 0, 255, 0, 0 }, { 0, 0, 255, 0 }, { 0, 0, 0, 255 }
+        };
+        for (int i = 0; i < dmx->getNumFixtures(); i++) {
+            const uint8_t* c = PRESETS[data[0]];
+            dmx->setFixtureColor(i, c[0], c[1], c[2], c[3]);
+        }
+        dmx->sendData();
+    } else if (size == 1 && data[0] == DOWNLINK_PATTERN_STOP) {
+        if (node.patterns.isActive()) {
+            node.patterns.stop();
+        }
+    } else if (size == 6 && data[0] == DOWNLINK_PATTERN_START) {
+        const EffectInfo* effect = DmxPattern::findEffect(data[1]);
+        node.patterns.start(effect != NULL ? effect : &DmxPattern::EFFECTS[0],
+                            data[2] | (data[3] << 8), data[4] | (data[5] << 8));
+    } else if (size >= 6 && data[0] >= 1 && data[0] <= DOWNLINK_MAX_LIGHTS && size == 1 + data[0] * 5u) {
+        for (int i = 0; i < data[0]; i++) {
+            const uint8_t* light = data + 1 + i * 5;
+            if (light[0] >= 1 && light[0] + 3 < DmxController::FRAME_SIZE) {
+                memcpy(dmx->getDmxData() + light[0], light + 1, 4);
+            }
+        }
+        dmx->sendData();
+    } else if (size == 2 && data[0] == PATCH_OPCODE_COUNT) {
+        int maxLights = min(25, min(DmxController::MAX_FIXTURES, DmxController::MAX_CHANNELS / 4));
+        node.patch.reset((uint8_t)min(maxLights, max(1, (int)data[1])));
+        syncPatch(node, 0);
+        savePatchJournal(node);
+    } else {
+        node.ignored++;
+    }
+}
+
+// Apply a local command to one node
+static void applyLocal(Node& node, const Command& command, uint64_t nowUs) {
+    if (command.args[0] == "reboot") {
+        delete node.dmx;
+        bootNode(node);
+        return;
+    }
+    const std::string& param = command.args[1];
+    double value = atof(command.args[2].c_str());
+    if (param == "delay") {
+        node.delayMs = (int)value;
+    } else if (param == "jitter") {
+        node.jitterMs = (int)value;
+    } else if (param == "loss") {
+        node.lossPercent = value;
+    } else if (param == "duty") {
+        node.dutyPercent = value;
+    } else if (param == "drift") {
+        // Re-anchor so the clock keeps running from where it is
+        node.anchorLocalUs = localTime(node, nowUs);
+        node.anchorGlobalUs = nowUs;
+        node.driftPpm = value;
+    } else {
+        fail("unknown setting %s", param.c_str());
+    }
+}
+
+// Put one payload on the air to a set of nodes and schedule its deliveries;
+// one that cannot start before the run ends stays queued
+static void transmit(size_t index, const std::vector<int>& targets, uint64_t nowUs, uint64_t runEndUs,
+                     uint64_t& radioFreeUs, const DownlinkEncoder& encoder, std::vector<Delivery>& inFlight) {
+    const Command& command = commands[index];
+    CommandStats& s = stats[index];
+
+    uint64_t radioReadyUs = max(nowUs, radioFreeUs);
+    uint64_t startUs = radioReadyUs;
+    for (size_t t = 0; t < targets.size(); t++) {
+        startUs = max(startUs, nodes[targets[t]]->dutyFreeUs);
+    }
+    uint64_t airtimeUs = (uint64_t)(encoder.airtimeMs(command.payload.size()) * 1000);
+    uint64_t endUs = startUs + airtimeUs;
+    radioFreeUs = endUs;
+    if (startUs >= runEndUs) {
+        s.queued++;
+        return;
+    }
+    s.transmissions++;
+    s.airtimeUs += airtimeUs;
+
+    for (size_t t = 0; t < targets.size(); t++) {
+        Node& node = *nodes[targets[t]];
+        if (node.dutyFreeUs > radioReadyUs) {
+            node.dutyWaitUs += node.dutyFreeUs - radioReadyUs;
+        }
+        if (node.dutyPercent > 0) {
+            node.dutyFreeUs = endUs + (uint64_t)(airtimeUs * (100.0 / node.dutyPercent - 1));
+        }
+        s.targets++;
+        if (random01() * 100 < node.lossPercent) {
+            node.lost++;
+            s.lost++;
+            continue;
+        }
+        Delivery delivery;
+        delivery.atUs = endUs + (uint64_t)node.delayMs * 1000 + (uint64_t)(random01() * node.jitterMs * 1000);
+        delivery.node = targets[t];
+        delivery.command = index;
+        inFlight.push_back(delivery);
+    }
+}
+
+// Send a script command: local commands apply at once, downlinks go on air
+static void dispatch(size_t index, uint64_t nowUs, uint64_t runEndUs, uint64_t& radioFreeUs,
+                     const DownlinkEncoder& encoder, std::vector<Delivery>& inFlight) {
+    const Command& command = commands[index];
+    std::vector<int> targets;
+    if (command.target >= 0) {
+        targets.push_back(command.target);
+    } else {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            targets.push_back((int)i);
+        }
+    }
+
+    if (command.payload.empty()) {
+        for (size_t t = 0; t < targets.size(); t++) {
+            selectNode(*nodes[targets[t]], nowUs);
+            applyLocal(*nodes[targets[t]], command, nowUs);
+        }
+        return;
+    }
+    if (command.target == TARGET_EACH) {
+        for (size_t t = 0; t < targets.size(); t++) {
+            transmit(index, std::vector<int>(1, targets[t]), nowUs, runEndUs, radioFreeUs, encoder, inFlight);
+        }
+    } else {
+        transmit(index, targets, nowUs, runEndUs, radioFreeUs, encoder, inFlight);
+    }
+}
+
+// Value at rank p (0-1) of a sorted list
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[(size_t)(p * (sorted.size() - 1) + 0.5)];
+}
+
+// Mean of a list in ms
+static double meanMs(const std::vector<uint64_t>& values) {
+    if (values.empty()) {
+        return 0;
+    }
+    double total = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        total += values[i];
+    }
+    return total / values.size() / 1000.0;
+}
+
+int main(int argc, char** argv) {
+    int numNodes = FLEET_DEFAULT_NODES;
+    double seconds = FLEET_DEFAULT_SECONDS;
+    int dataRate = FLEET_DEFAULT_DR;
+    double driftPpm = FLEET_DEFAULT_DRIFT_PPM;
+    int delayMs = FLEET_DEFAULT_DELAY_MS;
+    int jitterMs = FLEET_DEFAULT_JITTER_MS;
+    double lossPercent = 0;
+    double dutyPercent = 0;
+    uint64_t seed = 1;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'v') {
+            shimSerialEcho = true;
+            continue;
+        }
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: fleet [-n nodes] [-x fixtures] [-t seconds] [-r dr] [-d drift_ppm] [-D delay_ms] "
+                            "[-j jitter_ms] [-L loss_pct] [-c duty_pct] [-s seed] [-f frame_ms] [-l loop_ms] [-v] [script|-]\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'n': numNodes = atoi(value); break;
+            case 'x': numFixtures = atoi(value); break;
+            case 't': seconds = atof(value); break;
+            case 'r': dataRate = atoi(value); break;
+            case 'd': driftPpm = fabs(atof(value)); break;
+            case 'D': delayMs = max(0, atoi(value)); break;
+            case 'j': jitterMs = max(0, atoi(value)); break;
+            case 'L': lossPercent = atof(value); break;
+            case 'c': dutyPercent = atof(value); break;
+            case 's': seed = strtoull(value, NULL, 10); break;
+            case 'f': frameMs = max(1, atoi(value)); break;
+            case 'l': loopMs = max(1, atoi(value)); break;
+            default: fail("unknown option -%c", option);
+        }
+    }
+    if (numNodes < 1) {
+        fail("need at least one node");
+    }
+    if (numFixtures < 1 || numFixtures > DmxController::MAX_FIXTURES || numFixtures * 4 > DmxController::MAX_CHANNELS) {
+        fail("fixture count must be 1-%d", min(DmxController::MAX_FIXTURES, DmxController::MAX_CHANNELS / 4));
+    }
+    if (dataRate < 8 || dataRate >= 8 + US915_DOWNLINK_RATE_COUNT) {
+        fail("data rate must be 8-%d", 7 + US915_DOWNLINK_RATE_COUNT);
+    }
+    DownlinkEncoder encoder(US915_DOWNLINK_RATES[dataRate - 8]);
+    const LoraDataRate& rate = encoder.getDataRate();
+
+    if (arg < argc) {
+        readScript(argv[arg], numNodes);
+    }
+    if (commands.empty()) {
+        fail("nothing to simulate: give a scenario script");
+    }
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (commands[i].payload.size() > rate.maxPayload) {
+            fail("command %zu is %zu bytes, over the %u-byte limit at %s", i, commands[i].payload.size(),
+                 rate.maxPayload, rate.name);
+        }
+    }
+    std::stable_sort(commands.begin(), commands.end(),
+                     [](const Command& a, const Command& b) { return a.atUs < b.atUs; });
+    stats.resize(commands.size());
+
+    // Boot the fleet: every node has been up for a different time, so
+    // their loops and frames run at different phases
+    rngState = seed * 0x9E3779B97F4A7C15ULL + 1;
+    for (int i = 0; i < numNodes; i++) {
+        Node* node = new Node();
+        node->context = shimCreateContext();
+        node->dmxMutex = xSemaphoreCreateMutex();
+        node->driftPpm = (random01() * 2 - 1) * driftPpm;
+        node->anchorGlobalUs = 0;
+        node->anchorLocalUs = (uint64_t)(random01() * FLEET_MAX_UPTIME_US);
+        node->delayMs = delayMs;
+        node->jitterMs = jitterMs;
+        node->lossPercent = lossPercent;
+        node->dutyPercent = dutyPercent;
+        node->dutyFreeUs = 0;
+        node->pendingOnset = -1;
+        node->received = node->lost = node->ignored = 0;
+        node->dutyWaitUs = 0;
+        nodes.push_back(node);
+        selectNode(*node, 0);
+        bootNode(*node);
+        uint64_t bootedUs = localTime(*node, 0);
+        node->nextLoopUs = bootedUs + (uint64_t)(random01() * loopMs * 1000);
+        node->nextFrameUs = bootedUs + (uint64_t)(random01() * frameMs * 1000);
+    }
+
+    // Merge the script, deliveries, every node's loop() and output frames,
+    // and the output samples on the global clock
+    uint64_t endUs = (uint64_t)(seconds * 1e6);
+    uint64_t frameUs = (uint64_t)frameMs * 1000;
+    uint64_t loopUs = (uint64_t)loopMs * 1000;
+    uint64_t radioFreeUs = 0;
+    uint64_t nextSampleUs = frameUs;
+    size_t nextCommand = 0;
+    std::vector<Delivery> inFlight;
+    size_t samples = 0, matchingSamples = 0;
+    int worstDifference = 0;
+    while (true) {
+        uint64_t commandAt = nextCommand < commands.size() ? commands[nextCommand].atUs : UINT64_MAX;
+        size_t delivery = inFlight.size();
+        uint64_t deliveryAt = UINT64_MAX;
+        for (size_t d = 0; d < inFlight.size(); d++) {
+            if (inFlight[d].atUs < deliveryAt) {
+                deliveryAt = inFlight[d].atUs;
+                delivery = d;
+            }
+        }
+        int loopNode = -1, frameNode = -1;
+        uint64_t loopAt = UINT64_MAX, frameAt = UINT64_MAX;
+        for (size_t i = 0; i < nodes.size(); i++) {
+            uint64_t at = globalTime(*nodes[i], nodes[i]->nextLoopUs);
+            if (at < loopAt) {
+                loopAt = at;
+                loopNode = (int)i;
+            }
+            at = globalTime(*nodes[i], nodes[i]->nextFrameUs);
+            if (at < frameAt) {
+                frameAt = at;
+                frameNode = (int)i;
+            }
+        }
+        uint64_t at = min(min(commandAt, deliveryAt), min(min(loopAt, frameAt), nextSampleUs));
+        if (at >= endUs) {
+            break;
+        }
+
+        // At equal times: script, deliveries, loop(), frames, then samples
+        if (commandAt == at) {
+            dispatch(nextCommand++, at, endUs, radioFreeUs, encoder, inFlight);
+        } else if (deliveryAt == at) {
+            Delivery d = inFlight[delivery];
+            inFlight.erase(inFlight.begin() + delivery);
+            Node& node = *nodes[d.node];
+            selectNode(node, at);
+            handleDownlink(node, commands[d.command].payload);
+            node.received++;
+            node.pendingOnset = (long)d.command;
+            stats[d.command].latenciesUs.push_back(at - commands[d.command].atUs);
+        } else if (loopAt == at) {
+            Node& node = *nodes[loopNode];
+            selectNode(node, at);
+            shimSetTimeUs(max((uint64_t)millis() * 1000, node.nextLoopUs));
+            node.nextLoopUs += loopUs;
+            if (node.patterns.isActive()) {
+                node.patterns.update();
+            }
+            if (node.keyframes.isActive()) {
+                node.keyframes.render(millis(), node.dmx->getDmxData(), node.dmx->getDmxFraction());
+                node.dmx->sendData();
+            }
+        } else if (frameAt == at) {
+            Node& node = *nodes[frameNode];
+            selectNode(node, at);
+            shimSetTimeUs(max((uint64_t)millis() * 1000, node.nextFrameUs));
+            node.nextFrameUs += frameUs;
+            node.dmx->transmitFrame(frameMs);
+            const uint8_t* out = node.dmx->getOutputData();
+            if (memcmp(out, node.onAir.data(), DmxController::FRAME_SIZE) != 0) {
+                if (node.pendingOnset >= 0) {
+                    stats[node.pendingOnset].onsetsUs.push_back(at);
+                    node.pendingOnset = -1;
+                }
+                memcpy(node.onAir.data(), out, DmxController::FRAME_SIZE);
+            }
+        } else {
+            // What a camera on the whole fleet would see at this instant
+            nextSampleUs += frameUs;
+            samples++;
+            bool match = true;
+            for (size_t i = 1; i < nodes.size(); i++) {
+                for (int ch = 1; ch < DmxController::FRAME_SIZE; ch++) {
+                    int difference = abs(nodes[i]->onAir[ch] - nodes[0]->onAir[ch]);
+                    if (difference != 0) {
+                        match = false;
+                        worstDifference = max(worstDifference, difference);
+                    }
+                }
+            }
+            matchingSamples += match ? 1 : 0;
+        }
+    }
+
+    // Per-command report
+    printf("Simulated %d nodes for %.1f s at %s (SF%u, %u kHz), seed %llu\n", numNodes, seconds, rate.name,
+           rate.spreadingFactor, rate.bandwidthKhz, (unsigned long long)seed);
+    printf("  %3s %8s %-6s %-10s %5s %4s %6s %10s %9s %9s %9s %9s\n", "cmd", "at_ms", "target", "command",
+           "bytes", "tx", "queued", "airtime_ms", "delivered", "lat_ms", "lat_max", "skew_ms");
+    uint64_t totalAirtimeUs = 0;
+    int totalTransmissions = 0, totalQueued = 0, totalTargets = 0, totalLost = 0;
+    std::vector<uint64_t> allLatencies, skews;
+    for (size_t i = 0; i < commands.size(); i++) {
+        const Command& command = commands[i];
+        CommandStats& s = stats[i];
+        std::sort(s.onsetsUs.begin(), s.onsetsUs.end());
+        std::sort(s.latenciesUs.begin(), s.latenciesUs.end());
+        allLatencies.insert(allLatencies.end(), s.latenciesUs.begin(), s.latenciesUs.end());
+        totalAirtimeUs += s.airtimeUs;
+        totalTransmissions += s.transmissions;
+        totalQueued += s.queued;
+        totalTargets += s.targets;
+        totalLost += s.lost;
+
+        char target[16];
+        snprintf(target, sizeof(target), "%s", command.target == TARGET_ALL ? "all" :
+                 command.target == TARGET_EACH ? "each" : std::to_string(command.target).c_str());
+        if (command.payload.empty()) {
+            printf("  %3zu %8llu %-6s %-10s %5s\n", i, (unsigned long long)(command.atUs / 1000), target,
+                   command.args[0].c_str(), "local");
+            continue;
+        }
+        char skew[16] = "-";
+        if (s.onsetsUs.size() >= 2) {
+            uint64_t spread = s.onsetsUs.back() - s.onsetsUs.front();
+            skews.push_back(spread);
+            snprintf(skew, sizeof(skew), "%.1f", spread / 1000.0);
+        }
+        char delivered[16];
+        snprintf(delivered, sizeof(delivered), "%zu/%d", s.latenciesUs.size(), s.targets);
+        printf("  %3zu %8llu %-6s %-10s %5zu %4d %6d %10.1f %9s %9.1f %9.1f %9s\n", i,
+               (unsigned long long)(command.atUs / 1000), target, command.args[0].c_str(), command.payload.size(),
+               s.transmissions, s.queued, s.airtimeUs / 1000.0, delivered, meanMs(s.latenciesUs),
+               s.latenciesUs.empty() ? 0.0 : s.latenciesUs.back() / 1000.0, skew);
+    }
+
+    // Per-node report
+    printf("Nodes\n");
+    printf("  %4s %9s %8s %8s %6s %6s %8s %6s %7s %11s\n", "node", "drift_ppm", "delay_ms", "jitter", "loss_%",
+           "duty_%", "received", "lost", "ignored", "duty_wait_s");
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node& node = *nodes[i];
+        printf("  %4zu %9.1f %8d %8d %6.1f %6.1f %8d %6d %7d %11.2f\n", i, node.driftPpm, node.delayMs,
+               node.jitterMs, node.lossPercent, node.dutyPercent, node.received, node.lost, node.ignored,
+               node.dutyWaitUs / 1e6);
+    }
+
+    // Fleet summary
+    std::sort(allLatencies.begin(), allLatencies.end());
+    std::sort(skews.begin(), skews.end());
+    printf("Fleet\n");
+    printf("  airtime    %.1f ms in %d transmissions (%.2f%% of the run), %d still queued at the end\n",
+           totalAirtimeUs / 1000.0, totalTransmissions, totalAirtimeUs / (seconds * 1e4), totalQueued);
+    printf("  delivery   %zu of %d (%d lost, %zu still in flight), latency mean %.1f ms, p50 %.1f, p99 %.1f, max %.1f\n",
+           allLatencies.size(), totalTargets, totalLost, inFlight.size(), meanMs(allLatencies), percentile(allLatencies, 0.5) / 1000.0,
+           percentile(allLatencies, 0.99) / 1000.0, allLatencies.empty() ? 0.0 : allLatencies.back() / 1000.0);
+    printf("  onset skew mean %.1f ms, max %.1f over %zu commands\n", meanMs(skews),
+           skews.empty() ? 0.0 : skews.back() / 1000.0, skews.size());
+    printf("  output     %.1f%% of %zu samples identical across nodes, worst channel difference %d\n",
+           samples == 0 ? 100.0 : 100.0 * matchingSamples / samples, samples, worstDifference);
+    return 0;
+}
@@ -0,0 +1,526 @@
+/**
+ * fuota.cpp - Delta patch generator and FUOTA loss simulator
+ *
+ * Server side of lib/Fuota, and a host harness for it:
+ *   diff     Make a delta patch (DeltaPatch.h format) from the running
+ *            image to a new one
+ *   apply    Apply a patch the way the node does (DeltaPatch)
+ *   sim      Send a file through FuotaManager the way a server would:
+ *            FragSessionSetup, M uncoded DataFragments, then redundancy
+ *            fragments from the TS004 parity matrix, dropping fragments
+ *            at the loss rate. The session is finalized like on the node
+ *            and the result compared with the file (or, with -d, the
+ *            patch applied against the old image and compared with the
+ *            new one)
+ *   sweep    sim over a range of loss rates, several trials each
+ *
+ * Usage: fuota diff OLD NEW PATCH
+ *        fuota apply OLD PATCH NEW
+ *        fuota [options] sim|sweep FILE
+ *   -d OLD      FILE is a new image: send the patch from OLD to it
+ *   -s BYTES    Fragment size (default 49, a 53-byte DR8 downlink less the
+ *               tag, CID and index)
+ *   -r PERCENT  Redundancy fragments sent after the uncoded ones (default 30)
+ *   -l PERCENT  Fragment loss rate for sim (default 10)
+ *   -b LENGTH   Mean loss burst length in fragments (default 1: independent)
+ *   -n TRIALS   Trials per loss rate for sweep (default 20)
+ *   -S SEED     Random seed (default 1)
+ *
+ * sim and sweep exit with status 1 if a transfer that should have
+ * recovered did not produce the expected image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "FuotaManager.h"
+#include "DeltaPatch.h"
+
+#define DIFF_WINDOW 8            // Bytes hashed to find a match in the old image
+#define DIFF_MIN_MATCH 12        // Shorter exact matches are sent as literals
+#define DIFF_MIN_COPY 8          // Shorter equal runs inside a match go into a DIFF
+#define DIFF_GIVE_UP 64          // Bytes scanned past a match without improving it
+
+typedef std::vector<uint8_t> Bytes;
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "fuota: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Read a whole file
+static Bytes readFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fail("cannot open ", path);
+    }
+    Bytes data;
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + length);
+    }
+    fclose(file);
+    return data;
+}
+
+// Write a whole file
+static void writeFile(const char* path, const Bytes& data) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL || (!data.empty() && fwrite(&data[0], 1, data.size(), file) != data.size())) {
+        fail("cannot write ", path);
+    }
+    fclose(file);
+}
+
+// Readers and writer over memory, for DeltaPatch
+class MemoryReader : public DeltaReader {
+public:
+    MemoryReader(const Bytes& data) : _data(data) {}
+    bool read(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset > _data.size() || length > _data.size() - offset) {
+            return false;
+        }
+        memcpy(data, &_data[0] + offset, length);
+        return true;
+    }
+
+private:
+    const Bytes& _data;
+};
+
+class MemoryWriter : public DeltaWriter {
+public:
+    bool write(const uint8_t* data, size_t length) override {
+        output.insert(output.end(), data, data + length);
+        return true;
+    }
+    Bytes output;
+};
+
+// Little endian 32-bit value
+static void putLe32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+// LEB128 varint
+static void putVarint(Bytes& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// One operation with its source offset and length
+static void putOp(Bytes& out, uint8_t op, uint32_t srcOffset, uint32_t length) {
+    out.push_back(op);
+    if (op != DELTA_OP_ADD) {
+        putVarint(out, srcOffset);
+    }
+    putVarint(out, length);
+}
+
+// Eight bytes as a map key
+static uint64_t windowKey(const uint8_t* data) {
+    uint64_t key;
+    memcpy(&key, data, sizeof(key));
+    return key;
+}
+
+// A matched region: equal runs of DIFF_MIN_COPY or more become COPY, the
+// bytes between them one DIFF each
+static void putMatch(Bytes& out, const Bytes& source, uint32_t src, const Bytes& target, uint32_t dst, uint32_t length) {
+    uint32_t i = 0;
+    while (i < length) {
+        uint32_t run = 0;
+        while (i + run < length && source[src + i + run] == target[dst + i + run]) {
+            run++;
+        }
+        if (run >= DIFF_MIN_COPY || i + run == length) {
+            if (run > 0) {
+                putOp(out, DELTA_OP_COPY, src + i, run);
+            }
+            i += run;
+            continue;
+        }
+        // Grow the DIFF until the next long equal run
+        uint32_t start = i;
+        uint32_t equal = 0;
+        while (i < length && equal < DIFF_MIN_COPY) {
+            equal = source[src + i] == target[dst + i] ? equal + 1 : 0;
+            i++;
+        }
+        if (equal >= DIFF_MIN_COPY) {
+            i -= equal;
+        }
+        putOp(out, DELTA_OP_DIFF, src + start, i - start);
+        for (uint32_t k = start; k < i; k++) {
+            out.push_back((uint8_t)(target[dst + k] - source[src + k]));
+        }
+    }
+}
+
+// Literal bytes
+static void putLiteral(Bytes& out, const Bytes& target, uint32_t start, uint32_t end) {
+    if (end > start) {
+        putOp(out, DELTA_OP_ADD, 0, end - start);
+        out.insert(out.end(), target.begin() + start, target.begin() + end);
+    }
+}
+
+// Greedy patch: find each region of the new image in the old one (trying
+// the previous alignment first, since recompiled code mostly moves in
+// blocks), extend it past small differences, and send the rest as literals
+static Bytes makePatch(const Bytes& source, const Bytes& target) {
+    Bytes out(DELTA_PATCH_MAGIC, DELTA_PATCH_MAGIC + 4);
+    putLe32(out, (uint32_t)source.size());
+    putLe32(out, deltaCrc32(0, source.empty() ? NULL : &source[0], source.size()));
+    putLe32(out, (uint32_t)target.size());
+    putLe32(out, deltaCrc32(0, target.empty() ? NULL : &target[0], target.size()));
+
+    std::map<uint64_t, uint32_t> index;
+    for (uint32_t i = 0; i + DIFF_WINDOW <= source.size(); i++) {
+        index.insert(std::make_pair(windowKey(&source[i]), i));
+    }
+
+    uint32_t pos = 0;
+    uint32_t literal = 0;
+    int64_t lastDelta = 0;
+    while (pos + DIFF_WINDOW <= target.size()) {
+        int64_t aligned = pos + lastDelta;
+        uint32_t src = 0;
+        bool found = false;
+        if (aligned >= 0 && aligned + DIFF_WINDOW <= (int64_t)source.size() &&
+            memcmp(&source[aligned], &target[pos], DIFF_WINDOW) == 0) {
+            src = (uint32_t)aligned;
+            found = true;
+        } else {
+            std::map<uint64_t, uint32_t>::const_iterator it = index.find(windowKey(&target[pos]));
+            if (it != index.end()) {
+                src = it->second;
+                found = true;
+            }
+        }
+        uint32_t exact = 0;
+        while (found && pos + exact < target.size() && src + exact < source.size() &&
+               source[src + exact] == target[pos + exact]) {
+            exact++;
+        }
+        if (exact < DIFF_MIN_MATCH) {
+            pos++;
+            continue;
+        }
+
+        // Take back literal bytes that match, then extend while matches
+        // outnumber differences
+        while (pos > literal && src > 0 && source[src - 1] == target[pos - 1]) {
+            pos--;
+            src--;
+            exact++;
+        }
+        uint32_t best = exact;
+        int32_t score = 0;
+        int32_t bestScore = 0;
+        for (uint32_t i = exact; pos + i < target.size() && src + i < source.size() && i - best < DIFF_GIVE_UP; i++) {
+            score += source[src + i] == target[pos + i] ? 1 : -1;
+            if (score > bestScore) {
+                bestScore = score;
+                best = i + 1;
+            }
+        }
+
+        putLiteral(out, target, literal, pos);
+        putMatch(out, source, src, target, pos, best);
+        lastDelta = (int64_t)src - pos;
+        pos += best;
+        literal = pos;
+    }
+    putLiteral(out, target, literal, (uint32_t)target.size());
+    out.push_back(DELTA_OP_END);
+    return out;
+}
+
+// RAM storage behind FuotaManager; finalize() applies patches against the
+// old image, like OtaPartitionBackend does against the running partition
+class RamBackend : public FuotaBackend {
+public:
+    RamBackend(const Bytes* source) : _source(source), _fileSize(0) {}
+
+    bool prepare(uint32_t fileSize, uint8_t fileType) override {
+        // The last fragment carries the padding past the end of the file
+        _file.assign(fileSize + FRAG_MAX_FRAG_SIZE, 0xFF);
+        _fileSize = fileSize;
+        return fileType == FUOTA_FILE_FULL_IMAGE || _source != NULL;
+    }
+
+    bool finalize(uint32_t fileSize, uint8_t fileType) override {
+        Bytes file(_file.begin(), _file.begin() + fileSize);
+        if (fileType == FUOTA_FILE_FULL_IMAGE) {
+            image = file;
+            return true;
+        }
+        MemoryReader patch(file);
+        MemoryReader source(*_source);
+        MemoryWriter target;
+        result = applyDeltaPatch(patch, fileSize, source, target);
+        image = target.output;
+        return result == DELTA_OK;
+    }
+
+    bool write(uint32_t offset, const uint8_t* data, size_t length) override {
+        if (offset > _file.size() || length > _file.size() - offset) {
+            return false;
+        }
+        memcpy(&_file[offset], data, length);
+        return true;
+    }
+
+    bool read(uint32_t offset, uint8_t* data, size_t length) override {
+        if (offset > _file.size() || length > _file.size() - offset) {
+            return false;
+        }
+        memcpy(data, &_file[offset], length);
+        return true;
+    }
+
+    Bytes image;
+    DeltaResult result;
+
+private:
+    const Bytes* _source;
+    Bytes _file;
+    uint32_t _fileSize;
+};
+
+// Simulation settings
+struct SimConfig {
+    uint8_t fragSize;
+    uint32_t redundancyPercent;
+    double lossRate;
+    double burstLength;
+};
+
+// Outcome of one transfer
+struct SimResult {
+    bool complete;       // Every uncoded fragment known
+    bool verified;       // finalize() accepted the file and the image matched
+    uint32_t sent;       // Fragments sent until complete (or all of them)
+    uint32_t lost;
+    bool outOfRows;      // Redundancy was dropped for lack of parity rows
+};
+
+// Deterministic generator (xorshift32), so runs repeat with -S
+static uint32_t randomState = 1;
+static double nextRandom() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return (randomState & 0xFFFFFF) / (double)0x1000000;
+}
+
+// Run TS004 commands; the answers are not needed
+static void downlink(FuotaManager& manager, const Bytes& command) {
+    uint8_t answer[FUOTA_MAX_ANSWER_SIZE];
+    manager.handleDownlink(&command[0], command.size(), answer);
+}
+
+// Send one file through a fresh session with a lossy link
+static SimResult simulate(const Bytes& file, uint8_t fileType, const Bytes* source, const Bytes& expected,
+                          const SimConfig& config) {
+    SimResult result = { false, false, 0, 0, false };
+    uint16_t nbFrag = (uint16_t)((file.size() + config.fragSize - 1) / config.fragSize);
+    uint8_t padding = (uint8_t)(nbFrag * config.fragSize - file.size());
+    RamBackend backend(source);
+    FuotaManager manager(&backend);
+
+    // FragSessionSetupReq: session 0, parity FEC, descriptor byte 0 = file type
+    uint8_t setup[] = { FUOTA_CID_FRAG_SESSION_SETUP, 0x00, (uint8_t)nbFrag, (uint8_t)(nbFrag >> 8),
+                        config.fragSize, 0x00, padding, fileType, 0, 0, 0 };
+    downlink(manager, Bytes(setup, setup + sizeof(setup)));
+    if (manager.getState() != FUOTA_RECEIVING) {
+        fail("the session was refused (file too large for the fragment size?)");
+    }
+
+    Bytes padded(file);
+    padded.resize((size_t)nbFrag * config.fragSize, 0);
+    uint32_t redundancy = (nbFrag * config.redundancyPercent + 99) / 100;
+    Bytes row((nbFrag + 7) / 8);
+
+    // Gilbert-Elliott: losses come in bursts of the mean length
+    double enterBurst = config.burstLength <= 1 ? config.lossRate
+                                                : config.lossRate / (config.burstLength * (1 - config.lossRate));
+    double leaveBurst = config.burstLength <= 1 ? 1 - config.lossRate : 1 / config.burstLength;
+    bool inBurst = false;
+
+    for (uint32_t index = 1; index <= nbFrag + redundancy && manager.getState() == FUOTA_RECEIVING; index++) {
+        Bytes command;
+        command.push_back(FUOTA_CID_DATA_FRAGMENT);
+        command.push_back((uint8_t)index);
+        command.push_back((uint8_t)((index >> 8) & 0x3F));
+        if (index <= nbFrag) {
+            command.insert(command.end(), padded.begin() + (index - 1) * config.fragSize,
+                           padded.begin() + index * config.fragSize);
+        } else {
+            FragDecoder::parityMatrixRow((uint16_t)(index - nbFrag), nbFrag, &row[0]);
+            Bytes coded(config.fragSize, 0);
+            for (uint16_t frag = 0; frag < nbFrag; frag++) {
+                if (row[frag >> 3] & (1 << (frag & 7))) {
+                    for (uint8_t i = 0; i < config.fragSize; i++) {
+                        coded[i] ^= padded[frag * config.fragSize + i];
+                    }
+                }
+            }
+            command.insert(command.end(), coded.begin(), coded.end());
+        }
+        result.sent++;
+        inBurst = inBurst ? nextRandom() >= leaveBurst : nextRandom() < enterBurst;
+        if (inBurst) {
+            result.lost++;
+            continue;
+        }
+        downlink(manager, command);
+    }
+
+    // An unfinished session is asked for its status, like a server does
+    // before sending more redundancy
+    if (manager.getState() == FUOTA_RECEIVING) {
+        uint8_t request[] = { FUOTA_CID_FRAG_SESSION_STATUS, 0x01 };
+        uint8_t answer[FUOTA_MAX_ANSWER_SIZE];
+        size_t length = manager.handleDownlink(request, sizeof(request), answer);
+        result.outOfRows = length == 5 && (answer[4] & 0x01) != 0;
+    }
+    result.complete = manager.getState() == FUOTA_VERIFYING;
+    if (result.complete) {
+        result.verified = manager.finalize() && backend.image == expected;
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    const char* oldPath = NULL;
+    SimConfig config = { 49, 30, 0.10, 1.0 };
+    long trials = 20;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: fuota diff OLD NEW PATCH\n"
+                            "       fuota apply OLD PATCH NEW\n"
+                            "       fuota [-d old] [-s frag_size] [-r redundancy%%] [-l loss%%] [-b burst] "
+                            "[-n trials] [-S seed] sim|sweep FILE\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'd': oldPath = value; break;
+            case 's': config.fragSize = (uint8_t)atoi(value); break;
+            case 'r': config.redundancyPercent = (uint32_t)atoi(value); break;
+            case 'l': config.lossRate = atof(value) / 100.0; break;
+            case 'b': config.burstLength = atof(value); break;
+            case 'n': trials = atol(value); break;
+            case 'S': randomState = (uint32_t)strtoul(value, NULL, 0) | 1; break;
+            default: fail("unknown option ", argv[arg - 1]);
+        }
+    }
+    if (arg >= argc) {
+        fail("missing command");
+    }
+    std::string command = argv[arg++];
+
+    if (command == "diff" || command == "apply") {
+        if (arg + 3 != argc) {
+            fail("expected three files");
+        }
+        Bytes source = readFile(argv[arg]);
+        Bytes input = readFile(argv[arg + 1]);
+        if (command == "diff") {
+            Bytes patch = makePatch(source, input);
+            writeFile(argv[arg + 2], patch);
+            printf("%zu -> %zu bytes, patch %zu bytes (%.1f%%)\n", source.size(), input.size(), patch.size(),
+                   input.empty() ? 0.0 : patch.size() * 100.0 / input.size());
+            return 0;
+        }
+        MemoryReader patch(input);
+        MemoryReader reader(source);
+        MemoryWriter target;
+        DeltaResult result = applyDeltaPatch(patch, (uint32_t)input.size(), reader, target);
+        if (result != DELTA_OK) {
+            fail("patch failed: ", deltaResultName(result));
+        }
+        writeFile(argv[arg + 2], target.output);
+        printf("Rebuilt %zu bytes\n", target.output.size());
+        return 0;
+    }
+
+    if ((command != "sim" && command != "sweep") || arg + 1 != argc) {
+        fail("unknown command or missing file: ", command.c_str());
+    }
+    if (config.fragSize < 1 || config.fragSize > FRAG_MAX_FRAG_SIZE || config.lossRate < 0 || config.lossRate >= 1 ||
+        config.burstLength < 1 || trials < 1) {
+        fail("option out of range");
+    }
+
+    // With -d the file is the new image and the patch is what gets sent
+    Bytes expected = readFile(argv[arg]);
+    Bytes source;
+    Bytes file = expected;
+    uint8_t fileType = FUOTA_FILE_FULL_IMAGE;
+    if (oldPath != NULL) {
+        source = readFile(oldPath);
+        file = makePatch(source, expected);
+        fileType = FUOTA_FILE_DELTA_PATCH;
+        printf("Patch: %zu bytes for a %zu-byte image\n", file.size(), expected.size());
+    }
+    uint32_t nbFrag = (uint32_t)((file.size() + config.fragSize - 1) / config.fragSize);
+    if (nbFrag == 0 || nbFrag > FRAG_MAX_FRAGMENTS) {
+        fail("the file needs 1-2048 fragments at this fragment size");
+    }
+    printf("%u fragments of %u bytes, %u%% redundancy (%u parity rows on the node)\n", nbFrag, config.fragSize,
+           config.redundancyPercent, FRAG_MAX_PARITY_ROWS);
+
+    std::vector<double> rates;
+    if (command == "sim") {
+        rates.push_back(config.lossRate);
+        trials = 1;
+    } else {
+        for (int percent = 0; percent <= 40; percent += 5) {
+            rates.push_back(percent / 100.0);
+        }
+    }
+
+    // A transfer should recover when no more was lost than the redundancy
+    // made up for and the node had the rows to hold it
+    bool ok = true;
+    printf("%6s %7s %9s %9s %9s %10s\n", "loss", "trials", "complete", "verified", "avg sent", "row limit");
+    for (size_t r = 0; r < rates.size(); r++) {
+        config.lossRate = rates[r];
+        long complete = 0;
+        long verified = 0;
+        long outOfRows = 0;
+        double sent = 0;
+        for (long t = 0; t < trials; t++) {
+            SimResult result = simulate(file, fileType, oldPath != NULL ? &source : NULL, expected, config);
+            complete += result.complete ? 1 : 0;
+            verified += result.verified ? 1 : 0;
+            outOfRows += result.outOfRows ? 1 : 0;
+            sent += result.sent;
+            if (result.complete && !result.verified) {
+                ok = false;
+            }
+        }
+        printf("%5.0f%% %7ld %9ld %9ld %9.0f %10ld\n", rates[r] * 100, trials, complete, verified, sent / trials,
+               outOfRows);
+    }
+    if (!ok) {
+        printf("FAIL: a complete transfer did not rebuild the expected image\n");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+/**
+ * kernels.cpp - Frame kernel cross-check and benchmark
+ *
+ * Runs frameKernelsSelfTest() (every kernel against its scalar reference,
+ * over every offset within a vector and a range of lengths, plus every
+ * value pair) and times each kernel against its reference over a
+ * 512-channel frame. A host build exercises the word and scalar paths; the
+ * PIE vector path of the ESP32-S3 is checked on the board with the
+ * {"kernels": "test"} console command. Kernels that are the scalar loop on
+ * the host (add and lerp, and scale and dither off the S3) are timed once
+ * and marked "scalar" instead of a speedup. The exit status is 1 on a
+ * mismatch.
+ *
+ * Usage: kernels [options]
+ *   -n FRAMES   Frames timed per kernel (default 20000)
+ *   -s          Self-test only, no timing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FrameKernels.h"
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "kernels: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Monotonic microsecond clock, in place of micros()
+static unsigned long clockUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char** argv) {
+    int frames = 20000;
+    bool timing = true;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        const char* opt = argv[arg];
+        if (strcmp(opt, "-s") == 0) {
+            timing = false;
+            continue;
+        }
+        if (strcmp(opt, "-n") != 0) {
+            fail("unknown option ", opt);
+        }
+        if (arg + 1 >= argc) {
+            fail("missing value for ", opt);
+        }
+        const char* value = argv[++arg];
+        frames = atoi(value);
+        if (frames < 1) {
+            fail("bad frame count ", value);
+        }
+    }
+    if (arg != argc) {
+        fail("unexpected argument ", argv[arg]);
+    }
+
+    int failures = frameKernelsSelfTest();
+    if (failures != 0) {
+        printf("Self-test: FAIL (%d mismatches)\n", failures);
+    } else {
+        printf("Self-test: pass\n");
+    }
+
+    if (timing) {
+        FrameKernelTiming timings[FRAME_KERNEL_COUNT];
+        frameKernelsBenchmark(clockUs, frames, timings);
+        printf("%-8s %12s %12s %8s\n", "kernel", "us/frame", "scalar", "speedup");
+        for (int k = 0; k < FRAME_KERNEL_COUNT; k++) {
+            double kernelUs = (double)timings[k].kernelUs / frames;
+            double scalarUs = (double)timings[k].scalarUs / frames;
+            if (timings[k].scalarOnly) {
+                // Both columns time the same loop here, so a ratio would be noise
+                printf("%-8s %12.3f %12s %8s\n", timings[k].name, kernelUs, "-", "scalar");
+                continue;
+            }
+            printf("%-8s %12.3f %12.3f %7.2fx\n", timings[k].name, kernelUs, scalarUs,
+                   kernelUs > 0 ? scalarUs / kernelUs : 0.0);
+        }
+    }
+    return failures != 0 ? 1 : 0;
+}
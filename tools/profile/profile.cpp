@@ -0,0 +1,412 @@
+/**
+ * profile.cpp - Host symbolizer for SamplingProfiler reports
+ *
+ * Reads a serial log containing a "PRF" report ({"profile": "stop"} or
+ * "report") and maps each sampled PC to a function of the firmware ELF,
+ * then prints the share of samples per task and a flat profile. The last
+ * complete report in the log is used.
+ *
+ * The symbol table is read from the ELF directly. With -a, addr2line adds
+ * the source line of each PC and the chain of functions inlined at it;
+ * the folded stacks then go core;task;function;inlined... and can be fed
+ * to flamegraph.pl or speedscope.
+ *
+ * Usage: profile -e firmware.elf [options] [log|-]
+ *   -a ADDR2LINE  addr2line of the firmware toolchain, e.g.
+ *                 ~/.platformio/packages/toolchain-xtensa-esp32s3/bin/xtensa-esp32s3-elf-addr2line
+ *   -o FILE       Write folded stacks for a flame graph
+ *   -t N          Rows of the flat profile and the PC list (default 25)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <cxxabi.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// One "PRF" histogram line
+struct Sample {
+    unsigned core;
+    std::string task;
+    uint32_t pc;
+    uint32_t count;
+};
+
+// An address range of the symbol table
+struct Symbol {
+    uint64_t start;
+    uint64_t size;
+    std::string name;
+};
+
+// What addr2line knows about a PC: innermost inlined function first
+struct Location {
+    std::vector<std::string> functions;
+    std::string line;
+};
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "profile: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Read a whole file ("-" = stdin)
+static std::vector<uint8_t> readFile(const char* path) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (file == NULL) {
+        fail("cannot open ", path);
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    return data;
+}
+
+// Little-endian field of the ELF image (bounds checked by the caller)
+static uint64_t readLe(const std::vector<uint8_t>& data, size_t offset, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | data[offset + i];
+    }
+    return value;
+}
+
+// Readable form of a C++ symbol
+static std::string demangle(const std::string& name) {
+    int status = 0;
+    char* readable = abi::__cxa_demangle(name.c_str(), NULL, NULL, &status);
+    if (status != 0 || readable == NULL) {
+        return name;
+    }
+    std::string result(readable);
+    free(readable);
+    return result;
+}
+
+// Function and object symbols of a little-endian ELF32 or ELF64 file,
+// sorted by address. Symbols without a size (the ROM functions the linker
+// script defines) extend to the next symbol.
+static std::vector<Symbol> loadSymbols(const char* path) {
+    std::vector<uint8_t> elf = readFile(path);
+    if (elf.size() < 64 || memcmp(elf.data(), "\x7f" "ELF", 4) != 0 || elf[5] != 1) {
+        fail("not a little-endian ELF file: ", path);
+    }
+    bool wide = elf[4] == 2;
+    uint64_t sectionOffset = wide ? readLe(elf, 0x28, 8) : readLe(elf, 0x20, 4);
+    size_t sectionSize = readLe(elf, wide ? 0x3A : 0x2E, 2);
+    size_t sectionCount = readLe(elf, wide ? 0x3C : 0x30, 2);
+    if (sectionOffset + sectionCount * sectionSize > elf.size()) {
+        fail("damaged section table in ", path);
+    }
+
+    std::vector<Symbol> symbols;
+    for (size_t i = 0; i < sectionCount; i++) {
+        size_t header = sectionOffset + i * sectionSize;
+        if (readLe(elf, header + 4, 4) != 2) {   // SHT_SYMTAB
+            continue;
+        }
+        uint64_t offset = readLe(elf, header + (wide ? 0x18 : 0x10), wide ? 8 : 4);
+        uint64_t size = readLe(elf, header + (wide ? 0x20 : 0x14), wide ? 8 : 4);
+        size_t link = readLe(elf, header + (wide ? 0x28 : 0x18), 4);
+        uint64_t entrySize = readLe(elf, header + (wide ? 0x38 : 0x24), wide ? 8 : 4);
+        if (link >= sectionCount || entrySize == 0 || offset + size > elf.size()) {
+            fail("damaged symbol table in ", path);
+        }
+        size_t stringHeader = sectionOffset + link * sectionSize;
+        uint64_t strings = readLe(elf, stringHeader + (wide ? 0x18 : 0x10), wide ? 8 : 4);
+        uint64_t stringsSize = readLe(elf, stringHeader + (wide ? 0x20 : 0x14), wide ? 8 : 4);
+        if (strings + stringsSize > elf.size()) {
+            fail("damaged string table in ", path);
+        }
+
+        for (uint64_t entry = offset; entry + entrySize <= offset + size; entry += entrySize) {
+            uint32_t nameOffset = readLe(elf, entry, 4);
+            uint8_t info = elf[entry + (wide ? 4 : 12)];
+            uint64_t value = readLe(elf, entry + (wide ? 8 : 4), wide ? 8 : 4);
+            uint64_t symbolSize = readLe(elf, entry + (wide ? 16 : 8), wide ? 8 : 4);
+            uint8_t type = info & 0x0F;
+            if ((type != 0 && type != 2) || value == 0 || nameOffset >= stringsSize) {   // NOTYPE or FUNC
+                continue;
+            }
+            const char* name = (const char*)&elf[strings + nameOffset];
+            if (name[0] == '\0' || name[0] == '$' || strncmp(name, ".L", 2) == 0) {
+                continue;
+            }
+            Symbol symbol = { value, symbolSize, demangle(name) };
+            symbols.push_back(symbol);
+        }
+    }
+    if (symbols.empty()) {
+        fail("no symbol table in ", path);
+    }
+
+    // Sized symbols first at equal addresses, then fill in missing sizes
+    std::sort(symbols.begin(), symbols.end(), [](const Symbol& a, const Symbol& b) {
+        return a.start != b.start ? a.start < b.start : a.size > b.size;
+    });
+    for (size_t i = 0; i < symbols.size(); i++) {
+        if (symbols[i].size == 0) {
+            uint64_t next = i + 1 < symbols.size() ? symbols[i + 1].start : symbols[i].start + 0x1000;
+            symbols[i].size = std::min(next - symbols[i].start, (uint64_t)0x1000);
+        }
+    }
+    return symbols;
+}
+
+// Function containing a PC ("0x..." if none)
+static std::string symbolize(const std::vector<Symbol>& symbols, uint32_t pc) {
+    std::vector<Symbol>::const_iterator it = std::upper_bound(symbols.begin(), symbols.end(), (uint64_t)pc,
+        [](uint64_t address, const Symbol& symbol) { return address < symbol.start; });
+    // Walk back over symbols at or below the PC; nested ones come later
+    while (it != symbols.begin()) {
+        --it;
+        if (pc < it->start + it->size) {
+            return it->name;
+        }
+        if (pc - it->start > 0x100000) {
+            break;
+        }
+    }
+    char text[16];
+    snprintf(text, sizeof(text), "0x%08x", pc);
+    return text;
+}
+
+// Ask addr2line for the inline chain and source line of every PC
+static std::map<uint32_t, Location> locate(const char* addr2line, const char* elf, const std::vector<Sample>& samples) {
+    std::map<uint32_t, Location> locations;
+    std::vector<uint32_t> pcs;
+    for (size_t i = 0; i < samples.size(); i++) {
+        pcs.push_back(samples[i].pc);
+    }
+    std::sort(pcs.begin(), pcs.end());
+    pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+
+    // Batches keep the command line short
+    for (size_t first = 0; first < pcs.size(); first += 200) {
+        std::string command = std::string("\"") + addr2line + "\" -e \"" + elf + "\" -a -f -i -C";
+        for (size_t i = first; i < pcs.size() && i < first + 200; i++) {
+            char address[16];
+            snprintf(address, sizeof(address), " 0x%08x", pcs[i]);
+            command += address;
+        }
+        FILE* pipe = popen(command.c_str(), "r");
+        if (pipe == NULL) {
+            fail("cannot run ", addr2line);
+        }
+
+        // "0x<pc>" starts a PC, then function / file:line pairs follow
+        char line[1024];
+        Location* current = NULL;
+        bool expectFunction = true;
+        while (fgets(line, sizeof(line), pipe) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            char* end;
+            if (line[0] == '0' && line[1] == 'x' && expectFunction) {
+                unsigned long long address = strtoull(line, &end, 16);
+                if (*end == '\0') {
+                    current = &locations[(uint32_t)address];
+                    continue;
+                }
+            }
+            if (current == NULL) {
+                continue;
+            }
+            if (expectFunction) {
+                current->functions.push_back(line);
+            } else if (current->line.empty()) {
+                const char* slash = strrchr(line, '/');
+                current->line = slash != NULL ? slash + 1 : line;
+            }
+            expectFunction = !expectFunction;
+        }
+        if (pclose(pipe) != 0) {
+            fail("addr2line failed: ", addr2line);
+        }
+    }
+    return locations;
+}
+
+// Sort a count map into rows, largest first
+template <typename Key>
+static std::vector<std::pair<Key, uint64_t> > ranked(const std::map<Key, uint64_t>& counts) {
+    std::vector<std::pair<Key, uint64_t> > rows(counts.begin(), counts.end());
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const std::pair<Key, uint64_t>& a, const std::pair<Key, uint64_t>& b) {
+                         return a.second > b.second;
+                     });
+    return rows;
+}
+
+int main(int argc, char** argv) {
+    const char* elfPath = NULL;
+    const char* addr2line = NULL;
+    const char* foldedPath = NULL;
+    size_t top = 25;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: profile -e firmware.elf [-a addr2line] [-o folded.txt] [-t rows] [log|-]\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'e': elfPath = value; break;
+            case 'a': addr2line = value; break;
+            case 'o': foldedPath = value; break;
+            case 't': top = (size_t)atol(value); break;
+            default: fail("unknown option ", argv[arg - 1]);
+        }
+    }
+    if (elfPath == NULL) {
+        fail("the firmware ELF is required (-e .pio/build/heltec_wifi_lora_32_V3/firmware.elf)");
+    }
+    std::vector<uint8_t> log = readFile(arg < argc ? argv[arg] : "-");
+
+    // Last complete report; lines may carry a monitor timestamp in front
+    std::vector<Sample> samples;
+    std::vector<Sample> pending;
+    bool inReport = false;
+    unsigned long hz = 0, elapsedMs = 0, total = 0, dropped = 0;
+    unsigned long pendingHz = 0, pendingElapsed = 0, pendingTotal = 0, pendingDropped = 0;
+    size_t start = 0;
+    while (start < log.size()) {
+        size_t end = start;
+        while (end < log.size() && log[end] != '\n') {
+            end++;
+        }
+        std::string line((const char*)&log[start], end - start);
+        start = end + 1;
+
+        size_t at = line.find("PRF ");
+        if (at == std::string::npos) {
+            continue;
+        }
+        const char* text = line.c_str() + at + 4;
+        char task[64];
+        unsigned core;
+        unsigned long pc, count;
+        if (sscanf(text, "begin %lu %lu %lu %lu", &pendingHz, &pendingElapsed, &pendingTotal, &pendingDropped) == 4) {
+            pending.clear();
+            inReport = true;
+        } else if (strncmp(text, "end", 3) == 0) {
+            if (inReport) {
+                samples = pending;
+                hz = pendingHz;
+                elapsedMs = pendingElapsed;
+                total = pendingTotal;
+                dropped = pendingDropped;
+            }
+            inReport = false;
+        } else if (inReport && sscanf(text, "%u %63s %lx %lu", &core, task, &pc, &count) == 4) {
+            Sample sample = { core, task, (uint32_t)pc, (uint32_t)count };
+            pending.push_back(sample);
+        }
+    }
+    if (samples.empty()) {
+        fail("no complete PRF report found (send {\"profile\": \"stop\"} and capture the console)");
+    }
+
+    std::vector<Symbol> symbols = loadSymbols(elfPath);
+    std::map<uint32_t, Location> locations;
+    if (addr2line != NULL) {
+        locations = locate(addr2line, elfPath, samples);
+    }
+
+    uint64_t sampled = 0;
+    std::map<std::string, uint64_t> byFunction;
+    std::map<std::string, uint64_t> byTask;
+    std::map<uint32_t, uint64_t> byPc;
+    std::map<unsigned, uint64_t> byCore;
+    std::map<std::string, uint64_t> folded;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample& sample = samples[i];
+        std::string function = symbolize(symbols, sample.pc);
+        char core[16];
+        snprintf(core, sizeof(core), "core%u", sample.core);
+
+        sampled += sample.count;
+        byFunction[function] += sample.count;
+        byTask[std::string(core) + " " + sample.task] += sample.count;
+        byPc[sample.pc] += sample.count;
+        byCore[sample.core] += sample.count;
+
+        std::string stack = std::string(core) + ";" + sample.task + ";" + function;
+        std::map<uint32_t, Location>::const_iterator location = locations.find(sample.pc);
+        if (location != locations.end()) {
+            // addr2line lists the innermost function first; the last one is
+            // the symbol itself. Repeats and unknowns add nothing.
+            const std::vector<std::string>& chain = location->second.functions;
+            std::string previous = function;
+            for (size_t j = chain.size() > 0 ? chain.size() - 1 : 0; j-- > 0;) {
+                if (chain[j] != previous && chain[j] != "??") {
+                    stack += ";" + chain[j];
+                    previous = chain[j];
+                }
+            }
+        }
+        folded[stack] += sample.count;
+    }
+
+    printf("%lu samples over %lu.%lu s at %lu Hz per core, %lu dropped\n\n", total,
+           elapsedMs / 1000, elapsedMs % 1000 / 100, hz, dropped);
+
+    printf("Tasks (share of the core's samples)\n");
+    std::vector<std::pair<std::string, uint64_t> > tasks = ranked(byTask);
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+                         return atoi(a.first.c_str() + 4) < atoi(b.first.c_str() + 4);
+                     });
+    for (size_t i = 0; i < tasks.size(); i++) {
+        unsigned core = (unsigned)atoi(tasks[i].first.c_str() + 4);
+        printf("  %-24s %8llu %6.1f%%\n", tasks[i].first.c_str(), (unsigned long long)tasks[i].second,
+               100.0 * tasks[i].second / byCore[core]);
+    }
+
+    printf("\nFunctions (share of all samples)\n");
+    std::vector<std::pair<std::string, uint64_t> > functions = ranked(byFunction);
+    for (size_t i = 0; i < functions.size() && i < top; i++) {
+        printf("  %8llu %6.1f%%  %s\n", (unsigned long long)functions[i].second,
+               100.0 * functions[i].second / sampled, functions[i].first.c_str());
+    }
+
+    printf("\nHottest PCs\n");
+    std::vector<std::pair<uint32_t, uint64_t> > pcs = ranked(byPc);
+    for (size_t i = 0; i < pcs.size() && i < top; i++) {
+        std::map<uint32_t, Location>::const_iterator location = locations.find(pcs[i].first);
+        std::string where = symbolize(symbols, pcs[i].first);
+        if (location != locations.end() && !location->second.functions.empty() &&
+            location->second.functions.front() != "??") {
+            where = location->second.functions.front() + "  " + location->second.line;
+        }
+        printf("  %08x %8llu %6.1f%%  %s\n", pcs[i].first, (unsigned long long)pcs[i].second,
+               100.0 * pcs[i].second / sampled, where.c_str());
+    }
+
+    if (foldedPath != NULL) {
+        FILE* out = strcmp(foldedPath, "-") == 0 ? stdout : fopen(foldedPath, "w");
+        if (out == NULL) {
+            fail("cannot write ", foldedPath);
+        }
+        for (std::map<std::string, uint64_t>::const_iterator it = folded.begin(); it != folded.end(); ++it) {
+            fprintf(out, "%s %llu\n", it->first.c_str(), (unsigned long long)it->second);
+        }
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,761 @@
+/**
+ * render.cpp - Offline effect renderer built from the firmware sources
+ *
+ * Links the real DmxPattern effects and the DmxController output stage
+ * (publish, color pass, slew limiting, dithering, idle-frame skipping) against the
+ * host stand-ins in shim/, runs a timed command script on a virtual clock
+ * and writes every output frame to a binary, CSV or PNG dump. The time
+ * each stage takes on the host is reported per frame, so effect math can
+ * be profiled with perf or valgrind without flashing hardware. Trigger
+ * inputs are mocked by the script, so the time from an input edge to the
+ * first frame that shows its action can be measured. Render passes are
+ * held against the frame deadline as on the device; a scripted stall (a
+ * flash write or long parse) shows how the output degrades under load.
+ *
+ * Usage: render [options] [script|-]
+ *   -t SECONDS   Show time to render (default 10)
+ *   -n COUNT     RGBW fixtures at channels 1, 5, 9, ... (default 8)
+ *   -p NAME      Start a pattern at 0 ms (same as the script line "0 pattern NAME")
+ *   -o FILE      Frame dump; the format follows the extension (.bin, .csv, .png)
+ *   -F FORMAT    Dump format when the extension does not say (bin, csv, png)
+ *   -f MS        Output frame period (default 25, as DMX_FRAME_PERIOD_MS)
+ *   -l MS        Render loop period (default 100, as loop() on the device)
+ *   -v           Echo the firmware's Serial output to stderr
+ *
+ * Script lines are "<ms> <command> [args]"; # starts a comment:
+ *   pattern <name> [speed_ms] [cycles]     stop
+ *   color <fixture|all> <r> <g> <b> [w]    cct <kelvin> [level]
+ *   slew <rate|off>                        extract <0-255> [r g b]
+ *   keepalive <ms>                         master <0-255>
+ *   dither <red|green|blue|white|all> <on|off>
+ *   stall <ms>                             The next loop() pass takes this much longer
+ *   triggers <hex>                         A 0xB0-0xB2 trigger configuration downlink
+ *   trigger <input> <level> [bounce_ms]    Set a mocked input's raw level (0/1, or
+ *                                          0-4095 if analog), with contact bounce
+ */
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <chrono>
+#include <vector>
+#include "DmxController.h"
+#include "DmxPattern.h"
+#include "StrobeGenerator.h"
+#include "ColorPipeline.h"
+#include "TriggerEngine.h"
+#include "RenderQos.h"
+
+#define RENDER_DEFAULT_SECONDS 10
+#define RENDER_DEFAULT_FIXTURES 8
+#define RENDER_DEFAULT_FRAME_MS 25
+#define RENDER_DEFAULT_LOOP_MS 100
+#define RENDER_PNG_COLUMN 8          // Pixels per fixture in a PNG strip
+#define RENDER_BOUNCE_STEP_US 700    // Contact bounce: time between chatter edges
+
+// One script command
+struct Command {
+    uint64_t atUs;
+    std::vector<std::string> args;
+};
+
+// Per-frame record
+struct FrameRecord {
+    uint32_t timeMs;
+    bool sent;                 // False: held as idle (fixtures keep the last frame)
+    uint32_t renderNs;         // Effect steps since the previous frame
+    uint32_t outputNs;         // transmitFrame()
+};
+
+static DmxController* dmx = NULL;
+static DmxPattern patterns;
+static StrobeGenerator strobe;   // Never started: edges come from a hardware timer
+static SemaphoreHandle_t dmxMutex = NULL;
+
+// A rule that fired, from the input edge to the first frame showing it
+struct TriggerShot {
+    uint8_t input;
+    uint8_t action;
+    uint64_t edgeUs;
+    uint64_t outputUs;             // UINT64_MAX until a frame differs from before
+    std::vector<uint8_t> before;   // Output when the rule fired
+};
+
+static TriggerEngine triggers;
+static int triggerLevels[TRIGGER_MAX_INPUTS];   // Mocked raw input levels
+static std::vector<TriggerShot> shots;
+static bool urgentPending = false;                 // An action called sendFrameNow()
+
+static RenderQos qos;
+static uint64_t stallUs = 0;                       // Added to the next loop() pass
+
+// Print an error and exit
+static void fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "render: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+// Nanoseconds on the host's monotonic clock
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Split a line on whitespace
+static std::vector<std::string> splitWords(const char* line) {
+    std::vector<std::string> words;
+    std::string word;
+    for (const char* p = line; ; p++) {
+        if (*p == '\0' || *p == '#' || *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+            if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+            if (*p == '\0' || *p == '#') {
+                break;
+            }
+        } else {
+            word += *p;
+        }
+    }
+    return words;
+}
+
+// Read a command script ("-" = stdin)
+static void readScript(const char* path, std::vector<Command>& commands) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == NULL) {
+        fail("cannot open %s", path);
+    }
+
+    char line[512];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        std::vector<std::string> words = splitWords(line);
+        if (words.empty()) {
+            continue;
+        }
+        if (words.size() < 2) {
+            fail("%s:%d: expected \"<ms> <command> [args]\"", path, lineNumber);
+        }
+        Command command;
+        command.atUs = (uint64_t)strtoull(words[0].c_str(), NULL, 10) * 1000;
+        command.args.assign(words.begin() + 1, words.end());
+        commands.push_back(command);
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+}
+
+// Integer argument or a default
+static int argInt(const Command& command, size_t index, int defaultValue) {
+    return index < command.args.size() ? atoi(command.args[index].c_str()) : defaultValue;
+}
+
+// Mocked input levels for the trigger engine
+static int readMockInput(uint8_t input, const TriggerInput& config, void* context) {
+    return triggerLevels[input];
+}
+
+// Carry out a fired rule as applyTrigger() does on the device. Presets and
+// master go out in an urgent frame; effects, stops and cues run where the
+// device hands them to loop(), which the trigger wakes at once.
+static void applyTrigger(const TriggerRule& rule, void* context) {
+    static const uint8_t PRESETS[5][4] = {
+        { 0, 0, 0, 0 }, { 255, 0, 0, 0 }, { 0, 255, 0, 0 }, { 0, 0, 255, 0 }, { 0, 0, 0, 255 }
+    };
+    TriggerShot shot;
+    shot.input = rule.input;
+    shot.action = rule.action;
+    shot.edgeUs = micros() - triggers.getLastLatencyUs();
+    shot.outputUs = UINT64_MAX;
+    shot.before.assign(dmx->getOutputData() + 1, dmx->getOutputData() + 1 + dmx->getHighestChannel());
+    shots.push_back(shot);
+
+    switch (rule.action) {
+        case TRIGGER_ACTION_MASTER:
+            dmx->setMaster(rule.args[0]);
+            dmx->sendFrameNow(dmx->getHighestChannel());
+            urgentPending = true;
+            break;
+        case TRIGGER_ACTION_PRESET: {
+            const uint8_t* c = PRESETS[rule.args[0]];
+            for (int i = 0; i < dmx->getNumFixtures(); i++) {
+                dmx->setFixtureColor(i, c[0], c[1], c[2], c[3]);
+            }
+            dmx->sendFrameNow(dmx->getHighestChannel());
+            urgentPending = true;
+            // The device then stops the effect in loop() and applies the preset again
+            if (patterns.isActive()) {
+                patterns.stop();
+                for (int i = 0; i < dmx->getNumFixtures(); i++) {
+                    dmx->setFixtureColor(i, c[0], c[1], c[2], c[3]);
+                }
+                dmx->sendData();
+            }
+            break;
+        }
+        case TRIGGER_ACTION_EFFECT: {
+            const EffectInfo* effect = DmxPattern::findEffect(rule.args[0]);
+            patterns.start(effect != NULL ? effect : &DmxPattern::EFFECTS[0],
+                           rule.args[2] | (rule.args[3] << 8), rule.args[1]);
+            break;
+        }
+        case TRIGGER_ACTION_STOP:
+            if (patterns.isActive()) {
+                patterns.stop();
+            }
+            break;
+        case TRIGGER_ACTION_CUE:
+            fprintf(stderr, "render: cue %d is a stored downlink and is not rendered on the host\n", rule.args[0]);
+            break;
+    }
+}
+
+// Parse hex bytes, split over any number of words
+static std::vector<uint8_t> parseHex(const Command& command, size_t first) {
+    std::string digits;
+    for (size_t i = first; i < command.args.size(); i++) {
+        digits += command.args[i];
+    }
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < digits.size(); i += 2) {
+        if (!isxdigit((unsigned char)digits[i]) || !isxdigit((unsigned char)digits[i + 1])) {
+            fail("bad hex byte %s", digits.substr(i, 2).c_str());
+        }
+        bytes.push_back((uint8_t)strtoul(digits.substr(i, 2).c_str(), NULL, 16));
+    }
+    if (digits.size() % 2 != 0) {
+        fail("odd number of hex digits in %s", digits.c_str());
+    }
+    return bytes;
+}
+
+// Spread "trigger" lines with contact bounce into the edges a bouncing
+// contact makes: the level chatters, then settles at the one asked for
+static void expandBounce(std::vector<Command>& commands) {
+    size_t count = commands.size();
+    for (size_t c = 0; c < count; c++) {
+        if (commands[c].args[0] != "trigger" || commands[c].args.size() < 4) {
+            continue;
+        }
+        uint64_t bounceUs = (uint64_t)atoi(commands[c].args[3].c_str()) * 1000;
+        commands[c].args.resize(3);
+        Command edge = commands[c];
+        bool settled = atoi(edge.args[2].c_str()) != 0;
+        bool level = settled;
+        for (uint64_t t = RENDER_BOUNCE_STEP_US; t < bounceUs; t += RENDER_BOUNCE_STEP_US) {
+            level = !level;
+            edge.atUs = commands[c].atUs + t;
+            edge.args[2] = level ? "1" : "0";
+            commands.push_back(edge);
+        }
+        if (level != settled) {
+            edge.atUs = commands[c].atUs + bounceUs;
+            edge.args[2] = settled ? "1" : "0";
+            commands.push_back(edge);
+        }
+    }
+}
+
+// Apply one script command, as the matching downlink handler would
+static void applyCommand(const Command& command) {
+    const std::string& name = command.args[0];
+
+    if (name == "pattern") {
+        if (command.args.size() < 2) {
+            fail("pattern needs a name");
+        }
+        const EffectInfo* effect = DmxPattern::findEffect(command.args[1].c_str());
+        if (effect == NULL) {
+            fail("unknown pattern %s", command.args[1].c_str());
+        }
+        if (effect->selfTimed) {
+            fprintf(stderr, "render: %s runs on a hardware timer and is not rendered on the host\n", effect->name);
+        }
+        patterns.start(effect, argInt(command, 2, effect->defaultSpeed), argInt(command, 3, effect->defaultCycles));
+        return;
+    }
+
+    if (name == "stop") {
+        if (patterns.isActive()) {
+            patterns.stop();
+        }
+        return;
+    }
+
+    if (name == "triggers") {
+        std::vector<uint8_t> bytes = parseHex(command, 1);
+        if (bytes.empty() || !triggers.configure(bytes.data(), bytes.size())) {
+            fail("invalid trigger configuration downlink");
+        }
+        return;
+    }
+
+    if (name == "trigger") {
+        int input = argInt(command, 1, -1);
+        if (command.args.size() < 3 || input < 0 || input >= TRIGGER_MAX_INPUTS) {
+            fail("trigger needs <input 0-%d> <level> [bounce_ms]", TRIGGER_MAX_INPUTS - 1);
+        }
+        triggerLevels[input] = argInt(command, 2, 0);
+        triggers.onEdge((uint8_t)input, micros());
+        return;
+    }
+
+    if (name == "stall") {
+        stallUs += (uint64_t)argInt(command, 1, 0) * 1000;
+        return;
+    }
+
+    if (name == "keepalive") {
+        dmx->setKeepaliveInterval(argInt(command, 1, DMX_KEEPALIVE_DEFAULT_MS));
+        return;
+    }
+
+    if (name == "color") {
+        if (command.args.size() < 5) {
+            fail("color needs <fixture|all> <r> <g> <b> [w]");
+        }
+        bool all = command.args[1] == "all";
+        int first = all ? 0 : argInt(command, 1, 0);
+        int last = all ? dmx->getNumFixtures() : first + 1;
+        for (int i = first; i < last; i++) {
+            dmx->setFixtureColor(i, argInt(command, 2, 0), argInt(command, 3, 0), argInt(command, 4, 0), argInt(command, 5, 0));
+        }
+    } else if (name == "cct") {
+        uint8_t r, g, b;
+        ColorPipeline::kelvinToRgb(argInt(command, 1, 3200), argInt(command, 2, 255), r, g, b);
+        for (int i = 0; i < dmx->getNumFixtures(); i++) {
+            dmx->setFixtureColor(i, r, g, b, 0);
+        }
+    } else if (name == "slew") {
+        if (command.args.size() > 1 && command.args[1] == "off") {
+            dmx->clearSlewLimits();
+        } else {
+            for (int role = FIXTURE_ROLE_RED; role <= FIXTURE_ROLE_WHITE; role++) {
+                dmx->setSlewLimitForRole(role, argInt(command, 1, 0));
+            }
+        }
+    } else if (name == "dither") {
+        static const char* roles[] = { "red", "green", "blue", "white" };
+        std::string role = command.args.size() > 1 ? command.args[1] : "all";
+        bool enabled = command.args.size() < 3 || command.args[2] != "off";
+        bool known = role == "all";
+        for (int i = FIXTURE_ROLE_RED; i <= FIXTURE_ROLE_WHITE; i++) {
+            if (role == "all" || role == roles[i]) {
+                dmx->setDitherForRole(i, enabled);
+                known = true;
+            }
+        }
+        if (!known) {
+            fail("dither needs <red|green|blue|white|all> <on|off>");
+        }
+    } else if (name == "master") {
+        dmx->setMaster(argInt(command, 1, 255));
+    } else if (name == "extract") {
+        ColorProfile profile = *dmx->getColorProfile(0);
+        profile.whiteExtract = argInt(command, 1, 255);
+        profile.whitePoint[0] = argInt(command, 2, 255);
+        profile.whitePoint[1] = argInt(command, 3, 255);
+        profile.whitePoint[2] = argInt(command, 4, 255);
+        dmx->setColorProfile(0, profile);
+        dmx->setFixtureColorProfile(-1, 0);
+    } else {
+        fail("unknown command %s", name.c_str());
+    }
+    dmx->sendData();
+}
+
+// Stamp the rules whose effect the frame just sent shows
+static void noteOutput() {
+    const uint8_t* out = dmx->getOutputData() + 1;
+    for (size_t i = 0; i < shots.size(); i++) {
+        TriggerShot& shot = shots[i];
+        if (shot.outputUs == UINT64_MAX && memcmp(out, shot.before.data(), shot.before.size()) != 0) {
+            shot.outputUs = micros();
+        }
+    }
+}
+
+// Run the trigger engine as its task would; an urgent frame an action asked
+// for is sent straight away, as the woken output task does
+static int64_t serviceTriggers(uint32_t frameMs, std::vector<uint32_t>& triggerCosts, size_t& urgentFrames) {
+    uint64_t start = nowNs();
+    size_t fired = shots.size();
+    int64_t waitUs = triggers.service(micros());
+    if (urgentPending) {
+        urgentPending = false;
+        dmx->transmitFrame(frameMs);
+        urgentFrames++;
+        noteOutput();
+    }
+    if (shots.size() > fired) {
+        triggerCosts.push_back((uint32_t)(nowNs() - start));
+    }
+    return waitUs;
+}
+
+// Value at rank p (0-1) of a sorted list
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+// One line of the cost table
+static void printStage(const char* name, std::vector<uint32_t> costsNs) {
+    if (costsNs.empty()) {
+        printf("  %-8s %8d\n", name, 0);
+        return;
+    }
+    std::sort(costsNs.begin(), costsNs.end());
+    double total = 0;
+    for (size_t i = 0; i < costsNs.size(); i++) {
+        total += costsNs[i];
+    }
+    printf("  %-8s %8zu %10.2f %10.2f %10.2f %10.2f\n", name, costsNs.size(),
+           total / costsNs.size() / 1000.0, percentile(costsNs, 0.5) / 1000.0,
+           percentile(costsNs, 0.99) / 1000.0, costsNs.back() / 1000.0);
+}
+
+// Append a big-endian 32-bit value
+static void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+// CRC-32 (PNG chunks)
+static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Append a PNG chunk
+static void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    putU32(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putU32(out, crc32(&out[start], out.size() - start));
+}
+
+// Write an RGB image as PNG (stored deflate blocks: no zlib needed)
+static void writePng(FILE* file, int width, int height, const std::vector<uint8_t>& rgb) {
+    std::vector<uint8_t> raw;
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);  // Filter: none
+        raw.insert(raw.end(), rgb.begin() + (size_t)y * width * 3, rgb.begin() + (size_t)(y + 1) * width * 3);
+    }
+
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t block = min(raw.size() - offset, (size_t)65535);
+        zlib.push_back(offset + block == raw.size() ? 1 : 0);
+        zlib.push_back((uint8_t)block);
+        zlib.push_back((uint8_t)(block >> 8));
+        zlib.push_back((uint8_t)~block);
+        zlib.push_back((uint8_t)(~block >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+        offset += block;
+    } while (offset < raw.size());
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putU32(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    putU32(header, width);
+    putU32(header, height);
+    header.push_back(8);   // Bit depth
+    header.push_back(2);   // RGB
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> out(signature, signature + 8);
+    putChunk(out, "IHDR", header);
+    putChunk(out, "IDAT", zlib);
+    putChunk(out, "IEND", std::vector<uint8_t>());
+    fwrite(out.data(), 1, out.size(), file);
+}
+
+int main(int argc, char** argv) {
+    double seconds = RENDER_DEFAULT_SECONDS;
+    int numFixtures = RENDER_DEFAULT_FIXTURES;
+    int frameMs = RENDER_DEFAULT_FRAME_MS;
+    int loopMs = RENDER_DEFAULT_LOOP_MS;
+    const char* outPath = NULL;
+    std::string format;
+    std::vector<Command> commands;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'v') {
+            shimSerialEcho = true;
+            continue;
+        }
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: render [-t seconds] [-n fixtures] [-p pattern] [-o file] [-F bin|csv|png] "
+                            "[-f frame_ms] [-l loop_ms] [-v] [script|-]\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 't': seconds = atof(value); break;
+            case 'n': numFixtures = atoi(value); break;
+            case 'o': outPath = value; break;
+            case 'F': format = value; break;
+            case 'f': frameMs = max(1, atoi(value)); break;
+            case 'l': loopMs = max(1, atoi(value)); break;
+            case 'p': {
+                Command command;
+                command.atUs = 0;
+                command.args.push_back("pattern");
+                command.args.push_back(value);
+                commands.push_back(command);
+                break;
+            }
+            default: fail("unknown option -%c", option);
+        }
+    }
+    if (arg < argc) {
+        readScript(argv[arg], commands);
+    }
+    expandBounce(commands);
+    if (commands.empty()) {
+        fail("nothing to render: give a script or -p <pattern>");
+    }
+    std::stable_sort(commands.begin(), commands.end(),
+                     [](const Command& a, const Command& b) { return a.atUs < b.atUs; });
+
+    if (format.empty() && outPath != NULL) {
+        const char* dot = strrchr(outPath, '.');
+        format = dot != NULL ? dot + 1 : "bin";
+    }
+    if (!format.empty() && format != "bin" && format != "csv" && format != "png") {
+        fail("unknown format %s", format.c_str());
+    }
+    if (numFixtures < 1 || numFixtures > DmxController::MAX_FIXTURES || numFixtures * 4 > DmxController::MAX_CHANNELS) {
+        fail("fixture count must be 1-%d", min(DmxController::MAX_FIXTURES, DmxController::MAX_CHANNELS / 4));
+    }
+
+    // Same bring-up as setup(): controller, fixtures, player
+    dmx = new DmxController(1, 19, 20, 5);
+    dmx->begin();
+    dmxMutex = xSemaphoreCreateMutex();
+    dmx->initializeFixtures(numFixtures, 4);
+    static char names[DmxController::MAX_FIXTURES][16];  // The controller keeps the pointer
+    for (int i = 0; i < numFixtures; i++) {
+        snprintf(names[i], sizeof(names[i]), "Fixture %d", i + 1);
+        int start = 1 + i * 4;
+        dmx->setFixtureConfig(i, names[i], start, start, start + 1, start + 2, start + 3);
+    }
+    dmx->publishFixtures();
+    patterns.begin(dmx, dmxMutex, &strobe);
+    triggers.setReader(readMockInput, NULL);
+    triggers.begin(applyTrigger, NULL);   // No task on the host: serviced below
+    qos.setBudget((uint32_t)frameMs * 1000);
+
+    int slots = dmx->getHighestChannel();
+    uint64_t frameUs = (uint64_t)frameMs * 1000;
+    uint64_t loopUs = (uint64_t)loopMs * 1000;
+    size_t totalFrames = (size_t)(seconds * 1000 / frameMs);
+    uint64_t baseUs = (uint64_t)millis() * 1000;
+
+    std::vector<FrameRecord> records;
+    std::vector<uint8_t> frames;       // slots bytes per frame
+    std::vector<uint32_t> stepCosts;   // Effect steps that did work
+    std::vector<uint32_t> outputCosts;
+    std::vector<uint32_t> triggerCosts;  // Trigger service passes that fired rules
+    size_t urgentFrames = 0;
+    std::vector<std::pair<uint32_t, uint8_t> > qosChanges;   // Time (ms) and new level
+    records.reserve(totalFrames);
+    frames.reserve(totalFrames * slots);
+
+    // Merge the script, trigger deadlines, loop() ticks and output frames on
+    // the virtual clock; at equal times commands run first, then triggers,
+    // then the render loop, then output
+    size_t nextCommand = 0;
+    uint64_t loopIndex = 0;
+    uint64_t triggerAt = UINT64_MAX;
+    uint64_t loopDelayUs = 0;          // Stalled passes push later ticks back
+    uint32_t pendingRenderNs = 0;
+    while (records.size() < totalFrames) {
+        uint64_t frameAt = records.size() * frameUs;
+        uint64_t loopAt = loopIndex * loopUs + loopDelayUs;
+        uint64_t commandAt = nextCommand < commands.size() ? commands[nextCommand].atUs : UINT64_MAX;
+        uint64_t at = min(min(frameAt, loopAt), min(commandAt, triggerAt));
+        shimSetTimeUs(baseUs + at);
+
+        if (commandAt == at) {
+            const Command& command = commands[nextCommand++];
+            applyCommand(command);
+            if (command.args[0] == "trigger" || command.args[0] == "triggers") {
+                triggerAt = at;   // The edge interrupt wakes the trigger task
+            }
+            continue;
+        }
+
+        if (triggerAt == at) {
+            int64_t waitUs = serviceTriggers(frameMs, triggerCosts, urgentFrames);
+            triggerAt = waitUs == INT64_MAX ? UINT64_MAX : at + max((int64_t)1, waitUs);
+            continue;
+        }
+
+        if (loopAt == at) {
+            loopIndex++;
+            uint32_t cost = 0;
+            bool rendering = patterns.isActive();
+            if (rendering) {
+                uint64_t start = nowNs();
+                patterns.update();
+                cost = (uint32_t)(nowNs() - start);
+                pendingRenderNs += cost;
+                stepCosts.push_back(cost);
+            }
+
+            // Same deadline accounting as endRenderPass() in the firmware
+            uint32_t passUs = (uint32_t)(stallUs + cost / 1000);
+            if (qos.endPass((uint32_t)((at + passUs) / 1000), passUs, cost / 1000, rendering)) {
+                uint8_t level = qos.getLevel();
+                patterns.setRateDivider(level >= QOS_LEVEL_HALF_RATE ? 2 : 1);
+                dmx->setDitherSuspended(level >= QOS_LEVEL_NO_DITHER);
+                dmx->sendData();
+                qosChanges.push_back(std::make_pair((uint32_t)(at / 1000), level));
+            }
+            loopDelayUs += stallUs;
+            stallUs = 0;
+            continue;
+        }
+
+        uint64_t start = nowNs();
+        bool sent = dmx->transmitFrame(frameMs);
+        uint32_t cost = (uint32_t)(nowNs() - start);
+        outputCosts.push_back(cost);
+
+        FrameRecord record = { (uint32_t)(at / 1000), sent, pendingRenderNs, cost };
+        records.push_back(record);
+        pendingRenderNs = 0;
+        const uint8_t* out = dmx->getOutputData();
+        frames.insert(frames.end(), out + 1, out + 1 + slots);
+        noteOutput();
+    }
+
+    // Frame dump
+    if (outPath != NULL) {
+        FILE* file = strcmp(outPath, "-") == 0 ? stdout : fopen(outPath, "wb");
+        if (file == NULL) {
+            fail("cannot write %s", outPath);
+        }
+        if (format == "csv") {
+            fprintf(file, "frame,time_ms,sent,render_us,output_us");
+            for (int ch = 1; ch <= slots; ch++) {
+                fprintf(file, ",ch%d", ch);
+            }
+            fprintf(file, "\n");
+            for (size_t f = 0; f < records.size(); f++) {
+                const FrameRecord& r = records[f];
+                fprintf(file, "%zu,%u,%d,%.2f,%.2f", f, r.timeMs, r.sent ? 1 : 0, r.renderNs / 1000.0, r.outputNs / 1000.0);
+                for (int ch = 0; ch < slots; ch++) {
+                    fprintf(file, ",%u", frames[f * slots + ch]);
+                }
+                fprintf(file, "\n");
+            }
+        } else if (format == "png") {
+            // One row per frame, one block of columns per fixture (white added to RGB)
+            int width = numFixtures * RENDER_PNG_COLUMN;
+            std::vector<uint8_t> rgb((size_t)width * records.size() * 3);
+            for (size_t f = 0; f < records.size(); f++) {
+                for (int i = 0; i < numFixtures; i++) {
+                    const FixtureConfig* fixture = dmx->getFixture(i);
+                    const uint8_t* frame = &frames[f * slots] - 1;  // Index by DMX channel
+                    uint8_t w = frame[fixture->whiteChannel];
+                    uint8_t pixel[3] = {
+                        (uint8_t)min(255, frame[fixture->redChannel] + w),
+                        (uint8_t)min(255, frame[fixture->greenChannel] + w),
+                        (uint8_t)min(255, frame[fixture->blueChannel] + w)
+                    };
+                    for (int x = 0; x < RENDER_PNG_COLUMN; x++) {
+                        memcpy(&rgb[((f * width) + i * RENDER_PNG_COLUMN + x) * 3], pixel, 3);
+                    }
+                }
+            }
+            writePng(file, width, (int)records.size(), rgb);
+        } else {
+            fwrite(frames.data(), 1, frames.size(), file);
+        }
+        if (file != stdout) {
+            fclose(file);
+        }
+    }
+
+    // Summary
+    size_t sent = 0;
+    uint64_t totalNs = 0;
+    for (size_t f = 0; f < records.size(); f++) {
+        sent += records[f].sent ? 1 : 0;
+        totalNs += records[f].renderNs + records[f].outputNs;
+    }
+    FILE* summary = outPath != NULL && strcmp(outPath, "-") == 0 ? stderr : stdout;
+    fprintf(summary, "Rendered %zu frames (%.1f s at %d ms), %d fixtures, %d slots per frame\n",
+            records.size(), records.size() * frameMs / 1000.0, frameMs, numFixtures, slots);
+    fprintf(summary, "  %zu sent, %zu held as idle, %zu effect steps\n",
+            sent, records.size() - sent, stepCosts.size());
+    if (!shots.empty()) {
+        std::vector<uint32_t> latencies;
+        for (size_t i = 0; i < shots.size(); i++) {
+            if (shots[i].outputUs != UINT64_MAX) {
+                latencies.push_back((uint32_t)(shots[i].outputUs - shots[i].edgeUs));
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        fprintf(summary, "  %zu trigger rules fired (%u edges dropped), %zu urgent frames\n",
+                shots.size(), (unsigned)triggers.getDroppedEdges(), urgentFrames);
+        fprintf(summary, "  edge to output: p50 %.1f ms, max %.1f ms, %zu with no visible change\n",
+                percentile(latencies, 0.5) / 1000.0, latencies.empty() ? 0.0 : latencies.back() / 1000.0,
+                shots.size() - latencies.size());
+    }
+    if (qos.getMisses() > 0 || !qosChanges.empty()) {
+        fprintf(summary, "  %u deadline misses in %u render passes (max pass %.1f ms)\n",
+                (unsigned)qos.getMisses(), (unsigned)qos.getPasses(), qos.getMaxPassUs() / 1000.0);
+        for (size_t i = 0; i < qosChanges.size(); i++) {
+            fprintf(summary, "  QoS level %u (%s) at %u ms\n", qosChanges[i].second,
+                    RenderQos::getLevelName(qosChanges[i].second), qosChanges[i].first);
+        }
+    }
+    fflush(summary);
+    if (summary == stdout) {
+        printf("  %-8s %8s %10s %10s %10s %10s\n", "stage", "calls", "mean_us", "p50_us", "p99_us", "max_us");
+        printStage("render", stepCosts);
+        printStage("output", outputCosts);
+        if (!shots.empty()) {
+            printStage("trigger", triggerCosts);
+        }
+        printf("  host CPU %.2f ms for %.1f s of show\n", totalNs / 1e6, records.size() * frameMs / 1000.0);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * Arduino.h - Host stand-in for the parts of the Arduino core the DMX
+ * libraries use
+ *
+ * Time is virtual: millis(), micros() and delay() follow a clock the host
+ * program advances with shimAdvanceUs(), so seconds of show time render in
+ * milliseconds and every run is repeatable. esp_timer_get_time() stays on
+ * the real monotonic clock, so the libraries' own cost counters measure
+ * real CPU time. Serial output is dropped unless shimSerialEcho is set.
+ *
+ * A host that runs several firmware instances gives each one a context
+ * (its own clock and Preferences store) and selects it before running
+ * that instance's code.
+ */
+
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 0x05
+#define HEX 16
+#define DEC 10
+#define SERIAL_8N1 0x800001c
+#define SERIAL_8N2 0x800003c
+#define IRAM_ATTR
+
+typedef uint8_t byte;
+
+// Virtual clock
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void shimAdvanceUs(uint64_t us);
+void shimSetTimeUs(uint64_t us);
+
+// Per-instance clock and flash; the default context is selected at start
+struct ShimContext;
+ShimContext* shimCreateContext();
+void shimSelectContext(ShimContext* context);
+
+// Echo Serial output to stderr
+extern bool shimSerialEcho;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+#define digitalPinToAnalogChannel(pin) (((pin) >= 1 && (pin) <= 20) ? (pin) - 1 : -1)  // ESP32-S3 ADC1/ADC2
+
+class String {
+public:
+    String(const char* text = "") : _s(text != NULL ? text : "") {}
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return (unsigned int)_s.size(); }
+    String& operator+=(char c) { _s += c; return *this; }
+    String& operator+=(const char* text) { _s += text; return *this; }
+    String& operator+=(const String& other) { _s += other._s; return *this; }
+    bool operator==(const char* text) const { return _s == text; }
+
+private:
+    std::string _s;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+
+    size_t print(const char* text);
+    size_t print(const String& text) { return print(text.c_str()); }
+    size_t print(char c);
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+    size_t println() { return print("\n"); }
+    template <typename T> size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+public:
+    explicit HardwareSerial(bool console) : _console(console), _bytesWritten(0) {}
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {}
+    void end() {}
+    size_t setRxBufferSize(size_t size) { return size; }
+    void updateBaudRate(unsigned long baud) {}
+    void flush() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t value);
+    using Print::write;
+    uint64_t getBytesWritten() const { return _bytesWritten; }
+
+private:
+    bool _console;            // Serial: text to stderr when echoing; UARTs count bytes
+    uint64_t _bytesWritten;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif // SHIM_ARDUINO_H
@@ -0,0 +1,30 @@
+/**
+ * Preferences.h - Host stand-in for NVS preferences, kept in memory
+ */
+
+#ifndef SHIM_PREFERENCES_H
+#define SHIM_PREFERENCES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end() {}
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    bool clear();
+    size_t putInt(const char* key, int32_t value);
+    int32_t getInt(const char* key, int32_t defaultValue = 0);
+    size_t putBytes(const char* key, const void* value, size_t length);
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+
+private:
+    std::string _name;
+    std::string path(const char* key) const { return _name + "/" + key; }
+};
+
+#endif // SHIM_PREFERENCES_H
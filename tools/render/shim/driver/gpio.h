@@ -0,0 +1,30 @@
+/**
+ * gpio.h - Host stand-in for the ESP-IDF GPIO interrupt calls (no-ops)
+ */
+
+#ifndef SHIM_DRIVER_GPIO_H
+#define SHIM_DRIVER_GPIO_H
+
+#include "esp_timer.h"
+
+#define GPIO_PIN_COUNT 49
+#define GPIO_IS_VALID_GPIO(pin) ((pin) >= 0 && (pin) < GPIO_PIN_COUNT && ((pin) < 22 || (pin) > 25))  // ESP32-S3
+
+typedef int gpio_num_t;
+typedef void (*gpio_isr_t)(void* arg);
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE
+} gpio_int_type_t;
+
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void* arg);
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type);
+esp_err_t gpio_intr_enable(gpio_num_t pin);
+esp_err_t gpio_reset_pin(gpio_num_t pin);
+
+#endif // SHIM_DRIVER_GPIO_H
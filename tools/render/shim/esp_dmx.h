@@ -0,0 +1,23 @@
+/**
+ * esp_dmx.h - Host stand-in for the esp_dmx declarations DmxController uses
+ */
+
+#ifndef SHIM_ESP_DMX_H
+#define SHIM_ESP_DMX_H
+
+typedef int dmx_port_t;
+
+typedef struct {
+    int interrupt_flags;
+} dmx_config_t;
+
+#define DMX_CONFIG_DEFAULT { 0 }
+
+typedef struct {
+    int footprint;
+    char description[33];
+} dmx_personality_t;
+
+bool dmx_driver_delete(dmx_port_t port);
+
+#endif // SHIM_ESP_DMX_H
@@ -0,0 +1,12 @@
+/**
+ * esp_rom_gpio.h - Host stand-in for GPIO matrix routing (no-op)
+ */
+
+#ifndef SHIM_ESP_ROM_GPIO_H
+#define SHIM_ESP_ROM_GPIO_H
+
+#include <stdint.h>
+
+void esp_rom_gpio_connect_in_signal(uint32_t pin, uint32_t signal, bool invert);
+
+#endif // SHIM_ESP_ROM_GPIO_H
@@ -0,0 +1,45 @@
+/**
+ * FreeRTOS.h - Host stand-in for the FreeRTOS calls the DMX libraries make
+ *
+ * The host renderer is single-threaded: mutexes always succeed, critical
+ * sections are empty and task creation fails. vTaskDelay() advances the
+ * virtual clock.
+ */
+
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef struct { int unused; } portMUX_TYPE;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define configMAX_PRIORITIES 25
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void*), const char* name, uint32_t stack, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken);
+void vTaskDelay(TickType_t ticks);
+
+#endif // SHIM_FREERTOS_H
@@ -0,0 +1,221 @@
+/**
+ * shim.cpp - Host implementations behind the stand-in headers
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_dmx.h>
+#include <esp_timer.h>
+#include <esp_rom_gpio.h>
+#include <driver/gpio.h>
+#include <soc/gpio_periph.h>
+#include <soc/uart_periph.h>
+#include <stdarg.h>
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Clock and Preferences store of one firmware instance
+struct ShimContext {
+    uint64_t clockUs;
+    std::map<std::string, std::vector<uint8_t> > store;
+
+    ShimContext() : clockUs(0) {}
+};
+
+static ShimContext shimDefaultContext;
+static ShimContext* shimContext = &shimDefaultContext;
+bool shimSerialEcho = false;
+
+HardwareSerial Serial(true);
+HardwareSerial Serial1(false);
+
+ShimContext* shimCreateContext() { return new ShimContext(); }
+void shimSelectContext(ShimContext* context) { shimContext = context != NULL ? context : &shimDefaultContext; }
+
+// Virtual clock
+unsigned long millis() { return (unsigned long)(shimContext->clockUs / 1000); }
+unsigned long micros() { return (unsigned long)shimContext->clockUs; }
+void delay(unsigned long ms) { shimContext->clockUs += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { shimContext->clockUs += us; }
+void shimAdvanceUs(uint64_t us) { shimContext->clockUs += us; }
+void shimSetTimeUs(uint64_t us) { shimContext->clockUs = us; }
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return LOW; }
+int analogRead(uint8_t pin) { return 0; }
+
+// Print: everything funnels into write()
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        write(buffer[i]);
+    }
+    return size;
+}
+
+size_t Print::print(const char* text) {
+    return write((const uint8_t*)text, strlen(text));
+}
+
+size_t Print::print(char c) {
+    return write((uint8_t)c);
+}
+
+size_t Print::print(long value, int base) {
+    char text[40];
+    if (base == HEX) {
+        snprintf(text, sizeof(text), "%lX", value);
+    } else {
+        snprintf(text, sizeof(text), "%ld", value);
+    }
+    return print(text);
+}
+
+size_t Print::print(unsigned long value, int base) {
+    char text[40];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+    return print(text);
+}
+
+size_t Print::print(double value, int digits) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return print(text);
+}
+
+size_t Print::printf(const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    return print(text);
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+    _bytesWritten++;
+    if (_console && shimSerialEcho) {
+        fputc(value, stderr);
+    }
+    return 1;
+}
+
+// FreeRTOS: single-threaded
+static int shimSemaphore;
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return &shimSemaphore; }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return &shimSemaphore; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void*), const char* name, uint32_t stack, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    if (handle != NULL) {
+        *handle = NULL;
+    }
+    return pdFAIL;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) { return 0; }
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {}
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+// esp_timer: real clock, timers never fire
+struct shim_esp_timer {
+    int unused;
+};
+static shim_esp_timer shimTimer;
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    *handle = &shimTimer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) { return ESP_OK; }
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) { return ESP_OK; }
+
+// esp_dmx
+bool dmx_driver_delete(dmx_port_t port) { return true; }
+
+// GPIO and UART routing: nothing to route on a host
+const uint32_t GPIO_PIN_MUX_REG[64] = { 0 };
+const uart_signal_conn_t uart_periph_signal[3] = { { 0, 0 }, { 0, 0 }, { 0, 0 } };
+
+esp_err_t gpio_install_isr_service(int flags) { return ESP_OK; }
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void* arg) { return ESP_FAIL; }
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin) { return ESP_OK; }
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) { return ESP_OK; }
+esp_err_t gpio_intr_enable(gpio_num_t pin) { return ESP_OK; }
+esp_err_t gpio_reset_pin(gpio_num_t pin) { return ESP_OK; }
+void esp_rom_gpio_connect_in_signal(uint32_t pin, uint32_t signal, bool invert) {}
+
+// Preferences: one in-memory store per context, shared by its namespaces
+static std::map<std::string, std::vector<uint8_t> >& shimStore() {
+    return shimContext->store;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    _name = name;
+    return true;
+}
+
+bool Preferences::isKey(const char* key) {
+    return shimStore().count(path(key)) != 0;
+}
+
+bool Preferences::remove(const char* key) {
+    return shimStore().erase(path(key)) != 0;
+}
+
+bool Preferences::clear() {
+    std::string prefix = _name + "/";
+    std::map<std::string, std::vector<uint8_t> >& store = shimStore();
+    for (std::map<std::string, std::vector<uint8_t> >::iterator it = store.begin(); it != store.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            store.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    return true;
+}
+
+size_t Preferences::putInt(const char* key, int32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+int32_t Preferences::getInt(const char* key, int32_t defaultValue) {
+    int32_t value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)value;
+    shimStore()[path(key)] = std::vector<uint8_t>(bytes, bytes + length);
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    std::map<std::string, std::vector<uint8_t> >::iterator it = shimStore().find(path(key));
+    return it == shimStore().end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    std::map<std::string, std::vector<uint8_t> >::iterator it = shimStore().find(path(key));
+    if (it == shimStore().end() || it->second.size() > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, it->second.data(), it->second.size());
+    return it->second.size();
+}
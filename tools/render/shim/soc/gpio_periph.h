@@ -0,0 +1,13 @@
+/**
+ * gpio_periph.h - Host stand-in for the IO MUX registers
+ */
+
+#ifndef SHIM_SOC_GPIO_PERIPH_H
+#define SHIM_SOC_GPIO_PERIPH_H
+
+#include <stdint.h>
+
+extern const uint32_t GPIO_PIN_MUX_REG[];
+#define PIN_INPUT_ENABLE(reg) ((void)(reg))
+
+#endif // SHIM_SOC_GPIO_PERIPH_H
@@ -0,0 +1,17 @@
+/**
+ * uart_periph.h - Host stand-in for the UART signal table
+ */
+
+#ifndef SHIM_SOC_UART_PERIPH_H
+#define SHIM_SOC_UART_PERIPH_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t tx_sig;
+    uint32_t rx_sig;
+} uart_signal_conn_t;
+
+extern const uart_signal_conn_t uart_periph_signal[];
+
+#endif // SHIM_SOC_UART_PERIPH_H
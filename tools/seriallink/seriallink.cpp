@@ -0,0 +1,639 @@
+/**
+ * seriallink.cpp - Host side of the USB serial control link
+ *
+ * Talks the binary protocol of lib/SerialLink to a node on a serial port:
+ * run commands, stream frames at up to 44 Hz and read telemetry and the
+ * on-air frame back. "emulate" opens a pseudo-terminal that answers like a
+ * node, using the firmware's own decoder, so the tool and the protocol can
+ * be exercised on a Linux host without hardware.
+ *
+ * Usage: seriallink [options] PORT COMMAND [args]
+ *        seriallink [options] emulate
+ *   -b BAUD     Port rate (default 115200)
+ *   -B BAUD     Switch the node and the port to this rate first; the node
+ *               falls back to 115200 after 3 s without messages
+ *   -r HZ       Stream rate (default 44)
+ *   -s SECONDS  Stream length (default: the whole file, or 10 s of chase)
+ *   -w SLOTS    Slots per frame of a stream file (default 512)
+ *   -c CHANNEL  First channel of streamed frames (default 1)
+ *   -L          Loop the stream file
+ *   -v          Print the node's log output
+ *
+ * Commands:
+ *   ping [COUNT]          Round trips with min/mean/max time
+ *   send JSON             Run a command as if it came over LoRa
+ *   sendhex HEX           Same, for a binary downlink payload
+ *   telemetry             Counters of the node and the link
+ *   read START COUNT      On-air slot values
+ *   stream FILE|chase     Stream raw frames (e.g. a tools/render .bin dump)
+ *                         or a chase across -w slots
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "SerialLink.h"
+
+#define LINK_DEFAULT_BAUD 115200
+#define LINK_DEFAULT_RATE 44
+#define LINK_DEFAULT_CHASE_SECONDS 10
+#define LINK_REPLY_TIMEOUT_MS 1000
+#define LINK_MAX_SLOTS 512
+
+static bool verbose = false;
+static volatile bool stopRequested = false;
+
+// Print an error and exit
+static void fail(const char* message, const char* detail = "") {
+    fprintf(stderr, "seriallink: %s%s\n", message, detail);
+    exit(1);
+}
+
+// Monotonic milliseconds
+static uint32_t nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+// termios constant of a baud rate
+static speed_t speedOf(long baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        case 3000000: return B3000000;
+        default: fail("unsupported baud rate"); return B0;
+    }
+}
+
+// Raw 8N1 mode at a given rate
+static void setRaw(int fd, long baud) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        fail("not a terminal: ", strerror(errno));
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~CRTSCTS;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speedOf(baud));
+    cfsetospeed(&tio, speedOf(baud));
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        fail("cannot configure the port: ", strerror(errno));
+    }
+}
+
+// Write all bytes
+static void writeAll(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno != EINTR && errno != EAGAIN) {
+            fail("write failed: ", strerror(errno));
+        }
+        if (written > 0) {
+            data += written;
+            length -= written;
+        } else {
+            struct pollfd wait = { fd, POLLOUT, 0 };
+            poll(&wait, 1, 100);
+        }
+    }
+}
+
+// Little-endian fields
+static void putU16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t getU16(const uint8_t* data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+// A serial port speaking the link protocol
+class LinkPort {
+public:
+    explicit LinkPort(int fd) : _fd(fd), _sequence(0) {}
+
+    // Send a message; returns its sequence number
+    uint8_t send(uint8_t type, const uint8_t* payload, size_t length) {
+        uint8_t frame[SERIAL_LINK_MAX_ENCODED];
+        uint8_t sequence = _sequence++;
+        size_t encoded = serialLinkEncode(type, sequence, payload, length, frame);
+        if (encoded == 0) {
+            fail("payload too long");
+        }
+        writeAll(_fd, frame, encoded);
+        return sequence;
+    }
+
+    // Send a request and wait for its reply; returns the status
+    // (the data after it lands in reply) or -1 on timeout
+    int request(uint8_t type, const uint8_t* payload, size_t length, std::vector<uint8_t>* reply = NULL) {
+        uint8_t sequence = send(type, payload, length);
+        uint32_t start = nowMs();
+        while (nowMs() - start < LINK_REPLY_TIMEOUT_MS) {
+            SerialLinkMessage message;
+            if (!receive(message, LINK_REPLY_TIMEOUT_MS - (nowMs() - start))) {
+                continue;
+            }
+            if (message.type != (type | SERIAL_LINK_REPLY) || message.sequence != sequence || message.length < 1) {
+                continue;  // Late reply to an earlier request
+            }
+            if (reply != NULL) {
+                reply->assign(message.payload + 1, message.payload + message.length);
+            }
+            return message.payload[0];
+        }
+        return -1;
+    }
+
+    // Read until a message arrives or the time is up. Text between
+    // messages is the node's log; it is printed once the next delimiter
+    // shows it is not the start of a frame.
+    bool receive(SerialLinkMessage& message, uint32_t timeoutMs) {
+        uint32_t start = nowMs();
+        for (;;) {
+            // Complete chunks already buffered
+            while (!_pending.empty()) {
+                std::vector<uint8_t>::iterator zero = std::find(_pending.begin(), _pending.end(), 0);
+                if (zero == _pending.end()) {
+                    break;
+                }
+                _chunk.assign(_pending.begin(), zero);
+                _pending.erase(_pending.begin(), zero + 1);
+                if (_chunk.empty()) {
+                    continue;
+                }
+                if (serialLinkDecode(_chunk.data(), _chunk.size(), message)) {
+                    return true;
+                }
+                printLog(_chunk);
+            }
+
+            uint32_t elapsed = nowMs() - start;
+            if (elapsed >= timeoutMs) {
+                return false;
+            }
+            struct pollfd wait = { _fd, POLLIN, 0 };
+            if (poll(&wait, 1, (int)(timeoutMs - elapsed)) <= 0) {
+                continue;
+            }
+            uint8_t data[1024];
+            ssize_t got = read(_fd, data, sizeof(data));
+            if (got < 0 && errno != EAGAIN && errno != EINTR) {
+                fail("read failed: ", strerror(errno));
+            }
+            if (got > 0) {
+                _pending.insert(_pending.end(), data, data + got);
+            }
+        }
+    }
+
+    // Print whatever is still buffered as log
+    void flushLog() {
+        printLog(_pending);
+        _pending.clear();
+    }
+
+    int fd() const { return _fd; }
+
+private:
+    int _fd;
+    uint8_t _sequence;
+    std::vector<uint8_t> _pending;
+    std::vector<uint8_t> _chunk;
+
+    static void printLog(const std::vector<uint8_t>& text) {
+        if (verbose) {
+            fwrite(text.data(), 1, text.size(), stderr);
+        }
+    }
+};
+
+// Human-readable reply status
+static const char* statusName(int status) {
+    switch (status) {
+        case -1: return "no reply";
+        case SERIAL_LINK_OK: return "ok";
+        case SERIAL_LINK_FAILED: return "failed";
+        case SERIAL_LINK_BAD_REQUEST: return "bad request";
+        case SERIAL_LINK_UNKNOWN: return "unknown message";
+        case SERIAL_LINK_NOT_READY: return "DMX not running";
+        default: return "?";
+    }
+}
+
+// Request and check for SERIAL_LINK_OK
+static void requireOk(LinkPort& port, uint8_t type, const uint8_t* payload, size_t length,
+                      std::vector<uint8_t>* reply = NULL) {
+    int status = port.request(type, payload, length, reply);
+    if (status != SERIAL_LINK_OK) {
+        fail("node answered: ", statusName(status));
+    }
+}
+
+// Fetch and print the telemetry
+static SerialLinkTelemetry printTelemetry(LinkPort& port) {
+    std::vector<uint8_t> reply;
+    requireOk(port, SERIAL_LINK_TELEMETRY, NULL, 0, &reply);
+    SerialLinkTelemetry t;
+    if (!serialLinkGetTelemetry(reply.data(), reply.size(), t)) {
+        fail("short telemetry reply");
+    }
+    printf("uptime %lu.%03lu s, free heap %lu\n", (unsigned long)(t.uptimeMs / 1000),
+           (unsigned long)(t.uptimeMs % 1000), (unsigned long)t.freeHeap);
+    printf("DMX %s, %u fixtures, highest channel %u, %lu frames sent, %lu idle%s\n",
+           (t.flags & 0x01) ? "running" : "off", t.fixtures, t.highestChannel, (unsigned long)t.framesSent,
+           (unsigned long)t.framesSkipped, (t.flags & 0x04) ? ", pattern active" : "");
+    printf("LoRa %s, last downlink RSSI %d dBm, SNR %d dB\n", (t.flags & 0x02) ? "joined" : "not joined",
+           t.rssi, t.snr);
+    printf("link %lu messages, %lu bad frames, %lu frames applied\n", (unsigned long)t.linkMessages,
+           (unsigned long)t.linkErrors, (unsigned long)t.linkFrames);
+    return t;
+}
+
+// Stream frames at a fixed rate
+static void stream(LinkPort& port, const char* source, double rate, double seconds, int slots, int channel,
+                   bool loop, long baud) {
+    std::vector<uint8_t> frames;
+    bool chase = strcmp(source, "chase") == 0;
+    if (!chase) {
+        FILE* file = strcmp(source, "-") == 0 ? stdin : fopen(source, "rb");
+        if (file == NULL) {
+            fail("cannot open ", source);
+        }
+        uint8_t chunk[4096];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            frames.insert(frames.end(), chunk, chunk + got);
+        }
+        if (file != stdin) {
+            fclose(file);
+        }
+        if (frames.size() < (size_t)slots) {
+            fail("stream file is shorter than one frame");
+        }
+    }
+    size_t frameCount = chase ? 0 : frames.size() / slots;
+    if (seconds <= 0) {
+        seconds = chase || loop ? LINK_DEFAULT_CHASE_SECONDS : frameCount / rate;
+    }
+
+    // Each byte is 10 bits on the wire; COBS and the header add about 10
+    double needed = rate * (slots + 10) * 10;
+    if (needed > baud) {
+        fprintf(stderr, "seriallink: %d-slot frames at %.0f Hz need %.0f baud; frames will back up (use -B 921600)\n",
+                slots, rate, needed);
+    }
+
+    SerialLinkTelemetry before;
+    std::vector<uint8_t> reply;
+    requireOk(port, SERIAL_LINK_TELEMETRY, NULL, 0, &reply);
+    serialLinkGetTelemetry(reply.data(), reply.size(), before);
+
+    uint8_t payload[2 + LINK_MAX_SLOTS];
+    putU16(payload, (uint16_t)channel);
+    long total = (long)(seconds * rate + 0.5);
+    long periodNs = (long)(1e9 / rate);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint32_t started = nowMs();
+    long sent = 0;
+    for (; sent < total && !stopRequested; sent++) {
+        if (chase) {
+            for (int i = 0; i < slots; i++) {
+                payload[2 + i] = (uint8_t)(i == sent % slots ? 255 : 0);
+            }
+        } else {
+            size_t index = sent % frameCount;
+            if (!loop && sent >= (long)frameCount) {
+                break;
+            }
+            memcpy(payload + 2, &frames[index * slots], slots);
+        }
+        port.send(SERIAL_LINK_FRAME, payload, 2 + slots);
+
+        // Drain the log so the node never blocks on a full output buffer
+        SerialLinkMessage ignored;
+        port.receive(ignored, 0);
+
+        next.tv_nsec += periodNs;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    uint32_t elapsed = nowMs() - started;
+    tcdrain(port.fd());
+
+    SerialLinkTelemetry after;
+    requireOk(port, SERIAL_LINK_TELEMETRY, NULL, 0, &reply);
+    serialLinkGetTelemetry(reply.data(), reply.size(), after);
+    printf("sent %ld frames in %.2f s (%.1f Hz); node applied %lu, %lu bad frames\n", sent, elapsed / 1000.0,
+           elapsed ? sent * 1000.0 / elapsed : 0.0, (unsigned long)(after.linkFrames - before.linkFrames),
+           (unsigned long)(after.linkErrors - before.linkErrors));
+}
+
+// Node stand-in behind a pseudo-terminal
+class Emulator : public SerialLinkHandler {
+public:
+    explicit Emulator(int fd) : _fd(fd), _decoder(this), _frames(0), _started(nowMs()) {
+        memset(_frame, 0, sizeof(_frame));
+    }
+
+    void run() {
+        while (!stopRequested) {
+            struct pollfd wait = { _fd, POLLIN, 0 };
+            if (poll(&wait, 1, 200) <= 0) {
+                continue;
+            }
+            uint8_t data[1024];
+            ssize_t got = read(_fd, data, sizeof(data));
+            if (got > 0) {
+                _decoder.feed(data, got, nowMs());
+            } else if (got < 0 && errno == EIO) {
+                usleep(100000);   // No client has the port open
+            }
+        }
+    }
+
+    void onMessage(const SerialLinkMessage& message) override {
+        uint8_t reply[SERIAL_LINK_MAX_PAYLOAD];
+        size_t length = 0;
+        reply[length++] = SERIAL_LINK_OK;
+
+        switch (message.type) {
+            case SERIAL_LINK_PING:
+                memcpy(reply + 1, message.payload, std::min(message.length, sizeof(reply) - 1));
+                length += std::min(message.length, sizeof(reply) - 1);
+                break;
+            case SERIAL_LINK_COMMAND:
+                // The firmware logs while it handles the command, before the reply
+                printf("command:");
+                for (size_t i = 0; i < message.length; i++) {
+                    printf(" %02x", message.payload[i]);
+                }
+                printf("\n");
+                fflush(stdout);
+                log("[emulate] command handled\r\n");
+                break;
+            case SERIAL_LINK_FRAME: {
+                uint16_t start = message.length >= 2 ? getU16(message.payload) : 0;
+                size_t count = message.length >= 2 ? message.length - 2 : 0;
+                if (start >= 1 && start + count - 1 <= LINK_MAX_SLOTS) {
+                    memcpy(_frame + start, message.payload + 2, count);
+                    _frames++;
+                }
+                return;
+            }
+            case SERIAL_LINK_TELEMETRY: {
+                SerialLinkTelemetry t;
+                memset(&t, 0, sizeof(t));
+                t.uptimeMs = nowMs() - _started;
+                t.framesSent = t.uptimeMs / 25;
+                t.linkMessages = _decoder.getMessages();
+                t.linkErrors = _decoder.getErrors();
+                t.linkFrames = _frames;
+                t.highestChannel = LINK_MAX_SLOTS;
+                t.flags = 0x01;
+                serialLinkPutTelemetry(t, reply + 1);
+                length += SERIAL_LINK_TELEMETRY_SIZE;
+                break;
+            }
+            case SERIAL_LINK_READ: {
+                uint16_t start = message.length >= 4 ? getU16(message.payload) : 0;
+                uint16_t count = message.length >= 4 ? getU16(message.payload + 2) : 0;
+                if (start < 1 || count == 0 || start + count - 1 > LINK_MAX_SLOTS) {
+                    reply[0] = SERIAL_LINK_BAD_REQUEST;
+                    break;
+                }
+                putU16(reply + 1, start);
+                memcpy(reply + 3, _frame + start, count);
+                length += 2 + count;
+                break;
+            }
+            case SERIAL_LINK_BAUD:
+                break;   // A pseudo-terminal has no rate
+            default:
+                reply[0] = SERIAL_LINK_UNKNOWN;
+                break;
+        }
+        uint8_t frame[SERIAL_LINK_MAX_ENCODED];
+        writeAll(_fd, frame, serialLinkEncode(message.type | SERIAL_LINK_REPLY, message.sequence, reply, length, frame));
+    }
+
+    void onLine(const char* line) override {
+        printf("console: %s\n", line);
+        fflush(stdout);
+    }
+
+private:
+    int _fd;
+    SerialLinkDecoder _decoder;
+    uint8_t _frame[1 + LINK_MAX_SLOTS];
+    uint32_t _frames;
+    uint32_t _started;
+
+    // Unframed text, like the firmware's Serial.print output
+    void log(const char* text) {
+        writeAll(_fd, (const uint8_t*)text, strlen(text));
+    }
+};
+
+// Open a pseudo-terminal and answer on it until interrupted
+static int emulate() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fail("cannot create a pseudo-terminal: ", strerror(errno));
+    }
+    const char* path = ptsname(master);
+    // Keep the slave open in raw mode so the line discipline passes bytes
+    // through and the master does not see a hangup between clients
+    int slave = open(path, O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        fail("cannot open ", path);
+    }
+    setRaw(slave, LINK_DEFAULT_BAUD);
+    printf("%s\n", path);
+    fflush(stdout);
+
+    Emulator emulator(master);
+    emulator.run();
+    close(slave);
+    close(master);
+    return 0;
+}
+
+// Parse a hex string
+static std::vector<uint8_t> parseHex(const char* text) {
+    std::vector<uint8_t> out;
+    size_t length = strlen(text);
+    if (length == 0 || length % 2 != 0) {
+        fail("hex payload must have an even number of digits");
+    }
+    for (size_t i = 0; i < length; i += 2) {
+        char pair[3] = { text[i], text[i + 1], 0 };
+        char* end;
+        out.push_back((uint8_t)strtol(pair, &end, 16));
+        if (*end != '\0') {
+            fail("not a hex payload: ", text);
+        }
+    }
+    return out;
+}
+
+static void onSignal(int) {
+    stopRequested = true;
+}
+
+int main(int argc, char** argv) {
+    long baud = LINK_DEFAULT_BAUD;
+    long linkBaud = 0;
+    double rate = LINK_DEFAULT_RATE;
+    double seconds = 0;
+    int slots = LINK_MAX_SLOTS;
+    int channel = 1;
+    bool loop = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++) {
+        char option = argv[arg][1];
+        if (option == 'v' || option == 'L') {
+            (option == 'v' ? verbose : loop) = true;
+            continue;
+        }
+        if (option == 'h' || arg + 1 >= argc) {
+            fprintf(stderr, "usage: seriallink [-b baud] [-B baud] [-r hz] [-s seconds] [-w slots] [-c channel] [-L] [-v] "
+                            "PORT ping|send|sendhex|telemetry|read|stream [args]\n"
+                            "       seriallink emulate\n");
+            return option == 'h' ? 0 : 1;
+        }
+        const char* value = argv[++arg];
+        switch (option) {
+            case 'b': baud = atol(value); break;
+            case 'B': linkBaud = atol(value); break;
+            case 'r': rate = atof(value); break;
+            case 's': seconds = atof(value); break;
+            case 'w': slots = atoi(value); break;
+            case 'c': channel = atoi(value); break;
+            default: fail("unknown option ", argv[arg - 1]);
+        }
+    }
+    if (rate <= 0 || rate > 1000 || slots < 1 || slots > LINK_MAX_SLOTS || channel < 1 ||
+        channel + slots - 1 > LINK_MAX_SLOTS) {
+        fail("rate must be 0-1000 Hz and the frame must fit channels 1-512");
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    if (arg < argc && strcmp(argv[arg], "emulate") == 0) {
+        return emulate();
+    }
+    if (arg + 1 >= argc) {
+        fail("a port and a command are required (-h for help)");
+    }
+    const char* path = argv[arg++];
+    std::string command = argv[arg++];
+
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        fail("cannot open ", path);
+    }
+    setRaw(fd, baud);
+    tcflush(fd, TCIFLUSH);
+    LinkPort port(fd);
+
+    // Start on a frame boundary even if the console holds a partial line
+    const uint8_t delimiter = 0;
+    writeAll(fd, &delimiter, 1);
+
+    if (linkBaud != 0) {
+        uint8_t payload[4] = { (uint8_t)linkBaud, (uint8_t)(linkBaud >> 8), (uint8_t)(linkBaud >> 16),
+                               (uint8_t)(linkBaud >> 24) };
+        requireOk(port, SERIAL_LINK_BAUD, payload, sizeof(payload));
+        tcdrain(fd);
+        setRaw(fd, linkBaud);
+        baud = linkBaud;
+    }
+
+    if (command == "ping") {
+        int count = arg < argc ? atoi(argv[arg]) : 4;
+        uint32_t minMs = 0xFFFFFFFFUL, maxMs = 0, totalMs = 0;
+        int answered = 0;
+        for (int i = 0; i < count && !stopRequested; i++) {
+            uint8_t payload[32];
+            for (size_t j = 0; j < sizeof(payload); j++) {
+                payload[j] = (uint8_t)(i + j);
+            }
+            std::vector<uint8_t> reply;
+            uint32_t start = nowMs();
+            int status = port.request(SERIAL_LINK_PING, payload, sizeof(payload), &reply);
+            uint32_t elapsed = nowMs() - start;
+            if (status != SERIAL_LINK_OK || reply.size() != sizeof(payload) ||
+                memcmp(reply.data(), payload, sizeof(payload)) != 0) {
+                printf("ping %d: %s\n", i + 1, status == SERIAL_LINK_OK ? "corrupted echo" : statusName(status));
+                continue;
+            }
+            answered++;
+            minMs = std::min(minMs, elapsed);
+            maxMs = std::max(maxMs, elapsed);
+            totalMs += elapsed;
+        }
+        if (answered == 0) {
+            fail("no answer");
+        }
+        printf("%d/%d answered, round trip min %lu ms, mean %.1f ms, max %lu ms\n", answered, count,
+               (unsigned long)minMs, (double)totalMs / answered, (unsigned long)maxMs);
+    } else if ((command == "send" || command == "sendhex") && arg < argc) {
+        std::vector<uint8_t> payload = command == "send" ?
+            std::vector<uint8_t>(argv[arg], argv[arg] + strlen(argv[arg])) : parseHex(argv[arg]);
+        requireOk(port, SERIAL_LINK_COMMAND, payload.data(), payload.size());
+        printf("ok\n");
+    } else if (command == "telemetry") {
+        printTelemetry(port);
+    } else if (command == "read" && arg + 1 < argc) {
+        int start = atoi(argv[arg]);
+        int count = atoi(argv[arg + 1]);
+        uint8_t payload[4];
+        putU16(payload, (uint16_t)start);
+        putU16(payload + 2, (uint16_t)count);
+        std::vector<uint8_t> reply;
+        requireOk(port, SERIAL_LINK_READ, payload, sizeof(payload), &reply);
+        for (size_t i = 2; i < reply.size(); i++) {
+            if ((i - 2) % 16 == 0) {
+                printf("%s%4u:", i > 2 ? "\n" : "", (unsigned)(start + i - 2));
+            }
+            printf(" %3u", reply[i]);
+        }
+        printf("\n");
+    } else if (command == "stream" && arg < argc) {
+        stream(port, argv[arg], rate, seconds, slots, channel, loop, baud);
+    } else {
+        fail("unknown command or missing arguments: ", command.c_str());
+    }
+    port.flushLog();
+    close(fd);
+    return 0;
+}
@@ -15,8 +15,22 @@ function decodeUplink(input) {
     return result;
   }
 
-  // Heartbeat/status payload from firmware (4-byte counter, status byte, fixture count)
-  if (bytes.length === 6 && (bytes[4] & 0xC0) === 0xC0) {
+  // Black-box dump fragment: 0x05, index (u16 BE), total (u16 BE), data.
+  // Checked before the heartbeat, whose short fragments it could resemble;
+  // feed the "fragment" hex of every uplink to tools/blackbox to decode.
+  if (bytes[0] === 0x05 && bytes.length > 5 && readUint16BE(bytes, 1) < readUint16BE(bytes, 3)) {
+    result.data.blackBox = {
+      index: readUint16BE(bytes, 1),
+      total: readUint16BE(bytes, 3),
+      fragment: bytesToHex(bytes)
+    };
+    return result;
+  }
+
+  // Heartbeat/status payload from firmware (4-byte counter, status byte, fixture count,
+  // optionally idle-output percentage and CPU ms saved since the previous heartbeat,
+  // then render deadline misses and the highest QoS level)
+  if ((bytes.length === 6 || bytes.length === 9 || bytes.length === 11) && (bytes[4] & 0xC0) === 0xC0) {
     var counter = readUint32BE(bytes, 0);
     var statusByte = bytes[4];
     var fixtureCount = bytes[5];
@@ -26,6 +40,14 @@ function decodeUplink(input) {
       isClassC: statusByte === 0xC5,
       dmxFixtures: fixtureCount
     };
+    if (bytes.length >= 9) {
+      result.data.heartbeat.idleFramePercent = bytes[6];
+      result.data.heartbeat.cpuSavedMs = (bytes[7] << 8) | bytes[8];
+    }
+    if (bytes.length === 11) {
+      result.data.heartbeat.deadlineMisses = bytes[9];
+      result.data.heartbeat.qosLevel = bytes[10];
+    }
     result.data.raw = bytesToHex(bytes);
     return result;
   }
@@ -61,6 +83,49 @@ function decodeUplink(input) {
     return result;
   }
 
+  // DMX loopback self-test result
+  if (messageType === 0x04 && bytes.length === 16) {
+    var flags = bytes[1];
+    var firstBad = readUint16BE(bytes, 6);
+    result.data.selfTest = {
+      passed: (flags & 0x01) !== 0,
+      mode: (flags & 0x02) ? "line" : "internal",
+      pattern: (flags & 0x04) !== 0,
+      edgesMissed: (flags & 0x08) !== 0,
+      frames: bytes[2],
+      framesMissing: bytes[3],
+      slotErrors: readUint16BE(bytes, 4),
+      firstBadSlot: firstBad === 0xFFFF ? null : firstBad,
+      breakUs: readUint16BE(bytes, 8),
+      mabUs: readUint16BE(bytes, 10),
+      refreshUs: readUint16BE(bytes, 12),
+      slots: readUint16BE(bytes, 14)
+    };
+    return result;
+  }
+
+  // Capability advertisement (sent on join and when the data rate changes):
+  // keep downlinks at or under maxDownlinkPayload, the server drops larger ones
+  if (messageType === 0x06 && bytes.length >= 13 && bytes[1] !== 0) {
+    var features = readUint16BE(bytes, 3);
+    var featureNames = ["presets", "compactLights", "json", "patterns", "fixtures", "patchEdits",
+                        "keyframes", "triggers", "schedule", "fuota"];
+    result.data.capability = {
+      version: bytes[1],
+      isClassC: (bytes[2] & 0x01) !== 0,
+      adr: (bytes[2] & 0x02) !== 0,
+      features: featureNames.filter(function(name, bit) { return (features & (1 << bit)) !== 0; }),
+      uplinkDataRate: bytes[5],
+      downlinkDataRate: bytes[6],
+      maxDownlinkPayload: bytes[7],
+      fragmentSlots: readUint16BE(bytes, 8),
+      maxFragmentSize: bytes[10],
+      freeCueSlots: bytes[11],
+      freeScheduleRules: bytes[12]
+    };
+    return result;
+  }
+
   // Attempt JSON parsing only if payload looks like printable ASCII JSON
   if (looksLikePrintableAscii(bytes)) {
     var str = String.fromCharCode.apply(null, bytes);
@@ -152,6 +217,10 @@ function readUint32BE(bytes, offset) {
 }
 
 // Downlink encoder function (application to device)
+function readUint16BE(bytes, offset) {
+  return ((bytes[offset] << 8) | bytes[offset + 1]) >>> 0;
+}
+
 function encodeDownlink(input) {
   // NEW: Direct hex string support
   if (input.data.hex && typeof input.data.hex === 'string') {